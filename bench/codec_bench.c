@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "codec.h"
+
+/*Reports the compression and decompression speed and the ratio of every in-process codec, at its
+lowest, default and highest level, on the files under the given directory. Every file is compressed
+on its own, as cib does when it inserts it.
+
+Usage: cib_bench <corpus-dir>*/
+
+#define BENCH_MAX_BYTES (256ULL << 20)      //The corpus is cut at this many bytes.
+
+typedef struct sample{
+    char *bytes;
+    uint64_t size;
+}* Sample;
+
+Sample samples = NULL;
+uint64_t samples_count = 0, samples_capacity = 0, corpus_bytes = 0;
+
+/*Reads every regular file under path in the samples.*/
+void BenchLoad(char *path){
+    struct stat info;
+    if(lstat(path, &info) == -1 || corpus_bytes >= BENCH_MAX_BYTES)
+        return;
+
+    if(S_ISDIR(info.st_mode)){
+        DIR *dir = opendir(path);
+        if(dir == NULL)
+            return;
+
+        struct dirent *entry;
+        while((entry = readdir(dir)) != NULL){
+            if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                continue;
+
+            char entry_path[strlen(path) + strlen(entry->d_name) + 2];
+            snprintf(entry_path, sizeof(entry_path), "%s/%s", path, entry->d_name);
+            BenchLoad(entry_path);
+        }
+
+        closedir(dir);
+        return;
+    }
+
+    FILE *file;
+    if(!S_ISREG(info.st_mode) || info.st_size == 0 || (file = fopen(path, "rb")) == NULL)
+        return;
+
+    if(samples_count == samples_capacity){
+        samples_capacity = samples_capacity == 0 ? 64 : samples_capacity * 2;
+        samples = realloc(samples, samples_capacity * sizeof(struct sample));
+    }
+
+    Sample sample = &samples[samples_count];
+    sample->bytes = malloc(info.st_size);
+    sample->size = fread(sample->bytes, 1, info.st_size, file);
+    fclose(file);
+
+    corpus_bytes += sample->size;
+    samples_count++;
+    return;
+}
+
+/*Returns the current time in seconds.*/
+double BenchNow(){
+    struct timespec now; clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*Compresses and decompresses every sample with the given codec and level and prints the results.*/
+void BenchRun(Codec codec, int level){
+    char **payloads = malloc(samples_count * sizeof(char *));
+    uint64_t *sizes = malloc(samples_count * sizeof(uint64_t)), compressed = 0;
+    bool valid = true;
+
+    double start = BenchNow();
+    for(uint64_t i = 0; i < samples_count; i++){
+        sizes[i] = codec->bound(samples[i].size);
+        payloads[i] = malloc(sizes[i]);
+
+        valid &= codec->compress(samples[i].bytes, samples[i].size, payloads[i], &sizes[i], level);
+        compressed += sizes[i];
+    }
+    double compress_time = BenchNow() - start;
+
+    char *raw = malloc(BENCH_MAX_BYTES);
+    start = BenchNow();
+    for(uint64_t i = 0; i < samples_count; i++){
+        char *out = samples[i].size <= BENCH_MAX_BYTES ? raw : malloc(samples[i].size);
+
+        valid &= codec->decompress(payloads[i], sizes[i], out, samples[i].size) && memcmp(out, samples[i].bytes, samples[i].size) == 0;
+        if(out != raw) free(out);
+    }
+    double decompress_time = BenchNow() - start;
+
+    double mb = corpus_bytes / 1e6;
+    printf("%-8s %5d %9.2f %9.1f %11.1f %6.3f%s\n", codec->name, level, mb, mb / compress_time, mb / decompress_time,
+        (double) corpus_bytes / (compressed == 0 ? 1 : compressed), valid == true ? "" : "  ROUND TRIP FAILED");
+
+    for(uint64_t i = 0; i < samples_count; i++)
+        free(payloads[i]);
+
+    free(payloads); free(sizes); free(raw);
+    return;
+}
+
+int main(int argc, char *argv[]){
+    if(argc != 2){
+        fprintf(stderr, "Usage: %s <corpus-dir>\n", argv[0]);
+        return -1;
+    }
+
+    BenchLoad(argv[1]);
+    if(samples_count == 0){
+        fprintf(stderr, "%s: No files found under %s.\n", argv[0], argv[1]);
+        return -1;
+    }
+
+    printf("%lu files, %lu bytes\n", samples_count, corpus_bytes);
+    printf("%-8s %5s %9s %9s %11s %6s\n", "codec", "level", "MB", "comp MB/s", "decomp MB/s", "ratio");
+
+    for(uint8_t id = 0; id < CODEC_COUNT; id++){
+        Codec codec = CodecGet(id);
+        if(codec == NULL || codec->compress == NULL)
+            continue;
+
+        int levels[3] = {codec->min_level, codec->default_level, codec->max_level};
+        for(int i = 0; i < 3; i++)
+            if(i == 0 || levels[i] != levels[i - 1])
+                BenchRun(codec, levels[i]);
+    }
+
+    for(uint64_t i = 0; i < samples_count; i++)
+        free(samples[i].bytes);
+
+    free(samples);
+    return 0;
+}
@@ -23,6 +23,13 @@ typedef unsigned int (* HashFunc)(void *, int);
 //and returns an index.
 unsigned int HashString(void *vs, int size);
 
+//Given the size of an array, the function hashes the 64-bit integer
+//and returns an index.
+unsigned int HashUint64(void *vx, int size);
+
+//Compares two 64-bit integers. Returns 0 if they are equal.
+int CompareUint64(void *a, void *b);
+
 //Returns the item contained in the hash node.
 void *HNGetItem(HashNode node);
 
@@ -1,6 +1,7 @@
 #include "ADTVector.h"
 #include <stdbool.h>
 #include <stdint.h>
+#pragma once
 
 /*Input Flags*/
 #define C 1
@@ -12,12 +13,42 @@
 #define X 32
 #define M 64
 #define P 128
+#define S 256
+#define COMPACT 512
+#define VACUUM 1024
+#define TRACE 2048
+#define RELAYOUT 4096
+#define LOG 8192
+#define CLEAN 16384
+#define SOLID 32768
+#define DICT 65536
+#define STAGE 131072
+#define RESUME 262144
+#define SERVE 524288
+#define CLIENT 1048576
+#define MLOCK 2097152
+#define VERIFY 4194304
 
 typedef struct cib_arguments{
     Vector paths;
 
     char *cib_file;
-    uint8_t flags;
+    char *snapshot;         //Name given with --snapshot. NULL if the live tree is used.
+    char *base;             //Base archive given with --base. NULL if the archive is not differential.
+    uint64_t steps;         //Chunks that --compact may move, given with --steps. 0 means no limit.
+    uint64_t hot;           //Traced entries that --relayout moves, given with --hot. 0 means every traced entry.
+    uint8_t codec;          //Codec of -j, given as -j codec[:level]. CODEC_GZIP by default, CODEC_FILTER with --filter.
+    uint8_t level;          //Level of the codec. With --rate or --deadline, the level that the insertion starts from.
+    uint64_t rate;          //Target rate of -j in MB/s, given with --rate. 0 if there is none.
+    uint64_t deadline;      //Seconds in which -j should end, given with --deadline. 0 if there is none.
+    uint64_t threads;       //Threads that compress or decompress the frames of a file, given with --threads. 0 means one per processor.
+                            //As many external programs compress files at once.
+    char *filter;           //Command of the external program that compresses the files, given with --filter. NULL if there is none.
+    uint8_t durability;     //When the changes to the archive reach the disk, given with --durability. DURABILITY_COMMIT by default.
+    uint64_t checkpoint;    //Seconds between the commits of -c or -a, given with --checkpoint. 0 if there are none.
+    char *socket;           //Socket of --serve and --client, given with --socket. NULL for <archive-file>.sock.
+    uint64_t batch;         //Requests that --client sends at once, given with --batch. 0 for the default.
+    uint32_t flags;
 }* CIBArgs;
 
 /*Reads the arguments and stores them inside a cib_arguments struct.
@@ -29,6 +60,14 @@ CIBArgs CIBReadArgs(int argc, char *argv[]);
 /*Frees the memory of cib_arguments struct.*/
 void CIBArgsDestroy(CIBArgs args);
 
+/*Returns true iff the argument that follows -j can only be meant as a codec specification: it has a level, names a
+codec known to cib, or is a short lowercase word that is not an existing path, unlike the archive-file that may follow
+-j instead.*/
+bool CLIIsCodecSpec(char *arg);
+
+/*Removes "." and ".." out of a path. Returns a pointer to the new path, which is an absolute path.*/
+char *RealPath(const char *path);
+
 /*Given a vector of paths, which may be full paths or relative to cwd, this function
 makes them relative to the given base_dir.
 
@@ -47,8 +86,109 @@ void CIBCannotInsertPath(char *path);
 /*Error Message: Path cannot be compressed.*/
 void CIBCannotCompress(char *path);
 
+/*Error Message: The file was compressed by the program of --filter with the given name, and the extraction was not
+given a command that runs it.*/
+void CIBFilterNeeded(char *path, char *name);
+
+/*Error Message: The codec specification of -j names a codec that is unknown or was not built, or an invalid level.*/
+void CIBInvalidCodec(char *spec);
+
+/*Error Message: The stored data of the file cannot be decompressed.*/
+void CIBCorruptData(char *path);
+
 /*Error Message: Path does not exist.*/
 void CIBPathDoesNotExist(char *path);
 
 /*Error Message: Path is not a directory.*/
-void CIBPathIsNotDir(char *path);
\ No newline at end of file
+void CIBPathIsNotDir(char *path);
+
+/*Error Message: Snapshot not found inside .cib file.*/
+void CIBSnapshotNotFound(char *name, char *cib_file);
+
+/*Error Message: Snapshot cannot be created.*/
+void CIBCannotCreateSnapshot(char *name);
+
+/*Error Message: Data of a differential archive's entry cannot be found.*/
+void CIBBaseNotFound(char *path);
+
+/*Error Message: Base archive cannot be used.*/
+void CIBInvalidBase(char *base_file);
+
+/*Error Message: The base archive is found neither where its record points relative to the archive nor at its
+absolute path.*/
+void CIBBaseMissing(char *relative_path, char *absolute_path);
+
+/*Error Message: The base archive is not the one that the differential archive was created from, or its data have changed since.*/
+void CIBBaseChanged(char *base_file);
+
+/*Error Message: The vacuumed cib file cannot be written to the given file.*/
+void CIBInvalidVacuumTarget(char *out_file);
+
+/*Error Message: An interrupted update of the cib file cannot be completed without write access to it.*/
+void CIBJournalNotReplayed(char *cib_file);
+
+/*Warning Message: The pages that an update changes cannot be found, so the cib file is updated in place, without a journal.*/
+void CIBUpdatedInPlace(char *cib_file);
+
+/*Error Message: The creation of the cib file cannot be resumed, since it is an archive of another tree.*/
+void CIBCannotResume(char *cib_file);
+
+/*Error Message: The files cannot be staged, since the dictionary of the cib file has yet to be trained.*/
+void CIBCannotStage(char *cib_file);
+
+/*Prints the disk space that was released by punching holes in the freed chunks of the cib file.*/
+void CIBPunchReport(char *cib_file, uint64_t bytes);
+
+/*Error Message: No access trace has been recorded for the cib file.*/
+void CIBTraceNotFound(char *cib_file);
+
+/*Prints how the files inserted in the cib file were compressed. The files stored as they are are split into
+those that the probe found incompressible, which were not compressed at all, and those that compression did
+not shrink. saved_ms is the estimated compression time that the probe saved, or negative if it is unknown.*/
+void CIBCompressionReport(char *cib_file, uint64_t compressed_files, uint64_t compressed_bytes, uint64_t payload_bytes, uint64_t probed_files,
+    uint64_t probed_bytes, uint64_t expanded_files, uint64_t expanded_bytes, int64_t saved_ms);
+
+/*Prints the rate at which files were inserted in the cib file and how many files and bytes were inserted at
+each level of the codec, files[level] and bytes[level], between the given levels.*/
+void CIBLevelReport(char *cib_file, char *codec, uint8_t min_level, uint8_t max_level, uint64_t *files, uint64_t *bytes, double rate);
+
+/*Prints the size of the dictionary of the cib file, how many files it was trained on, 0 if it was already
+stored, and how many files were compressed with it.*/
+void CIBDictionaryReport(char *cib_file, uint64_t dict_size, uint64_t samples, uint64_t files);
+
+/*Prints the outcome of a relayout of the cib file.*/
+void CIBRelayoutReport(char *cib_file, uint64_t hot_chunks, uint64_t moved);
+
+/*Error Message: The operation cannot be performed on a log-structured cib file.*/
+void CIBLogStructured(char *cib_file);
+
+/*Error Message: The cib file is not log-structured, so it has no segments to clean.*/
+void CIBNotLogStructured(char *cib_file);
+
+/*Prints the outcome of the cleaning of a log-structured cib file.*/
+void CIBCleanReport(char *cib_file, uint64_t cleaned, uint64_t moved, uint64_t orphans, uint64_t old_size, uint64_t new_size);
+
+/*Prints the outcome of a compaction of the cib file.*/
+void CIBCompactReport(char *cib_file, uint64_t moved, uint64_t orphans, uint64_t old_size, uint64_t new_size, bool finished);
+
+/*Error Message: The socket of the server cannot be created.*/
+void CIBCannotServe(char *socket_path);
+
+/*Error Message: The metadata of the served cib file cannot be locked in memory.*/
+void CIBCannotPin(char *cib_file);
+
+/*Error Message: No server listens on the socket.*/
+void CIBServerNotFound(char *socket_path);
+
+/*Error Message: The server that listens on the socket does not serve the cib file.*/
+void CIBNotServed(char *cib_file, char *socket_path);
+
+/*Error Message: A line of the client's input is not a request.*/
+void CIBInvalidRequest(char *line);
+
+/*Prints how many requests of the given operation the server served and the p50 and p99 of their latency.*/
+void CIBLatencyReport(char *server, char *op, uint64_t requests, uint64_t p50_ns, uint64_t p99_ns);
+
+/*Prints, to the standard error, how many requests the client sent in how many batches, the p50 and p99 of the
+time that a batch took and the rate of the requests.*/
+void CIBClientReport(char *server, uint64_t requests, uint64_t batches, uint64_t p50_ns, uint64_t p99_ns, double seconds);
\ No newline at end of file
@@ -0,0 +1,187 @@
+#include <stdint.h>
+#include <stdbool.h>
+#pragma once
+
+/*Codec ids. The id of the codec that compressed the content of a data chunk is stored in the chunk.
+CODEC_GZIP is the external gzip of -j, which has no in-process implementation. Neither has CODEC_FILTER, the
+external program given with --filter; it cannot be selected by name.*/
+#define CODEC_NONE 0
+#define CODEC_GZIP 1
+#define CODEC_DEFLATE 2
+#define CODEC_LZ 3
+#define CODEC_LZMA 4
+#define CODEC_FILTER 5
+#define CODEC_COUNT 6
+
+#define CODEC_FRAME_BYTES (1 << 20)         //Frame size of the codecs whose window is at most 64KB.
+#define CODEC_LZMA_FRAME_BYTES (8 << 20)    //Frame size of lzma, which finds matches megabytes apart.
+
+/*A codec: its name, its range of levels and its functions.*/
+typedef struct codec{
+    char *name;
+    uint8_t id;
+
+    uint8_t min_level;
+    uint8_t max_level;
+    uint8_t default_level;
+
+    //Bytes of content of each frame that a large file is compressed in. Codecs with larger windows need larger frames.
+    uint64_t frame_bytes;
+
+    //Maximum size of the payload of "size" bytes of content. NULL iff there is no in-process implementation.
+    uint64_t (*bound)(uint64_t size);
+
+    //Compresses size bytes of src in dest, whose capacity is *dest_size. The payload size is stored in *dest_size.
+    bool (*compress)(const void *src, uint64_t size, void *dest, uint64_t *dest_size, int level);
+
+    //Decompresses the size bytes of the payload src in dest, which must hold exactly raw_size bytes.
+    bool (*decompress)(const void *src, uint64_t size, void *dest, uint64_t raw_size);
+
+    //As compress and decompress, but the content may refer to the dict_size bytes of dict as if they preceded it.
+    //NULL iff the codec cannot use a dictionary.
+    bool (*compress_dict)(const void *src, uint64_t size, void *dest, uint64_t *dest_size, int level, const void *dict, uint64_t dict_size);
+    bool (*decompress_dict)(const void *src, uint64_t size, void *dest, uint64_t raw_size, const void *dict, uint64_t dict_size);
+}* Codec;
+
+/*Returns the codec with the given id. If it is unknown or was not built, NULL is returned.*/
+Codec CodecGet(uint8_t id);
+
+/*Returns the codec with the given name. If it is unknown or was not built, NULL is returned.*/
+Codec CodecFind(char *name);
+
+/*Returns true iff the name of the codec specification, its part before ':', is the name of a codec known to cib,
+whether or not it was built.*/
+bool CodecIsKnown(char *spec);
+
+/*Returns true iff the codec with the given id is implemented in-process.*/
+bool CodecIsInProcess(uint8_t id);
+
+/*Returns true iff the codec with the given id is an external program, whose output is not readable in place.*/
+bool CodecIsExternal(uint8_t id);
+
+/*Reads a codec specification of the form "name" or "name:level". The codec's id is stored in *id and
+the level in *level; if the level is omitted the codec's default level is used.
+
+Returns false if the codec is unknown or the level is out of its range.*/
+bool CodecParse(char *spec, uint8_t *id, uint8_t *level);
+
+#define CODEC_PROBE_BYTES 4096      //Size of the sample that the probe looks at.
+#define CODEC_PROBE_ENTROPY 7.5     //Entropy, in bits per byte, from which a sample may be incompressible.
+#define CODEC_PROBE_GAIN 3          //Percent that the fast lz codec must save on a sample for it to be compressible.
+
+/*Decides, from the first CODEC_PROBE_BYTES bytes of the data, whether compressing them is worth it. Data
+that start with the signature of a compressed format are not. Otherwise, the sample is not worth it iff its
+entropy is at least CODEC_PROBE_ENTROPY bits per byte, so that entropy coding gains nothing, and the fast lz
+codec shrinks it by less than CODEC_PROBE_GAIN percent, so that there are no repeats to gain from either.*/
+bool CodecIsCompressible(const void *mem, uint64_t size);
+
+#define CODEC_DICT_SIZE (32 << 10)          //Size of a trained dictionary.
+#define CODEC_DICT_SAMPLE_BYTES (4 << 20)   //Bytes of samples that a dictionary is trained on, at most.
+
+/*Trains a dictionary of at most capacity bytes on count samples, whose sizes are given and whose bytes are stored
+one after the other in samples. The dictionary is made of the segments of the samples whose 8-byte substrings occur
+in the most samples. It is stored in dict and its size is returned; 0 if the samples share nothing.*/
+uint64_t CodecTrainDictionary(const char *samples, const uint64_t *sizes, uint64_t count, char *dict, uint64_t capacity);
+
+#define CODEC_CONTROL_BATCH_BYTES (4ULL << 20)     //A batch of the level controller holds at least this many bytes
+#define CODEC_CONTROL_BATCH_NS 200000000ULL         //or lasts this many nanoseconds.
+#define CODEC_CONTROL_SLACK 10                      //Percent by which a batch may miss the target rate.
+
+/*A controller that adapts the level of a codec between files, so that an insertion keeps up with a target
+rate or ends by a deadline.*/
+typedef struct codec_controller *CodecController;
+
+/*Returns the current time in nanoseconds.*/
+uint64_t CodecControllerNow();
+
+/*Creates a controller that adapts the level of the given codec, starting from the given level. Either rate is
+the target rate in MB/s, or deadline is the number of seconds in which total_bytes bytes should be inserted.*/
+CodecController CodecControllerCreate(uint8_t codec_id, uint8_t level, uint64_t rate, uint64_t deadline, uint64_t total_bytes);
+
+/*Returns the level at which the next files should be compressed.*/
+uint8_t CodecControllerGetLevel(CodecController controller);
+
+/*Records that the given number of files, which hold in_bytes bytes, were inserted at the current level in
+wall_ns nanoseconds, of which compress_ns were spent on compressing them. At the end of a batch the level is
+adapted. The level for the next files is returned.*/
+uint8_t CodecControllerUpdate(CodecController controller, uint64_t files, uint64_t in_bytes, uint64_t compress_ns, uint64_t wall_ns);
+
+/*Returns the number of files inserted at the given level. The number of their bytes is stored in *bytes.*/
+uint64_t CodecControllerGetUsage(CodecController controller, uint8_t level, uint64_t *bytes);
+
+/*Frees the memory of the controller.*/
+void CodecControllerDestroy(CodecController controller);
+
+/*A pool of threads that run the jobs of a batch in parallel, such as the frames of a file. The caller of
+CodecPoolRun() runs jobs too, so a pool of n threads runs n + 1 jobs at once.*/
+typedef struct codec_pool *CodecPool;
+
+/*A job of a batch: the batch's argument and the index of the job.*/
+typedef void (*CodecJob)(void *arg, uint64_t job);
+
+/*Creates a pool of the given number of threads. If a thread cannot be created, the pool has fewer.*/
+CodecPool CodecPoolCreate(uint64_t threads);
+
+/*Returns the number of threads of the pool.*/
+uint64_t CodecPoolGetThreads(CodecPool pool);
+
+/*Calls job(arg, i) for every i in [0, jobs) on the threads of the pool and on the calling thread, and returns
+once every call has returned. Jobs are started in order of i.*/
+void CodecPoolRun(CodecPool pool, CodecJob job, void *arg, uint64_t jobs);
+
+/*Stops the threads of the pool and frees its memory.*/
+void CodecPoolDestroy(CodecPool pool);
+
+/*A filter runs external programs, such as gzip, on files, at most a given number at once. Each program reads
+a file from its standard input and writes its output to a pipe; no temporary files are created.*/
+typedef struct codec_filter *CodecFilter;
+
+/*Called when a program of a filter ends, with the tag that it was run with, its output, the nanoseconds
+it ran for and whether it exited with 0. The output is freed once the callback returns.*/
+typedef void (*CodecFilterDone)(void *tag, char *output, uint64_t size, uint64_t elapsed_ns, bool ok);
+
+/*Returns the name that identifies the program of the command in an archive: the file name of its first word,
+without the directories and the arguments. The name is allocated in heap; it is empty if the command has no words.*/
+char *CodecFilterName(const char *command);
+
+/*Creates a filter that runs at most the given number of programs at once and calls done when each one ends.*/
+CodecFilter CodecFilterCreate(uint64_t children, CodecFilterDone done);
+
+/*Returns the number of programs that the filter runs at once, at most.*/
+uint64_t CodecFilterGetChildren(CodecFilter filter);
+
+/*Runs the program of the command, without a shell, with the file defined by path as its standard input. If
+as many programs as the filter allows already run, it first waits until one of them ends. When the program ends,
+the callback is given the tag and the program's output. If the file cannot be opened, the callback is called at once.*/
+void CodecFilterRun(CodecFilter filter, char *command, char *path, void *tag);
+
+/*Waits until every program of the filter has ended.*/
+void CodecFilterWait(CodecFilter filter);
+
+/*Waits until every program of the filter has ended and frees its memory.*/
+void CodecFilterDestroy(CodecFilter filter);
+
+/*Runs the program of the command with -d, without a shell, with the size bytes of src as its standard input and the
+file descriptor out as its standard output, and waits until it ends. Returns true iff it read all of src and
+exited with 0.*/
+bool CodecFilterDecode(char *command, const void *src, uint64_t size, int out);
+
+//Codec implementations.
+
+uint64_t DeflateBound(uint64_t size);
+bool DeflateCompress(const void *src, uint64_t size, void *dest, uint64_t *dest_size, int level);
+bool DeflateDecompress(const void *src, uint64_t size, void *dest, uint64_t raw_size);
+bool DeflateCompressDict(const void *src, uint64_t size, void *dest, uint64_t *dest_size, int level, const void *dict, uint64_t dict_size);
+bool DeflateDecompressDict(const void *src, uint64_t size, void *dest, uint64_t raw_size, const void *dict, uint64_t dict_size);
+
+uint64_t LZBound(uint64_t size);
+bool LZCompress(const void *src, uint64_t size, void *dest, uint64_t *dest_size, int level);
+bool LZDecompress(const void *src, uint64_t size, void *dest, uint64_t raw_size);
+bool LZCompressDict(const void *src, uint64_t size, void *dest, uint64_t *dest_size, int level, const void *dict, uint64_t dict_size);
+bool LZDecompressDict(const void *src, uint64_t size, void *dest, uint64_t raw_size, const void *dict, uint64_t dict_size);
+
+#ifdef CIB_HAVE_LZMA
+uint64_t LZMABound(uint64_t size);
+bool LZMACompress(const void *src, uint64_t size, void *dest, uint64_t *dest_size, int level);
+bool LZMADecompress(const void *src, uint64_t size, void *dest, uint64_t raw_size);
+#endif
@@ -1,6 +1,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "ADTVector.h"
+
 #define FILE_EXTRA_DATA 32
 
 #define DATA_BLOCK_SIZE 1024
@@ -8,18 +10,233 @@
 
 #define EXTRA_BLOCKS_NEEDED 1
 
+#define DATA_PLACEMENT_WINDOW 4096     //Blocks around the placement hint in which a free chunk is considered near.
+#define DATA_SEGMENT_BLOCKS 1024       //Minimum size of a segment of the log in log-structured mode.
+#define DATA_CLEAN_THRESHOLD 50        //Percentage of live blocks under which a segment is cleaned.
+
 typedef uint64_t DataBlockId;
 
-/*Inserts the data of the file defined by the given path inside the data "partition".
-If zipped is true then data are marked as zipped.*/
-DataBlockId DataInsertFile(char *path, bool zipped);
+/*Reasons for which the content of a file that was to be compressed is stored as is. The reason is recorded
+in the file's chunk.*/
+#define DATA_RAW_NONE 0             //The content is compressed, or it was not to be compressed.
+#define DATA_RAW_PROBED 1           //The probe found that compressing it is not worth it, so it was not compressed.
+#define DATA_RAW_EXPANDED 2         //Compressing it did not make it smaller.
+
+/*What the code of the data partition keeps about an archive: its caches, counters and settings. Part of CIBState.*/
+typedef struct data_state *DataState;
+
+/*Returns a new data state, allocated in heap. Its settings, whether the dictionary is used, the number of
+threads and the command of the extraction's filter, are copied from the given state, unless it is NULL.*/
+DataState DataStateCreate(DataState settings);
+
+/*Destroys the given data state.*/
+void DataStateDestroy(DataState state);
+
+/*Drops what the data state of the current archive derived from its content, the cached solid chunk and the
+placement hint, since other processes may have changed the archive while it was unlocked.*/
+void DataStateDropCaches();
+
+/*Counters of the compression of the files inserted in the current archive.*/
+typedef struct data_compression_stats{
+    uint64_t compressed_files;      //Files stored compressed,
+    uint64_t compressed_bytes;      //their size
+    uint64_t payload_bytes;         //and the size they are stored in.
+
+    uint64_t probed_files;          //Files stored as they are because of the probe
+    uint64_t probed_bytes;          //and their size.
+    uint64_t expanded_files;        //Files stored as they are because compressing them did not make them smaller
+    uint64_t expanded_bytes;        //and their size.
+
+    uint64_t probe_ns;              //Time spent on probing.
+    uint64_t compress_ns;           //Time spent by in-process codecs on compressing
+    uint64_t timed_bytes;           //the given number of bytes.
+
+    uint64_t dictionary_files;      //Files stored compressed with the dictionary of the archive.
+}* DataCompressionStats;
+
+/*Differential archives do not store the files that are unchanged since their base archive was created.
+The entries of these files hold a "base reference" instead of a data block id: the most significant bit
+is set, the next bits hold how many archives down the chain of bases the data are stored (minus one) and 
+the lower bits hold the entry's pointer inside that archive.*/
+#define DATA_POINTER_BASE (1ULL << 63)
+#define DATA_POINTER_DEPTH_SHIFT 56
+#define DATA_POINTER_DEPTH_MASK (0x3FULL << DATA_POINTER_DEPTH_SHIFT)
+#define DATA_MAX_BASE_DEPTH 64
+
+/*The entries of the members of a solid chunk hold a "member pointer": bit 62 is set, the bits from
+DATA_POINTER_MEMBER_SHIFT hold the index of the member and the lower bits the first block of the chunk.*/
+#define DATA_POINTER_MEMBER (1ULL << 62)
+#define DATA_POINTER_MEMBER_SHIFT 40
+#define DATA_POINTER_MEMBER_MASK (0xFFFFULL << DATA_POINTER_MEMBER_SHIFT)
+#define DATA_SOLID_MAX_MEMBERS 65536
+#define DATA_SOLID_MAX_FILE (64 << 10)         //Files of at most this many bytes are stored in solid chunks.
+#define DATA_SOLID_MAX_BYTES (4 << 20)         //Members are added to a solid chunk until it holds this many bytes.
+
+/*Files of at most DATA_DICT_MAX_FILE bytes may be compressed with the dictionary of the archive, as if its
+bytes preceded theirs. The size that precedes the payload of such a file has DATA_FRAME_DICT set.*/
+#define DATA_DICT_MAX_FILE (64 << 10)
+#define DATA_FRAME_DICT (1ULL << 63)
+
+/*Files larger than the frame_bytes of their codec are compressed in frames of frame_bytes bytes of content, each
+compressed on its own, so that a range of the file can be read by decompressing only the frames that hold it and
+the frames can be compressed and decompressed in parallel. The size that precedes the payload has DATA_FRAME_INDEXED set and is
+followed by the frame size, the end of the payload of each frame and the payloads. A frame whose payload is as
+large as its content is stored as it is.*/
+#define DATA_FRAME_INDEXED (1ULL << 62)
+
+/*Inserts the data of the file defined by the given path inside the data "partition". If the codec is
+in-process the data are compressed with it at the given level, unless the probe finds that it is not worth
+it. Otherwise they are stored as they are and marked with the codec.*/
+DataBlockId DataInsertFile(char *path, uint8_t codec, uint8_t level);
+
+/*Inserts the data of the file defined by path, which an external program has compressed in the size bytes of
+output. With CODEC_GZIP the output is gzip's at the given level. With CODEC_FILTER the name of the program, as
+CodecFilterName() returns it, is stored before the output; the command is not, so the file is extracted only by a
+program with the same name that the extraction is given. If the output is not smaller, the data of the original
+file are inserted as they are.*/
+DataBlockId DataInsertFiltered(char *path, char *output, uint64_t size, uint8_t codec, uint8_t level, char *name);
+
+/*Inserts the data of the file defined by the given path as they are, although they were to be compressed.
+The given reason, one of DATA_RAW_*, is recorded in the chunk.*/
+DataBlockId DataInsertRawFile(char *path, uint8_t reason);
+
+/*Returns true iff compressing the data of the file defined by the given path is worth it, according to
+CodecIsCompressible(). Only the first CODEC_PROBE_BYTES bytes of the file are read.*/
+bool DataProbeFile(char *path);
+
+/*Returns the counters of the compression of the files inserted in the current archive so far.*/
+DataCompressionStats DataGetCompressionStats();
+
+/*Returns the reason, one of DATA_RAW_*, for which the content of the chunk that starts from the given block is
+stored as is although it was to be compressed.*/
+uint8_t DataGetRawReason(DataBlockId block);
+
+/*Records why the content of the chunk that starts from the given block is stored as is. Used when the
+content is copied from another chunk.*/
+void DataSetRawReason(DataBlockId block, uint8_t reason);
+
+/*Copies size bytes from the given address in memmory. The data are marked as encoded with the given codec and level.*/
+DataBlockId DataInsertBytes(void *mem, uint64_t size, uint8_t codec, uint8_t level);
+
+/*Returns a pointer to the data stored in the chunk that starts from the given block. The
+size of the data is stored in *size.*/
+void *DataGetBytes(DataBlockId block, uint64_t *size);
+
+/*Extends the data partition by the given number of blocks, which form a new free chunk at its end.
+The first block of the new chunk is returned.*/
+DataBlockId DataExtend(uint64_t blocks);
+
+/*Sets the chunk near which the next inserted chunk is placed. Every insertion moves the hint to the
+inserted chunk, so consecutive insertions are stored one after the other. 0 means no preference.*/
+void DataSetPlacementHint(DataBlockId block);
+
+/*Returns the bytes of the data partition whose disk space has been released by freeing chunks.*/
+uint64_t DataGetPunchedBytes();
+
+/*Returns the codec of the content of the chunk that starts from the given block. Its level is stored in *level.*/
+uint8_t DataGetCodec(DataBlockId block, uint8_t *level);
+
+/*Returns true if the size of the file stored in the chunk that starts from the given block, or in the given
+member of a solid chunk, is known, i.e. its content is not gzip-ed. The size is stored in *size.*/
+bool DataGetFileSize(DataBlockId block, uint64_t *size);
+
+/*Returns true iff the given entry pointer is a reference to the data of a base archive.*/
+bool DataIsBaseRef(uint64_t pointer);
+
+/*Creates the reference that an entry of a differential archive holds, given the entry's pointer
+inside the base archive.*/
+uint64_t DataBaseRefCreate(uint64_t base_pointer);
+
+/*Returns the pointer that the given base reference refers to. *depth is set to the depth of the
+base archive that holds it; 1 is the base of the current archive, 2 the base of the base and so on.*/
+uint64_t DataBaseRefResolve(uint64_t pointer, int *depth);
+
+/*Returns true iff the given entry pointer refers to a member of a solid chunk.*/
+bool DataIsMember(uint64_t pointer);
+
+/*Returns the entry pointer of the given member of the solid chunk that starts from the given block.*/
+uint64_t DataMemberPointer(DataBlockId block, uint64_t member);
+
+/*Returns the first block of the chunk that the given entry pointer, which must not be a base reference, refers to.*/
+DataBlockId DataGetChunk(uint64_t pointer);
+
+/*Returns the given entry pointer changed to refer to the chunk that starts from the given block. Used when
+the chunk is moved.*/
+uint64_t DataSetChunk(uint64_t pointer, DataBlockId block);
+
+/*Inserts count files, whose sizes are given and whose bytes are stored one after the other in members, as one
+solid chunk compressed with the given in-process codec and level. The chunk is shared by refs entries. The first
+block of the chunk is returned; the pointer of member i is DataMemberPointer(block, i).*/
+DataBlockId DataInsertSolid(char *members, uint64_t *sizes, uint64_t count, uint32_t refs, uint8_t codec, uint8_t level);
+
+/*Inserts the given dictionary, of the given size, in the data partition and records it in the header as the
+compression dictionary of the archive. The first block of its chunk is returned.*/
+DataBlockId DataSetDictionary(void *dict, uint64_t size);
+
+/*Sets whether the files inserted from now on, if small enough, are compressed with the dictionary of the archive.*/
+void DataUseDictionary(bool use);
+
+/*Sets the number of threads that compress and decompress the frames of a file, the calling thread included.
+0 means one per processor. Must be called before the first file is compressed or decompressed in frames.*/
+void DataSetThreads(uint64_t threads);
+
+/*Sets the command of the program that decompresses the files that the program of --filter compressed, or NULL if
+none is given. The command is run with -d, but only on files whose stored name is the name of its program.*/
+void DataSetFilter(char *command);
 
 /*Inserts the stored path of the symlink, which is defined by path, in data partition.*/
 DataBlockId DataInsertLink(char *path);
 
-/*Deletes the file which is stored in data partition starting from the given block.*/
+/*Deletes the file which is stored in data partition starting from the given block, or in the given member
+of a solid chunk. If the chunk is shared with other entries, only its reference count is decreased.*/
 void DataDeleteFile(DataBlockId block);
 
+/*Deletes the files stored in the chunks that start from the given blocks. The chunks that are no longer
+shared are freed together: they are sorted and every run of adjacent chunks is freed, and merged with
+its free neighbours, at once. In log-structured mode they are only marked dead. Blocks that refer to a
+base archive are ignored.*/
+void DataDeleteFiles(Vector blocks);
+
+/*Frees the chunk that starts from the given block, regardless of how many entries share it. The
+chunk is merged with the neighbouring free chunks. In log-structured mode it is only marked dead.*/
+void DataFreeChunk(DataBlockId block);
+
+/*Frees every run of adjacent dead chunks of a log-structured data partition, except for the unused rest of
+the current segment. The freed runs are merged with their free neighbours and their disk space is released.
+Returns the number of freed blocks.*/
+uint64_t DataReclaimDeadChunks();
+
+/*Returns true iff the chunk that starts from the given block has been deleted in log-structured mode
+and waits to be reclaimed.*/
+bool DataIsDead(DataBlockId block);
+
+/*Copies the chunk that starts from block "src" to a new chunk at the end of the log of a log-structured data
+partition and returns the new chunk's first block. The chunk "src" is not freed.*/
+DataBlockId DataAppendChunk(DataBlockId src);
+
+/*Returns the first block of the chunk that follows the chunk which starts from the given block.
+*used is set to true iff the chunk that starts from the given block is not free. The first chunk
+of the data partition starts from block 1.*/
+DataBlockId DataGetNextChunk(DataBlockId block, bool *used);
+
+/*Returns the first block of the last chunk of the data partition. *used is set as in DataGetNextChunk()
+and *blocks to the size of the chunk in blocks. If the data partition holds no chunks, 0 is returned.*/
+DataBlockId DataGetLastChunk(bool *used, uint64_t *blocks);
+
+/*Searches the free chunks for the one that starts from the lowest block, has at least "blocks" blocks and
+starts from a block in [from, limit). If found, its first block is stored in *found and true is returned.*/
+bool DataFindLowestFreeChunk(uint64_t blocks, DataBlockId from, DataBlockId limit, DataBlockId *found);
+
+/*Copies the chunk that starts from block "src" in the beginning of the free chunk that starts from block
+"dest", which must be large enough. The rest of the free chunk remains free.
+
+The chunk "src" is not freed; DataFreeChunk() should be called after the entries that point to it are updated.*/
+void DataMoveChunk(DataBlockId src, DataBlockId dest);
+
+/*Marks the chunk that starts from the given block, or the solid chunk of the given member, as shared by one
+more entry. The chunk will be freed only after every entry that points to it has been deleted.*/
+void DataShareFile(DataBlockId block);
+
 /*Calculates the amount of blocks needed to store the given bytes of data.*/
 uint64_t DataCaclulateNeededBlocks(uint64_t size);
 
@@ -38,15 +255,35 @@ data "partition". If found then we shrink the data partition and shift the metad
 reducing the file's size.*/
 void DataRemoveLastChunk();
 
-/*Extracts the file that is stored in the data chunk whose first block is "block" inside
-the file defined by path. The file is opened/created with the given permissions.
+/*Returns the bytes of the data partition, from its start, that only the inside of the free chunk at its end
+spans: every block of the chunk but its first and its last, which hold its links and its size. Nothing refers
+to them. Returns false if the last chunk is not free or has no inside.*/
+bool DataGetFreeTail(uint64_t *offset, uint64_t *length);
+
+/*Stores in *ranges, allocated in heap, the offset from the start of the data partition and the length of the inside
+of every free chunk, as in DataGetFreeTail(), one pair after the other, and returns the number of pairs. Nothing
+refers to these bytes.*/
+uint64_t DataGetFreeInsides(uint64_t **ranges);
 
-If the file was zipped then fork and exec are called to unzip the file using "gunzip".
-This function will not use wait() to collect the zombie process created.
+/*Extracts the file that is stored in the data chunk whose first block is "block", or in the given member
+of a solid chunk, inside the file defined by path. The file is opened/created with the given permissions.
 
-Returns true if the file was zipped or false if it wasn't.*/
+If the file was gzip-ed then fork and exec are called to unzip the file using "gunzip".
+This function will not use wait() to collect the zombie process created. A file compressed by the
+program of --filter is decompressed by it before the function returns. Files compressed
+by an in-process codec are decompressed straight into the extracted file; the frames of a large file
+are decompressed in parallel.
+
+Returns true if the file was gzip-ed or false if it wasn't.*/
 bool DataExtractFile(DataBlockId block, char *path, int perm);
 
+/*Copies at most length bytes of the file that is stored in the chunk that starts from the given block, or in the
+given member of a solid chunk, from the given offset on, in dest. The number of bytes copied is stored in *read.
+Of a file compressed in frames, only the frames that hold the bytes are decompressed.
+
+Returns false if the file cannot be read in place, because it is gzip-ed, or its content is corrupt.*/
+bool DataReadRange(DataBlockId block, uint64_t offset, uint64_t length, void *dest, uint64_t *read);
+
 /*Extracts the link that is stored in the data chunk whose first block is "block" in the link
 specified by the given path.*/
 void DataExtractLink(DataBlockId block, char *path);
\ No newline at end of file
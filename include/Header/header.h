@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <stdbool.h>
 
 /*Returns the base directory.*/
 char *HeadGetBaseDir();
@@ -7,7 +8,7 @@ char *HeadGetBaseDir();
 uint64_t HeadCalculateNeededSpace(char *base_dir);
 
 /*Initialize the header partition. Base_dir will be the base directory
-for the .cib file.*/
+for the .cib file, which is given a new random identity.*/
 void HeadInit(char *base_dir);
 
 /*Returns the metadata size.*/
@@ -53,4 +54,57 @@ void HeadSetNestLevel(uint8_t nest_level);
 uint32_t HeadGetMDFreeNodeBlocks();
 
 /*Sets the counter of free node blocks in metadata partition to the given value.*/
-void HeadSetMDFreeNodeBlocks(uint32_t blocks);
\ No newline at end of file
+void HeadSetMDFreeNodeBlocks(uint32_t blocks);
+
+/*Returns true iff the snapshot table exists. If it does, its first cib-node block is stored in *block.*/
+bool HeadGetSnapshotBlock(uint32_t *block);
+
+/*Sets the first cib-node block of the snapshot table.*/
+void HeadSetSnapshotBlock(uint32_t block);
+
+/*Returns the data block that holds the path of the base archive. If the archive is not a differential
+archive, 0 is returned.*/
+uint64_t HeadGetBaseArchive();
+
+/*Sets the data block that holds the path of the base archive.*/
+void HeadSetBaseArchive(uint64_t block);
+
+/*Returns true iff the data of the cib file are stored in log-structured mode.*/
+bool HeadIsLogStructured();
+
+/*Sets whether the data of the cib file are stored in log-structured mode.*/
+void HeadSetLogStructured(bool log_structured);
+
+/*Returns true iff the cib file is being created without checkpoints, or its creation was interrupted.*/
+bool HeadIsUnfinished();
+
+/*Sets whether the cib file is being created without checkpoints.*/
+void HeadSetUnfinished(bool unfinished);
+
+/*Returns the first block of the unused rest of the log's current segment. If there is none, 0 is returned.*/
+uint64_t HeadGetLogTail();
+
+/*Sets the first block of the unused rest of the log's current segment.*/
+void HeadSetLogTail(uint64_t block);
+
+/*Returns the data block that holds the compression dictionary of the archive. If there is none, 0 is returned.*/
+uint64_t HeadGetDictionary();
+
+/*Sets the data block that holds the compression dictionary of the archive.*/
+void HeadSetDictionary(uint64_t block);
+
+/*Returns the 16 bytes of the random identity that the cib file was given when it was created.*/
+uint8_t *HeadGetUUID();
+
+/*Returns the data generation of the cib file, which changes whenever used data chunks are freed. The chunks that a
+differential archive refers to stay where they are as long as the data generation of its base archive is the same.*/
+uint64_t HeadGetDataGeneration();
+
+/*Sets the data generation of the cib file.*/
+void HeadSetDataGeneration(uint64_t generation);
+
+/*Returns the data block that holds the directory cursor of the last insertion, which was interrupted. 0 if there is none.*/
+uint64_t HeadGetResumeCursor();
+
+/*Sets the data block that holds the directory cursor of the insertion.*/
+void HeadSetResumeCursor(uint64_t block);
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*libcib: read access to cib files from a long-running process. Each open cib file is an archive handle, which
+keeps the file mapped until it is closed, and any number of archives may be open at once. An archive keeps the
+writers of its cib file waiting until it is closed or released. The functions may be called from any thread. Calls
+on the same archive are serialized, while calls on different archives run in parallel.
+
+Paths are relative to the root of the archive, e.g. "dirA/file1.txt"; "." is the root. If snapshot is not NULL,
+the path is looked up in the snapshot with that name instead of the current tree.*/
+typedef struct cib_archive *CIBArchive;
+
+/*The metadata of an entry of an archive.*/
+typedef struct cib_archive_stat{
+    uint32_t mode;          //Type and permissions of the entry, as in struct stat.
+    uint32_t modified;      //Modification time, in seconds since the Epoch.
+    uint64_t size;          //Size of the content of a file. 0 for directories and links.
+    bool sized;             //False if the size of the file is unknown, because an external program compressed it.
+}* CIBArchiveStat;
+
+/*Opens the cib file defined by path. Returns NULL if it cannot be opened.*/
+CIBArchive CIBArchiveOpen(char *path);
+
+/*Closes the archive and frees its memory.*/
+void CIBArchiveClose(CIBArchive archive);
+
+/*Releases the shared lock of the cib file of the archive, which stays mapped, so that writers may update the cib
+file. The next call on the archive waits until the writers are done and locks it again; if the cib file changed
+size or was replaced meanwhile, it is opened again; CIBArchiveTryAcquire() does so without waiting. A long-running
+process releases its archives whenever it is idle, so that it does not keep writers waiting.*/
+void CIBArchiveRelease(CIBArchive archive);
+
+/*Holds the shared lock of the cib file of the archive again, if it was released, without waiting for the writers
+of the cib file, so that a process that serves many archives on one thread is never blocked by one of them. Returns
+0 if the archive holds the lock; the next calls on it do not wait then. Returns 1 if a writer holds the lock, in
+which case the archive stays released and the call may be repeated later, and -1 if the cib file cannot be opened
+again.*/
+int CIBArchiveTryAcquire(CIBArchive archive);
+
+/*Locks the header and the metadata of the cib file of the archive in memory, so that lookups never wait for the
+disk, also after the cib file is opened again. Returns false if the process may not lock that much memory.*/
+bool CIBArchivePin(CIBArchive archive);
+
+/*Returns true iff the path exists in the archive.*/
+bool CIBArchiveQuery(CIBArchive archive, char *path, char *snapshot);
+
+/*Stores the metadata of the entry defined by path in *stat. Returns false if the path does not exist.*/
+bool CIBArchiveGetStat(CIBArchive archive, char *path, char *snapshot, CIBArchiveStat stat);
+
+/*Returns an array with the names, allocated in heap, of the entries of the directory defined by path and stores
+their number in *count. If the path does not exist or is not a directory, NULL is returned. The array must be freed
+with CIBArchiveListFree().*/
+char **CIBArchiveList(CIBArchive archive, char *path, char *snapshot, uint64_t *count);
+
+/*Frees the array of count names that CIBArchiveList() returned.*/
+void CIBArchiveListFree(char **names, uint64_t count);
+
+/*Copies at most length bytes of the file defined by path, from the given offset on, in dest. The number of bytes
+copied is stored in *read. Of a file compressed in frames, only the frames that hold the bytes are decompressed.
+
+Returns false if the path is not a file, or the file cannot be read in place, because an external program
+compressed it, or its content is corrupt.*/
+bool CIBArchiveRead(CIBArchive archive, char *path, char *snapshot, uint64_t offset, uint64_t length, void *dest, uint64_t *read);
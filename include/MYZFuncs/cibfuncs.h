@@ -3,6 +3,9 @@
 #include "ADTVector.h"
 #include "metadata.h"
 #include "cib_struct.h"
+#include "cli_utils.h"
+#include "file_management.h"
+#pragma once
 
 typedef struct entry_path_pair{
     char *path;
@@ -10,12 +13,35 @@ typedef struct entry_path_pair{
 
 }* EPPair;
 
+/*What the operations keep about an archive: the settings of the insertions into it and the state of the operation
+that runs on it.*/
+typedef struct cib_operation *CIBOperation;
 
-void CIBCreate(char *cib_file, Vector paths);
-void CIBPrintStructure(char *cib_file);
+/*Returns a new operation state, allocated in heap. The settings of the insertions are copied from the given
+operation state, unless it is NULL.*/
+CIBOperation CIBOperationCreate(CIBOperation settings);
+
+/*Destroys the given operation state. Its base archives must have been closed.*/
+void CIBOperationDestroy(CIBOperation operation);
+
+void CIBCreate(char *cib_file, Vector paths, bool compress, char *base_file, bool log_structured);
+void CIBPrintStructure(char *cib_file, char *snapshot);
 void CIBPrintMetadata(char *cib_file);
-void CIBQuery(char *cib_file, Vector paths);
+void CIBQuery(char *cib_file, Vector paths, char *snapshot);
+void CIBExtract(char *cib_file, Vector paths, char *snapshot, bool traced);
+void CIBSnapshot(char *cib_file, char *name);
+void CIBDeleteSnapshot(char *cib_file, char *name);
+void CIBCompact(char *cib_file, uint64_t steps);
+void CIBVacuum(char *cib_file, char *out_file);
+void CIBRelayout(char *cib_file, uint64_t hot);
+void CIBClean(char *cib_file);
+
+/*Selects which function should be called.*/
+void CIBStart(CIBArgs args);
 
-void TruncMapAndUpdate(uint64_t header_size, int64_t md_size, int64_t data_size, bool mapped);
+/*Returns the state of the base archive of the given depth. The chain of base archives is opened on demand
+and stays open until CIBCloseBases() is called. If the base archive cannot be opened, NULL is returned.*/
+CIBState CIBGetBase(int depth);
 
-void DataRemoveLastChunk();
\ No newline at end of file
+/*Closes every base archive that was opened by CIBGetBase().*/
+void CIBCloseBases();
\ No newline at end of file
@@ -1,18 +1,134 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <sys/stat.h>
+#include <sys/file.h>
 
 #include "ADTVector.h"
+#pragma once
 
-/*Opens the existing cib file defined by path. If the opening is successful, the file is
-mapped and the pointers are set to pointing to the different partitions of the file.
+/*The state of an archive: the file descriptor of its cib file, the addresses of its partitions and what the code of
+the data and metadata partitions, of the updates and of the operations keeps about it. Every function operates on the archive that
+the calling thread's cib points to, which CIBStateUse() sets, so threads may work on different archives at once.*/
+typedef struct cib_state{
+    int fd;
+    void *header;
+    void *data;
+    void *md;
+
+    struct data_state *data_state;          //Kept by data.c.
+    struct md_state *md_state;              //Kept by cib_struct.c.
+    struct cib_update *update;              //Kept by file_management.c.
+    struct cib_operation *operation;        //Kept by cibfuncs.c.
+}* CIBState;
+
+//The archive that the calling thread works on.
+extern __thread CIBState cib;
+
+/*Returns a new state, allocated in heap, of an archive with no open cib file. Its settings, e.g. the durability
+and the codec of insertions, are copied from the current state, if there is one.*/
+CIBState CIBStateCreate();
+
+/*Destroys the given state. Its cib file must have been closed.*/
+void CIBStateDestroy(CIBState state);
+
+/*Makes the given state the current one of the calling thread and returns the previous one.*/
+CIBState CIBStateUse(CIBState state);
+
+/*When the changes to a cib file that is open for writing reach the disk.*/
+#define DURABILITY_NONE 0       //When the system writes them. The cib file survives an interrupted cib, but may not survive a crash of the system.
+#define DURABILITY_COMMIT 1     //When the update is committed, at the end of the operation.
+#define DURABILITY_FILE 2       //After each file is stored and after each step of --compact, --relayout and --clean.
+
+/*Sets when the changes to the cib files that are opened for writing reach the disk. One of DURABILITY_*.*/
+void CIBSetDurability(int level);
+
+/*Makes the updates of the cib files that are opened for writing be committed, between two files or steps, once
+the given number of seconds have passed since they were last committed. 0 turns the checkpoints off.*/
+void CIBSetCheckpoint(uint64_t seconds);
+
+/*Sets the directory cursor of the insertion into the cib file that is open for writing to the given path, relative
+to the base directory, of a directory whose entries, and the entries inserted before it, are all stored. Each commit
+stores the cursor in the cib file, so that a resumed insertion skips the entries before it without reading them
+again. NULL removes the cursor; an insertion that ends does so.*/
+void CIBSetCheckpointCursor(char *path);
+
+/*Resumes the interrupted insertion into the cib file that is open for writing from the directory cursor that it
+stored, if any. Until the cursor changes, it is kept in the cib file.*/
+void CIBResumeBegin();
+
+/*Returns true iff the entry with the given name in the directory defined by dir_path, relative to the base directory,
+was inserted, with everything under it, before the directory cursor of the resumed insertion. Insertions that store
+a cursor visit the entries of each directory in the order of their names. If name is NULL, the directory itself is
+checked.*/
+bool CIBResumeSkips(char *dir_path, char *name);
+
+/*Ends the resumed insertion.*/
+void CIBResumeEnd();
+
+/*Waits until the open cib file of the current archive is locked with the given lock, LOCK_SH
+or LOCK_EX. Any number of processes may hold a shared lock on a cib file at once, but an exclusive lock only one
+and while no shared lock is held. The lock is released when the file is closed. If lock includes LOCK_NB, the call
+does not wait: if another process holds a lock that conflicts with it, 1 is returned.
+
+On success 0 is returned. On failure, -1 is returned.*/
+int LockCIB(int lock);
+
+/*Returns the absolute path, allocated in heap, of the open cib file. If it cannot be found, NULL is returned.*/
+char *CIBGetPath();
+
+/*Opens the existing cib file defined by path for writing. The call waits until it holds the exclusive
+lock of the file. If the opening is successful, the file is mapped and the pointers are set to pointing
+to the different partitions of the file. The changes are committed when the file is closed.
 
 On success 0 is returned. On failure, -1 is returned.*/
 int OpenExistingCIB(char *path);
 
-/*Closes the open cib file with file descriptor the global int fd and unmaps it.*/
+/*Opens the existing cib file defined by path for reading only. The call waits until it holds a shared
+lock of the file, so that no writer changes the file while it is open. If the opening is successful, the
+file is mapped read-only and the pointers are set to pointing to the different partitions of the file.
+
+On success 0 is returned. On failure, -1 is returned.*/
+int OpenExistingCIBReadOnly(char *path);
+
+/*Releases the shared lock of the open cib file, which is open for reading only and stays mapped, so that writers may
+update it meanwhile. Nothing of the cib file may be read until RelockCIB() locks it again.*/
+void UnlockCIB();
+
+/*Waits until the open cib file, defined by path and mapped size bytes long, whose lock UnlockCIB() released, holds
+a shared lock again. The updates that were committed meanwhile are seen through the mapping, unless they changed the
+size of the file; then, or if path now refers to another file or an update of it was interrupted, the cib file is
+closed and opened again. A cib file whose fd is -1, since it could not be opened again, is opened. If wait is false,
+the call does not wait while a writer holds the lock of the file.
+
+Returns 0 if the mapping is kept and 1 if the cib file was opened again. If wait is false and a writer holds the
+lock, 2 is returned and the cib file stays released; its fd is -1 if it was closed. On failure, -1 is returned and
+the cib file is closed. Whenever the lock is held again, the data state drops what it derived from the content.*/
+int RelockCIB(char *path, uint64_t size, bool wait);
+
+/*Creates the cib file defined by path, or opens it to be overwritten, and waits until it holds its exclusive lock.
+The journal that an interrupted update of an older file with the same path may have left is deleted.
+
+On success 0 is returned. On failure, -1 is returned.*/
+int OpenNewCIB(char *path);
+
+/*Closes the open cib file of the current archive and unmaps it. If the file is open for
+writing, its changes are committed first.*/
 void CloseExistingCIB();
 
+/*Writes the changes made to the open cib file to the disk. The function returns after the write is complete.
+If the cib file is open for writing, its changes are committed instead when every step is to be durable, or when
+they take too much memory; otherwise they are committed when the file is closed.*/
+void CIBSync();
+
+/*Marks that a file has been stored in the open cib file. If the cib file is open for writing, the changes made
+so far are committed when every file is to be durable, when a checkpoint is due, or when they take too much memory.*/
+void CIBFileStored();
+
+/*Releases the disk space of length bytes of the open cib file from the given offset. Their content reads as
+zeros afterwards. If the cib file is open for writing, the space that the committed file refers to is released
+when the update is committed. Returns false if the file system does not support it.*/
+bool CIBPunchHole(uint64_t offset, uint64_t length);
+
 /*Sets the size of the different partitions of the cib file to the given sizes. After truncation, the
 file is re-mapped and the pointers of the different partitions are recalculated.
 
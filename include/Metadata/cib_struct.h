@@ -1,6 +1,7 @@
 #include <stdbool.h>
 #include "metadata.h"
 #include "ADTList.h"
+#include "ADTHashTable.h"
 
 /*Initializes the given list block.*/
 void CIBListBlockInit(ListBlock block);
@@ -12,7 +13,9 @@ void CIBListInit(CIBEntry root);
 entry_id contains. If the given entry_id is not a directory, NULL is returned.*/
 List CIBListGetDirEntries(EntryId dir_id);
 
-/*Prints the Metadata for each entry stored in the metadata partition.*/
+/*Prints the Metadata for each entry of the current tree. The entries that only snapshots hold follow, under
+the name of the first snapshot that holds each of them; entries shared with the current tree or with a snapshot
+printed earlier are not repeated.*/
 void CIBListPrintEntriesMetadata();
 
 /*Prints the struct of the directory with id "current_id" and name "name". This funtion
@@ -31,6 +34,63 @@ of the directory specified by the "current_id".
 Found is set to true if the requested entry was found. Otherwise it is set to false.*/
 EntryId CIBListGetEntry(EntryId current_id, char *path, bool *found);
 
-/*Deletes the entry specified by entry_id. If it is a directory then its content
-is also deleted.*/
-void CIBListDeleteEntry(EntryId entry_id, EntryId parent_id);
\ No newline at end of file
+/*Returns the entry id of the entry defined by the given path, as CIBListGetEntry() does. Every entry
+on the way, including the returned one, that is shared with a snapshot is copied first, so that it can be
+modified. The directory "current_id" must not be shared.*/
+EntryId CIBListUnsharePath(EntryId current_id, char *path, bool *found);
+
+/*Copies the entry "src_id" to a new entry and returns its id. The copy is not inserted under any directory.
+If the entry is a directory, the copy gets its own cib-node, with parent_id as parent, that lists the same
+entries; these become shared by one more tree, so a whole tree is copied in O(1) per entry of its root. Files
+and links of the copy share their data chunks with the original entries.
+
+If parent_id is equal to src_id the copy is its own parent. This is how the root of a snapshot is created.*/
+EntryId CIBListCopyEntry(EntryId src_id, EntryId parent_id);
+
+/*Creates a snapshot of the tree rooted at entry 0 with the given name. Only the root is copied; the rest of the
+tree is shared with the current one, and a directory of the current tree is copied the first time it is modified.
+
+If a snapshot with the same name exists, *created is set to false and 0 is returned.*/
+EntryId CIBListCreateSnapshot(char *name, bool *created);
+
+/*Returns the root entry id of the snapshot with the given name. Found is set to false if no
+such snapshot exists.*/
+EntryId CIBListGetSnapshot(char *name, bool *found);
+
+/*Removes the snapshot whose root is the given entry from the snapshot table. The snapshot's tree
+is not deleted.*/
+void CIBListRemoveSnapshot(EntryId root);
+
+/*Returns a list containing the pairs <root_id, name> of every snapshot.*/
+List CIBListGetSnapshots();
+
+/*Deletes the entry specified by entry_id and everything under it. The data pointers of the deleted
+files and links are inserted in "pointers", so that their data can be deleted all at once. If parent_id
+is equal to entry_id, the entry is the root of a snapshot and has no parent; otherwise the parent must not
+be shared. Entries that are shared with other trees are kept.*/
+void CIBListDeleteTree(EntryId entry_id, EntryId parent_id, Vector pointers);
+
+/*Returns a hash table that maps the first block of each data chunk to a list with the entry ids of the
+files and links that point to it, or to one of its members if it is solid. Entries that refer to the data
+of a base archive are not included.*/
+HashTable CIBListGetDataOwners();
+
+/*Returns true iff the given entry id belongs to an entry that is in use.*/
+bool CIBListEntryExists(EntryId entry_id);
+
+/*Starts a bulk load. The metadata partition must have just been initialized with MDInit(). Every
+free node block is reserved for the load.*/
+void CIBListBulkBegin();
+
+/*Creates the cib-node of the directory with the given id, with enough consecutive blocks for the given
+number of entries. The entries that follow are inserted in that directory. Every directory that is inserted
+during the bulk load must be opened exactly once, even if it is empty.*/
+void CIBListBulkOpenDir(EntryId dir_id, EntryId parent_id, uint64_t entries);
+
+/*Inserts the given entry, with the given name, in the directory that was opened last and returns its
+entry id. If the entry is a directory it must be opened later with CIBListBulkOpenDir().*/
+EntryId CIBListBulkInsertEntry(CIBEntry entry, char *name);
+
+/*Ends the bulk load. The node blocks that were not used are given back to the free list and the
+bitmaps of the CIB-List are set.*/
+void CIBListBulkEnd();
\ No newline at end of file
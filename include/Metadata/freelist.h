@@ -14,5 +14,11 @@ void FreeListIncreaseNodeBlocks(uint32_t nblocks);
 If there are no free-blocks then the file is truncated.*/
 MDBlockId FreeListRequestNodeBlock();
 
+/*Returns the id of a free block, preferring the block right after "hint", so that the blocks of a cib-node
+stay consecutive. If that block lies past the end of the metadata partition, the partition grows by a run of
+blocks: the first is returned and the rest stay free for the cib-node to grow into. Otherwise, any free block
+is returned.*/
+MDBlockId FreeListRequestNodeBlockNear(MDBlockId hint);
+
 /*Increases the size of the list by the specified amount of blocks.*/
 void FreeListIncreaseListSize(uint32_t blocks);
\ No newline at end of file
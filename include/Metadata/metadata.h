@@ -2,6 +2,8 @@
 #include <stdbool.h>
 
 #include "ADTList.h"
+#include "ADTHashTable.h"
+#include "ADTVector.h"
 
 #define LIST_ENTRIES_PER_BLOCK 31
 #define FREE_LIST_MAX_ENTRIES 253
@@ -17,6 +19,15 @@ typedef uint32_t ListBlock;
 typedef uint32_t MDBlockId;
 typedef uint64_t EntryId;
 
+/*What the code of the metadata partition keeps about an archive: where its bulk load is. Part of CIBState.*/
+typedef struct md_state *MDState;
+
+/*Returns a new metadata state, allocated in heap.*/
+MDState MDStateCreate();
+
+/*Destroys the given metadata state.*/
+void MDStateDestroy(MDState state);
+
 /*Each entity inserted in the cib file is assigned an entry_id as well as a "spot"
 in the CIB-List. This spot is considered a cib-entry.*/
 typedef struct cib_entry *CIBEntry;
@@ -30,6 +41,10 @@ Entry's pointer is set to 0. It can be later changed with CIBEntrySetPointer().
 If mem == NULL then a cib_entry struct is allocated in heap.*/
 CIBEntry CIBEntryCreate(CIBEntry mem, char *path);
 
+/*Returns a copy, allocated in heap, of the cib_entry with the given id. The pointer of the
+copy is set to 0, as in CIBEntryCreate().*/
+CIBEntry CIBEntryCopy(EntryId entry_id);
+
 /*Given an entry id, the function returns a pointer to the cib_entry which is stored inside
 the CIB file.
 
@@ -42,6 +57,12 @@ void CIBEntrySetPointer(EntryId entry_id, uint64_t pointer);
 /*Returns the pointer of the entry with the given id.*/
 uint64_t CIBEntryGetPointer(EntryId entry_id);
 
+/*Returns the modification time of the entry with the given id.*/
+uint32_t CIBEntryGetModified(EntryId entry_id);
+
+/*Returns the mode of the entry with the given id.*/
+uint32_t CIBEntryGetMode(EntryId entry_id);
+
 /*Return true or false whether or not the given entry is a directory.*/
 bool CIBEntryIsDir(CIBEntry entry);
 
@@ -84,7 +105,10 @@ will result in inserting file1.txt.
 
 On the other hand if the path base_dir/dirA exists inside cib-file and its entry_id is 7, whilst
 base_dir/dirA does not contain dirD, then running MDInsertPath(entry, "dirD/file2.txt", 7, inserted) will result
-in inserting "dirD" and not "dirD/file2.txt" as you may expect.*/
+in inserting "dirD" and not "dirD/file2.txt" as you may expect.
+
+Entries on the way that are shared with snapshots are copied before they are modified, thus start_id must
+not be shared: it must be 0 or an id that this function returned.*/
 EntryId MDUpdatePath(CIBEntry entry, char *path, EntryId start_id, bool *inserted);
 
 /*Returns the entry_id of the entity defined by "path". We consider "path" to be relative
@@ -93,19 +117,65 @@ to the directory specified by "start_id".
 If found, the flag "found" is set to true. Otherwise, the flag is set to false.*/
 EntryId MDGetPath(char *path, EntryId start_id, bool *found);
 
-/*Prints the structure of the CIB file.*/
-void MDPrintStructure();
+/*Returns the entry_id of the entity defined by "path", as MDGetPath() does. Every entry on the way,
+including the returned one, that is shared with a snapshot is copied first, so that it can be modified.
+As in MDUpdatePath(), start_id must not be shared.*/
+EntryId MDUnsharePath(char *path, EntryId start_id, bool *found);
+
+/*Prints the structure of the tree rooted at the given entry.*/
+void MDPrintStructure(EntryId root);
 
-/*Prints information about every entity inside the CIB file.*/
+/*Prints information about every entity inside the CIB file. The entities that only snapshots hold are
+printed under the name of a snapshot.*/
 void MDPrintEntriesMetadata();
 
 /*Returns a list with the entry_ids that the directory under start_id defined by "path" contains.
 If the entity defined by path and start_id is not a directory, NULL is returned.*/
 List MDGetDirEntries(EntryId dir_id);
 
-/*Deletes the entry specified by entry_id. If it is a directory then its content
-is also deleted.*/
-void MDDeleteEntry(EntryId entry_id, EntryId parent_id);
+/*Deletes the entry specified by entry_id and everything under it. The data pointers of the deleted
+files and links are inserted in "pointers", so that their data can be deleted all at once. Entries that
+are shared with snapshots are kept for them. The parent must not be shared; see MDUnsharePath().*/
+void MDDeleteTree(EntryId entry_id, EntryId parent_id, Vector pointers);
+
+/*Starts a bulk load of the metadata partition, which must have just been initialized with MDInit().
+Entries are inserted with MDBulkInsertEntry() one directory at a time, and MDBulkEnd() must be called
+when every entry has been inserted. Nothing else may modify the metadata in between.*/
+void MDBulkBegin();
+
+/*Opens the directory with the given id, whose parent is parent_id and which will contain the given
+number of entries. The entries inserted next are placed in that directory.*/
+void MDBulkOpenDir(EntryId dir_id, EntryId parent_id, uint64_t entries);
+
+/*Inserts the given entry, with the given name, in the directory that was opened last and returns its
+entry id. Directories must be opened with MDBulkOpenDir() after they are inserted.*/
+EntryId MDBulkInsertEntry(CIBEntry entry, char *name);
+
+/*Ends the bulk load of the metadata partition.*/
+void MDBulkEnd();
+
+/*Creates a snapshot of the current tree with the given name and returns its root entry id.
+
+If a snapshot with that name already exists, or the name is not valid, *created is set to false.*/
+EntryId MDCreateSnapshot(char *name, bool *created);
+
+/*Returns the root entry id of the snapshot with the given name. Found is set to false if no
+such snapshot exists.*/
+EntryId MDGetSnapshot(char *name, bool *found);
+
+/*Removes the snapshot whose root is the given entry from the snapshot table. The snapshot's
+tree should be deleted with MDDeleteTree().*/
+void MDRemoveSnapshot(EntryId root);
+
+/*Returns a list containing the pairs <root_id, name> of every snapshot.*/
+List MDGetSnapshots();
+
+/*Returns a hash table that maps the first block of each data chunk to a list with the entry ids of the
+files and links that point to it.*/
+HashTable MDGetDataOwners();
+
+/*Returns true iff the given entry id belongs to an entry that is in use.*/
+bool MDEntryExists(EntryId entry_id);
 
 //INPair
 
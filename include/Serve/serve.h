@@ -0,0 +1,62 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ADTVector.h"
+#pragma once
+
+/*The protocol of cib --serve. A client connects to the Unix domain socket of the server and sends requests, each a
+struct serve_request followed by path_size bytes of the path and snapshot_size bytes of the name of the snapshot.
+The server answers the requests of a client in order, each with a struct serve_reply followed by size bytes of
+payload for SERVE_LIST, SERVE_READ and SERVE_STATS. It answers every request that has arrived before it writes the
+replies, so a client that sends a batch of requests at once gets their replies at once. Integers are in the byte
+order of the host.
+
+Paths are relative to the root of the archive, as in libcib; "." is the root.*/
+
+#define SERVE_OPEN 0        //Path is the absolute path of a served archive. size is set to the index of the archive.
+#define SERVE_QUERY 1       //status tells whether the path exists.
+#define SERVE_STAT 2        //mode, modified and, if sized is 1, size of the entry.
+#define SERVE_LIST 3        //The names of the entries of a directory, each followed by '\0'.
+#define SERVE_READ 4        //At most length bytes, and at most SERVE_MAX_READ, of a file, from offset.
+#define SERVE_STATS 5       //For each operation, from SERVE_OPEN to SERVE_STATS, the number of requests and the p50 and
+                            //p99 of their latency in nanoseconds: 3 uint64_t. archive and path are ignored.
+#define SERVE_OPS 6
+
+#define SERVE_OK 0
+#define SERVE_NOT_FOUND 1   //The archive is not served, or the path or snapshot does not exist.
+#define SERVE_ERROR 2       //The request is invalid, the file cannot be read in place or the archive cannot be opened again.
+
+#define SERVE_MAX_READ (4 << 20)
+
+typedef struct serve_request{
+    uint8_t op;             //One of SERVE_*.
+    uint8_t padding;
+    uint16_t archive;       //Index of the archive that SERVE_OPEN returned.
+    uint16_t path_size;
+    uint16_t snapshot_size; //0 for the current tree.
+    uint64_t offset;        //Of SERVE_READ.
+    uint64_t length;
+}* ServeRequest;
+
+typedef struct serve_reply{
+    uint64_t size;          //Bytes of payload that follow; of SERVE_OPEN, the index of the archive; of SERVE_STAT, the size of the file.
+    uint32_t mode;          //Of SERVE_STAT, as in struct stat.
+    uint32_t modified;      //Of SERVE_STAT, in seconds since the Epoch.
+    uint8_t status;         //One of SERVE_OK, SERVE_NOT_FOUND or SERVE_ERROR.
+    uint8_t sized;          //Of SERVE_STAT, 0 if the size of the file is unknown.
+    char padding[6];
+}* ServeReply;
+
+/*Serves the cib file and the other cib files of the vector, which stay open, on the Unix domain socket defined by
+path, <cib-file>.sock if it is NULL, until the process is interrupted. If pin is true, their metadata are locked in
+memory. Between batches of requests the cib files are released, so that writers may update them.
+
+Then prints how many requests of each operation were served and the p50 and p99 of their latency.*/
+void CIBServe(char *socket_path, char *cib_file, Vector paths, bool pin);
+
+/*Sends the requests that are read from the standard input, one per line, to the server of the cib file, on the
+socket defined by path, <cib-file>.sock if it is NULL, in batches of the given size, and prints their replies. A
+line is one of "query <path>", "stat <path>", "list <path>", "read <offset> <length> <path>" and "stats".
+
+Then prints, to the standard error, the p50 and p99 of the time that a batch took.*/
+void CIBClient(char *socket_path, char *cib_file, char *snapshot, uint64_t batch);
@@ -33,6 +33,25 @@ unsigned int HashString(void *vs, int size){
     return (int) res;
 }
 
+//Given the size of an array, the function hashes the 64-bit integer
+//and returns an index.
+unsigned int HashUint64(void *vx, int size){
+    uint64_t x = *(uint64_t *) vx;
+
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+
+    return (unsigned int) (x % size);
+}
+
+//Compares two 64-bit integers. Returns 0 if they are equal.
+int CompareUint64(void *a, void *b){
+    uint64_t x = *(uint64_t *) a, y = *(uint64_t *) b;
+
+    return x < y ? -1 : x > y;
+}
+
 /*Similar to strdup() but for integers. May be useful for storing integers inside the hash table.*/
 uint64_t *intdup(uint64_t x){
     uint64_t *c = malloc(sizeof(uint64_t));
@@ -123,6 +142,28 @@ void HTInsertNode(HashTable table, HashNode node){
     return;
 }
 
+//Doubles the capacity of the hash table and re-inserts every hash node.
+//Called when the number of items exceeds the capacity, so that the lists stay short.
+void HTRehash(HashTable table){
+    unsigned int old_capacity = table->capacity;
+    List *old_array = table->array;
+
+    table->capacity <<= 1;
+    table->array = calloc(table->capacity, sizeof(List));
+
+    for(unsigned int i = 0; i < old_capacity; i++){
+        if(old_array[i] != NULL){
+            for(LNode node = ListGetFirstNode(old_array[i]); node != NULL; node = LNodeGetNext(node))
+                HTInsertNode(table, LNodeGetItem(node));
+
+            ListDestroy(old_array[i]);
+        }
+    }
+
+    free(old_array);
+    return;
+}
+
 //Given a list containing pointers to hash nodes, the function returns
 //the first list node in the list that contains a hash node with a key equal to "key".
 //If there is no such list node, NULL is returned.
@@ -180,7 +221,8 @@ void HTInsertItem(HashTable table, void *key, void *item){
         HashNode node = HNCreate(key, item);
         HTInsertNode(table, node);
 
-        table->size++;
+        if(++table->size > table->capacity)
+            HTRehash(table);
     }
 
     return;
@@ -5,6 +5,15 @@
 
 #include "cli_utils.h"
 #include "syscalls.h"
+#include "codec.h"
+#include "file_management.h"
+
+//The codecs that -j can select in this build, as the usage lists them.
+#ifdef CIB_HAVE_LZMA
+#define CLI_CODECS "gzip (external, default), deflate, lz (fast) or lzma (high ratio)"
+#else
+#define CLI_CODECS "gzip (external, default), deflate or lz (fast)"
+#endif
 
 //------------------------------------------------------------------
 //Error Messages
@@ -52,6 +61,43 @@ void CIBCannotCompress(char *path){
     return;
 }
 
+/*Error Message: The file was compressed by the program of --filter with the given name, and the extraction was not
+given a command that runs it.*/
+void CIBFilterNeeded(char *path, char *name){
+    char buff[128 + strlen(path) + 2 * strlen(name)];
+    snprintf(buff, sizeof(buff), "./cib: Error: %s was compressed by %s. Extract it with --filter and a command that runs %s.\n", path, name, name);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: The codec specification of -j names a codec that is unknown or was not built, or an invalid level.*/
+void CIBInvalidCodec(char *spec){
+    char buff[256 + strlen(spec)];
+    uint64_t length = strcspn(spec, ":");
+
+    char name[length + 1]; memcpy(name, spec, length); name[length] = '\0';
+
+    if(CodecIsKnown(spec) == true && CodecFind(name) == NULL)
+        snprintf(buff, sizeof(buff), "./cib: Error: cib was built without the codec %s.\n", name);
+    else if(CodecIsKnown(spec) == true)
+        snprintf(buff, sizeof(buff), "./cib: Error: Invalid codec specification %s.\n", spec);
+    else
+        snprintf(buff, sizeof(buff), "./cib: Error: Unknown codec %s. The codecs of -j are %s.\n", name, CLI_CODECS);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: The stored data of the file cannot be decompressed.*/
+void CIBCorruptData(char *path){
+    char buff[64 + strlen(path)];
+    snprintf(buff, sizeof(buff), "./cib: Error: The data of %s are corrupted.\n", path);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
 /*Error Message: Path does not exist.*/
 void CIBPathDoesNotExist(char *path){
     char buff[64 + strlen(path)]; 
@@ -61,6 +107,287 @@ void CIBPathDoesNotExist(char *path){
     return;
 }
 
+/*Error Message: Snapshot not found inside .cib file.*/
+void CIBSnapshotNotFound(char *name, char *cib_file){
+    char buff[64 + strlen(name) + strlen(cib_file)];
+    snprintf(buff, sizeof(buff), "./cib: Error: Snapshot %s does not exist inside %s file.\n", name, cib_file);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: Snapshot cannot be created.*/
+void CIBCannotCreateSnapshot(char *name){
+    char buff[128 + strlen(name)];
+    snprintf(buff, sizeof(buff), "./cib: Error: Snapshot %s already exists or is not a valid name.\n", name);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: Data of a differential archive's entry cannot be found.*/
+void CIBBaseNotFound(char *path){
+    char buff[128 + strlen(path)];
+    snprintf(buff, sizeof(buff), "./cib: Error: Cannot open the base archive that holds the data of %s.\n", path);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: Base archive cannot be used.*/
+void CIBInvalidBase(char *base_file){
+    char buff[128 + strlen(base_file)];
+    snprintf(buff, sizeof(buff), "./cib: Error: %s cannot be the base of the archive being created.\n", base_file);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: The base archive is found neither where its record points relative to the archive nor at its
+absolute path.*/
+void CIBBaseMissing(char *relative_path, char *absolute_path){
+    char buff[160 + strlen(relative_path) + strlen(absolute_path)];
+    snprintf(buff, sizeof(buff), "./cib: Error: The base archive is found neither at %s, relative to the archive, nor at %s.\n", relative_path, absolute_path);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: The base archive is not the one that the differential archive was created from, or its data have changed since.*/
+void CIBBaseChanged(char *base_file){
+    char buff[192 + strlen(base_file)];
+    snprintf(buff, sizeof(buff), "./cib: Error: %s is not the base archive that the archive was created from, or data were deleted from it since, so the data that the archive refers to cannot be read from it.\n", base_file);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: The vacuumed cib file cannot be written to the given file.*/
+void CIBInvalidVacuumTarget(char *out_file){
+    char buff[128 + strlen(out_file)];
+    snprintf(buff, sizeof(buff), "./cib: Error: %s cannot be overwritten by the archive it is vacuumed from.\n", out_file);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: An interrupted update of the cib file cannot be completed without write access to it.*/
+void CIBJournalNotReplayed(char *cib_file){
+    char buff[160 + strlen(cib_file)];
+    snprintf(buff, sizeof(buff), "./cib: Error: The update of %s was interrupted and must be completed by a user who can write to it.\n", cib_file);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Warning Message: The pages that an update changes cannot be found, so the cib file is updated in place, without a journal.*/
+void CIBUpdatedInPlace(char *cib_file){
+    char buff[192 + strlen(cib_file)];
+    snprintf(buff, sizeof(buff), "./cib: Warning: /proc/self/pagemap cannot be read, so %s is updated in place, without a journal; an interrupted update may damage it.\n", cib_file);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: The creation of the cib file cannot be resumed, since it is an archive of another tree.*/
+void CIBCannotResume(char *cib_file){
+    char buff[160 + strlen(cib_file)];
+    snprintf(buff, sizeof(buff), "./cib: Error: %s is not an archive of this directory with the same options, so its creation cannot be resumed.\n", cib_file);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: The files cannot be staged, since the dictionary of the cib file has yet to be trained.*/
+void CIBCannotStage(char *cib_file){
+    char buff[192 + strlen(cib_file)];
+    snprintf(buff, sizeof(buff), "./cib: Warning: %s has no dictionary yet, which only one appender may train, so the files are appended under its lock instead of being staged.\n", cib_file);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Prints the disk space that was released by punching holes in the freed chunks of the cib file.*/
+void CIBPunchReport(char *cib_file, uint64_t bytes){
+    char buff[128 + strlen(cib_file)];
+    snprintf(buff, sizeof(buff), "%s: Released %lu bytes of disk space held by deleted data.\n", cib_file, bytes);
+
+    WriteBytes(buff, strlen(buff), 1);
+    return;
+}
+
+/*Error Message: No access trace has been recorded for the cib file.*/
+void CIBTraceNotFound(char *cib_file){
+    char buff[128 + strlen(cib_file)];
+    snprintf(buff, sizeof(buff), "./cib: Error: No access trace of %s has been recorded. Extract with -x --trace first.\n", cib_file);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Prints how the files inserted in the cib file were compressed. The files stored as they are are split into
+those that the probe found incompressible, which were not compressed at all, and those that compression did
+not shrink. saved_ms is the estimated compression time that the probe saved, or negative if it is unknown.*/
+void CIBCompressionReport(char *cib_file, uint64_t compressed_files, uint64_t compressed_bytes, uint64_t payload_bytes, uint64_t probed_files,
+    uint64_t probed_bytes, uint64_t expanded_files, uint64_t expanded_bytes, int64_t saved_ms){
+    char saved[64] = "";
+    if(saved_ms >= 0)
+        snprintf(saved, sizeof(saved), ", saving about %ld ms of compression,", saved_ms);
+
+    char buff[512 + 2 * strlen(cib_file)];
+    snprintf(buff, sizeof(buff), "%s: Compressed %lu files, %lu -> %lu bytes.\n%s: Stored as they are %lu files (%lu bytes) that the probe found "
+        "incompressible%s and %lu files (%lu bytes) that compression did not shrink.\n", cib_file, compressed_files, compressed_bytes, payload_bytes,
+        cib_file, probed_files, probed_bytes, saved, expanded_files, expanded_bytes);
+
+    WriteBytes(buff, strlen(buff), 1);
+    return;
+}
+
+/*Prints the rate at which files were inserted in the cib file and how many files and bytes were inserted at
+each level of the codec, files[level] and bytes[level], between the given levels.*/
+void CIBLevelReport(char *cib_file, char *codec, uint8_t min_level, uint8_t max_level, uint64_t *files, uint64_t *bytes, double rate){
+    char buff[256 + strlen(cib_file) + strlen(codec) + 64 * (max_level - min_level + 1)];
+    int length = snprintf(buff, sizeof(buff), "%s: Inserted at %.1f MB/s. Files (bytes) per %s level:", cib_file, rate, codec);
+
+    for(int level = min_level; level <= max_level; level++)
+        if(files[level] != 0)
+            length += snprintf(buff + length, sizeof(buff) - length, " %d: %lu (%lu)", level, files[level], bytes[level]);
+
+    snprintf(buff + length, sizeof(buff) - length, ".\n");
+
+    WriteBytes(buff, strlen(buff), 1);
+    return;
+}
+
+/*Prints the size of the dictionary of the cib file, how many files it was trained on, 0 if it was already
+stored, and how many files were compressed with it.*/
+void CIBDictionaryReport(char *cib_file, uint64_t dict_size, uint64_t samples, uint64_t files){
+    char trained[64] = "reused";
+    if(samples != 0)
+        snprintf(trained, sizeof(trained), "trained on %lu files", samples);
+
+    char buff[256 + strlen(cib_file)];
+    if(dict_size == 0)
+        snprintf(buff, sizeof(buff), "%s: The small files share too little for a dictionary; each was compressed on its own.\n", cib_file);
+    else
+        snprintf(buff, sizeof(buff), "%s: Compressed %lu files with a dictionary of %lu bytes, %s.\n", cib_file, files, dict_size, trained);
+
+    WriteBytes(buff, strlen(buff), 1);
+    return;
+}
+
+/*Prints the outcome of a relayout of the cib file.*/
+void CIBRelayoutReport(char *cib_file, uint64_t hot_chunks, uint64_t moved){
+    char buff[128 + strlen(cib_file)];
+    snprintf(buff, sizeof(buff), "%s: Laid out %lu hot chunks at the start of the data, moving %lu chunks.\n", cib_file, hot_chunks, moved);
+
+    WriteBytes(buff, strlen(buff), 1);
+    return;
+}
+
+/*Error Message: The operation cannot be performed on a log-structured cib file.*/
+void CIBLogStructured(char *cib_file){
+    char buff[128 + strlen(cib_file)];
+    snprintf(buff, sizeof(buff), "./cib: Error: %s is log-structured. Its data can only be rearranged with --clean.\n", cib_file);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: The cib file is not log-structured, so it has no segments to clean.*/
+void CIBNotLogStructured(char *cib_file){
+    char buff[128 + strlen(cib_file)];
+    snprintf(buff, sizeof(buff), "./cib: Error: %s is not log-structured. Use --compact instead.\n", cib_file);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Prints the outcome of the cleaning of a log-structured cib file.*/
+void CIBCleanReport(char *cib_file, uint64_t cleaned, uint64_t moved, uint64_t orphans, uint64_t old_size, uint64_t new_size){
+    char buff[256 + strlen(cib_file)];
+    snprintf(buff, sizeof(buff), "%s: Cleaned %lu segments, moved %lu chunks, freed %lu unreferenced chunks, size %lu -> %lu bytes.\n",
+        cib_file, cleaned, moved, orphans, old_size, new_size);
+
+    WriteBytes(buff, strlen(buff), 1);
+    return;
+}
+
+/*Prints the outcome of a compaction of the cib file.*/
+void CIBCompactReport(char *cib_file, uint64_t moved, uint64_t orphans, uint64_t old_size, uint64_t new_size, bool finished){
+    char buff[256 + strlen(cib_file)];
+    snprintf(buff, sizeof(buff), "%s: Moved %lu chunks, freed %lu unreferenced chunks, size %lu -> %lu bytes.%s\n", cib_file, moved, orphans,
+        old_size, new_size, finished == true ? "" : " Step limit reached; run again to continue.");
+
+    WriteBytes(buff, strlen(buff), 1);
+    return;
+}
+
+/*Error Message: The socket of the server cannot be created.*/
+void CIBCannotServe(char *socket_path){
+    char buff[128 + strlen(socket_path)];
+    snprintf(buff, sizeof(buff), "./cib: Error: Cannot listen on %s; another server may be listening on it.\n", socket_path);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: The metadata of the served cib file cannot be locked in memory.*/
+void CIBCannotPin(char *cib_file){
+    char buff[160 + strlen(cib_file)];
+    snprintf(buff, sizeof(buff), "./cib: Warning: The metadata of %s cannot be locked in memory; the limit of locked memory (ulimit -l) is too low.\n", cib_file);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: No server listens on the socket.*/
+void CIBServerNotFound(char *socket_path){
+    char buff[128 + strlen(socket_path)];
+    snprintf(buff, sizeof(buff), "./cib: Error: No server listens on %s.\n", socket_path);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: The server that listens on the socket does not serve the cib file.*/
+void CIBNotServed(char *cib_file, char *socket_path){
+    char buff[128 + strlen(cib_file) + strlen(socket_path)];
+    snprintf(buff, sizeof(buff), "./cib: Error: %s is not served on %s.\n", cib_file, socket_path);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Error Message: A line of the client's input is not a request.*/
+void CIBInvalidRequest(char *line){
+    char buff[128 + strlen(line)];
+    snprintf(buff, sizeof(buff), "./cib: Error: Invalid request: %s\n", line);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
+/*Prints how many requests of the given operation the server served and the p50 and p99 of their latency.*/
+void CIBLatencyReport(char *server, char *op, uint64_t requests, uint64_t p50_ns, uint64_t p99_ns){
+    char buff[256 + strlen(server) + strlen(op)];
+    snprintf(buff, sizeof(buff), "%s: Served %lu %s requests, p50 %.1f us, p99 %.1f us.\n", server, requests, op, p50_ns / 1e3, p99_ns / 1e3);
+
+    WriteBytes(buff, strlen(buff), 1);
+    return;
+}
+
+/*Prints, to the standard error, how many requests the client sent in how many batches, the p50 and p99 of the
+time that a batch took and the rate of the requests.*/
+void CIBClientReport(char *server, uint64_t requests, uint64_t batches, uint64_t p50_ns, uint64_t p99_ns, double seconds){
+    char buff[256 + strlen(server)];
+    snprintf(buff, sizeof(buff), "%s: Sent %lu requests in %lu batches, %.0f requests/s; a batch took p50 %.1f us, p99 %.1f us.\n", server,
+        requests, batches, seconds > 0 ? requests / seconds : 0, p50_ns / 1e3, p99_ns / 1e3);
+
+    WriteBytes(buff, strlen(buff), 2);
+    return;
+}
+
 /*Returns the full path. Function assumes that path is relative to cwd.*/
 char *FullPath(const char *path){
     char *cwd = getcwd(NULL, 0), *full_path;
@@ -167,11 +494,26 @@ void CIBArgsDestroy(CIBArgs args){
     VectorDestroy(args->paths);
     
     free(args->cib_file);
+    free(args->snapshot);
+    free(args->base);
+    free(args->filter);
+    free(args->socket);
     free(args);
 
     return;
 }
 
+/*Returns true iff the argument that follows -j can only be meant as a codec specification: it has a level, names a
+codec known to cib, or is a short lowercase word that is not an existing path, unlike the archive-file that may follow
+-j instead.*/
+bool CLIIsCodecSpec(char *arg){
+    if(strchr(arg, ':') != NULL || CodecIsKnown(arg) == true)
+        return true;
+
+    uint64_t length = strlen(arg);
+    return length != 0 && length <= 16 && strspn(arg, "abcdefghijklmnopqrstuvwxyz0123456789") == length && access(arg, F_OK) != 0;
+}
+
 /*Reads the arguments and stores them inside a cib_arguments struct.
 
 If the input was correct a pointer to the cib_arguments struct is returned.
@@ -179,21 +521,137 @@ Otherwise, NULL is returned.*/
 CIBArgs CIBReadArgs(int argc, char *argv[]){
     CIBArgs  arguments = calloc(1, sizeof(struct cib_arguments));
     arguments->paths = VectorCreate(argc, free);
+    CodecParse("gzip", &arguments->codec, &arguments->level);
+    arguments->durability = DURABILITY_COMMIT;
     
-    bool flag = false;
+    bool flag = false, durability = false, reported = false;
     
     for(int i = 1; i < argc && flag == false; i++){
-        if(argv[i][0] == '-' && strlen(argv[i]) == 2){
+        if(strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc && arguments->snapshot == NULL){
+            arguments->snapshot = strdup(argv[++i]);
+
+        }else if(strcmp(argv[i], "--base") == 0 && i + 1 < argc && arguments->base == NULL){
+            arguments->base = strdup(argv[++i]);
+
+        }else if(strcmp(argv[i], "--compact") == 0){
+            arguments->flags |= COMPACT;
+
+        }else if(strcmp(argv[i], "--vacuum") == 0){
+            arguments->flags |= VACUUM;
+
+        }else if(strcmp(argv[i], "--log") == 0){
+            arguments->flags |= LOG;
+
+        }else if(strcmp(argv[i], "--solid") == 0){
+            arguments->flags |= SOLID;
+
+        }else if(strcmp(argv[i], "--dict") == 0){
+            arguments->flags |= DICT;
+
+        }else if(strcmp(argv[i], "--stage") == 0){
+            arguments->flags |= STAGE;
+
+        }else if(strcmp(argv[i], "--resume") == 0){
+            arguments->flags |= RESUME;
+
+        }else if(strcmp(argv[i], "--verify") == 0){
+            arguments->flags |= VERIFY;
+
+        }else if(strcmp(argv[i], "--serve") == 0){
+            arguments->flags |= SERVE;
+
+        }else if(strcmp(argv[i], "--client") == 0){
+            arguments->flags |= CLIENT;
+
+        }else if(strcmp(argv[i], "--mlock") == 0){
+            arguments->flags |= MLOCK;
+
+        }else if(strcmp(argv[i], "--socket") == 0 && i + 1 < argc && arguments->socket == NULL){
+            arguments->socket = strdup(argv[++i]);
+
+        }else if(strcmp(argv[i], "--batch") == 0 && i + 1 < argc && arguments->batch == 0){
+            char *end;
+            arguments->batch = strtoull(argv[++i], &end, 10);
+            flag = *end != '\0' || arguments->batch == 0;
+
+        }else if(strcmp(argv[i], "--clean") == 0){
+            arguments->flags |= CLEAN;
+
+        }else if(strcmp(argv[i], "--trace") == 0){
+            arguments->flags |= TRACE;
+
+        }else if(strcmp(argv[i], "--relayout") == 0){
+            arguments->flags |= RELAYOUT;
+
+        }else if(strcmp(argv[i], "--hot") == 0 && i + 1 < argc && arguments->hot == 0){
+            char *end;
+            arguments->hot = strtoull(argv[++i], &end, 10);
+            flag = *end != '\0' || arguments->hot == 0;
+
+        }else if(strcmp(argv[i], "--rate") == 0 && i + 1 < argc && arguments->rate == 0){
+            char *end;
+            arguments->rate = strtoull(argv[++i], &end, 10);
+            flag = *end != '\0' || arguments->rate == 0;
+
+        }else if(strcmp(argv[i], "--deadline") == 0 && i + 1 < argc && arguments->deadline == 0){
+            char *end;
+            arguments->deadline = strtoull(argv[++i], &end, 10);
+            flag = *end != '\0' || arguments->deadline == 0;
+
+        }else if(strcmp(argv[i], "--filter") == 0 && i + 1 < argc && arguments->filter == NULL){
+            arguments->filter = strdup(argv[++i]);
+
+        }else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc && arguments->threads == 0){
+            char *end;
+            arguments->threads = strtoull(argv[++i], &end, 10);
+            flag = *end != '\0' || arguments->threads == 0;
+
+        }else if(strcmp(argv[i], "--durability") == 0 && i + 1 < argc && durability == false){
+            durability = true;
+            i++;
+
+            if(strcmp(argv[i], "none") == 0)
+                arguments->durability = DURABILITY_NONE;
+            else if(strcmp(argv[i], "commit") == 0)
+                arguments->durability = DURABILITY_COMMIT;
+            else if(strcmp(argv[i], "file") == 0)
+                arguments->durability = DURABILITY_FILE;
+            else
+                flag = true;
+
+        }else if(strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc && arguments->checkpoint == 0){
+            char *end;
+            arguments->checkpoint = strtoull(argv[++i], &end, 10);
+            flag = *end != '\0' || arguments->checkpoint == 0;
+
+        }else if(strcmp(argv[i], "--steps") == 0 && i + 1 < argc && arguments->steps == 0){
+            char *end;
+            arguments->steps = strtoull(argv[++i], &end, 10);
+            flag = *end != '\0' || arguments->steps == 0;
+
+        }else if(argv[i][0] == '-' && strlen(argv[i]) == 2){
 
             switch (argv[i][1]){
                 case 'c': arguments->flags |= C; break;
                 case 'a': arguments->flags |= A; break;
                 case 'x': arguments->flags |= X; break;
-                case 'j': arguments->flags |= J; break;
+                case 'j':
+                    arguments->flags |= J;
+
+                    //An optional codec specification follows. A codec that is unknown or was not built, or an invalid
+                    //level, is an error, and so is a word that can only be meant as a codec.
+                    if(i + 1 < argc && CodecParse(argv[i + 1], &arguments->codec, &arguments->level) == true)
+                        i++;
+                    else if(i + 1 < argc && CLIIsCodecSpec(argv[i + 1]) == true){
+                        CIBInvalidCodec(argv[i + 1]);
+                        flag = reported = true;
+                    }
+                    break;
                 case 'd': arguments->flags |= D; break;
                 case 'm': arguments->flags |= M; break;
                 case 'q': arguments->flags |= Q; break;
                 case 'p': arguments->flags |= P; break;
+                case 's': arguments->flags |= S; break;
                 default: flag = true;
             }
             
@@ -209,30 +667,175 @@ CIBArgs CIBReadArgs(int argc, char *argv[]){
         }
     }
 
-    switch (arguments->flags){
-        case C: case A: case X: case D: case M:
-        case Q: case P: case C | J: case A | J: break;
+    //Check that the number of paths is the one that the operation expects.
+    int paths = VectorGetSize(arguments->paths);
+    switch (arguments->flags & ~(SOLID | DICT | RESUME | VERIFY)){
+        case C: case A: case Q:
+        case C | J: case A | J:
+        case A | STAGE: case A | J | STAGE:
+        case C | LOG: case C | J | LOG: flag |= paths == 0; break;
+        case D: flag |= (paths == 0) == (arguments->snapshot == NULL); break;
+        case M: case P: case COMPACT: case RELAYOUT: case CLEAN: case CLIENT: flag |= paths != 0; break;
+        case SERVE: case SERVE | MLOCK: break;
+        case S: case VACUUM: flag |= paths != 1; break;
+        case X: case X | TRACE: break;
 
         default: flag = true;
     }
 
-    if(flag == true || !((VectorGetSize(arguments->paths) == 0 && arguments->flags >= X) || (VectorGetSize(arguments->paths) > 0 && arguments->flags <= X))){
+    //Only read operations and the deletion of a snapshot may refer to a snapshot.
+    if(arguments->snapshot != NULL && !(arguments->flags == X || arguments->flags == (X | TRACE) || arguments->flags == P || arguments->flags == Q || arguments->flags == D ||
+        arguments->flags == CLIENT))
+        flag = true;
+
+    //Only a new archive can be differential, and only a differential archive compares the contents of files.
+    if(arguments->base != NULL && (arguments->flags & ~(J | LOG | SOLID | DICT | RESUME | VERIFY)) != C)
+        flag = true;
+
+    if((arguments->flags & VERIFY) != 0 && arguments->base == NULL)
+        flag = true;
+
+    //Only a compressed insertion can store small files in solid chunks.
+    if((arguments->flags & SOLID) != 0 && ((arguments->flags & J) == 0 || (arguments->flags & (C | A)) == 0))
+        flag = true;
+
+    //Only a compressed insertion can use a dictionary, with a codec that supports one, and not in solid chunks.
+    //gzip is replaced by deflate.
+    uint8_t dict_codec = arguments->codec == CODEC_GZIP ? CODEC_DEFLATE : arguments->codec;
+    if((arguments->flags & DICT) != 0 && ((arguments->flags & J) == 0 || (arguments->flags & (C | A)) == 0 ||
+        (arguments->flags & SOLID) != 0 || CodecGet(dict_codec)->compress_dict == NULL))
+        flag = true;
+
+    //Only a compressed insertion or an extraction can be given a number of threads.
+    if(arguments->threads != 0 && (arguments->flags & J) == 0 && (arguments->flags & X) == 0)
+        flag = true;
+
+    //Only a compressed insertion can use an external program, instead of the codec of -j and not in solid chunks,
+    //with a dictionary or at an adapted level. An extraction is given the program that decompresses what it compressed.
+    bool extract_filter = arguments->filter != NULL && (arguments->flags & X) != 0 && (arguments->flags & J) == 0;
+    char *filter_name = arguments->filter != NULL ? CodecFilterName(arguments->filter) : NULL;
+
+    if(filter_name != NULL && filter_name[0] == '\0')
+        flag = true;
+    else if(arguments->filter != NULL && extract_filter == false && ((arguments->flags & J) == 0 || (arguments->flags & (C | A)) == 0 ||
+        arguments->codec != CODEC_GZIP || (arguments->flags & (SOLID | DICT)) != 0 || arguments->rate != 0 || arguments->deadline != 0))
+        flag = true;
+    else if(arguments->filter != NULL && extract_filter == false){
+        arguments->codec = CODEC_FILTER;
+        arguments->level = 0;
+    }
+    free(filter_name);
+
+    //Only a compaction can be limited to a number of steps.
+    if(arguments->steps != 0 && arguments->flags != COMPACT)
+        flag = true;
+
+    //Only a relayout can be limited to a number of hot entries.
+    if(arguments->hot != 0 && arguments->flags != RELAYOUT)
+        flag = true;
+
+    //Only a compressed insertion can target a rate or a deadline, and not both.
+    if((arguments->rate != 0 || arguments->deadline != 0) && ((arguments->flags & J) == 0 || (arguments->rate != 0 && arguments->deadline != 0)))
+        flag = true;
+
+    //Only the server and its clients use a socket, and only a client sends requests in batches.
+    if((arguments->socket != NULL && (arguments->flags & (SERVE | CLIENT)) == 0) || (arguments->batch != 0 && arguments->flags != CLIENT))
+        flag = true;
+
+    //Only an insertion, and not a staged one, can take checkpoints and be resumed.
+    bool checkpoints = arguments->checkpoint != 0 || (arguments->flags & RESUME) != 0;
+    if(checkpoints == true && ((arguments->flags & (C | A)) == 0 || (arguments->flags & STAGE) != 0))
+        flag = true;
+
+    //Only an operation that changes an existing archive updates it in place, as does -c that takes checkpoints.
+    if(durability == true && (arguments->flags & (A | D | S | COMPACT | RELAYOUT | CLEAN)) == 0 && ((arguments->flags & C) == 0 || checkpoints == false))
+        flag = true;
+
+    if(flag == true || arguments->cib_file == NULL){
         char *error_msg = "cib: Error: Missing or Invalid arguments.\n\
 Usage:\n\
     cib -c <archive-file> <list-of-files/dirs>     Create a new archive.\n\
         -a <archive-file> <list-of-files/dirs>     Append files/directories to an existing archive.\n\
         -x <archive-file> <list-of-files/dirs>     Extract the contents to the current directory. List may be empty.\n\
-        -j <archive-file>                          Compress the archive using gzip. Used only with -a or -c\n\
-        -d <archive-file> <list-of-files/dirs>     Delete files/directories from the archive.\n\
+        -j [codec[:level]] <archive-file>          Compress the archive. Used only with -a or -c. The codec is gzip\n\
+                                                   (external, default), deflate"
+#ifdef CIB_HAVE_LZMA
+                                                   ", lz (fast) or lzma (high ratio).\n\
+"
+#else
+                                                   " or lz (fast).\n\
+"
+#endif
+"        -d <archive-file> <list-of-files/dirs>     Delete files/directories from the archive.\n\
         -m <archive-file>                          Print metadata of stored items.\n\
         -q <archive-file> <list-of-files/dirs>     Check if files/directories exist in the archive.\n\
-        -p <archive-file>                          Print a human-readable archive structure.\n";
-
-
-        WriteBytes(error_msg, strlen(error_msg), 2);
+        -p <archive-file>                          Print a human-readable archive structure.\n\
+        -s <archive-file> <snapshot-name>          Take a snapshot of the archive's current tree.\n\
+    --snapshot <snapshot-name>                     Use the snapshot instead of the current tree. Used with -x, -p or -q.\n\
+                                                   With -d and no paths, the snapshot is deleted.\n\
+    --base <base-archive>                          Used with -c. Files unchanged since base-archive was created are\n\
+                                                   not stored; their data are read from base-archive.\n\
+    --verify                                       Used with --base. Compare the content of each file whose metadata\n\
+                                                   are unchanged with the base archive's copy.\n\
+    --compact <archive-file>                       Move the stored data towards the start of the archive and shrink it.\n\
+    --steps <count>                                Used with --compact. Move at most count chunks; run again to continue.\n\
+    --vacuum <archive-file> <new-archive-file>     Write the current tree to a new archive without free space, laid out\n\
+                                                   in extraction order. Snapshots are not copied.\n\
+    --log                                          Used with -c. Only append data to the archive; deleted data are\n\
+                                                   reclaimed with --clean.\n\
+    --stage                                        Used with -a. Insert the files in a staging archive next to the\n\
+                                                   archive and then commit it, so that many -a may insert at once.\n\
+    --clean <archive-file>                         Reclaim the space of deleted data of an archive created with --log.\n\
+    --trace                                        Used with -x. Record the extracted entries in <archive-file>.trace.\n\
+    --relayout <archive-file>                      Move the data of the traced entries to the start of the archive, in\n\
+                                                   the order in which they were first extracted.\n\
+    --hot <count>                                  Used with --relayout. Move only the count most extracted entries.\n\
+    --solid                                        Used with -j. Store the small files together in solid chunks, each\n\
+                                                   compressed as a whole. gzip is replaced by deflate.\n\
+    --dict                                         Used with -j. Train a dictionary on a sample of the small files and\n\
+                                                   compress each small file with it. gzip is replaced by deflate;\n\
+                                                   lzma cannot use one. -a reuses the archive's dictionary.\n\
+    --rate <MB/s>                                  Used with -j. Adapt the codec's level between files so that files\n\
+                                                   are inserted at about the given rate.\n\
+    --deadline <seconds>                           Used with -j. Adapt the codec's level between files so that the\n\
+                                                   insertion ends in about the given time.\n\
+    --threads <count>                              Used with -j or -x. Compress or decompress the frames of large files\n\
+                                                   on count threads instead of one per core. With an external program,\n\
+                                                   run at most count programs at once.\n\
+    --filter <command>                             Used with -j. Compress each file with the command, which reads the\n\
+                                                   file from its input and writes to its output, e.g. \"zstd -19\". It is\n\
+                                                   run without a shell; only the name of its program is stored. Used\n\
+                                                   with -x, the command that extracts those files, run with -d, e.g.\n\
+                                                   \"zstd\"; its program must have the stored name.\n\
+    --durability none|commit|file                  Used with -a, -d, -s, --compact, --relayout, --clean or -c with\n\
+                                                   --checkpoint. When the changes reach the disk: left to the system,\n\
+                                                   once the operation commits them (default), or after each file or step.\n\
+    --checkpoint <seconds>                         Used with -c or -a. Commit the inserted files every given seconds,\n\
+                                                   so that an interrupted insertion keeps them.\n\
+    --resume                                       Used with -c or -a. Skip the files that the archive already holds\n\
+                                                   unchanged, to go on with an interrupted insertion. Implies\n\
+                                                   --checkpoint 60 unless it is given.\n\
+    --serve <archive-file> <list-of-archive-files>  Keep the archives open and answer the requests of --client on the\n\
+                                                   socket <archive-file>.sock until interrupted. Then print the p50\n\
+                                                   and p99 latency of each operation.\n\
+    --mlock                                        Used with --serve. Lock the metadata of the archives in memory.\n\
+    --client <archive-file>                        Send the requests read from the input to the server of the archive\n\
+                                                   and print the replies. A line is \"query <path>\", \"stat <path>\",\n\
+                                                   \"list <path>\", \"read <offset> <length> <path>\" or \"stats\".\n\
+    --socket <path>                                Used with --serve or --client instead of <archive-file>.sock.\n\
+    --batch <count>                                Used with --client. Send count requests at once (default 64).\n";
+
+
+        //An error that was already reported needs no usage.
+        if(reported == false)
+            WriteBytes(error_msg, strlen(error_msg), 2);
 
         VectorDestroy(arguments->paths);
         free(arguments->cib_file);
+        free(arguments->snapshot);
+        free(arguments->base);
+        free(arguments->filter);
+        free(arguments->socket);
         free(arguments);
         return NULL;
     }
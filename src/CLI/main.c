@@ -0,0 +1,14 @@
+#include "cli_utils.h"
+#include "cibfuncs.h"
+
+int main(int argc, char *argv[]){
+    CIBArgs args;
+    
+    if((args = CIBReadArgs(argc, argv)) == NULL)
+        return -1;
+
+    CIBStart(args);
+
+    CIBArgsDestroy(args);
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "codec.h"
+
+/*The codecs that are known to cib. The ones whose library was not found at build time have no
+implementation and cannot be selected.*/
+static struct codec codecs[CODEC_COUNT] = {
+    {"none", CODEC_NONE, 0, 0, 0, 0, NULL, NULL, NULL, NULL, NULL},
+    {"gzip", CODEC_GZIP, 1, 9, 6, 0, NULL, NULL, NULL, NULL, NULL},
+    {"deflate", CODEC_DEFLATE, 1, 9, 6, CODEC_FRAME_BYTES, DeflateBound, DeflateCompress, DeflateDecompress, DeflateCompressDict, DeflateDecompressDict},
+    {"lz", CODEC_LZ, 1, 9, 1, CODEC_FRAME_BYTES, LZBound, LZCompress, LZDecompress, LZCompressDict, LZDecompressDict},
+#ifdef CIB_HAVE_LZMA
+    {"lzma", CODEC_LZMA, 0, 9, 6, CODEC_LZMA_FRAME_BYTES, LZMABound, LZMACompress, LZMADecompress, NULL, NULL},
+#else
+    {NULL, CODEC_LZMA, 0, 0, 0, 0, NULL, NULL, NULL, NULL, NULL},
+#endif
+    {"filter", CODEC_FILTER, 0, 0, 0, 0, NULL, NULL, NULL, NULL, NULL},
+};
+
+/*The names of the codecs that are known to cib, whether or not their library was found at build time.*/
+static const char *codec_names[CODEC_COUNT] = {"none", "gzip", "deflate", "lz", "lzma", "filter"};
+
+/*Returns the codec with the given id. If it is unknown or was not built, NULL is returned.*/
+Codec CodecGet(uint8_t id){
+    if(id >= CODEC_COUNT || codecs[id].name == NULL)
+        return NULL;
+
+    return &codecs[id];
+}
+
+/*Returns the codec with the given name. If it is unknown or was not built, NULL is returned.*/
+Codec CodecFind(char *name){
+    for(int i = 0; i < CODEC_COUNT; i++)
+        if(codecs[i].name != NULL && strcmp(codecs[i].name, name) == 0)
+            return &codecs[i];
+
+    return NULL;
+}
+
+/*Returns true iff the name of the codec specification, its part before ':', is the name of a codec known to cib,
+whether or not it was built.*/
+bool CodecIsKnown(char *spec){
+    uint64_t length = strcspn(spec, ":");
+
+    for(int i = 0; i < CODEC_COUNT; i++)
+        if(strlen(codec_names[i]) == length && strncmp(codec_names[i], spec, length) == 0)
+            return true;
+
+    return false;
+}
+
+/*Returns true iff the codec with the given id is implemented in-process.*/
+bool CodecIsInProcess(uint8_t id){
+    Codec codec = CodecGet(id);
+
+    return codec != NULL && codec->compress != NULL;
+}
+
+/*Returns true iff the codec with the given id is an external program, whose output is not readable in place.*/
+bool CodecIsExternal(uint8_t id){
+    return id == CODEC_GZIP || id == CODEC_FILTER;
+}
+
+/*Reads a codec specification of the form "name" or "name:level". The codec's id is stored in *id and
+the level in *level; if the level is omitted the codec's default level is used.
+
+Returns false if the codec is unknown or the level is out of its range.*/
+bool CodecParse(char *spec, uint8_t *id, uint8_t *level){
+    char name[strlen(spec) + 1]; strcpy(name, spec);
+    char *colon = strchr(name, ':');
+    if(colon != NULL)
+        *colon = '\0';
+
+    Codec codec = CodecFind(name);
+    if(codec == NULL || codec->id == CODEC_NONE || codec->id == CODEC_FILTER)
+        return false;
+
+    *id = codec->id;
+    *level = codec->default_level;
+    if(colon == NULL)
+        return true;
+
+    char *end; long value = strtol(colon + 1, &end, 10);
+    if(colon[1] == '\0' || *end != '\0' || value < codec->min_level || value > codec->max_level)
+        return false;
+
+    *level = value;
+    return true;
+}
@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <time.h>
+
+#include "codec.h"
+
+/*The controller looks at the insertion in batches of at least CODEC_CONTROL_BATCH_BYTES bytes or
+CODEC_CONTROL_BATCH_NS nanoseconds. At the end of each batch it compares the rate at which the batch's
+files were read, compressed and written with the target rate:
+
+- If the batch was slower than the target and compression took most of its time, the CPU is the bottleneck
+  and the level is lowered.
+- If it was slower but compression took little of its time, the disk is the bottleneck. A higher level writes
+  fewer bytes, so the level is raised.
+- If it was faster than the target, there is time to spare for a better ratio and the level is raised.
+
+With a deadline, the target rate is recomputed at every batch from the bytes and the time that remain.*/
+
+struct codec_controller{
+    Codec codec;
+    uint8_t level;
+
+    double rate;                //Target rate in bytes per second. 0 if there is a deadline instead.
+    uint64_t deadline;          //Time, as returned by CodecControllerNow(), by which the insertion should end.
+    uint64_t remaining_bytes;   //Bytes that are still to be inserted, for the deadline.
+
+    uint64_t batch_bytes;
+    uint64_t batch_compress_ns;
+    uint64_t batch_wall_ns;
+
+    uint64_t files[256];        //Files and bytes inserted at each level.
+    uint64_t bytes[256];
+};
+
+/*Returns the current time in nanoseconds.*/
+uint64_t CodecControllerNow(){
+    struct timespec now; clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*Creates a controller that adapts the level of the given codec, starting from the given level. Either rate is
+the target rate in MB/s, or deadline is the number of seconds in which total_bytes bytes should be inserted.*/
+CodecController CodecControllerCreate(uint8_t codec_id, uint8_t level, uint64_t rate, uint64_t deadline, uint64_t total_bytes){
+    CodecController controller = calloc(1, sizeof(struct codec_controller));
+
+    controller->codec = CodecGet(codec_id);
+    controller->level = level;
+    controller->rate = rate * 1e6;
+    controller->deadline = deadline == 0 ? 0 : CodecControllerNow() + deadline * 1000000000ULL;
+    controller->remaining_bytes = total_bytes;
+
+    return controller;
+}
+
+/*Returns the level at which the next files should be compressed.*/
+uint8_t CodecControllerGetLevel(CodecController controller){
+    return controller->level;
+}
+
+/*Records that the given number of files, which hold in_bytes bytes, were inserted at the current level in
+wall_ns nanoseconds, of which compress_ns were spent on compressing them. At the end of a batch the level is
+adapted. The level for the next files is returned.*/
+uint8_t CodecControllerUpdate(CodecController controller, uint64_t files, uint64_t in_bytes, uint64_t compress_ns, uint64_t wall_ns){
+    controller->files[controller->level] += files;
+    controller->bytes[controller->level] += in_bytes;
+    controller->remaining_bytes -= in_bytes < controller->remaining_bytes ? in_bytes : controller->remaining_bytes;
+
+    controller->batch_bytes += in_bytes;
+    controller->batch_compress_ns += compress_ns;
+    controller->batch_wall_ns += wall_ns;
+
+    if(controller->batch_bytes < CODEC_CONTROL_BATCH_BYTES && controller->batch_wall_ns < CODEC_CONTROL_BATCH_NS)
+        return controller->level;
+
+    double target = controller->rate;
+    if(controller->deadline != 0){
+        uint64_t now = CodecControllerNow();
+
+        //Past the deadline only the fastest level is left.
+        if(now >= controller->deadline){
+            controller->level = controller->codec->min_level;
+            controller->batch_bytes = controller->batch_compress_ns = controller->batch_wall_ns = 0;
+
+            return controller->level;
+        }
+
+        target = controller->remaining_bytes / ((controller->deadline - now) / 1e9);
+    }
+
+    double achieved = controller->batch_bytes / (controller->batch_wall_ns / 1e9 + 1e-9);
+    bool cpu_bound = controller->batch_compress_ns * 2 >= controller->batch_wall_ns;
+
+    if(achieved * 100 < target * (100 - CODEC_CONTROL_SLACK)){
+        if(cpu_bound == true && controller->level > controller->codec->min_level)
+            controller->level--;
+        else if(cpu_bound == false && controller->level < controller->codec->max_level)
+            controller->level++;
+
+    }else if(achieved * 100 > target * (100 + CODEC_CONTROL_SLACK) && controller->level < controller->codec->max_level)
+        controller->level++;
+
+    controller->batch_bytes = controller->batch_compress_ns = controller->batch_wall_ns = 0;
+    return controller->level;
+}
+
+/*Returns the number of files inserted at the given level. The number of their bytes is stored in *bytes.*/
+uint64_t CodecControllerGetUsage(CodecController controller, uint8_t level, uint64_t *bytes){
+    *bytes = controller->bytes[level];
+
+    return controller->files[level];
+}
+
+/*Frees the memory of the controller.*/
+void CodecControllerDestroy(CodecController controller){
+    free(controller);
+
+    return;
+}
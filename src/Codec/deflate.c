@@ -0,0 +1,66 @@
+#include <zlib.h>
+
+#include "codec.h"
+
+/*The deflate codec is zlib's deflate, in the zlib format. With a dictionary, the dictionary is set as zlib's
+preset dictionary; the payload records its checksum.*/
+
+/*Returns the maximum size of the payload of "size" bytes of content.*/
+uint64_t DeflateBound(uint64_t size){
+    return compressBound(size);
+}
+
+/*Compresses size bytes of src in dest, whose capacity is *dest_size. The payload size is stored in *dest_size.*/
+bool DeflateCompress(const void *src, uint64_t size, void *dest, uint64_t *dest_size, int level){
+    uLongf length = *dest_size;
+
+    if(compress2(dest, &length, src, size, level) != Z_OK)
+        return false;
+
+    *dest_size = length;
+    return true;
+}
+
+/*Decompresses the size bytes of the payload src in dest, which must hold exactly raw_size bytes.*/
+bool DeflateDecompress(const void *src, uint64_t size, void *dest, uint64_t raw_size){
+    uLongf length = raw_size;
+
+    return uncompress(dest, &length, src, size) == Z_OK && length == raw_size;
+}
+
+/*Compresses size bytes of src in dest, whose capacity is *dest_size, with the given preset dictionary.
+The payload size is stored in *dest_size.*/
+bool DeflateCompressDict(const void *src, uint64_t size, void *dest, uint64_t *dest_size, int level, const void *dict, uint64_t dict_size){
+    z_stream stream = {0};
+    if(deflateInit(&stream, level) != Z_OK)
+        return false;
+
+    stream.next_in = (Bytef *) src; stream.avail_in = size;
+    stream.next_out = dest; stream.avail_out = *dest_size;
+
+    bool done = deflateSetDictionary(&stream, dict, dict_size) == Z_OK && deflate(&stream, Z_FINISH) == Z_STREAM_END;
+    *dest_size = stream.total_out;
+
+    deflateEnd(&stream);
+    return done;
+}
+
+/*Decompresses the size bytes of the payload src, which was compressed with the given preset dictionary, in dest,
+which must hold exactly raw_size bytes.*/
+bool DeflateDecompressDict(const void *src, uint64_t size, void *dest, uint64_t raw_size, const void *dict, uint64_t dict_size){
+    z_stream stream = {0};
+    if(inflateInit(&stream) != Z_OK)
+        return false;
+
+    stream.next_in = (Bytef *) src; stream.avail_in = size;
+    stream.next_out = dest; stream.avail_out = raw_size;
+
+    int result = inflate(&stream, Z_FINISH);
+    if(result == Z_NEED_DICT && inflateSetDictionary(&stream, dict, dict_size) == Z_OK)
+        result = inflate(&stream, Z_FINISH);
+
+    bool done = result == Z_STREAM_END && stream.total_out == raw_size;
+
+    inflateEnd(&stream);
+    return done;
+}
@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "codec.h"
+
+#define DICT_DMER 8                 //Length of the substrings whose frequency is counted.
+#define DICT_SEGMENT 64             //Length of the segments that the dictionary is made of.
+#define DICT_HASH_BITS 20
+
+/*The trainer follows the COVER algorithm. The frequency of an 8-byte substring (a "dmer") is the number of
+samples it occurs in; a dmer that occurs in one sample only is worth nothing, since that sample alone gains from
+it. The samples are split in as many epochs as the segments that fit in the dictionary and from each epoch the
+segment whose dmers are the most frequent is picked. The dmers of a picked segment are then worth nothing, so
+that later segments cover different content.
+
+The segments are placed from the end of the dictionary backwards, so that the first epochs, whose segments were
+picked while every dmer still counted, end up closest to the content, where codecs encode matches in fewer bytes.*/
+
+/*Hashes the dmer that starts from p.*/
+static uint32_t DictHash(const uint8_t *p){
+    uint64_t value; memcpy(&value, p, sizeof(uint64_t));
+
+    return (value * 0x9E3779B97F4A7C15ULL) >> (64 - DICT_HASH_BITS);
+}
+
+/*Returns the worth of the dmer with the given hash.*/
+static uint64_t DictWorth(uint32_t *frequencies, uint32_t hash){
+    return frequencies[hash] > 1 ? frequencies[hash] : 0;
+}
+
+/*Trains a dictionary of at most capacity bytes on count samples, whose sizes are given and whose bytes are stored
+one after the other in samples. The dictionary is made of the segments of the samples whose 8-byte substrings occur
+in the most samples. It is stored in dict and its size is returned; 0 if the samples share nothing.*/
+uint64_t CodecTrainDictionary(const char *samples, const uint64_t *sizes, uint64_t count, char *dict, uint64_t capacity){
+    const uint8_t *bytes = (const uint8_t *) samples;
+
+    uint64_t total = 0;
+    for(uint64_t i = 0; i < count; i++)
+        total += sizes[i];
+
+    if(count < 2 || total < DICT_SEGMENT || capacity < DICT_SEGMENT)
+        return 0;
+
+    uint32_t *frequencies = calloc(1ULL << DICT_HASH_BITS, sizeof(uint32_t));
+    uint32_t *seen = malloc(sizeof(uint32_t) << DICT_HASH_BITS);        //Last sample in which each dmer was counted.
+    uint32_t *hashes = malloc(sizeof(uint32_t) * total);
+    memset(seen, 0xFF, sizeof(uint32_t) << DICT_HASH_BITS);
+
+    for(uint64_t i = 0, offset = 0; i < count; offset += sizes[i++])
+        for(uint64_t pos = offset; pos + DICT_DMER <= offset + sizes[i]; pos++){
+            uint32_t hash = hashes[pos] = DictHash(bytes + pos);
+
+            if(seen[hash] != i){
+                seen[hash] = i;
+                frequencies[hash]++;
+            }
+        }
+
+    uint64_t segments = capacity / DICT_SEGMENT;
+    uint64_t epoch = total / segments > DICT_SEGMENT ? total / segments : DICT_SEGMENT;
+    uint64_t dict_start = capacity, sample = 0, sample_offset = 0;
+
+    for(uint64_t epoch_start = 0; epoch_start < total && dict_start >= DICT_SEGMENT; epoch_start += epoch){
+        uint64_t epoch_end = epoch_start + epoch < total ? epoch_start + epoch : total;
+        uint64_t best = 0, best_worth = 0;
+
+        while(sample_offset + sizes[sample] <= epoch_start){
+            sample_offset += sizes[sample];
+            sample++;
+        }
+
+        //A segment must lie inside one sample, so each sample that the epoch overlaps is searched on its own.
+        for(uint64_t i = sample, offset = sample_offset; i < count && offset < epoch_end; offset += sizes[i++]){
+            uint64_t from = offset > epoch_start ? offset : epoch_start;
+            if(offset + sizes[i] < from + DICT_SEGMENT)
+                continue;
+
+            uint64_t last = offset + sizes[i] - DICT_SEGMENT < epoch_end - 1 ? offset + sizes[i] - DICT_SEGMENT : epoch_end - 1;
+
+            //The worth of a segment is the sum of the worth of its dmers, which slides along the sample.
+            uint64_t worth = 0;
+            for(uint64_t pos = from; pos <= from + DICT_SEGMENT - DICT_DMER; pos++)
+                worth += DictWorth(frequencies, hashes[pos]);
+
+            for(uint64_t pos = from; pos <= last; pos++){
+                if(worth > best_worth){
+                    best_worth = worth;
+                    best = pos;
+                }
+
+                if(pos < last)
+                    worth += DictWorth(frequencies, hashes[pos + DICT_SEGMENT - DICT_DMER + 1]) - DictWorth(frequencies, hashes[pos]);
+            }
+        }
+
+        if(best_worth == 0)
+            continue;
+
+        dict_start -= DICT_SEGMENT;
+        memcpy(dict + dict_start, bytes + best, DICT_SEGMENT);
+
+        for(uint64_t pos = best; pos <= best + DICT_SEGMENT - DICT_DMER; pos++)
+            frequencies[hashes[pos]] = 0;
+    }
+
+    free(frequencies); free(seen); free(hashes);
+
+    memmove(dict, dict + dict_start, capacity - dict_start);
+    return capacity - dict_start;
+}
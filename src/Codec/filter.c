@@ -0,0 +1,239 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "codec.h"
+
+#define FILTER_READ_BYTES (64 << 10)    //Bytes read from a pipe at once.
+
+/*Each program of a filter runs with a file as its standard input and the write end of a pipe
+as its standard output. The filter collects the output of the programs that run in memory and, when a program
+ends, hands its output to the callback. At most "children" programs run at once; running one more first waits
+for one of them to end.*/
+
+typedef struct filter_job{
+    pid_t pid;
+    int pipe;                   //Read end of the pipe of the program's output.
+    void *tag;
+
+    char *output;
+    uint64_t size;
+    uint64_t capacity;
+
+    uint64_t start;             //Time when the program was started.
+}* FilterJob;
+
+struct codec_filter{
+    struct filter_job *jobs;    //The programs that run.
+    uint64_t running;
+    uint64_t children;
+
+    CodecFilterDone done;
+};
+
+/*Replaces the calling process with the program of the command. The command is split in words at spaces and tabs
+and the program is run directly with them as its arguments, followed by extra unless it is NULL. No shell is run,
+so quotes, variables and other characters special to a shell are passed to the program as they are.*/
+static void CodecFilterExec(char *command, char *extra){
+    char words[strlen(command) + 1]; strcpy(words, command);
+    char *argv[strlen(command) / 2 + 3], *save;
+    int argc = 0;
+
+    for(char *word = strtok_r(words, " \t", &save); word != NULL; word = strtok_r(NULL, " \t", &save))
+        argv[argc++] = word;
+
+    if(argc != 0 && extra != NULL)
+        argv[argc++] = extra;
+    argv[argc] = NULL;
+
+    if(argc != 0)
+        execvp(argv[0], argv);
+
+    _exit(127);
+}
+
+/*Returns the name that identifies the program of the command in an archive: the file name of its first word,
+without the directories and the arguments. The name is allocated in heap; it is empty if the command has no words.*/
+char *CodecFilterName(const char *command){
+    command += strspn(command, " \t");
+    char *name = strndup(command, strcspn(command, " \t"));
+
+    char *slash = strrchr(name, '/');
+    if(slash != NULL)
+        memmove(name, slash + 1, strlen(slash + 1) + 1);
+
+    return name;
+}
+
+/*Creates a filter that runs at most the given number of programs at once and calls done when each one ends.*/
+CodecFilter CodecFilterCreate(uint64_t children, CodecFilterDone done){
+    CodecFilter filter = malloc(sizeof(struct codec_filter));
+
+    filter->children = children != 0 ? children : 1;
+    filter->jobs = malloc(sizeof(struct filter_job) * filter->children);
+    filter->running = 0;
+    filter->done = done;
+
+    return filter;
+}
+
+/*Returns the number of programs that the filter runs at once, at most.*/
+uint64_t CodecFilterGetChildren(CodecFilter filter){
+    return filter->children;
+}
+
+/*Reads what is available from the pipe of the given job. Returns false once the program has closed it.*/
+static bool CodecFilterRead(FilterJob job){
+    if(job->capacity - job->size < FILTER_READ_BYTES){
+        job->capacity = job->capacity * 2 + FILTER_READ_BYTES;
+        job->output = realloc(job->output, job->capacity);
+    }
+
+    ssize_t bytes = read(job->pipe, job->output + job->size, FILTER_READ_BYTES);
+    if(bytes > 0)
+        job->size += bytes;
+
+    return bytes > 0 || (bytes == -1 && errno == EINTR);
+}
+
+/*Collects the end of the program of the job with the given index and hands its output to the callback.*/
+static void CodecFilterEnd(CodecFilter filter, uint64_t index){
+    struct filter_job job = filter->jobs[index];
+    filter->jobs[index] = filter->jobs[--filter->running];
+
+    int status;
+    close(job.pipe);
+    waitpid(job.pid, &status, 0);
+
+    bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    filter->done(job.tag, job.output, job.size, CodecControllerNow() - job.start, ok);
+
+    free(job.output);
+    return;
+}
+
+/*Waits until the programs that run write to their pipes, reads their output and collects those that
+have ended. Returns once at least one program has ended.*/
+static void CodecFilterCollect(CodecFilter filter){
+    struct pollfd fds[filter->running];
+    uint64_t running = filter->running;
+
+    for(uint64_t i = 0; i < running; i++){
+        fds[i].fd = filter->jobs[i].pipe;
+        fds[i].events = POLLIN;
+    }
+
+    while(filter->running == running){
+        if(poll(fds, running, -1) == -1)
+            continue;
+
+        //Ended jobs are collected from the last one, so that the indices of the rest stay the same.
+        for(uint64_t i = running; i-- > 0; )
+            if(fds[i].revents != 0 && CodecFilterRead(&filter->jobs[i]) == false)
+                CodecFilterEnd(filter, i);
+    }
+
+    return;
+}
+
+/*Runs the program of the command, without a shell, with the file defined by path as its standard input. If
+as many programs as the filter allows already run, it first waits until one of them ends. When the program ends,
+the callback is given the tag and the program's output. If the file cannot be opened, the callback is called at once.*/
+void CodecFilterRun(CodecFilter filter, char *command, char *path, void *tag){
+    while(filter->running == filter->children)
+        CodecFilterCollect(filter);
+
+    int in = open(path, O_RDONLY | O_CLOEXEC), out[2];
+    if(in == -1 || pipe2(out, O_CLOEXEC) == -1){
+        if(in != -1)
+            close(in);
+
+        filter->done(tag, NULL, 0, 0, false);
+        return;
+    }
+
+    uint64_t start = CodecControllerNow();
+    pid_t pid = fork();
+
+    if(pid == 0){
+        dup2(in, 0);
+        dup2(out[1], 1);
+
+        CodecFilterExec(command, NULL);
+    }
+
+    close(in); close(out[1]);
+
+    if(pid == -1){
+        close(out[0]);
+        filter->done(tag, NULL, 0, 0, false);
+        return;
+    }
+
+    filter->jobs[filter->running++] = (struct filter_job) {pid, out[0], tag, NULL, 0, 0, start};
+    return;
+}
+
+/*Waits until every program of the filter has ended.*/
+void CodecFilterWait(CodecFilter filter){
+    while(filter->running != 0)
+        CodecFilterCollect(filter);
+
+    return;
+}
+
+/*Waits until every program of the filter has ended and frees its memory.*/
+void CodecFilterDestroy(CodecFilter filter){
+    CodecFilterWait(filter);
+
+    free(filter->jobs); free(filter);
+    return;
+}
+
+/*Runs the program of the command with -d, without a shell, with the size bytes of src as its standard input and the
+file descriptor out as its standard output, and waits until it ends. Returns true iff it read all of src and
+exited with 0.*/
+bool CodecFilterDecode(char *command, const void *src, uint64_t size, int out){
+    int in[2];
+    if(pipe2(in, O_CLOEXEC) == -1)
+        return false;
+
+    pid_t pid = fork();
+
+    if(pid == 0){
+        dup2(in[0], 0);
+        dup2(out, 1);
+
+        CodecFilterExec(command, "-d");
+    }
+
+    close(in[0]);
+
+    //A program that ends before it reads all of its input must not end cib too.
+    void (*handler)(int) = signal(SIGPIPE, SIG_IGN);
+    uint64_t written = 0;
+
+    while(pid != -1 && written < size){
+        ssize_t bytes = write(in[1], (const char *) src + written, size - written);
+
+        if(bytes == -1 && errno != EINTR)
+            break;
+
+        written += bytes > 0 ? bytes : 0;
+    }
+
+    close(in[1]);
+    signal(SIGPIPE, handler);
+
+    int status;
+    if(pid == -1 || waitpid(pid, &status, 0) == -1)
+        return false;
+
+    return written == size && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
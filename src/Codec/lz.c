@@ -0,0 +1,317 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "codec.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_WINDOW 65535             //Maximum distance of a match.
+#define LZ_MAX_HASH_BITS 16
+#define LZ_MIN_HASH_BITS 10
+#define LZ_BUCKET 2                 //Positions that a bucket of the hash table holds.
+
+/*The lz codec is a byte-oriented LZ77 codec that trades ratio for speed, in the spirit of LZ4.
+
+The payload is a sequence of sequences. Each one starts with a token byte: its high 4 bits hold the number of
+literals and its low 4 bits the length of the match minus LZ_MIN_MATCH. A value of 15 means that bytes follow,
+which are added to it, until a byte that is not 255. The literals follow the token (and the bytes of their
+length) and then the 2-byte little endian distance of the match and the bytes of its length. The last sequence
+holds only literals.
+
+Level 1 checks the two most recent positions with the same hash, which a bucket of the hash table holds, and
+skips ahead faster the longer no match is found. Higher levels follow the chain of earlier positions with the same
+hash, up to 2^(level - 1) of them, and match lazily: a match is put off by a byte while one that is longer by more
+than the literal it adds starts from the next position.
+
+With a dictionary, the content is encoded as if the dictionary preceded it, so matches may reach into it.*/
+
+/*Hashes the 4 bytes that start from p.*/
+static uint32_t LZHash(const uint8_t *p, int bits){
+    uint32_t value; memcpy(&value, p, sizeof(uint32_t));
+
+    return (value * 2654435761U) >> (32 - bits);
+}
+
+/*Writes a length of a token in the bytes that follow it. Returns the new end of the output.*/
+static uint8_t *LZWriteLength(uint8_t *out, uint64_t length){
+    for(length -= 15; length >= 255; length -= 255)
+        *out++ = 255;
+
+    *out++ = length;
+    return out;
+}
+
+/*Writes a sequence. If length is 0 the sequence holds only literals. Returns the new end of the output or
+NULL if it does not fit in the output.*/
+static uint8_t *LZWriteSequence(uint8_t *out, uint8_t *out_end, const uint8_t *literals, uint64_t literals_count, uint64_t distance, uint64_t length){
+    if((uint64_t) (out_end - out) < 1 + literals_count + literals_count / 255 + 1 + 2 + length / 255 + 1)
+        return NULL;
+
+    uint8_t *token = out++;
+    *token = (literals_count < 15 ? literals_count : 15) << 4;
+    if(literals_count >= 15)
+        out = LZWriteLength(out, literals_count);
+
+    memcpy(out, literals, literals_count);
+    out += literals_count;
+
+    if(length == 0)
+        return out;
+
+    *out++ = distance & 0xFF;
+    *out++ = distance >> 8;
+
+    length -= LZ_MIN_MATCH;
+    *token |= length < 15 ? length : 15;
+    if(length >= 15)
+        out = LZWriteLength(out, length);
+
+    return out;
+}
+
+/*Returns the maximum size of the payload of "size" bytes of content.*/
+uint64_t LZBound(uint64_t size){
+    return size + size / 255 + 16;
+}
+
+/*The positions of the input that matches are searched among.*/
+typedef struct lz_matcher{
+    const uint8_t *in;
+    uint64_t size;
+    int bits;
+
+    int64_t *head;          //LZ_BUCKET positions with each hash, the most recent first. -1 if there is none.
+    int64_t *chain;         //Of the higher levels: for each position of the window, the previous one with the same hash.
+    uint64_t attempts;      //Positions that are checked for each match.
+}* LZMatcher;
+
+/*Adds the given position to the positions that matches are searched among.*/
+static void LZInsert(LZMatcher matcher, uint64_t pos){
+    int64_t *bucket = matcher->head + LZ_BUCKET * LZHash(matcher->in + pos, matcher->bits);
+
+    if(matcher->chain != NULL)
+        matcher->chain[pos & LZ_WINDOW] = bucket[0];
+
+    memmove(bucket + 1, bucket, (LZ_BUCKET - 1) * sizeof(int64_t));
+    bucket[0] = pos;
+    return;
+}
+
+/*Returns the number of bytes that start from pos and are equal to those that start from the earlier position
+candidate, without reading past size.*/
+static uint64_t LZMatchLength(const uint8_t *in, uint64_t candidate, uint64_t pos, uint64_t size){
+    uint64_t length = 0;
+
+    while(pos + length + sizeof(uint64_t) <= size){
+        uint64_t a, b;
+        memcpy(&a, in + candidate + length, sizeof(uint64_t));
+        memcpy(&b, in + pos + length, sizeof(uint64_t));
+
+        if(a != b)
+            return length + (__builtin_ctzll(a ^ b) >> 3);
+
+        length += sizeof(uint64_t);
+    }
+
+    while(pos + length < size && in[candidate + length] == in[pos + length])
+        length++;
+
+    return length;
+}
+
+/*Returns the position that is checked after the i-th candidate of a match, which came from the given bucket, or -1
+if there is none.*/
+static int64_t LZNextCandidate(LZMatcher matcher, int64_t *bucket, int64_t candidate, uint64_t i){
+    int64_t next = matcher->chain != NULL ? matcher->chain[candidate & LZ_WINDOW] : i + 1 < LZ_BUCKET ? bucket[i + 1] : -1;
+
+    //A chain slot that was overwritten by a later position ends the chain.
+    return next < candidate ? next : -1;
+}
+
+/*Returns the length of the longest match of the bytes that start from pos, which must not have been inserted yet,
+with earlier bytes. Its distance is stored in *distance.*/
+static uint64_t LZFindMatch(LZMatcher matcher, uint64_t pos, uint64_t *distance){
+    const uint8_t *in = matcher->in;
+    int64_t *bucket = matcher->head + LZ_BUCKET * LZHash(in + pos, matcher->bits);
+    int64_t candidate = bucket[0];
+    uint64_t best = 0;
+
+    for(uint64_t i = 0; candidate >= 0 && pos - candidate <= LZ_WINDOW && i < matcher->attempts; i++){
+        //A candidate that differs at the end of the best match so far cannot beat it.
+        if(best > 0 && (pos + best >= matcher->size || in[candidate + best] != in[pos + best])){
+            candidate = LZNextCandidate(matcher, bucket, candidate, i);
+            continue;
+        }
+
+        uint64_t length = LZMatchLength(in, candidate, pos, matcher->size);
+
+        if(length > best){
+            best = length;
+            *distance = pos - candidate;
+        }
+
+        candidate = LZNextCandidate(matcher, bucket, candidate, i);
+    }
+
+    return best;
+}
+
+/*Compresses the bytes of in from start to size in dest, whose capacity is *dest_size. The first start bytes
+are a prefix that matches may refer to. The payload size is stored in *dest_size.*/
+static bool LZEncode(const uint8_t *in, uint64_t start, uint64_t size, void *dest, uint64_t *dest_size, int level){
+    const uint8_t *anchor = in + start;
+    uint8_t *out = dest, *out_end = out + *dest_size;
+
+    struct lz_matcher matcher = {in, size, LZ_MIN_HASH_BITS, NULL, NULL, level > 1 ? 1ULL << (level - 1) : LZ_BUCKET};
+
+    //Small inputs use a smaller hash table, which is cheaper to set up.
+    while(matcher.bits < LZ_MAX_HASH_BITS && (1ULL << matcher.bits) < size)
+        matcher.bits++;
+
+    matcher.head = malloc(LZ_BUCKET * sizeof(int64_t) << matcher.bits);
+    memset(matcher.head, 0xFF, LZ_BUCKET * sizeof(int64_t) << matcher.bits);
+    matcher.chain = level > 1 ? malloc(sizeof(int64_t) * (LZ_WINDOW + 1)) : NULL;
+
+    for(uint64_t pos = start > LZ_WINDOW ? start - LZ_WINDOW : 0; pos < start && pos + LZ_MIN_MATCH <= size; pos++)
+        LZInsert(&matcher, pos);
+
+    for(uint64_t pos = start; pos + LZ_MIN_MATCH <= size && out != NULL;){
+        uint64_t distance = 0, best = LZFindMatch(&matcher, pos, &distance);
+        LZInsert(&matcher, pos);
+
+        if(best < LZ_MIN_MATCH){
+            pos += level > 1 ? 1 : 1 + ((pos - (anchor - in)) >> 6);
+            continue;
+        }
+
+        //The higher levels put the match off while a longer one starts from the next position.
+        while(level > 1 && pos + 1 + LZ_MIN_MATCH <= size){
+            uint64_t next_distance = 0, next = LZFindMatch(&matcher, pos + 1, &next_distance);
+            if(next <= best + 1)
+                break;
+
+            LZInsert(&matcher, ++pos);
+            best = next; distance = next_distance;
+        }
+
+        out = LZWriteSequence(out, out_end, anchor, in + pos - anchor, distance, best);
+
+        //The higher levels hash every position inside the match, level 1 only the one near its end.
+        for(uint64_t i = matcher.chain != NULL ? 1 : best > 2 ? best - 2 : best; i < best && pos + i + LZ_MIN_MATCH <= size; i++)
+            LZInsert(&matcher, pos + i);
+
+        pos += best;
+        anchor = in + pos;
+    }
+
+    if(out != NULL)
+        out = LZWriteSequence(out, out_end, anchor, in + size - anchor, 0, 0);
+
+    free(matcher.head); free(matcher.chain);
+    if(out == NULL)
+        return false;
+
+    *dest_size = out - (uint8_t *) dest;
+    return true;
+}
+
+/*Compresses size bytes of src in dest, whose capacity is *dest_size. The payload size is stored in *dest_size.*/
+bool LZCompress(const void *src, uint64_t size, void *dest, uint64_t *dest_size, int level){
+    return LZEncode(src, 0, size, dest, dest_size, level);
+}
+
+/*Compresses size bytes of src in dest, whose capacity is *dest_size, as if the dict_size bytes of dict preceded
+them. The payload size is stored in *dest_size.*/
+bool LZCompressDict(const void *src, uint64_t size, void *dest, uint64_t *dest_size, int level, const void *dict, uint64_t dict_size){
+    uint8_t *in = malloc(dict_size + size);
+    memcpy(in, dict, dict_size);
+    memcpy(in + dict_size, src, size);
+
+    bool done = LZEncode(in, dict_size, dict_size + size, dest, dest_size, level);
+
+    free(in);
+    return done;
+}
+
+/*Reads a length of a token from the bytes that follow it. Returns false if the input ends.*/
+static bool LZReadLength(const uint8_t **in, const uint8_t *in_end, uint64_t *length){
+    uint8_t byte;
+
+    do{
+        if(*in == in_end)
+            return false;
+
+        byte = *(*in)++;
+        *length += byte;
+    }while(byte == 255);
+
+    return true;
+}
+
+/*Decompresses the size bytes of the payload src in base, from byte start on, which must leave exactly raw_size
+bytes for it. The first start bytes of base are the prefix that the payload was encoded with.*/
+static bool LZDecode(const void *src, uint64_t size, uint8_t *base, uint64_t start, uint64_t raw_size){
+    const uint8_t *in = src, *in_end = in + size;
+    uint8_t *out = base + start, *out_end = out + raw_size;
+
+    while(in < in_end){
+        uint8_t token = *in++;
+
+        uint64_t literals = token >> 4;
+        if(literals == 15 && LZReadLength(&in, in_end, &literals) == false)
+            return false;
+
+        if(literals > (uint64_t) (in_end - in) || literals > (uint64_t) (out_end - out))
+            return false;
+
+        memcpy(out, in, literals);
+        in += literals; out += literals;
+
+        if(in == in_end)
+            break;
+
+        if(in_end - in < 2)
+            return false;
+
+        uint64_t distance = in[0] | (in[1] << 8);
+        in += 2;
+
+        uint64_t length = token & 15;
+        if(length == 15 && LZReadLength(&in, in_end, &length) == false)
+            return false;
+        length += LZ_MIN_MATCH;
+
+        if(distance == 0 || distance > (uint64_t) (out - base) || length > (uint64_t) (out_end - out))
+            return false;
+
+        //Matches may overlap the bytes they produce, so they are copied byte by byte unless they cannot.
+        const uint8_t *match = out - distance;
+        if(distance >= length)
+            memcpy(out, match, length);
+        else
+            for(uint64_t i = 0; i < length; i++)
+                out[i] = match[i];
+
+        out += length;
+    }
+
+    return out == out_end;
+}
+
+/*Decompresses the size bytes of the payload src in dest, which must hold exactly raw_size bytes.*/
+bool LZDecompress(const void *src, uint64_t size, void *dest, uint64_t raw_size){
+    return LZDecode(src, size, dest, 0, raw_size);
+}
+
+/*Decompresses the size bytes of the payload src, which was compressed with the given dictionary, in dest,
+which must hold exactly raw_size bytes.*/
+bool LZDecompressDict(const void *src, uint64_t size, void *dest, uint64_t raw_size, const void *dict, uint64_t dict_size){
+    uint8_t *base = malloc(dict_size + raw_size);
+    memcpy(base, dict, dict_size);
+
+    bool done = LZDecode(src, size, base, dict_size, raw_size);
+    if(done == true)
+        memcpy(dest, base + dict_size, raw_size);
+
+    free(base);
+    return done;
+}
@@ -0,0 +1,34 @@
+#include "codec.h"
+
+#ifdef CIB_HAVE_LZMA
+#include <lzma.h>
+
+/*The lzma codec is liblzma's xz format without an integrity check, for a high ratio. It is built only
+if liblzma is found.*/
+
+/*Returns the maximum size of the payload of "size" bytes of content.*/
+uint64_t LZMABound(uint64_t size){
+    return lzma_stream_buffer_bound(size);
+}
+
+/*Compresses size bytes of src in dest, whose capacity is *dest_size. The payload size is stored in *dest_size.*/
+bool LZMACompress(const void *src, uint64_t size, void *dest, uint64_t *dest_size, int level){
+    size_t position = 0;
+
+    if(lzma_easy_buffer_encode(level, LZMA_CHECK_NONE, NULL, src, size, dest, &position, *dest_size) != LZMA_OK)
+        return false;
+
+    *dest_size = position;
+    return true;
+}
+
+/*Decompresses the size bytes of the payload src in dest, which must hold exactly raw_size bytes.*/
+bool LZMADecompress(const void *src, uint64_t size, void *dest, uint64_t raw_size){
+    uint64_t memory_limit = UINT64_MAX;
+    size_t in_position = 0, out_position = 0;
+
+    return lzma_stream_buffer_decode(&memory_limit, 0, NULL, src, &in_position, size, dest, &out_position, raw_size) == LZMA_OK
+        && out_position == raw_size;
+}
+
+#endif
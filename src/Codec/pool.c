@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "codec.h"
+
+/*The threads of a pool wait for a batch. The jobs of a batch are handed out one at a time, in order, to the
+threads and to the caller of CodecPoolRun(), which returns once every job has ended. Only one batch runs at a time.*/
+
+struct codec_pool{
+    pthread_t *threads;
+    uint64_t count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;        //Signalled when a batch starts or the pool is destroyed.
+    pthread_cond_t finished;    //Signalled when the last job of a batch ends.
+
+    CodecJob job;
+    void *arg;
+    uint64_t jobs;              //Jobs of the current batch, 0 if there is none,
+    uint64_t next;              //the next one to be handed out
+    uint64_t done;              //and how many have ended.
+
+    bool stop;
+};
+
+/*Runs the jobs of the current batch that are still to be handed out. The pool must be locked.*/
+static void CodecPoolWork(CodecPool pool){
+    while(pool->next < pool->jobs){
+        uint64_t job = pool->next++;
+
+        pthread_mutex_unlock(&pool->lock);
+        pool->job(pool->arg, job);
+        pthread_mutex_lock(&pool->lock);
+
+        if(++pool->done == pool->jobs)
+            pthread_cond_broadcast(&pool->finished);
+    }
+
+    return;
+}
+
+/*The function of the threads of the pool.*/
+static void *CodecPoolThread(void *arg){
+    CodecPool pool = arg;
+    pthread_mutex_lock(&pool->lock);
+
+    while(pool->stop == false){
+        CodecPoolWork(pool);
+
+        if(pool->stop == false)
+            pthread_cond_wait(&pool->work, &pool->lock);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/*Creates a pool of the given number of threads. If a thread cannot be created, the pool has fewer.*/
+CodecPool CodecPoolCreate(uint64_t threads){
+    CodecPool pool = calloc(1, sizeof(struct codec_pool));
+    pool->threads = malloc(sizeof(pthread_t) * (threads + 1));
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+
+    for(uint64_t i = 0; i < threads && pthread_create(&pool->threads[pool->count], NULL, CodecPoolThread, pool) == 0; i++)
+        pool->count++;
+
+    return pool;
+}
+
+/*Returns the number of threads of the pool.*/
+uint64_t CodecPoolGetThreads(CodecPool pool){
+    return pool->count;
+}
+
+/*Calls job(arg, i) for every i in [0, jobs) on the threads of the pool and on the calling thread, and returns
+once every call has returned. Jobs are started in order of i.*/
+void CodecPoolRun(CodecPool pool, CodecJob job, void *arg, uint64_t jobs){
+    pthread_mutex_lock(&pool->lock);
+
+    pool->job = job;
+    pool->arg = arg;
+    pool->jobs = jobs;
+    pool->next = pool->done = 0;
+    pthread_cond_broadcast(&pool->work);
+
+    CodecPoolWork(pool);
+    while(pool->done < pool->jobs)
+        pthread_cond_wait(&pool->finished, &pool->lock);
+
+    pool->jobs = pool->next = 0;
+
+    pthread_mutex_unlock(&pool->lock);
+    return;
+}
+
+/*Stops the threads of the pool and frees its memory.*/
+void CodecPoolDestroy(CodecPool pool){
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(uint64_t i = 0; i < pool->count; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->finished);
+
+    free(pool->threads); free(pool);
+    return;
+}
@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "codec.h"
+
+/*Signatures of formats whose content is already compressed.*/
+typedef struct magic{
+    uint8_t offset;
+    uint8_t length;
+    char *bytes;
+}* Magic;
+
+static struct magic magics[] = {
+    {0, 3, "\xFF\xD8\xFF"},                     //JPEG
+    {0, 8, "\x89PNG\r\n\x1A\n"},                //PNG
+    {0, 4, "GIF8"},                             //GIF
+    {0, 4, "PK\x03\x04"},                       //ZIP, JAR, DOCX, APK
+    {0, 2, "\x1F\x8B"},                         //GZIP
+    {0, 3, "BZh"},                              //BZIP2
+    {0, 6, "\xFD" "7zXZ\x00"},                  //XZ
+    {0, 4, "\x28\xB5\x2F\xFD"},                 //ZSTD
+    {0, 4, "\x04\x22\x4D\x18"},                 //LZ4
+    {0, 6, "7z\xBC\xAF\x27\x1C"},               //7Z
+    {0, 4, "Rar!"},                             //RAR
+    {4, 4, "ftyp"},                             //MP4, MOV, HEIC
+    {0, 4, "\x1A\x45\xDF\xA3"},                 //MKV, WEBM
+    {0, 4, "OggS"},                             //OGG
+    {0, 3, "ID3"},                              //MP3
+    {0, 4, "fLaC"},                             //FLAC
+};
+
+/*Returns true iff the data start with the signature of a compressed format.*/
+static bool CodecHasCompressedMagic(const uint8_t *bytes, uint64_t size){
+    for(uint64_t i = 0; i < sizeof(magics) / sizeof(struct magic); i++)
+        if(size >= (uint64_t) magics[i].offset + magics[i].length && memcmp(bytes + magics[i].offset, magics[i].bytes, magics[i].length) == 0)
+            return true;
+
+    return false;
+}
+
+/*Returns the entropy of the given bytes in bits per byte.*/
+static double CodecEntropy(const uint8_t *bytes, uint64_t size){
+    uint64_t counts[256] = {0};
+    for(uint64_t i = 0; i < size; i++)
+        counts[bytes[i]]++;
+
+    double entropy = 0;
+    for(int i = 0; i < 256; i++)
+        if(counts[i] != 0)
+            entropy -= counts[i] * log2((double) counts[i] / size);
+
+    return entropy / size;
+}
+
+/*Decides, from the first CODEC_PROBE_BYTES bytes of the data, whether compressing them is worth it. Data
+that start with the signature of a compressed format are not. Otherwise, the sample is not worth it iff its
+entropy is at least CODEC_PROBE_ENTROPY bits per byte, so that entropy coding gains nothing, and the fast lz
+codec shrinks it by less than CODEC_PROBE_GAIN percent, so that there are no repeats to gain from either.*/
+bool CodecIsCompressible(const void *mem, uint64_t size){
+    uint64_t sample = size < CODEC_PROBE_BYTES ? size : CODEC_PROBE_BYTES;
+
+    if(CodecHasCompressedMagic(mem, sample) == true)
+        return false;
+
+    if(CodecEntropy(mem, sample) < CODEC_PROBE_ENTROPY)
+        return true;
+
+    uint64_t length = LZBound(sample);
+    void *buff = malloc(length);
+    bool compressible = LZCompress(mem, sample, buff, &length, 1) == true && length * 100 < sample * (100 - CODEC_PROBE_GAIN);
+
+    free(buff);
+    return compressible;
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -6,18 +7,95 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <linux/falloc.h>
 
 #include "header.h"
 #include "file_management.h"
 #include "data.h"
+#include "codec.h"
+#include "cli_utils.h"
 #include "syscalls.h"
+#include "ADTVector.h"
+#include "ADTHashTable.h"
 
 #define MD_FREE_LIST_ENTRIES 63
 #define MD_FREE_LIST_BLOCK 0
+#define DATA_CHUNK_DEAD 2
+
+/*What the code of the data partition keeps about an archive.*/
+struct data_state{
+    //Bytes of the data partition whose disk space has been released by DFreeBlocks() so far.
+    uint64_t punched_bytes;
+
+    //Chunk near which the next chunk is placed. 0 if there is no preference.
+    DataBlockId placement_hint;
+
+    //Counters of the compression of the files inserted so far.
+    struct data_compression_stats compression_stats;
+
+    //True iff small files are compressed with the dictionary of the archive.
+    bool use_dictionary;
+
+    //Pool that compresses and decompresses the frames of files and the threads it runs them on. 0 means one per processor.
+    CodecPool frame_pool;
+    uint64_t frame_threads;
+
+    //Command of the program that decompresses the files compressed by the program of --filter. NULL if none is given.
+    char *extract_filter;
+
+    /*The content of the solid chunk that was read last, decompressed, so that its members are read with one
+    decompression. The chunk is identified by the address of the data partition it belongs to, the data generation
+    of the archive when it was read and its first block.*/
+    struct solid_cache{
+        void *data;
+        uint64_t generation;
+        DataBlockId block;
+        char *content;
+        uint64_t size;
+    } solid_cache;
+};
+
+/*Returns a new data state, allocated in heap. Its settings, whether the dictionary is used, the number of
+threads and the command of the extraction's filter, are copied from the given state, unless it is NULL.*/
+DataState DataStateCreate(DataState settings){
+    DataState state = calloc(1, sizeof(struct data_state));
+
+    if(settings != NULL){
+        state->use_dictionary = settings->use_dictionary;
+        state->frame_threads = settings->frame_threads;
+        state->extract_filter = settings->extract_filter;
+    }
+
+    return state;
+}
+
+/*Destroys the given data state.*/
+void DataStateDestroy(DataState state){
+    if(state->frame_pool != NULL)
+        CodecPoolDestroy(state->frame_pool);
+
+    free(state->solid_cache.content);
+    free(state);
+    return;
+}
 
-extern void *md;
-extern void *data;
-extern void *header;
+/*Drops what the data state of the current archive derived from its content, the cached solid chunk and the
+placement hint, since other processes may have changed the archive while it was unlocked.*/
+void DataStateDropCaches(){
+    cib->data_state->solid_cache.data = NULL;
+    cib->data_state->placement_hint = 0;
+
+    return;
+}
+
+/*Returns true if solid_cache holds the content of the solid chunk that starts from the given block.*/
+static bool DSolidCacheHolds(DataBlockId block){
+    struct solid_cache *cache = &cib->data_state->solid_cache;
+
+    return cache->data == cib->data && cache->generation == HeadGetDataGeneration() && cache->block == block;
+}
 
 /*In this partition we split the address space in blocks of DATA_BLOCK_SIZE bytes.
 
@@ -27,16 +105,29 @@ Furthermore, the last 8 bytes of each chunk (the last 8 bytes of the chunk's las
 blocks that the chunk holds.
 
 This provides an easy way to merge chunks. When a chunk that contains data is freed then we can easily check whether
-the previous or the next one are used. If not then we merge them creating a bigger chunk.*/
+the previous or the next one are used. If not then we merge them creating a bigger chunk.
+
+In log-structured mode chunks are never searched for. They are cut one after the other from the current segment,
+a run of at least DATA_SEGMENT_BLOCKS blocks, whose unused rest starts from the header's log tail. Deleted chunks are
+only marked dead (their first byte is set to DATA_CHUNK_DEAD) and so is the unused rest of the segment. Dead chunks are
+never merged with their neighbours; DataReclaimDeadChunks() turns them into free chunks, which become new segments.
+
+A solid chunk stores many small files, its members, as one content, which is compressed as a whole. The content
+starts with the number of members and the end offset of each member, as 8-byte integers, followed by the bytes of
+the members. Every member is an entry that shares the chunk; its pointer holds the chunk and the member's index.*/
 
 /*This struct represents the first data_block of a chunk that contain the data of a file/link.
 
 The variable used is set to 1.*/
 typedef struct file{
     uint8_t used;
-    uint8_t zipped;         //1 iff the content is zipped. Unzip will be needed when extracting.
+    uint8_t codec;          //Codec of the content. CODEC_GZIP needs gunzip when extracting, CODEC_FILTER stores the
+                            //name of its program first; in-process codecs store the size of the content in
+                            //the first 8 bytes of data.
+    uint8_t level;          //Level of the codec.
+    uint8_t raw;            //Why the content is stored as is although it was to be compressed. One of DATA_RAW_*.
 
-    char padding[6];
+    uint32_t refs;          //Number of entries that point to this chunk. Snapshots share chunks with the live tree.
 
     uint64_t blocks;        //The number of blocks thata this chunk of blocks holds.
     uint64_t size;          //The size of data in bytes.
@@ -85,17 +176,25 @@ typedef struct data_free_list{
 
 /*Return the addresss of the given block.*/
 void *DGetDBlockAddress(DataBlockId block){
-    return (void *) ((char *) data + (block << DATA_BLOCK_SHIFT));
+    return (void *) ((char *) cib->data + (block << DATA_BLOCK_SHIFT));
 }
 
 /*Returns the address of the data_free_list.*/
 DFreeList DGetFreeListAddress(){
-    return (void *) ((char *) data + (MD_FREE_LIST_BLOCK << DATA_BLOCK_SHIFT));
+    return (void *) ((char *) cib->data + (MD_FREE_LIST_BLOCK << DATA_BLOCK_SHIFT));
 }
 
 //--------------------------------------------------------
 //Data-Free-Chunk Functions
 
+/*Releases the disk space of count blocks starting from the given block. Their content reads as zeros
+afterwards, or once the update of the cib file is committed. Returns false if the file system does not support it.*/
+bool DPunchBlocks(DataBlockId block, uint64_t count){
+    off_t offset = (char *) DGetDBlockAddress(block) - (char *) cib->header;
+
+    return CIBPunchHole(offset, count << DATA_BLOCK_SHIFT);
+}
+
 /*Initializes a free chunk. Used is set to 0 and block count is written in the first block's field
 as well as in the chunk's last 8 bytes.*/
 void DFreeChunkInit(DataBlockId block, uint64_t block_count){
@@ -249,7 +348,7 @@ void DFreeListInsertChunk(DataBlockId start, uint64_t blocks_count){
 
                     //If no previous exists then iter was the head of the list.
                     }else{
-                        list->list_head = iter;
+                        list->list_head = start;
                     }
 
                     return;
@@ -280,7 +379,7 @@ void DFreeListInsertChunk(DataBlockId start, uint64_t blocks_count){
         list->list_flag = 1;
         
         for(int i = last_index; i != index;){
-            int previous = (i - 1) % MD_FREE_LIST_ENTRIES;
+            int previous = (i - 1 + MD_FREE_LIST_ENTRIES) % MD_FREE_LIST_ENTRIES;
 
             list->chunks[i] = list->chunks[previous];
             list->blocks_count[i] = list->blocks_count[previous];
@@ -302,7 +401,8 @@ void DFreeListRemoveChunk(DataBlockId start){
     DFreeList list = DGetFreeListAddress();
 
     if(list->arr_count <= 1){
-        list->arr_count = 0;
+        if(list->arr_count == 1 && list->chunks[list->arr_start] == start)
+            list->arr_count = 0;
 
         return;
     }
@@ -362,14 +462,14 @@ void DFreeListRemoveChunk(DataBlockId start){
         DataBlockId prev_id = DFreeChunkGetPrevious(start, &prev_flag);
         DataBlockId next_id = DFreeChunkGetNext(start, &next_flag);
 
-        if(prev_id == true && next_id == true){
+        if(prev_flag == true && next_flag == true){
             DFreeChunkSetNext(prev_id, next_id);
             DFreeChunkSetPrevious(next_id, prev_id);
 
-        }else if(prev_id == true){
+        }else if(prev_flag == true){
             DFreeChunkRemoveNext(prev_id);
 
-        }else if(next_id == true){
+        }else if(next_flag == true){
             DFreeChunkRemovePrevious(next_id);
             list->list_head = next_id;
 
@@ -377,13 +477,42 @@ void DFreeListRemoveChunk(DataBlockId start){
             list->list_flag = 0;
 
         }
-    
-    }else if(list->list_flag == 0)
-        printf("We have a problem");
+    }
 
+    //Otherwise the chunk is not in the free list, so there is nothing to remove.
     return;
 }
 
+/*Returns true if the chunk that starts from the given block is linked in the free list struct. A block
+whose first byte is 0 may also be the stale header of a chunk that has been merged into a larger one.*/
+bool DFreeListContains(DataBlockId start){
+    DFreeList list = DGetFreeListAddress();
+
+    for(int i = 0; i < list->arr_count; i++){
+        if(list->chunks[(list->arr_start + i) % MD_FREE_LIST_ENTRIES] == start)
+            return true;
+    }
+
+    bool next_flag = list->list_flag == 1;
+    for(DataBlockId current = list->list_head; next_flag == true; current = DFreeChunkGetNext(current, &next_flag)){
+        if(current == start)
+            return true;
+    }
+
+    return false;
+}
+
+/*Extends the data partition by the given number of blocks and returns the first of them. The blocks
+are not initialized.*/
+DataBlockId DGrowBlocks(uint64_t blocks){
+    DataBlockId new_chunk = HeadGetDataSize() >> DATA_BLOCK_SHIFT;
+
+    TruncMapAndUpdate(HeadGetHeaderSize(), HeadGetMDSize(), HeadGetDataSize() + (blocks << DATA_BLOCK_SHIFT), true);
+    memmove(cib->md, (char *) cib->md - (blocks << DATA_BLOCK_SHIFT), HeadGetMDSize());
+
+    return new_chunk;
+}
+
 /*Returns the first block's id of a chunk of size "block_count".
 
 The function selects a chunk and "cuts" from it a chunk of size "block_count".
@@ -411,59 +540,149 @@ DataBlockId DFreeListRequestChunk(uint64_t block_count){
 
         return target;
         
-    }else {
-        printf("Needed Blocks\n");
-        DataBlockId new_chunk = (HeadGetDataSize() >> DATA_BLOCK_SHIFT);
+    }
+
+    //No free chunk is large enough, so the data partition grows.
+    return DGrowBlocks(block_count);
+}
+
+/*Marks the given number of blocks starting from the given block as a dead chunk.*/
+void DDeadChunkInit(DataBlockId block, uint64_t block_count){
+    File chunk = DGetDBlockAddress(block);
+    memset(chunk, 0, FILE_EXTRA_DATA);
 
-        uint64_t extra_space = (block_count << DATA_BLOCK_SHIFT);
-        TruncMapAndUpdate(HeadGetHeaderSize(), HeadGetMDSize(), HeadGetDataSize() + extra_space, true);
+    chunk->used = DATA_CHUNK_DEAD;
+    chunk->blocks = block_count;
+    *((uint64_t *) ((char *) DGetDBlockAddress(block + block_count) - sizeof(uint64_t))) = block_count;
+    return;
+}
 
-        memmove(md, (char *)md - extra_space, HeadGetMDSize());
-        return new_chunk;
+/*Returns the first block's id of a chunk of size "block_count" in log-structured mode. The chunk is cut
+from the start of the current segment. If the segment is too small, the rest of it is left dead and a new
+segment is taken from the largest free chunk, or from new blocks at the end of the data partition.*/
+DataBlockId DLogRequestChunk(uint64_t block_count){
+    DataBlockId tail = HeadGetLogTail();
+    uint64_t left = tail == 0 ? 0 : ((File) DGetDBlockAddress(tail))->blocks;
+
+    if(left < block_count){
+        DFreeList list = DGetFreeListAddress();
+        left = block_count > DATA_SEGMENT_BLOCKS ? block_count : DATA_SEGMENT_BLOCKS;
+
+        if(list->arr_count > 0 && list->blocks_count[list->arr_start] >= left)
+            tail = DFreeListRequestChunk(left);
+        else
+            tail = DGrowBlocks(left);
     }
-    
+
+    if(left > block_count)
+        DDeadChunkInit(tail + block_count, left - block_count);
+
+    HeadSetLogTail(left > block_count ? tail + block_count : 0);
+    return tail;
+}
+
+/*Finds a free chunk of at least block_count blocks close to the chunk that starts from "hint" and marks the
+needed blocks as used. The free chunk right after the hint is preferred, if it is linked in the free list; otherwise the closest free chunk
+within DATA_PLACEMENT_WINDOW blocks of the hint. If none fits, the chunk is requested by size only.*/
+DataBlockId DFreeListRequestChunkNear(uint64_t block_count, DataBlockId hint){
+    DataBlockId end = HeadGetDataSize() >> DATA_BLOCK_SHIFT;
+    if(hint == 0 || hint >= end)
+        return DFreeListRequestChunk(block_count);
+
+    DFreeList list = DGetFreeListAddress();
+    DataBlockId found = 0; uint64_t found_blocks = 0, distance = DATA_PLACEMENT_WINDOW + 1;
+
+    //The chunk right after the hint.
+    File chunk = DGetDBlockAddress(hint);
+    DataBlockId next = hint + (chunk->used != 0 ? chunk->blocks : ((DFreeChunk) chunk)->block_count);
+
+    if(next > hint && next < end && *(uint8_t *) DGetDBlockAddress(next) == 0 && ((DFreeChunk) DGetDBlockAddress(next))->block_count >= block_count && DFreeListContains(next) == true){
+        found = next;
+        found_blocks = ((DFreeChunk) DGetDBlockAddress(next))->block_count;
+
+    }else{
+        //Both the array and the list are sorted by size, so each search stops at the first chunk that is too small.
+        for(int i = 0; i < list->arr_count; i++){
+            int index = (list->arr_start + i) % MD_FREE_LIST_ENTRIES;
+            if(list->blocks_count[index] < block_count)
+                break;
+
+            uint64_t d = list->chunks[index] > hint ? list->chunks[index] - hint : hint - list->chunks[index];
+            if(d < distance){
+                found = list->chunks[index]; found_blocks = list->blocks_count[index];
+                distance = d;
+            }
+        }
+
+        bool next_flag = list->list_flag == 1;
+        for(DataBlockId current = list->list_head; next_flag == true; current = DFreeChunkGetNext(current, &next_flag)){
+            DFreeChunk free_chunk = DGetDBlockAddress(current);
+            if(free_chunk->block_count < block_count)
+                break;
+
+            uint64_t d = current > hint ? current - hint : hint - current;
+            if(d < distance){
+                found = current; found_blocks = free_chunk->block_count;
+                distance = d;
+            }
+        }
+    }
+
+    if(found == 0)
+        return DFreeListRequestChunk(block_count);
+
+    DFreeListRemoveChunk(found);
+    if(found_blocks != block_count)
+        DFreeListInsertChunk(found + block_count, found_blocks - block_count);
+
+    return found;
 }
 
 /*Scans the struct that holds the free chunks to find the chunk whose position is at the end of the
-data "partition". If found then we shrink the data partition and shift the metadata partition, thus 
-reducing the file's size.*/
-void DFreeListRemoveLastChunk(){
+data "partition" and returns its first block. found is set to false if the last chunk is not free.*/
+DataBlockId DFreeListFindLastChunk(bool *found){
     DFreeList list = DGetFreeListAddress();
-    bool found = false; DataBlockId last;
+    DataBlockId last = 0;
+    *found = false;
     
-    for(int i = 0; i < list->arr_count  && found == false; i++){
+    for(int i = 0; i < list->arr_count  && *found == false; i++){
         int index = (i + list->arr_start) % MD_FREE_LIST_ENTRIES;
 
         if(list->chunks[index] + list->blocks_count[index] == (HeadGetDataSize() >> DATA_BLOCK_SHIFT)){
             last = list->chunks[index];
-            DFreeListRemoveChunk(list->chunks[index]);
-
-            found = true;
+            *found = true;
         }
 
     }
 
-    if(list->list_flag == 1 && found == false){
+    if(list->list_flag == 1 && *found == false){
         DataBlockId current = list->list_head; bool next_flag;
 
         do{
             DFreeChunk chunk = DGetDBlockAddress(current);
 
             if(chunk->block_count + current == (HeadGetDataSize() >> DATA_BLOCK_SHIFT)){
-                DFreeListRemoveChunk(current);
                 last = current;
-
-                found = true;
+                *found = true;
             }
 
             current = chunk->next_block;
             next_flag = chunk->next_flag;
 
-        }while(next_flag == true && found == false);
+        }while(next_flag == true && *found == false);
     }
 
+    return last;
+}
+
+/*Finds the free chunk whose position is at the end of the data "partition". If found then we shrink the
+data partition and shift the metadata partition, thus reducing the file's size.*/
+void DFreeListRemoveLastChunk(){
+    bool found; DataBlockId last = DFreeListFindLastChunk(&found);
+
     if(found == true){
-        memmove(DGetDBlockAddress(last), md, HeadGetMDSize());
+        DFreeListRemoveChunk(last);
+        memmove(DGetDBlockAddress(last), cib->md, HeadGetMDSize());
 
         TruncMapAndUpdate(HeadGetHeaderSize(), HeadGetMDSize(), last << DATA_BLOCK_SHIFT, true);
     }
@@ -482,36 +701,395 @@ uint64_t DataCaclulateNeededBlocks(uint64_t size){
 }
 
 
-/*Copies size bytes from the given address in memmory. If zipped is true then data are marked as zipped.*/
-DataBlockId DataInsertBytes(void *mem, uint64_t size, bool zipped){
+/*Returns a pointer to the data stored in the chunk that starts from the given block. The
+size of the data is stored in *size.*/
+void *DataGetBytes(DataBlockId block, uint64_t *size){
+    File src = DGetDBlockAddress(block);
+    *size = src->size;
+
+    return src->data;
+}
+
+/*Returns the codec of the content of the chunk that starts from the given block. Its level is stored in *level.*/
+uint8_t DataGetCodec(DataBlockId block, uint8_t *level){
+    File src = DGetDBlockAddress(block);
+    *level = src->level;
+
+    return src->codec;
+}
+
+char *DGetMember(uint64_t pointer, uint64_t *size);
+
+/*Returns the size of the content of the chunk src, which is compressed by an in-process codec, as recorded in
+the chunk's frame. *dictionary is set to true iff it was compressed with the dictionary of the archive.*/
+uint64_t DGetFrameSize(File src, bool *dictionary){
+    uint64_t size; memcpy(&size, src->data, sizeof(uint64_t));
+    *dictionary = (size & DATA_FRAME_DICT) != 0;
+
+    return size & ~(DATA_FRAME_DICT | DATA_FRAME_INDEXED);
+}
+
+/*Returns true iff the content of the chunk src, which is compressed by an in-process codec, is compressed in frames.*/
+bool DIsFramed(File src){
+    uint64_t size; memcpy(&size, src->data, sizeof(uint64_t));
+
+    return (size & DATA_FRAME_INDEXED) != 0;
+}
+
+/*Returns the bytes of content of each frame of the chunk src, whose content is compressed in frames.*/
+uint64_t DGetFrameBytes(File src){
+    uint64_t frame_bytes; memcpy(&frame_bytes, src->data + sizeof(uint64_t), sizeof(uint64_t));
+
+    return frame_bytes;
+}
+
+/*Returns the number of frames that size bytes of content are split in, if each holds frame_bytes bytes.*/
+uint64_t DFrameCount(uint64_t size, uint64_t frame_bytes){
+    return (size + frame_bytes - 1) / frame_bytes;
+}
+
+/*Decompresses the given frame of the chunk src, whose content is size bytes compressed in frames by the given
+codec, in dest, which must hold the frame's content. Returns false if it cannot be decompressed.*/
+bool DDecodeFrame(File src, Codec codec, uint64_t size, uint64_t frame, char *dest){
+    uint64_t frame_bytes = DGetFrameBytes(src), start = 0, end;
+    if(frame_bytes == 0 || frame >= DFrameCount(size, frame_bytes))
+        return false;
+
+    char *index = src->data + 2 * sizeof(uint64_t);
+    uint64_t header = (DFrameCount(size, frame_bytes) + 2) * sizeof(uint64_t);
+    if(header > src->size)
+        return false;
+
+    if(frame != 0)
+        memcpy(&start, index + (frame - 1) * sizeof(uint64_t), sizeof(uint64_t));
+    memcpy(&end, index + frame * sizeof(uint64_t), sizeof(uint64_t));
+
+    if(start > end || end > src->size - header)
+        return false;
+
+    //A frame whose payload is as large as its content was stored as it is.
+    uint64_t raw = size - frame * frame_bytes < frame_bytes ? size - frame * frame_bytes : frame_bytes;
+    if(end - start == raw){
+        memcpy(dest, src->data + header + start, raw);
+        return true;
+    }
+
+    return codec->decompress(src->data + header + start, end - start, dest, raw);
+}
+
+/*Returns the pool that compresses and decompresses the frames of files, which is created the first time it is
+needed. Its threads and the calling thread make frame_threads threads, or one per processor if that is 0.*/
+CodecPool DGetFramePool(){
+    if(cib->data_state->frame_pool != NULL)
+        return cib->data_state->frame_pool;
+
+    int64_t threads = cib->data_state->frame_threads != 0 ? cib->data_state->frame_threads : sysconf(_SC_NPROCESSORS_ONLN);
+    cib->data_state->frame_pool = CodecPoolCreate(threads > 1 ? threads - 1 : 0);
+
+    return cib->data_state->frame_pool;
+}
+
+/*The frames of a chunk that are compressed or decompressed in parallel.*/
+typedef struct frame_batch{
+    Codec codec;
+    uint8_t level;
+    uint64_t size;              //Size of the content.
+    uint64_t frame_bytes;
+
+    File src;                   //Chunk whose frames are decompressed in dest.
+    char *dest;
+
+    char *mem;                  //Content whose frames are compressed, each in its slot of slot_bytes bytes in out.
+    char *out;
+    uint64_t slot_bytes;
+
+    uint64_t *payloads;         //Size of the payload of each compressed frame.
+    bool *done;                 //Whether each frame was decompressed.
+}* FrameBatch;
+
+/*Decompresses the given frame of the batch in place in its destination.*/
+void DDecodeFrameJob(void *arg, uint64_t frame){
+    FrameBatch batch = arg;
+    batch->done[frame] = DDecodeFrame(batch->src, batch->codec, batch->size, frame, batch->dest + frame * batch->frame_bytes);
+
+    return;
+}
+
+/*Decompresses the content of the chunk src, which is size bytes compressed in frames, in dest. The frames are
+decompressed in parallel by the frame pool. Returns false if a frame cannot be decompressed.*/
+bool DDecompressFrames(File src, void *dest, uint64_t size){
+    uint64_t frame_bytes = DGetFrameBytes(src);
+    if(frame_bytes == 0)
+        return false;
+
+    uint64_t count = DFrameCount(size, frame_bytes);
+    struct frame_batch batch = {CodecGet(src->codec), 0, size, frame_bytes, src, dest, NULL, NULL, 0, NULL, malloc(count)};
+
+    CodecPoolRun(DGetFramePool(), DDecodeFrameJob, &batch, count);
+
+    bool done = true;
+    for(uint64_t frame = 0; frame < count; frame++)
+        done = done && batch.done[frame];
+
+    free(batch.done);
+    return done;
+}
+
+/*Returns the maximum size of size bytes of content compressed in frames by the given codec.*/
+uint64_t DFramesBound(Codec codec, uint64_t size){
+    uint64_t count = DFrameCount(size, codec->frame_bytes);
+
+    return (count + 1) * sizeof(uint64_t) + count * codec->bound(codec->frame_bytes);
+}
+
+/*Compresses the given frame of the batch in its slot. A frame that compression does not shrink is copied as it is.*/
+void DEncodeFrameJob(void *arg, uint64_t frame){
+    FrameBatch batch = arg;
+    uint64_t start = frame * batch->frame_bytes, raw = batch->size - start < batch->frame_bytes ? batch->size - start : batch->frame_bytes;
+    char *slot = batch->out + frame * batch->slot_bytes;
+
+    uint64_t payload = batch->slot_bytes;
+    if(batch->codec->compress(batch->mem + start, raw, slot, &payload, batch->level) == false || payload >= raw){
+        memcpy(slot, batch->mem + start, raw);
+        payload = raw;
+    }
+
+    batch->payloads[frame] = payload;
+    return;
+}
+
+/*Compresses size bytes from mem with the given codec and level in frames of the codec's frame_bytes bytes of
+content, which are compressed in parallel by the frame pool. The frame size and the end of the payload of each
+frame are stored at the start of out, whose capacity must be DFramesBound(), and the payloads follow in order.
+The size of all of it is stored in *out_size.*/
+void DCompressFrames(Codec codec, char *mem, uint64_t size, uint8_t level, char *out, uint64_t *out_size){
+    uint64_t frame_bytes = codec->frame_bytes, count = DFrameCount(size, frame_bytes);
+    uint64_t header = (count + 1) * sizeof(uint64_t), end = 0;
+
+    //Every frame is compressed in a slot that fits its largest payload. The payloads are then moved next to each other.
+    struct frame_batch batch = {codec, level, size, frame_bytes, NULL, NULL, mem, out + header, codec->bound(frame_bytes), malloc(sizeof(uint64_t) * count), NULL};
+    CodecPoolRun(DGetFramePool(), DEncodeFrameJob, &batch, count);
+
+    memcpy(out, &frame_bytes, sizeof(uint64_t));
+    for(uint64_t frame = 0; frame < count; frame++){
+        memmove(out + header + end, batch.out + frame * batch.slot_bytes, batch.payloads[frame]);
+
+        end += batch.payloads[frame];
+        memcpy(out + (frame + 1) * sizeof(uint64_t), &end, sizeof(uint64_t));
+    }
+
+    free(batch.payloads);
+    *out_size = header + end;
+    return;
+}
+
+/*Decompresses the content of the chunk src, which is compressed by an in-process codec, in dest, which must hold
+exactly size bytes. Returns false if it cannot be decompressed.*/
+bool DDecompress(File src, void *dest, uint64_t size){
+    Codec codec = CodecGet(src->codec);
+    bool dictionary; DGetFrameSize(src, &dictionary);
+
+    if(DIsFramed(src) == true)
+        return DDecompressFrames(src, dest, size);
+
+    if(dictionary == false)
+        return codec->decompress(src->data + sizeof(uint64_t), src->size - sizeof(uint64_t), dest, size);
+
+    uint64_t dict_size;
+    if(HeadGetDictionary() == 0 || codec->decompress_dict == NULL)
+        return false;
+
+    void *dict = DataGetBytes(HeadGetDictionary(), &dict_size);
+    return codec->decompress_dict(src->data + sizeof(uint64_t), src->size - sizeof(uint64_t), dest, size, dict, dict_size);
+}
+
+/*Returns true if the size of the file stored in the chunk that starts from the given block, or in the given
+member of a solid chunk, is known, i.e. its content is not gzip-ed. The size is stored in *size.*/
+bool DataGetFileSize(DataBlockId block, uint64_t *size){
+    if(DataIsMember(block) == true)
+        return DGetMember(block, size) != NULL;
+
+    File src = DGetDBlockAddress(block);
+    *size = src->size;
+
+    bool dictionary;
+    if(CodecIsInProcess(src->codec) == true)
+        *size = DGetFrameSize(src, &dictionary);
+
+    return CodecIsExternal(src->codec) == false;
+}
+
+/*Returns true iff the given entry pointer is a reference to the data of a base archive.*/
+bool DataIsBaseRef(uint64_t pointer){
+    return (pointer & DATA_POINTER_BASE) != 0;
+}
+
+/*Creates the reference that an entry of a differential archive holds, given the entry's pointer
+inside the base archive.*/
+uint64_t DataBaseRefCreate(uint64_t base_pointer){
+    int depth = 0;
+    
+    if(DataIsBaseRef(base_pointer) == true)
+        base_pointer = DataBaseRefResolve(base_pointer, &depth);
+
+    return DATA_POINTER_BASE | ((uint64_t) depth << DATA_POINTER_DEPTH_SHIFT) | base_pointer;
+}
+
+/*Returns the pointer that the given base reference refers to. *depth is set to the depth of the
+base archive that holds it; 1 is the base of the current archive, 2 the base of the base and so on.*/
+uint64_t DataBaseRefResolve(uint64_t pointer, int *depth){
+    *depth = ((pointer & DATA_POINTER_DEPTH_MASK) >> DATA_POINTER_DEPTH_SHIFT) + 1;
+
+    return pointer & ~(DATA_POINTER_BASE | DATA_POINTER_DEPTH_MASK);
+}
+
+/*Copies size bytes from the given address in memmory. The data are marked as encoded with the given codec and level.*/
+DataBlockId DataInsertBytes(void *mem, uint64_t size, uint8_t codec, uint8_t level){
     uint64_t required_blocks = ((size + FILE_EXTRA_DATA) >> DATA_BLOCK_SHIFT) + 1;
-    DataBlockId block = DFreeListRequestChunk(required_blocks);
+    DataBlockId block = HeadIsLogStructured() == true ? DLogRequestChunk(required_blocks) : DFreeListRequestChunkNear(required_blocks, cib->data_state->placement_hint);
     File dest = DGetDBlockAddress(block);
 
 
     dest->blocks = required_blocks;
     dest->size = size;
     dest->used = 1;
-    dest->zipped = zipped == true;
+    dest->refs = 1;
+    dest->codec = codec;
+    dest->level = level;
+    dest->raw = DATA_RAW_NONE;
+
+    if(DSolidCacheHolds(block) == true)
+        cib->data_state->solid_cache.data = NULL;
     
     memcpy(dest->data, mem, size);
     *(uint64_t *) ((char *) DGetDBlockAddress(block + required_blocks) - sizeof(uint64_t)) = required_blocks;
 
+    //The next chunk is placed right after this one, if possible.
+    cib->data_state->placement_hint = block;
     return block;
 }
 
-/*Inserts the data of the file defined by the given path inside the data "partition".
-If zipped is true then data are marked as zipped.*/
-DataBlockId DataInsertFile(char *path, bool zipped){
-    int fd;
-    if(OpenFile(path, &fd, O_RDONLY, 0644) == -1){
-        printf("Shit\n");}
+/*Extends the data partition by the given number of blocks, which form a new free chunk at its end.
+The first block of the new chunk is returned.*/
+DataBlockId DataExtend(uint64_t blocks){
+    DataBlockId new_chunk = DGrowBlocks(blocks);
+
+    DFreeListInsertChunk(new_chunk, blocks);
+    return new_chunk;
+}
+
+/*Sets the chunk near which the next inserted chunk is placed. Every insertion moves the hint to the
+inserted chunk, so consecutive insertions are stored one after the other. 0 means no preference.*/
+void DataSetPlacementHint(DataBlockId block){
+    cib->data_state->placement_hint = block;
+
+    return;
+}
+
+/*Returns the current time in nanoseconds.*/
+uint64_t DNow(){
+    struct timespec now; clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*Inserts size bytes from the given address as they are, although they were to be compressed, and records why.*/
+DataBlockId DInsertRaw(void *mem, uint64_t size, uint8_t reason){
+    DataBlockId block = DataInsertBytes(mem, size, CODEC_NONE, 0);
+    ((File) DGetDBlockAddress(block))->raw = reason;
+
+    if(reason == DATA_RAW_PROBED){
+        cib->data_state->compression_stats.probed_files++;
+        cib->data_state->compression_stats.probed_bytes += size;
+
+    }else if(reason == DATA_RAW_EXPANDED){
+        cib->data_state->compression_stats.expanded_files++;
+        cib->data_state->compression_stats.expanded_bytes += size;
+    }
+
+    return block;
+}
+
+/*Compresses size bytes from the given address with the given in-process codec and inserts the size followed by
+the codec's payload. The data are first probed and, if compressing them is not worth it, they are inserted as they
+are. So are they if compression fails or does not make them smaller.
+
+If the dictionary is in use and the data are small, they are compressed with it and DATA_FRAME_DICT is set in
+the size. If they are larger than a frame of the codec, they are compressed in frames and DATA_FRAME_INDEXED is set.*/
+DataBlockId DInsertCompressed(void *mem, uint64_t size, uint8_t codec_id, uint8_t level){
+    if(size == 0)
+        return DataInsertBytes(mem, size, CODEC_NONE, 0);
+
+    uint64_t start = DNow();
+    bool compressible = CodecIsCompressible(mem, size);
+    cib->data_state->compression_stats.probe_ns += DNow() - start;
+
+    if(compressible == false)
+        return DInsertRaw(mem, size, DATA_RAW_PROBED);
+
+    Codec codec = CodecGet(codec_id);
+    bool framed = size > codec->frame_bytes;
+    uint64_t payload = framed == false ? codec->bound(size) : DFramesBound(codec, size);
+    uint64_t frame = framed == false ? size : size | DATA_FRAME_INDEXED, dict_size;
+    char *buff = malloc(sizeof(uint64_t) + payload);
+    DataBlockId block;
+
+    void *dict = NULL;
+    if(cib->data_state->use_dictionary == true && size <= DATA_DICT_MAX_FILE && HeadGetDictionary() != 0 && codec->compress_dict != NULL){
+        dict = DataGetBytes(HeadGetDictionary(), &dict_size);
+        frame |= DATA_FRAME_DICT;
+    }
+
+    start = DNow();
+    bool compressed = true;
+    if(framed == true)
+        DCompressFrames(codec, mem, size, level, buff + sizeof(uint64_t), &payload);
+    else if(dict == NULL)
+        compressed = codec->compress(mem, size, buff + sizeof(uint64_t), &payload, level);
+    else
+        compressed = codec->compress_dict(mem, size, buff + sizeof(uint64_t), &payload, level, dict, dict_size);
+
+    compressed = compressed == true && payload + sizeof(uint64_t) < size;
+    cib->data_state->compression_stats.compress_ns += DNow() - start;
+    cib->data_state->compression_stats.timed_bytes += size;
+
+    if(compressed == true){
+        memcpy(buff, &frame, sizeof(uint64_t));
+        block = DataInsertBytes(buff, payload + sizeof(uint64_t), codec_id, level);
+
+        cib->data_state->compression_stats.dictionary_files += dict != NULL;
+        cib->data_state->compression_stats.compressed_files++;
+        cib->data_state->compression_stats.compressed_bytes += size;
+        cib->data_state->compression_stats.payload_bytes += payload + sizeof(uint64_t);
+
+    }else
+        block = DInsertRaw(mem, size, DATA_RAW_EXPANDED);
+
+    free(buff);
+    return block;
+}
+
+/*Maps the file defined by the given path. Its size is stored in *size and its descriptor in *file_fd. A file
+that cannot be opened, e.g. because it was deleted after it was scanned, is mapped as an empty file.*/
+void *DMapFile(char *path, uint64_t *size, int *file_fd){
+    if(OpenFile(path, file_fd, O_RDONLY, 0644) == -1){
+        *size = 0;
+        return MAP_FAILED;
+    }
 
-    uint64_t size = lseek(fd, 0, SEEK_END);
+    *size = lseek(*file_fd, 0, SEEK_END);
 
-    void *mem = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    return mmap(NULL, *size, PROT_READ, MAP_PRIVATE, *file_fd, 0);
+}
+
+/*Inserts the data of the file defined by the given path inside the data "partition". If the codec is
+in-process the data are compressed with it at the given level, unless the probe finds that it is not worth
+it. Otherwise they are stored as they are and marked with the codec.*/
+DataBlockId DataInsertFile(char *path, uint8_t codec, uint8_t level){
+    int fd; uint64_t size;
+    void *mem = DMapFile(path, &size, &fd);
     
-    DataBlockId block = DataInsertBytes(mem, size, zipped);
+    DataBlockId block = CodecIsInProcess(codec) == true ? DInsertCompressed(mem, size, codec, level) : DataInsertBytes(mem, size, codec, level);
 
     munmap(mem, size);
     close(fd);
@@ -519,6 +1097,124 @@ DataBlockId DataInsertFile(char *path, bool zipped){
     return block;
 }
 
+/*Inserts the data of the file defined by path, which an external program has compressed in the size bytes of
+output. With CODEC_GZIP the output is gzip's at the given level. With CODEC_FILTER the name of the program, as
+CodecFilterName() returns it, is stored before the output; the command is not, so the file is extracted only by a
+program with the same name that the extraction is given. If the output is not smaller, the data of the original
+file are inserted as they are.*/
+DataBlockId DataInsertFiltered(char *path, char *output, uint64_t size, uint8_t codec, uint8_t level, char *name){
+    struct stat info;
+    bool found = stat(path, &info) == 0;
+    uint64_t command_size = codec == CODEC_FILTER ? strlen(name) + 1 : 0;
+
+    if(found == true && info.st_size == 0)
+        return DataInsertFile(path, CODEC_NONE, 0);
+
+    if(found == true && size + command_size >= info.st_size)
+        return DataInsertRawFile(path, DATA_RAW_EXPANDED);
+
+    if(found == true){
+        cib->data_state->compression_stats.compressed_files++;
+        cib->data_state->compression_stats.compressed_bytes += info.st_size;
+        cib->data_state->compression_stats.payload_bytes += size + command_size;
+    }
+
+    if(command_size == 0)
+        return DataInsertBytes(output, size, codec, level);
+
+    char *bytes = malloc(command_size + size);
+    memcpy(bytes, name, command_size);
+    memcpy(bytes + command_size, output, size);
+
+    DataBlockId block = DataInsertBytes(bytes, command_size + size, codec, level);
+
+    free(bytes);
+    return block;
+}
+
+/*Inserts the data of the file defined by the given path as they are, although they were to be compressed.
+The given reason, one of DATA_RAW_*, is recorded in the chunk.*/
+DataBlockId DataInsertRawFile(char *path, uint8_t reason){
+    int fd; uint64_t size;
+    void *mem = DMapFile(path, &size, &fd);
+
+    DataBlockId block = DInsertRaw(mem, size, reason);
+
+    munmap(mem, size);
+    close(fd);
+
+    return block;
+}
+
+/*Returns true iff compressing the data of the file defined by the given path is worth it, according to
+CodecIsCompressible(). Only the first CODEC_PROBE_BYTES bytes of the file are read.*/
+bool DataProbeFile(char *path){
+    char sample[CODEC_PROBE_BYTES];
+    int fd;
+
+    if(OpenFile(path, &fd, O_RDONLY, 0644) == -1)
+        return true;
+
+    uint64_t start = DNow();
+    ssize_t size = pread(fd, sample, sizeof(sample), 0);
+    bool compressible = size <= 0 || CodecIsCompressible(sample, size);
+    cib->data_state->compression_stats.probe_ns += DNow() - start;
+
+    close(fd);
+    return compressible;
+}
+
+/*Returns the counters of the compression of the files inserted in the current archive so far.*/
+DataCompressionStats DataGetCompressionStats(){
+    return &cib->data_state->compression_stats;
+}
+
+/*Returns the reason, one of DATA_RAW_*, for which the content of the chunk that starts from the given block is
+stored as is although it was to be compressed.*/
+uint8_t DataGetRawReason(DataBlockId block){
+    return ((File) DGetDBlockAddress(block))->raw;
+}
+
+/*Records why the content of the chunk that starts from the given block is stored as is. Used when the
+content is copied from another chunk.*/
+void DataSetRawReason(DataBlockId block, uint8_t reason){
+    ((File) DGetDBlockAddress(block))->raw = reason;
+
+    return;
+}
+
+/*Inserts the given dictionary, of the given size, in the data partition and records it in the header as the
+compression dictionary of the archive. The first block of its chunk is returned.*/
+DataBlockId DataSetDictionary(void *dict, uint64_t size){
+    DataBlockId block = DataInsertBytes(dict, size, CODEC_NONE, 0);
+    HeadSetDictionary(block);
+
+    return block;
+}
+
+/*Sets whether the files inserted from now on, if small enough, are compressed with the dictionary of the archive.*/
+void DataUseDictionary(bool use){
+    cib->data_state->use_dictionary = use;
+
+    return;
+}
+
+/*Sets the number of threads that compress and decompress the frames of a file, the calling thread included.
+0 means one per processor. Must be called before the first file is compressed or decompressed in frames.*/
+void DataSetThreads(uint64_t threads){
+    cib->data_state->frame_threads = threads;
+
+    return;
+}
+
+/*Sets the command of the program that decompresses the files that the program of --filter compressed, or NULL if
+none is given. The command is run with -d, but only on files whose stored name is the name of its program.*/
+void DataSetFilter(char *command){
+    cib->data_state->extract_filter = command;
+
+    return;
+}
+
 /*Inserts the stored path of the symlink, which is defined by path, in data partition.*/
 DataBlockId DataInsertLink(char *path){
     int max_size = 4096;
@@ -531,38 +1227,233 @@ DataBlockId DataInsertLink(char *path){
         max_size *= 2;
     }
 
-    DataBlockId block = DataInsertBytes(buff, strlen(buff), 0);
+    DataBlockId block = DataInsertBytes(buff, strlen(buff), CODEC_NONE, 0);
     
     free(buff);
     return block;
 }
 
-/*Deletes the file which is stored in data partition starting from the given block.*/
+/*Returns true iff the given entry pointer refers to a member of a solid chunk.*/
+bool DataIsMember(uint64_t pointer){
+    return (pointer & DATA_POINTER_MEMBER) != 0;
+}
+
+/*Returns the entry pointer of the given member of the solid chunk that starts from the given block.*/
+uint64_t DataMemberPointer(DataBlockId block, uint64_t member){
+    return DATA_POINTER_MEMBER | (member << DATA_POINTER_MEMBER_SHIFT) | block;
+}
+
+/*Returns the first block of the chunk that the given entry pointer, which must not be a base reference, refers to.*/
+DataBlockId DataGetChunk(uint64_t pointer){
+    return pointer & ~(DATA_POINTER_MEMBER | DATA_POINTER_MEMBER_MASK);
+}
+
+/*Returns the given entry pointer changed to refer to the chunk that starts from the given block. Used when
+the chunk is moved.*/
+uint64_t DataSetChunk(uint64_t pointer, DataBlockId block){
+    return (pointer & (DATA_POINTER_MEMBER | DATA_POINTER_MEMBER_MASK)) | block;
+}
+
+/*Inserts count files, whose sizes are given and whose bytes are stored one after the other in members, as one
+solid chunk compressed with the given in-process codec and level. The chunk is shared by refs entries. The first
+block of the chunk is returned; the pointer of member i is DataMemberPointer(block, i).*/
+DataBlockId DataInsertSolid(char *members, uint64_t *sizes, uint64_t count, uint32_t refs, uint8_t codec, uint8_t level){
+    uint64_t header = (count + 1) * sizeof(uint64_t), size = 0;
+    for(uint64_t i = 0; i < count; i++)
+        size += sizes[i];
+
+    char *content = malloc(header + size);
+    memcpy(content, &count, sizeof(uint64_t));
+
+    for(uint64_t i = 0, end = 0; i < count; i++){
+        end += sizes[i];
+        memcpy(content + (i + 1) * sizeof(uint64_t), &end, sizeof(uint64_t));
+    }
+    memcpy(content + header, members, size);
+
+    DataBlockId block = DInsertCompressed(content, header + size, codec, level);
+    File chunk = DGetDBlockAddress(block);
+    chunk->refs = refs;
+
+    //The chunk was counted as one file.
+    if(chunk->raw == DATA_RAW_PROBED)
+        cib->data_state->compression_stats.probed_files += count - 1;
+    else if(chunk->raw == DATA_RAW_EXPANDED)
+        cib->data_state->compression_stats.expanded_files += count - 1;
+    else if(chunk->codec != CODEC_NONE)
+        cib->data_state->compression_stats.compressed_files += count - 1;
+
+    free(content);
+    return block;
+}
+
+/*Returns a pointer to the bytes of the given member of a solid chunk and stores their number in *size. The
+content of the chunk is decompressed in solid_cache, unless it is already there. If it cannot be decompressed,
+or the member does not exist, NULL is returned.*/
+char *DGetMember(uint64_t pointer, uint64_t *size){
+    DataBlockId block = DataGetChunk(pointer);
+    uint64_t member = (pointer & DATA_POINTER_MEMBER_MASK) >> DATA_POINTER_MEMBER_SHIFT;
+
+    File src = DGetDBlockAddress(block);
+    char *content = src->data;
+    uint64_t content_size = src->size;
+
+    if(CodecIsInProcess(src->codec) == true && DSolidCacheHolds(block) == false){
+        bool dictionary;
+        content_size = DGetFrameSize(src, &dictionary);
+        free(cib->data_state->solid_cache.content);
+
+        cib->data_state->solid_cache.content = malloc(content_size);
+        cib->data_state->solid_cache.data = NULL;
+
+        if(DDecompress(src, cib->data_state->solid_cache.content, content_size) == false)
+            return NULL;
+
+        cib->data_state->solid_cache.data = cib->data;
+        cib->data_state->solid_cache.generation = HeadGetDataGeneration();
+        cib->data_state->solid_cache.block = block;
+        cib->data_state->solid_cache.size = content_size;
+    }
+
+    if(CodecIsInProcess(src->codec) == true){
+        content = cib->data_state->solid_cache.content;
+        content_size = cib->data_state->solid_cache.size;
+    }
+
+    uint64_t count, start = 0, end;
+    if(content_size < sizeof(uint64_t))
+        return NULL;
+
+    memcpy(&count, content, sizeof(uint64_t));
+    if(member >= count || count >= content_size / sizeof(uint64_t))
+        return NULL;
+
+    if(member != 0)
+        memcpy(&start, content + member * sizeof(uint64_t), sizeof(uint64_t));
+    memcpy(&end, content + (member + 1) * sizeof(uint64_t), sizeof(uint64_t));
+
+    uint64_t header = (count + 1) * sizeof(uint64_t);
+    if(start > end || end > content_size - header)
+        return NULL;
+
+    *size = end - start;
+    return content + header + start;
+}
+
+/*Extracts the given member of a solid chunk in the file defined by path, which is opened/created with the
+given permissions. Returns false, as members are never gzip-ed.*/
+bool DExtractMember(uint64_t pointer, char *path, int perm){
+    uint64_t size; char *bytes = DGetMember(pointer, &size);
+
+    int file_desc;
+    if(OpenFile(path, &file_desc, O_RDWR | O_CREAT | O_TRUNC, perm) == -1)
+        return false;
+
+    if(bytes == NULL)
+        CIBCorruptData(path);
+
+    for(uint64_t written = 0; bytes != NULL && written < size; written += DATA_BLOCK_SIZE << 10){
+        uint64_t bytes_left = size - written;
+        WriteBytes(bytes + written, bytes_left < (DATA_BLOCK_SIZE << 10) ? bytes_left : DATA_BLOCK_SIZE << 10, file_desc);
+    }
+
+    close(file_desc);
+    return false;
+}
+
+/*Extracts the file that the program of --filter compressed in the given chunk, in the file defined by path, which
+is opened/created with the given permissions. The command that the extraction was given with --filter is run with -d
+on the stored output, if its program has the stored name; nothing that the archive holds is run. Returns false, as
+the program has ended before the function returns.*/
+bool DExtractFiltered(File src, char *path, int perm){
+    char *end = memchr(src->data, '\0', src->size);
+    if(end == NULL){
+        CIBCorruptData(path);
+        return false;
+    }
+
+    //Archives written before only the name was stored hold the whole command.
+    char *stored = CodecFilterName(src->data), *given = cib->data_state->extract_filter != NULL ? CodecFilterName(cib->data_state->extract_filter) : NULL;
+    bool allowed = given != NULL && stored[0] != '\0' && strcmp(stored, given) == 0;
+
+    if(stored[0] == '\0')
+        CIBCorruptData(path);
+    else if(allowed == false)
+        CIBFilterNeeded(path, stored);
+
+    free(stored); free(given);
+
+    int file_desc;
+    if(allowed == false || OpenFile(path, &file_desc, O_RDWR | O_CREAT | O_TRUNC, perm) == -1)
+        return false;
+
+    uint64_t name_size = end - src->data + 1;
+    if(CodecFilterDecode(cib->data_state->extract_filter, src->data + name_size, src->size - name_size, file_desc) == false)
+        CIBCorruptData(path);
+
+    close(file_desc);
+    return false;
+}
+
+/*Marks the chunk that starts from the given block, or the solid chunk of the given member, as shared by one
+more entry. The chunk will be freed only after every entry that points to it has been deleted.*/
+void DataShareFile(DataBlockId block){
+    if(DataIsBaseRef(block) == true)
+        return;
+
+    File target = DGetDBlockAddress(DataGetChunk(block));
+
+    //Chunks written before reference counting was introduced have refs set to 0.
+    target->refs = target->refs == 0 ? 2 : target->refs + 1;
+    return;
+}
+
+/*Deletes the file which is stored in data partition starting from the given block, or in the given member
+of a solid chunk. If the chunk is shared with other entries, only its reference count is decreased.*/
 void DataDeleteFile(DataBlockId block){
-    
-    File target = DGetDBlockAddress(block);
-    uint64_t new_chunk_size = target->blocks;
+    //The data of base references belong to the base archive.
+    if(DataIsBaseRef(block) == true)
+        return;
+
+    File target = DGetDBlockAddress(DataGetChunk(block));
+    if(target->refs > 1){
+        target->refs--;
 
-    if(((block + target->blocks) << DATA_BLOCK_SHIFT) < HeadGetDataSize()){
-        DataBlockId next_id = block + target->blocks;
+        return;
+    }
+
+    DataFreeChunk(DataGetChunk(block));
+    return;
+}
+
+/*Frees the given number of blocks starting from the given block. The blocks must make up one or more
+adjacent used chunks. They are merged with the neighbouring free chunks.*/
+void DFreeBlocks(DataBlockId block, uint64_t blocks){
+    uint64_t new_chunk_size = blocks;
+    uint64_t neighbours_interior = 0;
+
+    if(((block + blocks) << DATA_BLOCK_SHIFT) < HeadGetDataSize()){
+        DataBlockId next_id = block + blocks;
         uint8_t next_used = *((uint8_t *) DGetDBlockAddress(next_id));
 
         if(next_used == 0){
             DFreeChunk next = DGetDBlockAddress(next_id);
 
             new_chunk_size += next->block_count;
+            neighbours_interior += next->block_count > 2 ? next->block_count - 2 : 0;
             DFreeListRemoveChunk(next_id);
         }
     }
 
     if(block > 1){
-        DataBlockId previous_id = block - *(uint64_t *)((char *) target - sizeof(uint64_t));
+        DataBlockId previous_id = block - *(uint64_t *)((char *) DGetDBlockAddress(block) - sizeof(uint64_t));
         uint8_t previous_used = *((uint8_t *) DGetDBlockAddress(previous_id));
 
         if(previous_used == 0){
             DFreeChunk previous = DGetDBlockAddress(previous_id);
 
             new_chunk_size += previous->block_count;
+            neighbours_interior += previous->block_count > 2 ? previous->block_count - 2 : 0;
             DFreeListRemoveChunk(previous_id);
             
             block = previous_id;
@@ -571,21 +1462,230 @@ void DataDeleteFile(DataBlockId block){
 
     DFreeChunkInit(block, new_chunk_size);
     DFreeListInsertChunk(block, new_chunk_size);
+    HeadSetDataGeneration(HeadGetDataGeneration() + 1);
+
+    //A hint inside the freed range would point to a stale header, so it is moved to the start of the free chunk.
+    if(cib->data_state->placement_hint >= block && cib->data_state->placement_hint < block + new_chunk_size)
+        cib->data_state->placement_hint = block;
+
+    //Release the disk space of every block but the first and the last, which hold the free list's info.
+    //The interior of a free neighbour has already been released when that neighbour was freed.
+    if(new_chunk_size > 2 && DPunchBlocks(block + 1, new_chunk_size - 2) == true)
+        cib->data_state->punched_bytes += (new_chunk_size - 2 - neighbours_interior) << DATA_BLOCK_SHIFT;
+
     return;
 }
 
-/*Extracts the file that is stored in the data chunk whose first block is "block" inside
-the file defined by path. The file is opened/created with the given permissions.
+/*Frees the chunk that starts from the given block, regardless of how many entries share it. The
+chunk is merged with the neighbouring free chunks. In log-structured mode it is only marked dead.*/
+void DataFreeChunk(DataBlockId block){
+    if(HeadIsLogStructured() == true){
+        ((File) DGetDBlockAddress(block))->used = DATA_CHUNK_DEAD;
+        return;
+    }
 
-If the file was zipped then fork and exec are called to unzip the file using "gunzip".
-This function will not use wait() to collect the zombie process created.
+    DFreeBlocks(block, ((File) DGetDBlockAddress(block))->blocks);
 
-Returns true if the file was zipped or false if it wasn't.*/
+    return;
+}
+
+/*Deletes the files stored in the chunks that start from the given blocks. The chunks that are no longer
+shared are freed together: they are sorted and every run of adjacent chunks is freed, and merged with
+its free neighbours, at once. In log-structured mode they are only marked dead. Blocks that refer to a
+base archive are ignored.*/
+void DataDeleteFiles(Vector blocks){
+    Vector freed = VectorCreate(VectorGetSize(blocks) + 1, free);
+
+    for(int i = 0; i < VectorGetSize(blocks); i++){
+        DataBlockId *block = VectorGetAt(blocks, i);
+        if(*block == 0 || DataIsBaseRef(*block) == true)
+            continue;
+
+        File target = DGetDBlockAddress(DataGetChunk(*block));
+        if(target->refs > 1)
+            target->refs--;
+
+        else if(HeadIsLogStructured() == true)
+            target->used = DATA_CHUNK_DEAD;
+
+        else
+            VectorInsertLast(freed, intdup(DataGetChunk(*block)));
+    }
+
+    //VectorSort() places the greatest block first, so the chunks are visited from the last one.
+    VectorSort(freed, CompareUint64);
+
+    for(int i = VectorGetSize(freed) - 1; i >= 0;){
+        DataBlockId start = *(DataBlockId *) VectorGetAt(freed, i), end = start;
+
+        for(; i >= 0 && *(DataBlockId *) VectorGetAt(freed, i) == end; i--)
+            end += ((File) DGetDBlockAddress(end))->blocks;
+
+        DFreeBlocks(start, end - start);
+    }
+
+    VectorDestroy(freed);
+    return;
+}
+
+/*Frees every run of adjacent dead chunks of a log-structured data partition, except for the unused rest of
+the current segment. The freed runs are merged with their free neighbours and their disk space is released.
+Returns the number of freed blocks.*/
+uint64_t DataReclaimDeadChunks(){
+    Vector runs = VectorCreate(64, free);
+    DataBlockId end = HeadGetDataSize() >> DATA_BLOCK_SHIFT, start = 0;
+    uint64_t freed = 0;
+
+    //Every run is stored as its first block followed by its size.
+    for(DataBlockId block = 1, next; block <= end; block = next){
+        bool dead = false, used;
+        if(block < end){
+            dead = ((File) DGetDBlockAddress(block))->used == DATA_CHUNK_DEAD && block != HeadGetLogTail();
+            next = DataGetNextChunk(block, &used);
+        }else
+            next = end + 1;
+
+        if(dead == true && start == 0)
+            start = block;
+
+        else if(dead == false && start != 0){
+            VectorInsertLast(runs, intdup(start));
+            VectorInsertLast(runs, intdup(block - start));
+            start = 0;
+        }
+    }
+
+    for(int i = 0; i < VectorGetSize(runs); i += 2){
+        uint64_t blocks = *(uint64_t *) VectorGetAt(runs, i + 1);
+
+        DFreeBlocks(*(DataBlockId *) VectorGetAt(runs, i), blocks);
+        freed += blocks;
+    }
+
+    VectorDestroy(runs);
+    return freed;
+}
+
+/*Returns true iff the chunk that starts from the given block has been deleted in log-structured mode
+and waits to be reclaimed.*/
+bool DataIsDead(DataBlockId block){
+    return ((File) DGetDBlockAddress(block))->used == DATA_CHUNK_DEAD;
+}
+
+/*Copies the chunk that starts from block "src" to a new chunk at the end of the log of a log-structured data
+partition and returns the new chunk's first block. The chunk "src" is not freed.*/
+DataBlockId DataAppendChunk(DataBlockId src){
+    uint64_t blocks = ((File) DGetDBlockAddress(src))->blocks;
+    DataBlockId dest = DLogRequestChunk(blocks);
+
+    memcpy(DGetDBlockAddress(dest), DGetDBlockAddress(src), blocks << DATA_BLOCK_SHIFT);
+    return dest;
+}
+
+/*Returns the bytes of the data partition whose disk space has been released by freeing chunks.*/
+uint64_t DataGetPunchedBytes(){
+    return cib->data_state->punched_bytes;
+}
+
+/*Returns the first block of the chunk that follows the chunk which starts from the given block.
+*used is set to true iff the chunk that starts from the given block is not free. The first chunk
+of the data partition starts from block 1.*/
+DataBlockId DataGetNextChunk(DataBlockId block, bool *used){
+    File chunk = DGetDBlockAddress(block);
+    *used = chunk->used != 0;
+
+    return block + (*used == true ? chunk->blocks : ((DFreeChunk) chunk)->block_count);
+}
+
+/*Returns the first block of the last chunk of the data partition. *used is set as in DataGetNextChunk()
+and *blocks to the size of the chunk in blocks. If the data partition holds no chunks, 0 is returned.*/
+DataBlockId DataGetLastChunk(bool *used, uint64_t *blocks){
+    DataBlockId end = HeadGetDataSize() >> DATA_BLOCK_SHIFT;
+    if(end <= 1)
+        return 0;
+
+    *blocks = *(uint64_t *) ((char *) DGetDBlockAddress(end) - sizeof(uint64_t));
+    *used = *((uint8_t *) DGetDBlockAddress(end - *blocks)) != 0;
+
+    return end - *blocks;
+}
+
+/*Searches the free chunks for the one that starts from the lowest block, has at least "blocks" blocks and
+starts from a block in [from, limit). If found, its first block is stored in *found and true is returned.*/
+bool DataFindLowestFreeChunk(uint64_t blocks, DataBlockId from, DataBlockId limit, DataBlockId *found){
+    DFreeList list = DGetFreeListAddress();
+    bool exists = false;
+
+    //The array is sorted by size, so we can stop as soon as the chunks become too small.
+    for(int i = 0; i < list->arr_count; i++){
+        int index = (list->arr_start + i) % MD_FREE_LIST_ENTRIES;
+
+        if(list->blocks_count[index] < blocks)
+            return exists;
+
+        if(list->chunks[index] >= from && list->chunks[index] < limit && (exists == false || list->chunks[index] < *found)){
+            *found = list->chunks[index];
+            exists = true;
+        }
+    }
+
+    bool next_flag = list->list_flag == 1;
+    for(DataBlockId current = list->list_head; next_flag == true; current = DFreeChunkGetNext(current, &next_flag)){
+        DFreeChunk chunk = DGetDBlockAddress(current);
+
+        if(chunk->block_count < blocks)
+            break;
+
+        if(current >= from && current < limit && (exists == false || current < *found)){
+            *found = current;
+            exists = true;
+        }
+    }
+
+    return exists;
+}
+
+/*Copies the chunk that starts from block "src" in the beginning of the free chunk that starts from block
+"dest", which must be large enough. The rest of the free chunk remains free.
+
+The chunk "src" is not freed; DataFreeChunk() should be called after the entries that point to it are updated.*/
+void DataMoveChunk(DataBlockId src, DataBlockId dest){
+    uint64_t blocks = ((File) DGetDBlockAddress(src))->blocks;
+    uint64_t free_blocks = ((DFreeChunk) DGetDBlockAddress(dest))->block_count;
+
+    DFreeListRemoveChunk(dest);
+    if(free_blocks != blocks)
+        DFreeListInsertChunk(dest + blocks, free_blocks - blocks);
+
+    memcpy(DGetDBlockAddress(dest), DGetDBlockAddress(src), blocks << DATA_BLOCK_SHIFT);
+    return;
+}
+
+/*Extracts the file that is stored in the data chunk whose first block is "block", or in the given member
+of a solid chunk, inside the file defined by path. The file is opened/created with the given permissions.
+
+If the file was gzip-ed then fork and exec are called to unzip the file using "gunzip".
+This function will not use wait() to collect the zombie process created. Files compressed
+by an in-process codec are decompressed straight into the extracted file; the frames of a large file
+are decompressed in parallel.
+
+Returns true if the file was gzip-ed or false if it wasn't.*/
 bool DataExtractFile(DataBlockId block, char *path, int perm){
+    if(DataIsMember(block) == true)
+        return DExtractMember(block, path, perm);
+
     File src = DGetDBlockAddress(block);
+    bool compressed = CodecIsInProcess(src->codec), dictionary;
+
+    if(src->codec == CODEC_FILTER)
+        return DExtractFiltered(src, path, perm);
+
+    uint64_t size = src->size;
+    if(compressed == true)
+        size = DGetFrameSize(src, &dictionary);
 
     char *real_path;
-    if(src->zipped == 1 && src->size != 0){
+    if(src->codec == CODEC_GZIP && src->size != 0){
         real_path = malloc(sizeof(char) * (strlen(path) + 4));
         snprintf(real_path, strlen(path) + 4, "%s.gz", path);
 
@@ -598,36 +1698,106 @@ bool DataExtractFile(DataBlockId block, char *path, int perm){
     if(OpenFile(real_path, &file_desc, O_RDWR | O_CREAT | O_TRUNC, 0644) == -1)
         return false;
     
-    if(src->size == 0){
+    if(size == 0){
         close(file_desc); free(real_path);
         return false;
     }
 
-    ftruncate(file_desc, src->size);
-    void *target = mmap(NULL, src->size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_SHARED, file_desc, 0);
+    ftruncate(file_desc, size);
+    void *target = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_SHARED, file_desc, 0);
     
     if(target == MAP_FAILED){
-        switch(errno){
-            case EACCES: printf("EACCES\n"); break; 
-            case EAGAIN: printf("EAGAIN\n"); break;
-            case EBADF: printf("EBADF\n"); break;
-            case EEXIST: printf("EEXIST\n"); break;
-            case EINVAL: printf("EINVAL\n"); break;
-        }
+        perror("mmap");
+        close(file_desc); free(real_path);
+        return false;
     }
-        
 
-    memcpy(target, src->data, src->size);
+    if(compressed == false)
+        memcpy(target, src->data, size);
+
+    else if(DDecompress(src, target, size) == false)
+        CIBCorruptData(path);
 
-    munmap(target, src->size);
+    munmap(target, size);
     close(file_desc);
 
-    if(src->zipped == 1 && fork() == 0)
+    if(src->codec == CODEC_GZIP && fork() == 0)
         execlp("gunzip", "gunzip", "-f", real_path, NULL);
 
     free(real_path);
 
-    return src->zipped == 1;
+    return src->codec == CODEC_GZIP;
+}
+
+/*Copies at most length bytes of the file that is stored in the chunk that starts from the given block, or in the
+given member of a solid chunk, from the given offset on, in dest. The number of bytes copied is stored in *read.
+Of a file compressed in frames, only the frames that hold the bytes are decompressed.
+
+Returns false if the file cannot be read in place, because it is gzip-ed, or its content is corrupt.*/
+bool DataReadRange(DataBlockId block, uint64_t offset, uint64_t length, void *dest, uint64_t *read){
+    uint64_t size; *read = 0;
+
+    if(DataIsMember(block) == true){
+        char *bytes = DGetMember(block, &size);
+        if(bytes == NULL)
+            return false;
+
+        *read = offset >= size ? 0 : size - offset < length ? size - offset : length;
+        memcpy(dest, bytes + offset, *read);
+        return true;
+    }
+
+    File src = DGetDBlockAddress(block);
+    if(CodecIsExternal(src->codec) == true)
+        return false;
+
+    bool dictionary;
+    size = CodecIsInProcess(src->codec) == true ? DGetFrameSize(src, &dictionary) : src->size;
+    if(offset >= size)
+        return true;
+
+    uint64_t count = size - offset < length ? size - offset : length;
+    if(CodecIsInProcess(src->codec) == false){
+        memcpy(dest, src->data + offset, count);
+        *read = count;
+        return true;
+    }
+
+    //Without frames the whole content is decompressed.
+    if(DIsFramed(src) == false){
+        char *content = malloc(size);
+        bool done = DDecompress(src, content, size);
+
+        if(done == true){
+            memcpy(dest, content + offset, count);
+            *read = count;
+        }
+
+        free(content);
+        return done;
+    }
+
+    uint64_t frame_bytes = DGetFrameBytes(src);
+    if(frame_bytes == 0)
+        return false;
+
+    char *content = malloc(frame_bytes);
+    for(uint64_t frame = offset / frame_bytes; frame * frame_bytes < offset + count; frame++){
+        if(DDecodeFrame(src, CodecGet(src->codec), size, frame, content) == false){
+            free(content);
+            return false;
+        }
+
+        uint64_t frame_start = frame * frame_bytes;
+        uint64_t from = offset > frame_start ? offset : frame_start;
+        uint64_t to = offset + count < frame_start + frame_bytes ? offset + count : frame_start + frame_bytes;
+
+        memcpy((char *) dest + from - offset, content + from - frame_start, to - from);
+    }
+
+    free(content);
+    *read = count;
+    return true;
 }
 
 /*Extracts the link that is stored in the data chunk whose first block is "block" in the link
@@ -643,6 +1813,57 @@ void DataExtractLink(DataBlockId block, char *path){
     return;
 }
 
+/*Returns the bytes of the data partition, from its start, that only the inside of the free chunk at its end
+spans: every block of the chunk but its first and its last, which hold its links and its size. Nothing refers
+to them. Returns false if the last chunk is not free or has no inside.*/
+bool DataGetFreeTail(uint64_t *offset, uint64_t *length){
+    bool found; DataBlockId last = DFreeListFindLastChunk(&found);
+    uint64_t end = HeadGetDataSize() >> DATA_BLOCK_SHIFT;
+
+    if(found == false || end - last < 3)
+        return false;
+
+    *offset = (last + 1) << DATA_BLOCK_SHIFT;
+    *length = (end - last - 2) << DATA_BLOCK_SHIFT;
+    return true;
+}
+
+/*Stores in *ranges, allocated in heap, the offset from the start of the data partition and the length of the inside
+of every free chunk, as in DataGetFreeTail(), one pair after the other, and returns the number of pairs. Nothing
+refers to these bytes.*/
+uint64_t DataGetFreeInsides(uint64_t **ranges){
+    DFreeList list = DGetFreeListAddress();
+    uint64_t count = 0, capacity = list->arr_count + 16;
+    *ranges = malloc(2 * capacity * sizeof(uint64_t));
+
+    //The chunks of the array are visited first, then the ones of the list.
+    bool next_flag = list->list_flag == 1;
+    DataBlockId current = list->list_head;
+
+    for(int i = 0; i < list->arr_count || next_flag == true; i++){
+        DataBlockId chunk = current;
+        if(i < list->arr_count)
+            chunk = list->chunks[(list->arr_start + i) % MD_FREE_LIST_ENTRIES];
+        else
+            current = DFreeChunkGetNext(current, &next_flag);
+
+        uint64_t blocks = ((DFreeChunk) DGetDBlockAddress(chunk))->block_count;
+        if(blocks < 3)
+            continue;
+
+        if(count == capacity){
+            capacity *= 2;
+            *ranges = realloc(*ranges, 2 * capacity * sizeof(uint64_t));
+        }
+
+        (*ranges)[2 * count] = (chunk + 1) << DATA_BLOCK_SHIFT;
+        (*ranges)[2 * count + 1] = (blocks - 2) << DATA_BLOCK_SHIFT;
+        count++;
+    }
+
+    return count;
+}
+
 /*Wrapper function for DFreeListRemoveLastChunk().*/
 void DataRemoveLastChunk(){
     DFreeListRemoveLastChunk();
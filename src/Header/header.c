@@ -1,8 +1,13 @@
 #include "header.h"
 #include "metadata.h"
 #include "syscalls.h"
+#include "file_management.h"
 
 #include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/random.h>
 #define max(a,b) ((a) > (b) ? (a) : (b))
 
 typedef struct header{
@@ -14,42 +19,51 @@ typedef struct header{
     uint32_t list_blocks;       //Metadata CIBList blocks.
     uint32_t free_node_blocks;  //Metadata free blocks.
     uint8_t nest_level;         //CIBList nest level
+    uint8_t snapshot_flag;      //1 iff the snapshot table exists.
+    uint8_t log_structured;     //1 iff data are only appended to the log of the data partition.
+    uint8_t unfinished;         //1 iff the cib file is being created without checkpoints, so its metadata may be inconsistent.
+    uint32_t snapshot_block;    //First cib-node block of the snapshot table.
+    uint64_t base_archive;      //Data block that holds the path of the base archive. 0 iff there is no base archive.
+    uint64_t log_tail;          //First block of the unused rest of the log's current segment. 0 iff there is none.
+    uint64_t dictionary;        //Data block that holds the compression dictionary. 0 iff there is none.
+    uint8_t uuid[16];           //Random identity of the cib file, given when it is created.
+    uint64_t data_generation;   //Incremented whenever used data chunks are freed, which may then be reused.
+    uint64_t resume_cursor;     //Data block that holds the directory cursor of an insertion. 0 iff there is none.
 
     char base_dir[7 + 4096];     //Saves the base_dir path.
 }* Header;
 
-extern void *header;
 
 /*Returns the base directory.*/
 char *HeadGetBaseDir(){
-    return ((Header) header)->base_dir;
+    return ((Header) cib->header)->base_dir;
 }
 
 /*Returns the header size.*/
 uint64_t HeadGetHeaderSize(){
-    return max(sizeof(struct header), 33 + strlen(((Header) header)->base_dir) + 1);
+    return max(sizeof(struct header), offsetof(struct header, base_dir) + strlen(((Header) cib->header)->base_dir) + 1);
 }
 
 /*Returns the metadata size.*/
 uint64_t HeadGetMDSize(){
-    return ((Header) header)->md_size;
+    return ((Header) cib->header)->md_size;
 }
 
 /*Set the metadata size to the desired value.*/
 void HeadSetMDSize(uint64_t size){
-    ((Header) header)->md_size = size;
+    ((Header) cib->header)->md_size = size;
     
     return;
 }
 
 /*Returns the data size.*/
 uint64_t HeadGetDataSize(){
-    return ((Header) header)->data_size;
+    return ((Header) cib->header)->data_size;
 }
 
 /*Set the data size to the desired value.*/
 void HeadSetDataSize(uint64_t size){
-    ((Header) header)->data_size = size;
+    ((Header) cib->header)->data_size = size;
     
     return;
 }
@@ -61,24 +75,24 @@ uint64_t HeadGetFileSize(){
 
 /*Returns the metadata's CIBList blocks.*/
 uint32_t HeadGetListBlocks(){
-    return ((Header) header)->list_blocks;
+    return ((Header) cib->header)->list_blocks;
 }
 
 /*Sets the metadata's CIBList blocks count to the given value.*/
 void HeadSetListBlocks(uint32_t blocks){
-    ((Header) header)->list_blocks = blocks;
+    ((Header) cib->header)->list_blocks = blocks;
 
     return;
 }
 
 /*Returns the number of entries that the metadata partition holds.*/
 uint64_t HeadGetListEntries(){
-    return ((Header) header)->list_entries;
+    return ((Header) cib->header)->list_entries;
 }
 
 /*Sets the metadata CIBList entries count to the given value.*/
 void HeadSetListEntries(uint64_t entries){
-    ((Header) header)->list_entries = entries;
+    ((Header) cib->header)->list_entries = entries;
 
     return;
 }
@@ -90,25 +104,131 @@ uint64_t HeadGetListCapacity(){
 
 /*Returns the nest level of the CIBList.*/
 uint8_t HeadGetNestLevel(){
-    return ((Header) header)->nest_level;
+    return ((Header) cib->header)->nest_level;
 }
 
 /*Sets the CIBList nest level to the given value.*/
 void HeadSetNestLevel(uint8_t nest_level){
-    ((Header) header)->nest_level = nest_level;
+    ((Header) cib->header)->nest_level = nest_level;
 
     return;
 }
 
 /*Returns the number of free node blocks in metadata partition.*/
 uint32_t HeadGetMDFreeNodeBlocks(){
-    return ((Header) header)->free_node_blocks;
+    return ((Header) cib->header)->free_node_blocks;
 
 }
 
 /*Sets the counter of free node blocks in metadata partition to the given value.*/
 void HeadSetMDFreeNodeBlocks(uint32_t blocks){
-    ((Header) header)->free_node_blocks = blocks;
+    ((Header) cib->header)->free_node_blocks = blocks;
+
+    return;
+}
+
+/*Returns true iff the snapshot table exists. If it does, its first cib-node block is stored in *block.*/
+bool HeadGetSnapshotBlock(uint32_t *block){
+    *block = ((Header) cib->header)->snapshot_block;
+
+    return ((Header) cib->header)->snapshot_flag == 1;
+}
+
+/*Sets the first cib-node block of the snapshot table.*/
+void HeadSetSnapshotBlock(uint32_t block){
+    ((Header) cib->header)->snapshot_block = block;
+    ((Header) cib->header)->snapshot_flag = 1;
+
+    return;
+}
+
+/*Returns the data block that holds the path of the base archive. If the archive is not a differential
+archive, 0 is returned.*/
+uint64_t HeadGetBaseArchive(){
+    return ((Header) cib->header)->base_archive;
+}
+
+/*Sets the data block that holds the path of the base archive.*/
+void HeadSetBaseArchive(uint64_t block){
+    ((Header) cib->header)->base_archive = block;
+
+    return;
+}
+
+/*Returns true iff the data of the cib file are stored in log-structured mode.*/
+bool HeadIsLogStructured(){
+    return ((Header) cib->header)->log_structured == 1;
+}
+
+/*Sets whether the data of the cib file are stored in log-structured mode.*/
+void HeadSetLogStructured(bool log_structured){
+    ((Header) cib->header)->log_structured = log_structured == true;
+
+    return;
+}
+
+/*Returns true iff the cib file is being created without checkpoints, or its creation was interrupted.*/
+bool HeadIsUnfinished(){
+    return ((Header) cib->header)->unfinished == 1;
+}
+
+/*Sets whether the cib file is being created without checkpoints.*/
+void HeadSetUnfinished(bool unfinished){
+    ((Header) cib->header)->unfinished = unfinished == true;
+
+    return;
+}
+
+/*Returns the first block of the unused rest of the log's current segment. If there is none, 0 is returned.*/
+uint64_t HeadGetLogTail(){
+    return ((Header) cib->header)->log_tail;
+}
+
+/*Sets the first block of the unused rest of the log's current segment.*/
+void HeadSetLogTail(uint64_t block){
+    ((Header) cib->header)->log_tail = block;
+
+    return;
+}
+
+/*Returns the data block that holds the compression dictionary of the archive. If there is none, 0 is returned.*/
+uint64_t HeadGetDictionary(){
+    return ((Header) cib->header)->dictionary;
+}
+
+/*Sets the data block that holds the compression dictionary of the archive.*/
+void HeadSetDictionary(uint64_t block){
+    ((Header) cib->header)->dictionary = block;
+
+    return;
+}
+
+/*Returns the 16 bytes of the random identity that the cib file was given when it was created.*/
+uint8_t *HeadGetUUID(){
+    return ((Header) cib->header)->uuid;
+}
+
+/*Returns the data generation of the cib file, which changes whenever used data chunks are freed. The chunks that a
+differential archive refers to stay where they are as long as the data generation of its base archive is the same.*/
+uint64_t HeadGetDataGeneration(){
+    return ((Header) cib->header)->data_generation;
+}
+
+/*Sets the data generation of the cib file.*/
+void HeadSetDataGeneration(uint64_t generation){
+    ((Header) cib->header)->data_generation = generation;
+
+    return;
+}
+
+/*Returns the data block that holds the directory cursor of the last insertion, which was interrupted. 0 if there is none.*/
+uint64_t HeadGetResumeCursor(){
+    return ((Header) cib->header)->resume_cursor;
+}
+
+/*Sets the data block that holds the directory cursor of the insertion.*/
+void HeadSetResumeCursor(uint64_t block){
+    ((Header) cib->header)->resume_cursor = block;
 
     return;
 }
@@ -117,16 +237,25 @@ void HeadSetMDFreeNodeBlocks(uint32_t blocks){
 
 /*Calculates and returns the space that the header needs.*/
 uint64_t HeadCalculateNeededSpace(char *base_dir){
-    return max(sizeof(struct header), 33 + strlen(base_dir) + 1);
+    return max(sizeof(struct header), offsetof(struct header, base_dir) + strlen(base_dir) + 1);
 }
 
 /*Initialize the header partition. Base_dir will be the base directory
-for the .cib file.*/
+for the .cib file, which is given a new random identity.*/
 void HeadInit(char *base_dir){
     uint64_t header_size = HeadCalculateNeededSpace(base_dir);
 
-    memset(header, 0, header_size);
-    strcpy(((Header) header)->base_dir, base_dir);
+    memset(cib->header, 0, header_size);
+    strcpy(((Header) cib->header)->base_dir, base_dir);
+
+    //Without the random source, the time and the process make the identity unique enough.
+    Header head = cib->header;
+    if(getrandom(head->uuid, sizeof(head->uuid), 0) != sizeof(head->uuid)){
+        struct timespec now; clock_gettime(CLOCK_REALTIME, &now);
+        uint64_t seed[2] = {now.tv_sec * 1000000000ULL + now.tv_nsec, getpid()};
+
+        memcpy(head->uuid, seed, sizeof(head->uuid));
+    }
 
     return;
 }
\ No newline at end of file
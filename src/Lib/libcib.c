@@ -0,0 +1,309 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "libcib.h"
+#include "cibfuncs.h"
+
+#include "data.h"
+#include "header.h"
+#include "metadata.h"
+
+
+/*Every function of cib operates on the archive that the calling thread's cib points to. An archive holds the state
+of its cib file, which a call makes current while it runs, and the base archives that its calls opened. Its lock
+makes sure that only one call uses the state at a time; calls on different archives run in parallel.
+
+An archive holds the shared lock of its cib file, so that writers wait until it is closed, unless it is released;
+then the next call locks it again, and the base archives are closed. The file descriptor of an archive whose cib
+file could not be opened again is -1.*/
+
+struct cib_archive{
+    CIBState state;
+    CIBState previous;  //State that was current in the calling thread before the call entered the archive.
+    pthread_mutex_t lock;
+    char *path;         //Absolute path of the cib file.
+    uint64_t size;      //Bytes of the cib file that are mapped.
+    bool released;      //True iff the shared lock of the cib file has been released.
+    bool pinned;        //True iff the header and the metadata of the cib file are to be locked in memory.
+};
+
+/*Locks the header and the metadata of the open cib file in memory. Returns false if the limit of the process on
+locked memory is too low.*/
+static bool CIBArchiveMlock(){
+    return mlock(cib->header, HeadGetHeaderSize()) == 0 && mlock(cib->md, HeadGetMDSize()) == 0;
+}
+
+/*Stores the size of the open cib file, which the archive has just mapped, and locks its metadata in memory if the
+archive is pinned.*/
+static void CIBArchiveMapped(CIBArchive archive){
+    struct stat info; fstat(cib->fd, &info);
+    archive->size = info.st_size;
+
+    if(archive->pinned == true)
+        CIBArchiveMlock();
+
+    return;
+}
+
+/*Holds the shared lock of the cib file of the archive, which is the current one, again, if it was released. If wait
+is false, the call does not wait while a writer holds the lock. Returns 0 if the archive holds the lock, 1 if wait
+is false and a writer holds it, and -1 if the cib file cannot be opened again.*/
+static int CIBArchiveRelock(CIBArchive archive, bool wait){
+    if(archive->released == false)
+        return 0;
+
+    int res = RelockCIB(archive->path, archive->size, wait);
+    if(res == 2)
+        return 1;
+
+    if(res == -1){
+        cib->fd = -1;
+        return -1;
+    }
+
+    if(res == 1)
+        CIBArchiveMapped(archive);
+
+    archive->released = false;
+    return 0;
+}
+
+/*Locks the archive and makes its state the current one of the calling thread. The shared lock of the cib file, if
+it was released, is held again. Returns false if the cib file cannot be opened again; the archive must still be left.*/
+static bool CIBArchiveEnter(CIBArchive archive){
+    pthread_mutex_lock(&archive->lock);
+    archive->previous = CIBStateUse(archive->state);
+
+    return CIBArchiveRelock(archive, true) == 0;
+}
+
+/*Restores the state that was current in the calling thread and unlocks the archive. The base archives that the
+call opened stay open for the next calls, until the archive is released.*/
+static void CIBArchiveLeave(CIBArchive archive){
+    CIBStateUse(archive->previous);
+    pthread_mutex_unlock(&archive->lock);
+
+    return;
+}
+
+/*Returns the entry id of the given path in the tree or the snapshot. Found is set to false if it does not exist.*/
+static EntryId CIBArchiveGetPath(char *path, char *snapshot, bool *found){
+    *found = true;
+    EntryId root = snapshot == NULL ? 0 : MDGetSnapshot(snapshot, found);
+
+    if(*found == false || strcmp(path, ".") == 0)
+        return root;
+
+    return MDGetPath(path, root, found);
+}
+
+/*Opens the cib file defined by path. Returns NULL if it cannot be opened.*/
+CIBArchive CIBArchiveOpen(char *path){
+    CIBState state = CIBStateCreate(), previous = CIBStateUse(state);
+
+    CIBArchive archive = NULL;
+    if(OpenExistingCIBReadOnly(path) == 0){
+        archive = malloc(sizeof(struct cib_archive));
+        archive->state = state;
+        archive->path = RealPath(path);
+        archive->released = archive->pinned = false;
+        pthread_mutex_init(&archive->lock, NULL);
+
+        CIBArchiveMapped(archive);
+    }
+
+    CIBStateUse(previous);
+    if(archive == NULL)
+        CIBStateDestroy(state);
+
+    return archive;
+}
+
+/*Closes the archive and frees its memory.*/
+void CIBArchiveClose(CIBArchive archive){
+    pthread_mutex_lock(&archive->lock);
+    CIBState previous = CIBStateUse(archive->state);
+    CIBCloseBases();
+
+    //A released cib file may have changed size, so the size that is mapped is unmapped.
+    if(cib->fd != -1){
+        munmap(cib->header, archive->size);
+        close(cib->fd);
+    }
+
+    CIBStateUse(previous);
+    pthread_mutex_unlock(&archive->lock);
+
+    pthread_mutex_destroy(&archive->lock);
+    CIBStateDestroy(archive->state); free(archive->path); free(archive);
+    return;
+}
+
+/*Releases the shared lock of the cib file of the archive, which stays mapped, so that writers may update the cib
+file. The next call on the archive waits until the writers are done and locks it again; if the cib file changed
+size or was replaced meanwhile, it is opened again; CIBArchiveTryAcquire() does so without waiting. A long-running
+process releases its archives whenever it is idle, so that it does not keep writers waiting.*/
+void CIBArchiveRelease(CIBArchive archive){
+    pthread_mutex_lock(&archive->lock);
+    CIBState previous = CIBStateUse(archive->state);
+
+    //The base archives hold the shared locks of their cib files too.
+    CIBCloseBases();
+    if(archive->released == false && cib->fd != -1)
+        UnlockCIB();
+
+    archive->released = true;
+
+    CIBStateUse(previous);
+    pthread_mutex_unlock(&archive->lock);
+    return;
+}
+
+/*Holds the shared lock of the cib file of the archive again, if it was released, without waiting for the writers
+of the cib file, so that a process that serves many archives on one thread is never blocked by one of them. Returns
+0 if the archive holds the lock; the next calls on it do not wait then. Returns 1 if a writer holds the lock, in
+which case the archive stays released and the call may be repeated later, and -1 if the cib file cannot be opened
+again.*/
+int CIBArchiveTryAcquire(CIBArchive archive){
+    pthread_mutex_lock(&archive->lock);
+    CIBState previous = CIBStateUse(archive->state);
+
+    int res = CIBArchiveRelock(archive, false);
+
+    CIBStateUse(previous);
+    pthread_mutex_unlock(&archive->lock);
+    return res;
+}
+
+/*Locks the header and the metadata of the cib file of the archive in memory, so that lookups never wait for the
+disk, also after the cib file is opened again. Returns false if the process may not lock that much memory.*/
+bool CIBArchivePin(CIBArchive archive){
+    bool pinned = false;
+    archive->pinned = true;
+
+    if(CIBArchiveEnter(archive) == true)
+        pinned = CIBArchiveMlock();
+
+    CIBArchiveLeave(archive);
+    return pinned;
+}
+
+/*Returns true iff the path exists in the archive.*/
+bool CIBArchiveQuery(CIBArchive archive, char *path, char *snapshot){
+    bool found = false;
+
+    if(CIBArchiveEnter(archive) == true)
+        CIBArchiveGetPath(path, snapshot, &found);
+    CIBArchiveLeave(archive);
+
+    return found;
+}
+
+/*Stores the metadata of the entry defined by path in *stat. Returns false if the path does not exist.*/
+bool CIBArchiveGetStat(CIBArchive archive, char *path, char *snapshot, CIBArchiveStat stat){
+    bool found = false; EntryId entry_id = 0;
+
+    if(CIBArchiveEnter(archive) == true)
+        entry_id = CIBArchiveGetPath(path, snapshot, &found);
+
+    if(found == true){
+        stat->mode = CIBEntryGetMode(entry_id);
+        stat->modified = CIBEntryGetModified(entry_id);
+        stat->size = 0;
+        stat->sized = true;
+
+        uint64_t pointer = CIBEntryGetPointer(entry_id);
+        int depth;
+
+        //The data of an unchanged file of a differential archive are stored in a base archive.
+        if(CIBEntryIsFile(GetEntryAddress(entry_id)) == true && DataIsBaseRef(pointer) == true){
+            uint64_t base_pointer = DataBaseRefResolve(pointer, &depth);
+            CIBState base = CIBGetBase(depth);
+
+            stat->sized = false;
+            if(base != NULL){
+                CIBStateUse(base);
+                stat->sized = DataGetFileSize(base_pointer, &stat->size);
+                CIBStateUse(archive->state);
+            }
+
+        }else if(CIBEntryIsFile(GetEntryAddress(entry_id)) == true && pointer != 0)
+            stat->sized = DataGetFileSize(pointer, &stat->size);
+    }
+
+    CIBArchiveLeave(archive);
+    return found;
+}
+
+/*Returns an array with the names, allocated in heap, of the entries of the directory defined by path and stores
+their number in *count. If the path does not exist or is not a directory, NULL is returned. The array must be freed
+with CIBArchiveListFree().*/
+char **CIBArchiveList(CIBArchive archive, char *path, char *snapshot, uint64_t *count){
+    bool found = false; EntryId entry_id = 0;
+    char **names = NULL;
+    *count = 0;
+
+    if(CIBArchiveEnter(archive) == true)
+        entry_id = CIBArchiveGetPath(path, snapshot, &found);
+
+    if(found == true && CIBEntryIsDir(GetEntryAddress(entry_id)) == true){
+        List entries = MDGetDirEntries(entry_id);
+        names = malloc(sizeof(char *) * (ListGetSize(entries) + 1));
+
+        for(LNode node = ListGetFirstNode(entries); node != NULL; node = LNodeGetNext(node))
+            names[(*count)++] = strdup(INPairGetName(LNodeGetItem(node)));
+
+        ListDestroy(entries);
+    }
+
+    CIBArchiveLeave(archive);
+    return names;
+}
+
+/*Frees the array of count names that CIBArchiveList() returned.*/
+void CIBArchiveListFree(char **names, uint64_t count){
+    for(uint64_t i = 0; names != NULL && i < count; i++)
+        free(names[i]);
+
+    free(names);
+    return;
+}
+
+/*Copies at most length bytes of the file defined by path, from the given offset on, in dest. The number of bytes
+copied is stored in *read. Of a file compressed in frames, only the frames that hold the bytes are decompressed.
+
+Returns false if the path is not a file, or the file cannot be read in place, because an external program
+compressed it, or its content is corrupt.*/
+bool CIBArchiveRead(CIBArchive archive, char *path, char *snapshot, uint64_t offset, uint64_t length, void *dest, uint64_t *read){
+    bool found = false, done = false;
+    EntryId entry_id = 0;
+    *read = 0;
+
+    if(CIBArchiveEnter(archive) == true)
+        entry_id = CIBArchiveGetPath(path, snapshot, &found);
+
+    if(found == true && CIBEntryIsFile(GetEntryAddress(entry_id)) == true){
+        uint64_t pointer = CIBEntryGetPointer(entry_id);
+        int depth;
+
+        if(DataIsBaseRef(pointer) == true){
+            uint64_t base_pointer = DataBaseRefResolve(pointer, &depth);
+            CIBState base = CIBGetBase(depth);
+
+            if(base != NULL){
+                CIBStateUse(base);
+                done = DataReadRange(base_pointer, offset, length, dest, read);
+                CIBStateUse(archive->state);
+            }
+
+        //An empty file points to no data.
+        }else
+            done = pointer == 0 || DataReadRange(pointer, offset, length, dest, read);
+    }
+
+    CIBArchiveLeave(archive);
+    return done;
+}
@@ -1,10 +1,12 @@
 #include <stdlib.h>
+#include <math.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
 #include <linux/limits.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/file.h>
 #include <dirent.h>
 #include <libgen.h>
 #include <wait.h>
@@ -16,591 +18,2694 @@
 #include "data.h"
 
 #include "file_management.h"
+#include "cibfuncs.h"
 
 #include "cli_utils.h"
+#include "codec.h"
+#include "serve.h"
 
 #include "ADTList.h"
 #include "ADTHashTable.h"
 
-int fd;
-void *md = NULL;
-void *header = NULL;
-void *data = NULL;
+#define BASE_RECORD_MAGIC "CIBBASE1"
+#define VERIFY_BYTES (1 << 20)      //Bytes of a file that --verify compares at once.
+
+/*The record of its base archive that a differential archive stores in a data chunk. It is followed by the path of
+the base archive relative to the directory of the differential archive and by its absolute path, each ending with
+'\0'. The relative path is tried first, so that the archives can be moved together, and then the absolute one, so
+that the differential archive can be moved on its own.*/
+typedef struct base_record{
+    char magic[8];              //BASE_RECORD_MAGIC
+    uint8_t uuid[16];           //Identity of the base archive
+    uint64_t data_generation;   //and its data generation when the differential archive was created.
+}* BaseRecord;
+
+/*A file that an external program compresses: the entry that will point to its data, the level and the path.*/
+typedef struct filter_tag{
+    EntryId entry_id;
+    uint8_t level;
+    char path[];
+}* FilterTag;
+
+//Small files that wait to be stored in the next solid chunk, when -j is given with --solid.
+typedef struct solid_batch{
+    char *bytes;                //The files' bytes, one after the other.
+    uint64_t size;
+    uint64_t capacity;
+
+    EntryId *entries;           //The entry and the size of each member.
+    uint64_t *sizes;
+    uint64_t count;
+
+    uint32_t refs;              //Members that their entries will point to.
+    HashTable members;          //Maps each entry to its last member. A member that an entry was given earlier is dropped.
+}* SolidBatch;
+
+/*What the operations keep about an archive: the settings of the insertions into it and the state of the operation
+that runs on it.*/
+struct cib_operation{
+    //Files and links of the base archive indexed by their path, and its identity. Used only while a differential
+    //archive is created. base_verify is true iff --verify was given: the contents of files are compared, too.
+    HashTable base_files;
+    struct base_record base_identity;
+    bool base_verify;
+
+    //Codec that compresses the inserted files when compression is asked for, and its level. The files are
+    //compressed in-process, unless the codec is CODEC_GZIP or CODEC_FILTER, in which case the external gzip or
+    //the program of --filter, whose command is insert_filter, compresses them. Only the name of that program,
+    //insert_filter_name, is stored with each file.
+    uint8_t insert_codec;
+    uint8_t insert_level;
+    char *insert_filter;
+    char *insert_filter_name;
+
+    //Runs the external programs that compress the inserted files, a bounded number at once. NULL unless the
+    //codec of the insertion is external.
+    CodecFilter external_filter;
+
+    //Controller that adapts insert_level to the target rate or deadline of the insertion. NULL if there is none.
+    CodecController level_controller;
+
+    bool insert_solid;
+    struct solid_batch solid;
+
+    //True iff -j is given with --dict. The size of the archive's dictionary and the files it was trained on, 0 if
+    //it was already stored, are kept for the report.
+    bool insert_dictionary;
+    uint64_t dictionary_size, dictionary_samples;
+
+    //While CIBAppendStaged() writes a staging cib file: the inode of the cib file that it will be committed to, which
+    //is not inserted, and the dictionary of that cib file, which the staging cib file stores instead of training its
+    //own. staged_target is 0 otherwise.
+    ino_t staged_target;
+    void *staged_dictionary;
+    uint64_t staged_dictionary_size;
+
+    //Seconds between the checkpoints of an insertion, at which the cib file is committed, given with --checkpoint. 0 if
+    //it takes none. insert_resume is true iff --resume was given: the files that the cib file holds unchanged are skipped.
+    uint64_t insert_checkpoint;
+    bool insert_resume;
+
+    //Path of the last directory whose entries the insertion has inserted, relative to the base directory. Some of its
+    //files may still be in the solid batch, so it becomes the directory cursor once they are stored. NULL if there is none.
+    char *completed_dir;
+
+    //Counters of the compression and time when the level controller was last updated.
+    struct data_compression_stats control_stats;
+    uint64_t control_time;
+
+    //Base archives of the archive that have been opened so far. bases[i] is the base of depth i + 1. bases_failed
+    //is true iff the next base of the chain cannot be opened; it is not tried again until CIBCloseBases() is called.
+    CIBState bases[DATA_MAX_BASE_DEPTH];
+    int bases_count;
+    bool bases_failed;
+
+    //Access trace of the current extraction, in the order in which the entries were first extracted, and the map of
+    //its paths to its records. NULL if no trace is recorded.
+    Vector trace;
+    HashTable trace_index;
+};
+
+/*Returns a new operation state, allocated in heap. The settings of the insertions are copied from the given
+operation state, unless it is NULL.*/
+CIBOperation CIBOperationCreate(CIBOperation settings){
+    CIBOperation operation = calloc(1, sizeof(struct cib_operation));
+    operation->insert_codec = CODEC_GZIP;
+    operation->insert_level = 6;
+
+    if(settings != NULL){
+        operation->base_verify = settings->base_verify;
+        operation->insert_codec = settings->insert_codec;
+        operation->insert_level = settings->insert_level;
+        operation->insert_filter = settings->insert_filter;
+        operation->insert_filter_name = settings->insert_filter_name;
+        operation->insert_solid = settings->insert_solid;
+        operation->insert_dictionary = settings->insert_dictionary;
+        operation->insert_checkpoint = settings->insert_checkpoint;
+        operation->insert_resume = settings->insert_resume;
+    }
+
+    return operation;
+}
 
-/*Compresses the file specified by path and returns the name of the compressed file, which is malloc'd.
+/*Destroys the given operation state. Its base archives must have been closed.*/
+void CIBOperationDestroy(CIBOperation operation){
+    free(operation);
 
-Make sure that the given path is a file. This function will not perform wait() to collect the zombie
-process that is created due to fork(), exec().*/
-char *CIBCompressFile(char *dir_path, char *entry_name){
-    int pid = fork();
+    return;
+}
 
-    if(pid == 0){
-        //The name of the gzip-ed file will be the process id of the child process.
-        char gzip_name[(32 + strlen(dir_path) + 1)]; 
-        snprintf(gzip_name, sizeof(gzip_name), "%s/%d", dir_path, getpid());
+/*A directory that waits to be read during a bulk insertion.*/
+typedef struct pending_dir{
+    char *path;
+    EntryId entry_id;
+    EntryId parent_id;
+    bool whole;             //True iff every entry of the directory is inserted.
+}* PendingDir;
+
+/*A record of the access trace of a cib file. Entries are recorded by their path, relative to the base directory,
+since the ids of deleted entries are given to the entries inserted after them.*/
+typedef struct trace_record{
+    char *path;
+    uint64_t count;         //Number of times that the entry was extracted.
+}* TraceRecord;
+
+/*The start of a record in the file of the access trace. It is followed by the length bytes of the path.*/
+struct trace_header{
+    uint64_t count;
+    uint64_t length;
+};
+
+/*Information about a file or link of the base archive.*/
+typedef struct base_file{
+    uint64_t pointer;       //The pointer that an entry of the differential archive holds to refer to the file's data.
+    uint64_t size;          //Size of the file. Valid iff sized is true.
+    uint32_t modified;
+    uint32_t mode;
+    bool sized;
+}* BaseFile;
 
-        //Createt the path for the target file.
-        char file_name[strlen(entry_name) + strlen(dir_path) + 2]; 
-        snprintf(file_name, sizeof(file_name), "%s/%s", dir_path, entry_name);
+//--------------------------------------------
+//Access Trace Functions
 
-        //Open the gzip file.
-        int gzip_fd;
-        if(OpenFile(gzip_name, &gzip_fd, O_CREAT | O_RDWR | O_TRUNC, 0666) == -1){
-            CIBCannotCompress(file_name);
+/*Returns the path of the file that holds the access trace of the given cib file. It must be freed.*/
+char *CIBTracePath(char *cib_file){
+    char *path = malloc(strlen(cib_file) + 7);
+    sprintf(path, "%s.trace", cib_file);
 
-            //In case of failure it is better to exit the program as the parent process will not know
-            //that the file could not be compressed.
-            exit(-1);
-        }
+    return path;
+}
 
-        //Redirect gzip's fd to stdout and call gzip using execlp.
-        DupAndClose(gzip_fd, 1);
-        execlp("gzip", "gzip", "-f", "-c", file_name, NULL);
+/*Destroys the given trace record.*/
+void CIBTraceRecordDestroy(void *record){
+    free(((TraceRecord) record)->path);
+    free(record);
+
+    return;
+}
+
+/*Adds count extractions of the entry with the given path, which is copied, to the given trace and its index.*/
+void CIBTraceAdd(Vector records, HashTable index, char *path, uint64_t count){
+    HashNode node = HTFindKey(index, path);
+    if(node != NULL){
+        ((TraceRecord) HNGetItem(node))->count += count;
+        return;
     }
 
-    //Create the name of the gzip-ed file and return it.
-    char *gzip_name = malloc(sizeof(char) * 32); snprintf(gzip_name, 32, "%d", pid);
-    
-    return gzip_name;
+    TraceRecord record = malloc(sizeof(struct trace_record));
+    record->path = strdup(path);
+    record->count = count;
+
+    VectorInsertLast(records, record);
+    HTInsertItem(index, record->path, record);
+    return;
 }
 
-/*Compresses the files and links under the directory defined by dir and path.
+/*Returns a vector with the records of the access trace of the given cib file, in the order in which
+the entries were first extracted. If no trace has been recorded the vector is empty.
 
-Returns a Hashtable mapping each compressed_file to the original file.*/
-HashTable CIBCompressDir(DIR *dir, char *path){
-    struct stat cib_info; fstat(fd, &cib_info);
-    struct dirent *dir_entry;
+Every traced extraction appends its records to the trace file, so the records of the same path are merged.*/
+Vector CIBTraceLoad(char *cib_file){
+    char *path = CIBTracePath(cib_file);
+    int trace_fd = open(path, O_RDONLY | O_CLOEXEC);
+    free(path);
 
-    //#Files and Links under directory.
-    uint32_t files = 0;
-    HashTable mapping = HTCreate(10, HashString, (CompFunc) strcmp, free, free);
+    Vector records = VectorCreate(16, CIBTraceRecordDestroy);
+    struct stat info;
 
-    while((dir_entry = readdir(dir)) != NULL){
-        
-        //Obtain the path of the current entity.
-        char entry_path[strlen(path) + strlen(dir_entry->d_name) + 2];
-        snprintf(entry_path, sizeof(entry_path), "%s/%s", path, dir_entry->d_name);
-        struct stat info; lstat(entry_path, &info);
+    //The records that are being appended are waited for.
+    if(trace_fd == -1 || flock(trace_fd, LOCK_SH) == -1 || fstat(trace_fd, &info) == -1){
+        if(trace_fd != -1) close(trace_fd);
+        return records;
+    }
 
-        //Skip if entry is the .cib file or ".", "..".
-        if(strcmp(dir_entry->d_name, ".") == 0 || strcmp(dir_entry->d_name, "..") == 0 || info.st_ino == cib_info.st_ino)
-            continue;
+    char *buff = malloc(info.st_size + 1);
+    uint64_t size = ReadBytes(buff, info.st_size, trace_fd);
+    close(trace_fd);
 
-        //If entity is file , fork() and compress using exec.
-        if((S_ISREG(info.st_mode)) && HTFindKey(mapping, dir_entry->d_name) == NULL){
-            HTInsertItem(mapping, CIBCompressFile(path, dir_entry->d_name), strdup(dir_entry->d_name));
-            files++;
+    HashTable index = HTCreate(size / sizeof(struct trace_header) + 16, HashString, (CompFunc) strcmp, NULL, NULL);
 
-        }
+    //A record that was cut short is ignored.
+    for(uint64_t offset = 0; offset + sizeof(struct trace_header) <= size;){
+        struct trace_header header;
+        memcpy(&header, buff + offset, sizeof(header));
+        offset += sizeof(header);
+
+        if(header.length > size - offset)
+            break;
+
+        char *entry_path = strndup(buff + offset, header.length);
+        CIBTraceAdd(records, index, entry_path, header.count);
+
+        free(entry_path);
+        offset += header.length;
     }
 
-    rewinddir(dir);
-    //Collect the zombie processes.
-    for(int i = 0; i < files; i++)
-        wait(NULL);
+    HTDestroy(index);
+    free(buff);
+    return records;
+}
+
+/*Appends the given records to the access trace of the given cib file. The records are written at once, under
+an exclusive lock of the trace file, so that the records of extractions that end together are not mixed up.*/
+void CIBTraceSave(char *cib_file, Vector records){
+    char *path = CIBTracePath(cib_file);
+
+    int trace_fd;
+    if(OpenFile(path, &trace_fd, O_CREAT | O_APPEND | O_WRONLY | O_CLOEXEC, 0644) == -1){
+        free(path);
+        return;
+    }
+
+    uint64_t size = 0;
+    for(int i = 0; i < VectorGetSize(records); i++)
+        size += sizeof(struct trace_header) + strlen(((TraceRecord) VectorGetAt(records, i))->path);
+
+    char *buff = malloc(size + 1), *end = buff;
+    for(int i = 0; i < VectorGetSize(records); i++){
+        TraceRecord record = VectorGetAt(records, i);
+        struct trace_header header = {record->count, strlen(record->path)};
 
-    return mapping;
+        memcpy(end, &header, sizeof(header));
+        memcpy(end + sizeof(header), record->path, header.length);
+        end += sizeof(header) + header.length;
+    }
+
+    if(flock(trace_fd, LOCK_EX) == 0)
+        WriteBytes(buff, size, trace_fd);
+
+    close(trace_fd);
+    free(buff); free(path);
+    return;
 }
 
-/*Inserts all the entities under the directory that corresponds to the given point. The directory
-must be inserted before calling this function and its EntryId has to be passed as a parameter.
+/*Starts recording the extractions from the given cib file. The records are added to the ones of its trace
+when the recording stops.*/
+void CIBTraceBegin(){
+    cib->operation->trace = VectorCreate(16, CIBTraceRecordDestroy);
+    cib->operation->trace_index = HTCreate(64, HashString, (CompFunc) strcmp, NULL, NULL);
 
-If user wants its content compressed then the given flag should be set to true.*/
-void CIBInsertDirectory(char *path, EntryId dir_id, bool compress){
-    //Obtain the stat info about our cib file. We don't want to include it inside itself.
-    struct stat cib_info; fstat(fd, &cib_info);
-    
-    //Open the directory and create a file-mapping in case user needs the data inserted to be compressed.
-    DIR *dir = opendir(path);
-    HashTable file_map = compress == true ? CIBCompressDir(dir, path) : NULL;
+    return;
+}
 
-    //Go through directory entries.
-    struct dirent *dir_entry;
-    while((dir_entry = readdir(dir)) != NULL){
-        //Create the path of the current entry.
-        char entry_path[strlen(path) + strlen(dir_entry->d_name) + 2];
-        snprintf(entry_path, sizeof(entry_path), "%s/%s", path, dir_entry->d_name);
-        //Obtain stat info about the current entry.
-        struct stat info; lstat(entry_path, &info);
+/*Records an extraction of the entry with the given path, if a trace is being recorded.*/
+void CIBTraceAccess(char *path){
+    if(cib->operation->trace == NULL)
+        return;
+
+    //Paths of the entities under "." start with "./".
+    while(strncmp(path, "./", 2) == 0)
+        path += 2;
+
+    CIBTraceAdd(cib->operation->trace, cib->operation->trace_index, path, 1);
+    return;
+}
+
+/*Stops recording and appends the recorded extractions to the trace of the given cib file.*/
+void CIBTraceEnd(char *cib_file){
+    if(VectorGetSize(cib->operation->trace) > 0)
+        CIBTraceSave(cib_file, cib->operation->trace);
+
+    HTDestroy(cib->operation->trace_index);
+    VectorDestroy(cib->operation->trace);
+    cib->operation->trace = NULL; cib->operation->trace_index = NULL;
+    return;
+}
+
+/*Compares two trace records by their count.*/
+int CIBTraceCompare(void *a, void *b){
+    uint64_t x = ((TraceRecord) a)->count, y = ((TraceRecord) b)->count;
+    return (x > y) - (x < y);
+}
+
+//--------------------------------------------
+//Base Archive Functions
+
+/*Inserts in the given hash table every file and link of the directory with the given entry id. The
+keys are the paths relative to the base directory of the archive. Directories are visited recursively.*/
+void CIBBaseIndexRec(EntryId dir_id, char *path, HashTable index){
+    List entries = MDGetDirEntries(dir_id);
+
+    for(LNode node = ListGetFirstNode(entries); node != NULL; node = LNodeGetNext(node)){
+        INPair pair = LNodeGetItem(node);
+        EntryId entry_id = INPairGetId(pair);
+
+        char entry_path[strlen(path) + strlen(INPairGetName(pair)) + 2];
+        if(strcmp(path, ".") == 0)
+            strcpy(entry_path, INPairGetName(pair));
+        else
+            snprintf(entry_path, sizeof(entry_path), "%s/%s", path, INPairGetName(pair));
 
-        //If current entry is ., .. or is the open cib file we skip the loop.
-        if(strcmp(dir_entry->d_name, ".") == 0 || strcmp(dir_entry->d_name, "..") == 0 || info.st_ino == cib_info.st_ino)
+        if(CIBEntryIsDir(GetEntryAddress(entry_id)) == true){
+            CIBBaseIndexRec(entry_id, entry_path, index);
             continue;
+        }
 
-        if(!(S_ISDIR(info.st_mode) || S_ISLNK(info.st_mode) || S_ISREG(info.st_mode))){
-            CIBCannotInsertPath(entry_path);
+        uint64_t pointer = CIBEntryGetPointer(entry_id); int depth = 0;
+        if(DataIsBaseRef(pointer) == true)
+            DataBaseRefResolve(pointer, &depth);
 
-        //If entry is a directory then after inserting it inside the cib file its content is inserted
-        //too by calling this function again.
-        }else if(S_ISDIR(info.st_mode)){
-            CIBEntry entry = CIBEntryCreate(NULL, entry_path); bool inserted; 
-            EntryId entry_id = MDUpdatePath(entry, dir_entry->d_name, dir_id, &inserted); free(entry);
+        //The chain of bases cannot get any longer.
+        if(depth == DATA_MAX_BASE_DEPTH)
+            continue;
 
-            if(inserted == true)
-                CIBInsertDirectory(entry_path, entry_id, compress);
+        BaseFile file = malloc(sizeof(struct base_file));
+        file->pointer = DataBaseRefCreate(pointer);
+        file->modified = CIBEntryGetModified(entry_id);
+        file->mode = CIBEntryGetMode(entry_id);
+        file->sized = DataIsBaseRef(pointer) == false && DataGetFileSize(pointer, &file->size);
 
-        //If user asked for compression and the current entry is a compressed version of an entry of dir
-        //we insert it inside cib file.
-        }else if(file_map != NULL && HTFindKey(file_map, dir_entry->d_name) != NULL){
-            HashNode node = HTFindKey(file_map, dir_entry->d_name);
+        HTInsertItem(index, strdup(entry_path), file);
+    }
 
-            char *item = HNGetItem(node);
-            char item_path[strlen(item) + strlen(path) + 2]; snprintf(item_path, sizeof(item_path), "%s/%s", path, item);
+    ListDestroy(entries);
+    return;
+}
 
-            CIBEntry entry = CIBEntryCreate(NULL, item_path); bool inserted;
-            EntryId entry_id = MDUpdatePath(entry, item, dir_id, &inserted); free(entry);
+/*Opens the given base archive and returns a hash table which maps the path of each of its files and links
+to a base_file struct. The identity of the base archive is stored in *identity. On failure NULL is returned.*/
+HashTable CIBBaseIndexCreate(char *base_file, BaseRecord identity){
+    if(OpenExistingCIBReadOnly(base_file) == -1)
+        return NULL;
 
-            if(inserted == true){
-                //Pointer is not zero iff an entry with that path already existed. In this case we replace its content.
-                if(CIBEntryGetPointer(entry_id) != 0)
-                    DataDeleteFile(CIBEntryGetPointer(entry_id));
+    HashTable index = HTCreate(HeadGetListEntries(), HashString, (CompFunc) strcmp, free, free);
+    CIBBaseIndexRec(0, ".", index);
 
-                DataBlockId block = DataInsertFile(entry_path, true);
-                CIBEntrySetPointer(entry_id, block);
-            }
+    memcpy(identity->magic, BASE_RECORD_MAGIC, sizeof(identity->magic));
+    memcpy(identity->uuid, HeadGetUUID(), sizeof(identity->uuid));
+    identity->data_generation = HeadGetDataGeneration();
 
-            //Delete the gzip file.
-            unlink(entry_path);
+    CloseExistingCIB();
+    return index;
+}
 
-        //If user does not need compression, or entry is a link, we insert the entry as is.
-        }else if(file_map == NULL || S_ISLNK(info.st_mode)){
-            CIBEntry entry = CIBEntryCreate(NULL, entry_path); bool inserted;
-            EntryId entry_id = MDUpdatePath(entry, dir_entry->d_name, dir_id, &inserted);
+/*Returns the path, allocated in heap, of the absolute path "to" relative to the absolute directory "from".*/
+char *CIBRelativePath(char *from, char *to){
+    char dir[strlen(from) + 2];
+    snprintf(dir, sizeof(dir), "%s%s", from, strcmp(from, "/") == 0 ? "" : "/");
 
-            if(inserted == true && CIBEntryIsDir(entry) == true)
-                CIBInsertDirectory(entry_path, entry_id, compress);
+    //The paths share the components up to the last '/' before they differ.
+    size_t common = 0;
+    for(size_t i = 0; dir[i] != '\0' && dir[i] == to[i]; i++)
+        if(dir[i] == '/')
+            common = i + 1;
 
-            else if(inserted == true){
-                //Pointer is not zero iff an entry with that path already existed. In this case we replace its content.
-                if(CIBEntryGetPointer(entry_id) != 0)
-                    DataDeleteFile(CIBEntryGetPointer(entry_id));
+    int ups = 0;
+    for(size_t i = common; dir[i] != '\0'; i++)
+        ups += dir[i] == '/';
 
-                CIBEntrySetPointer(entry_id, CIBEntryIsFile(entry) == true ? DataInsertFile(entry_path, false) : DataInsertLink(entry_path));
-            }
+    char *path = malloc(3 * ups + strlen(to + common) + 1), *end = path;
+    for(int i = 0; i < ups; i++)
+        end += sprintf(end, "../");
 
-            free(entry);
+    strcpy(end, to + common);
+    return path;
+}
+
+/*Returns the record, allocated in heap, of the base archive defined by the absolute base_path, with the given
+identity, for the differential archive defined by cib_file. Its size is stored in *size.*/
+void *CIBBaseRecordCreate(char *base_path, char *cib_file, BaseRecord identity, uint64_t *size){
+    char *cib_path = RealPath(cib_file);
+    char *relative = CIBRelativePath(dirname(cib_path), base_path);
+
+    *size = sizeof(struct base_record) + strlen(relative) + 1 + strlen(base_path) + 1;
+    char *record = malloc(*size);
+
+    memcpy(record, identity, sizeof(struct base_record));
+    strcpy(record + sizeof(struct base_record), relative);
+    strcpy(record + sizeof(struct base_record) + strlen(relative) + 1, base_path);
+
+    free(cib_path); free(relative);
+    return record;
+}
+
+/*Returns the path, allocated in heap, of the base archive that the given record, of size bytes, of the differential
+archive defined by the absolute path cib_path refers to: its relative path, if a file exists there, or else its
+absolute path. Its identity is stored in *identity. If the record is invalid, or the base archive exists in neither
+path, NULL is returned, and an error message is printed iff report is true.*/
+char *CIBBaseRecordPath(void *record, uint64_t size, char *cib_path, BaseRecord identity, bool report){
+    char *relative = (char *) record + sizeof(struct base_record);
+
+    if(size < sizeof(struct base_record) + 2 || memcmp(record, BASE_RECORD_MAGIC, sizeof(identity->magic)) != 0 || ((char *) record)[size - 1] != '\0' ||
+        memchr(relative, '\0', size - sizeof(struct base_record) - 1) == NULL){
+        if(report == true) CIBInvalidBase(cib_path);
+        return NULL;
+    }
+
+    memcpy(identity, record, sizeof(struct base_record));
+    char *absolute = relative + strlen(relative) + 1;
+
+    char copy[strlen(cib_path) + 1]; strcpy(copy, cib_path);
+    char *dir = dirname(copy), joined[strlen(dir) + strlen(relative) + 2];
+    snprintf(joined, sizeof(joined), "%s/%s", dir, relative);
+
+    if(access(joined, F_OK) == 0)
+        return RealPath(joined);
+    if(access(absolute, F_OK) == 0)
+        return strdup(absolute);
+
+    if(report == true) CIBBaseMissing(relative, absolute);
+    return NULL;
+}
+
+/*Returns the state of the base archive of the given depth. The chain of base archives is opened on demand
+and stays open until CIBCloseBases() is called. If the base archive cannot be found, or it is not the archive,
+or no longer has the data, that the archive before it in the chain was created from, an error message is printed
+and NULL is returned.*/
+CIBState CIBGetBase(int depth){
+    CIBOperation operation = cib->operation;
+
+    while(operation->bases_count < depth && operation->bases_failed == false){
+        //The record of the next base is stored inside the last opened archive of the chain, relative to which its path is.
+        CIBState previous = operation->bases_count > 0 ? CIBStateUse(operation->bases[operation->bases_count - 1]) : cib;
+
+        char *path = NULL, *archive = CIBGetPath();
+        struct base_record identity; uint64_t size;
+        if(HeadGetBaseArchive() != 0 && archive != NULL){
+            void *record = DataGetBytes(HeadGetBaseArchive(), &size);
+            path = CIBBaseRecordPath(record, size, archive, &identity, true);
+        }
+
+        CIBStateUse(previous);
+        free(archive);
+
+        operation->bases_failed = path == NULL;
+        if(path == NULL)
+            break;
+
+        CIBState base = CIBStateCreate();
+        CIBStateUse(base);
+        int res = OpenExistingCIBReadOnly(path);
+
+        if(res == 0 && (memcmp(HeadGetUUID(), identity.uuid, sizeof(identity.uuid)) != 0 || HeadGetDataGeneration() != identity.data_generation)){
+            CIBBaseChanged(path);
+            CloseExistingCIB();
+            res = -1;
         }
+
+        CIBStateUse(previous); free(path);
+        if(res == 0)
+            operation->bases[operation->bases_count++] = base;
+        else
+            CIBStateDestroy(base);
+
+        operation->bases_failed = res == -1;
     }
 
-    if(file_map != NULL) HTDestroy(file_map);
+    return operation->bases_count < depth ? NULL : operation->bases[depth - 1];
+}
 
-    closedir(dir);
+/*Closes every base archive that was opened by CIBGetBase().*/
+void CIBCloseBases(){
+    CIBOperation operation = cib->operation;
+
+    for(int i = 0; i < operation->bases_count; i++){
+        CIBState previous = CIBStateUse(operation->bases[i]);
+        CloseExistingCIB();
+        CIBStateUse(previous);
+
+        CIBStateDestroy(operation->bases[i]);
+    }
+
+    operation->bases_count = 0;
+    operation->bases_failed = false;
     return;
 }
 
-/*Inserts each "component" of the given path. For example if this function is called with path
-"base_dir/dirA/dirB/file1.txt", where base_dir is the base directory of the cib file, then function
-will insert dirA, dirA/dirB, dirA/dirB/dirC.
+/*Returns true iff the content of the file or link defined by path, whose stat info is given, is the same as the
+content that the given base reference refers to. Content that gzip compressed cannot be read in place, so it is
+taken to differ.*/
+bool CIBBaseSameContent(char *path, struct stat *info, uint64_t pointer){
+    int depth; uint64_t base_pointer = DataBaseRefResolve(pointer, &depth);
 
-For each entry inserted with this function its entry id is saved in the hash table for future reference.*/
-EntryId CIBRecInsertEntry(char *rel_path, HashTable inserted_entries, bool compress, bool *inserted){
-    HashNode node;
-    *inserted = true;
+    CIBState base = CIBGetBase(depth);
+    if(base == NULL)
+        return false;
 
-    if((node = HTFindKey(inserted_entries, rel_path)) != NULL)
-        return *((EntryId *) HNGetItem(node));
-    
-    char copy[strlen(rel_path) + 1]; strcpy(copy, rel_path);
-    char *dir = strdup(dirname(copy)); strcpy(copy, rel_path);
+    uint64_t step = S_ISLNK(info->st_mode) ? (uint64_t) info->st_size + 1 : VERIFY_BYTES;
+    char *content = malloc(step), *stored = malloc(step);
+    bool same = true;
 
-    char *base_name = strdup(basename(copy));
-    
-    EntryId parent_id = CIBRecInsertEntry(dir, inserted_entries, compress, inserted);
+    int file_fd = S_ISLNK(info->st_mode) ? -1 : open(path, O_RDONLY | O_CLOEXEC);
+    if(S_ISREG(info->st_mode) && file_fd == -1)
+        same = false;
 
-    if(*inserted == false){
-        free(dir); free(base_name);
-        
-        return 0;
+    //A file is compared a step at a time, until the stored content ends; it must end where the file does.
+    for(uint64_t offset = 0, read = step; same == true && read == step; offset += read){
+        ssize_t length = file_fd == -1 ? readlink(path, content, step) : pread(file_fd, content, step, offset);
+
+        CIBState previous = CIBStateUse(base);
+        same = DataReadRange(base_pointer, offset, step, stored, &read) == true && length >= 0 && (uint64_t) length == read &&
+            memcmp(content, stored, read) == 0;
+        CIBStateUse(previous);
     }
 
-    CIBEntry entry = CIBEntryCreate(NULL, rel_path);
+    if(file_fd != -1)
+        close(file_fd);
 
-    EntryId rel_path_id = MDUpdatePath(entry, base_name, parent_id, inserted);
+    free(content); free(stored);
+    return same;
+}
 
-    if(*inserted == true && compress == true && CIBEntryIsFile(entry) == true){
-        if(CIBEntryGetPointer(rel_path_id) != 0)
-            DataDeleteFile(CIBEntryGetPointer(rel_path_id));
+/*Returns true if the entity defined by path, whose stat info is given, is unchanged since the base archive
+was created: its type, permissions, modification time and size are the same, and with --verify its content too.
+In that case, *pointer is set to the pointer that its entry should hold.*/
+bool CIBBaseLookup(char *path, struct stat *info, uint64_t *pointer){
+    if(cib->operation->base_files == NULL)
+        return false;
 
-        char *zipped = CIBCompressFile(dir, base_name); wait(NULL);
-        
-        DataBlockId block = DataInsertFile(zipped, true);
-        CIBEntrySetPointer(rel_path_id, block);
+    //Paths of the entities under "." start with "./".
+    char *key = strncmp(path, "./", 2) == 0 ? path + 2 : path;
 
-        unlink(zipped);
+    HashNode node = HTFindKey(cib->operation->base_files, key);
+    if(node == NULL)
+        return false;
 
-    }else if(*inserted == true && CIBEntryIsDir(entry) == false){
-        if(CIBEntryGetPointer(rel_path_id) != 0)
-            DataDeleteFile(CIBEntryGetPointer(rel_path_id));
+    BaseFile file = HNGetItem(node);
+    if(file->mode != info->st_mode || file->modified != (uint32_t) info->st_mtime || (file->sized == true && file->size != (uint64_t) info->st_size))
+        return false;
 
-        DataBlockId block = CIBEntryIsFile(entry) == true ? DataInsertFile(rel_path, false) : DataInsertLink(rel_path);
-        CIBEntrySetPointer(rel_path_id, block);
+    if(cib->operation->base_verify == true && CIBBaseSameContent(path, info, file->pointer) == false)
+        return false;
 
-    }else if(*inserted == true && CIBEntryIsDir(entry) == true)
-        HTInsertItem(inserted_entries, strdup(rel_path), intdup(rel_path_id));
- 
-    free(entry); free(dir); free(base_name);
-    return rel_path_id;
+    *pointer = file->pointer;
+    return true;
 }
 
-/*Inserts the given paths inside the .cib file. If any of these entries already exist, their content will be updated.
+/*Extracts the file or link, whose entry holds the given base reference, in the given path.
 
-If compressed == true then the data will be compressed before inserted inside the .cib file.*/
-void CIBInsertEntries(Vector rel_paths, bool compress){
-    HashTable inserted_entries = HTCreate(VectorGetSize(rel_paths) * 2, HashString, (CompFunc) strcmp, free, free);
-    HTInsertItem(inserted_entries, strdup("."), intdup(0));
+Returns true if a process was created in order to unzip the file.*/
+bool CIBExtractFromBase(uint64_t pointer, char *path, bool is_file){
+    int depth; uint64_t base_pointer = DataBaseRefResolve(pointer, &depth);
+    
+    CIBState base = CIBGetBase(depth);
+    if(base == NULL){
+        CIBBaseNotFound(path);
+        return false;
+    }
 
-    struct stat cib_info; fstat(fd, &cib_info);
+    bool zipped = false;
 
-    for(int i = 0; i < VectorGetSize(rel_paths); i++){
-        char *path = VectorGetAt(rel_paths, i);
-        struct stat info;
+    CIBState previous = CIBStateUse(base);
+    if(is_file == true)
+        zipped = DataExtractFile(base_pointer, path, 0644);
+    else
+        DataExtractLink(base_pointer, path);
 
-        //If attempting to inserted the .cib file itself or an entry that does not exist or is not a file/link/directory
-        //then an error message is printed.
-        if(lstat(path, &info) == -1 || !(S_ISDIR(info.st_mode) || S_ISLNK(info.st_mode) || S_ISREG(info.st_mode)) || info.st_ino == cib_info.st_ino){
-            CIBCannotInsertPath(path);    
+    CIBStateUse(previous);
+    return zipped;
+}
+
+//--------------------------------------------
+
+/*Returns true iff a file of the given size, which is to be gzip-ed, is compressed in frames instead. Large files
+are compressed in parallel frames by the in-process deflate, which is gzip's algorithm, at the same level, as a
+single gzip would compress them on one core.*/
+bool CIBGzipInFrames(uint64_t size){
+    return size > CodecGet(CODEC_DEFLATE)->frame_bytes;
+}
+
+/*Returns the total size of the regular files under the given path.*/
+uint64_t CIBPathSize(char *path){
+    struct stat info;
+    if(lstat(path, &info) == -1)
+        return 0;
+
+    if(S_ISREG(info.st_mode))
+        return info.st_size;
+
+    DIR *dir;
+    if(!S_ISDIR(info.st_mode) || (dir = opendir(path)) == NULL)
+        return 0;
+
+    uint64_t size = 0;
+    struct dirent *dir_entry;
+    while((dir_entry = readdir(dir)) != NULL){
+        if(strcmp(dir_entry->d_name, ".") == 0 || strcmp(dir_entry->d_name, "..") == 0)
             continue;
-            
-        }
 
-        bool inserted; EntryId entry_id = CIBRecInsertEntry(path, inserted_entries, compress, &inserted);
+        char entry_path[strlen(path) + strlen(dir_entry->d_name) + 2];
+        snprintf(entry_path, sizeof(entry_path), "%s/%s", path, dir_entry->d_name);
+        size += CIBPathSize(entry_path);
+    }
 
-        if(inserted == true && S_ISDIR(info.st_mode))
-            CIBInsertDirectory(path, entry_id, compress);
+    closedir(dir);
+    return size;
+}
+
+/*Adds the paths of the regular files under path whose size is at most DATA_DICT_MAX_FILE to small, and their
+sizes to *bytes.*/
+void CIBDictionaryCandidates(char *path, Vector small, uint64_t *bytes){
+    struct stat info;
+    if(lstat(path, &info) == -1)
+        return;
+
+    if(S_ISREG(info.st_mode) && info.st_size != 0 && info.st_size <= DATA_DICT_MAX_FILE){
+        VectorInsertLast(small, strdup(path));
+        *bytes += info.st_size;
+        return;
     }
 
-    HTDestroy(inserted_entries);
+    DIR *dir;
+    if(!S_ISDIR(info.st_mode) || (dir = opendir(path)) == NULL)
+        return;
+
+    struct dirent *dir_entry;
+    while((dir_entry = readdir(dir)) != NULL){
+        if(strcmp(dir_entry->d_name, ".") == 0 || strcmp(dir_entry->d_name, "..") == 0)
+            continue;
+
+        char entry_path[strlen(path) + strlen(dir_entry->d_name) + 2];
+        snprintf(entry_path, sizeof(entry_path), "%s/%s", path, dir_entry->d_name);
+        CIBDictionaryCandidates(entry_path, small, bytes);
+    }
+
+    closedir(dir);
     return;
 }
 
-//--------------------------------------------
+/*Trains a dictionary on the small files under the given paths and stores it as the dictionary of the open
+cib file. If there are more than CODEC_DICT_SAMPLE_BYTES bytes of small files, files are picked at even
+intervals, so that the samples are spread over the whole tree. If the files share too little, no dictionary
+is stored.*/
+void CIBTrainDictionary(Vector rel_paths){
+    Vector small = VectorCreate(64, free); uint64_t small_bytes = 0;
+    for(int i = 0; i < VectorGetSize(rel_paths); i++)
+        CIBDictionaryCandidates(VectorGetAt(rel_paths, i), small, &small_bytes);
+
+    uint64_t step = small_bytes / CODEC_DICT_SAMPLE_BYTES + 1, count = 0, size = 0;
+    uint64_t *sizes = malloc(sizeof(uint64_t) * (VectorGetSize(small) / step + 1));
+    char *samples = malloc(CODEC_DICT_SAMPLE_BYTES);
+
+    for(uint64_t i = 0; i < (uint64_t) VectorGetSize(small) && size < CODEC_DICT_SAMPLE_BYTES; i += step){
+        int file_fd;
+        if(OpenFile(VectorGetAt(small, i), &file_fd, O_RDONLY, 0644) == -1)
+            continue;
 
-/*Creates the specified cib file and inserted the paths stored in the vector. If compressed == true
-then the inserted entities will be compressed before inserttion.*/
-void CIBCreate(char *cib_file, Vector paths, bool compress){
-    if(OpenFile(cib_file, &fd, O_CREAT | O_RDWR, 0755) == -1)
+        int read = ReadBytes(samples + size, fmin(DATA_DICT_MAX_FILE, CODEC_DICT_SAMPLE_BYTES - size), file_fd);
+        close(file_fd);
+
+        if(read > 0){
+            sizes[count++] = read;
+            size += read;
+        }
+    }
+
+    char *dict = malloc(CODEC_DICT_SIZE);
+    cib->operation->dictionary_size = CodecTrainDictionary(samples, sizes, count, dict, CODEC_DICT_SIZE);
+    cib->operation->dictionary_samples = count;
+
+    if(cib->operation->dictionary_size != 0)
+        DataSetDictionary(dict, cib->operation->dictionary_size);
+
+    free(dict); free(samples); free(sizes);
+    VectorDestroy(small);
+    return;
+}
+
+/*Feeds the level controller with the files that were inserted since it was last fed, and the time it took.
+gzip_ns is the time that the external program spent on compressing them. The level of the next files is updated.*/
+void CIBControlLevel(uint64_t gzip_ns){
+    if(cib->operation->level_controller == NULL)
         return;
 
-    //The cib file will have as a base directory the current working directory. Thus, we make
-    //every path given as input relative to the current working directory.
-    char *cwd = getcwd(NULL, 0);
-    Vector rel_paths = CreateRelativePath(paths, cwd);
+    DataCompressionStats stats = DataGetCompressionStats();
+    uint64_t now = CodecControllerNow();
 
-    if(VectorGetSize(rel_paths) != 0){
-        //Calculate how many node_blocks, data_blocks and list blocks we need.
-        uint32_t node_blocks_needed; uint64_t data_blocks;
-        uint64_t entries = CalculateSpace(rel_paths, &node_blocks_needed, &data_blocks);
-        
-        uint32_t list_blocks = entries / LIST_ENTRIES_PER_BLOCK + (entries % LIST_ENTRIES_PER_BLOCK > 0);
-        uint64_t md_blocks = 1 + node_blocks_needed + list_blocks; //+1 for the free_list_block.
-        uint64_t header_size = HeadCalculateNeededSpace(cwd);
-        data_blocks += EXTRA_BLOCKS_NEEDED;
+    uint64_t files = (stats->compressed_files + stats->probed_files + stats->expanded_files) - 
+        (cib->operation->control_stats.compressed_files + cib->operation->control_stats.probed_files + cib->operation->control_stats.expanded_files);
+    uint64_t bytes = (stats->compressed_bytes + stats->probed_bytes + stats->expanded_bytes) - 
+        (cib->operation->control_stats.compressed_bytes + cib->operation->control_stats.probed_bytes + cib->operation->control_stats.expanded_bytes);
+
+    cib->operation->insert_level = CodecControllerUpdate(cib->operation->level_controller, files, bytes, stats->compress_ns - cib->operation->control_stats.compress_ns + gzip_ns, now - cib->operation->control_time);
+
+    cib->operation->control_stats = *stats;
+    cib->operation->control_time = now;
+    return;
+}
+
+/*Inserts the data of the file defined by path, which is to be gzip-ed but is compressed in frames instead.*/
+DataBlockId CIBInsertFramed(char *path){
+    DataBlockId block = DataInsertFile(path, CODEC_DEFLATE, cib->operation->insert_level);
+
+    CIBControlLevel(0);
+    return block;
+}
+
+/*Inserts the output of the external program that compressed the file of the given tag and points the file's
+entry to it. If the program failed, the file is inserted as it is.*/
+void CIBFilterDone(void *tag, char *output, uint64_t size, uint64_t elapsed_ns, bool ok){
+    FilterTag file = tag;
+    DataBlockId block;
+
+    if(ok == false){
+        CIBCannotCompress(file->path);
+        block = DataInsertFile(file->path, CODEC_NONE, 0);
+
+    }else
+        block = DataInsertFiltered(file->path, output, size, cib->operation->insert_codec, file->level, cib->operation->insert_filter_name);
+
+    //The entry was given other data while the program ran.
+    if(CIBEntryGetPointer(file->entry_id) != 0)
+        DataDeleteFile(CIBEntryGetPointer(file->entry_id));
+
+    CIBEntrySetPointer(file->entry_id, block);
+    CIBFileStored();
+
+    //The programs run side by side, so each one is charged with its share of the time.
+    CIBControlLevel(elapsed_ns / CodecFilterGetChildren(cib->operation->external_filter));
+
+    free(file);
+    return;
+}
+
+/*Has the external program of the insertion compress the file defined by path. The given entry points to
+nothing until the program ends, when it is pointed to the program's output.*/
+void CIBFilterFile(EntryId entry_id, char *path){
+    FilterTag file = malloc(sizeof(struct filter_tag) + strlen(path) + 1);
+    file->entry_id = entry_id;
+    file->level = cib->operation->insert_level;
+    strcpy(file->path, path);
+
+    char gzip[32]; snprintf(gzip, sizeof(gzip), "gzip -c -%d", cib->operation->insert_level);
+
+    CIBEntrySetPointer(entry_id, 0);
+    CodecFilterRun(cib->operation->external_filter, cib->operation->insert_codec == CODEC_FILTER ? cib->operation->insert_filter : gzip, path, file);
+    return;
+}
+
+/*Inserts the data of the file defined by path. If compress is true and the codec of the insertion is
+in-process, the data are compressed with it.*/
+DataBlockId CIBInsertFileData(char *path, bool compress){
+    if(compress == true && CodecIsInProcess(cib->operation->insert_codec) == true){
+        DataBlockId block = DataInsertFile(path, cib->operation->insert_codec, cib->operation->insert_level);
+
+        CIBControlLevel(0);
+        return block;
+    }
+
+    return DataInsertFile(path, CODEC_NONE, 0);
+}
+
+/*Stores the members of the solid batch in a solid chunk and points their entries to it.*/
+void CIBSolidFlush(){
+    if(cib->operation->solid.count == 0)
+        return;
+
+    DataBlockId block = DataInsertSolid(cib->operation->solid.bytes, cib->operation->solid.sizes, cib->operation->solid.count, cib->operation->solid.refs, cib->operation->insert_codec, cib->operation->insert_level);
+
+    for(uint64_t i = 0; i < cib->operation->solid.count; i++)
+        if(*(uint64_t *) HNGetItem(HTFindKey(cib->operation->solid.members, &cib->operation->solid.entries[i])) == i)
+            CIBEntrySetPointer(cib->operation->solid.entries[i], DataMemberPointer(block, i));
+    CIBFileStored();
+
+    HTDestroy(cib->operation->solid.members);
+    cib->operation->solid.members = NULL;
+    cib->operation->solid.size = cib->operation->solid.count = cib->operation->solid.refs = 0;
+
+    if(cib->operation->completed_dir != NULL)
+        CIBSetCheckpointCursor(cib->operation->completed_dir);
+
+    CIBControlLevel(0);
+    return;
+}
+
+/*Adds the file defined by path to the solid batch as a member for the given entry, if it is small enough.
+The batch is stored when it is full. Returns false if the file was not added.*/
+bool CIBSolidAdd(EntryId entry_id, char *path){
+    int file_fd; struct stat info;
+    if(lstat(path, &info) == -1 || info.st_size > DATA_SOLID_MAX_FILE || OpenFile(path, &file_fd, O_RDONLY, 0644) == -1)
+        return false;
+
+    if(cib->operation->solid.members == NULL){
+        cib->operation->solid.members = HTCreate(1024, HashUint64, CompareUint64, free, free);
+        cib->operation->solid.entries = realloc(cib->operation->solid.entries, DATA_SOLID_MAX_MEMBERS * sizeof(EntryId));
+        cib->operation->solid.sizes = realloc(cib->operation->solid.sizes, DATA_SOLID_MAX_MEMBERS * sizeof(uint64_t));
+    }
+
+    if(cib->operation->solid.size + info.st_size > cib->operation->solid.capacity){
+        cib->operation->solid.capacity = cib->operation->solid.size + info.st_size > 2 * cib->operation->solid.capacity ? cib->operation->solid.size + info.st_size : 2 * cib->operation->solid.capacity;
+        cib->operation->solid.bytes = realloc(cib->operation->solid.bytes, cib->operation->solid.capacity);
+    }
+
+    ssize_t bytes = pread(file_fd, cib->operation->solid.bytes + cib->operation->solid.size, info.st_size, 0);
+    close(file_fd);
+
+    cib->operation->solid.entries[cib->operation->solid.count] = entry_id;
+    cib->operation->solid.sizes[cib->operation->solid.count] = bytes > 0 ? bytes : 0;
+    cib->operation->solid.size += cib->operation->solid.sizes[cib->operation->solid.count];
+
+    HashNode node = HTFindKey(cib->operation->solid.members, &entry_id);
+    if(node == NULL){
+        HTInsertItem(cib->operation->solid.members, intdup(entry_id), intdup(cib->operation->solid.count));
+        cib->operation->solid.refs++;
+
+    }else
+        *(uint64_t *) HNGetItem(node) = cib->operation->solid.count;
+
+    if(++cib->operation->solid.count == DATA_SOLID_MAX_MEMBERS || cib->operation->solid.size >= DATA_SOLID_MAX_BYTES)
+        CIBSolidFlush();
+
+    return true;
+}
+
+/*Stores the data of the file defined by path and points the given entry to them. If compress is true and
+--solid was given, small files are added to the solid batch instead; their entries point to nothing until
+the batch is stored. So do the entries of the files that an external program compresses, until it ends.*/
+void CIBSetFileData(EntryId entry_id, char *path, bool compress){
+    if(compress == true && cib->operation->insert_solid == true && CIBSolidAdd(entry_id, path) == true){
+        CIBEntrySetPointer(entry_id, 0);
+        return;
+    }
+
+    if(compress == true && CodecIsExternal(cib->operation->insert_codec) == true){
+        if(DataProbeFile(path) == false)
+            CIBEntrySetPointer(entry_id, DataInsertRawFile(path, DATA_RAW_PROBED));
+
+        else if(cib->operation->insert_codec == CODEC_GZIP && CIBGzipInFrames(CIBPathSize(path)) == true)
+            CIBEntrySetPointer(entry_id, CIBInsertFramed(path));
+
+        else
+            CIBFilterFile(entry_id, path);
+
+        CIBFileStored();
+        return;
+    }
+
+    CIBEntrySetPointer(entry_id, CIBInsertFileData(path, compress));
+    CIBFileStored();
+    return;
+}
+
+/*Makes the data that are inserted next be stored near the last chunk of the files and links of the given
+directory. If the directory holds no data, the placement hint is not changed.*/
+void CIBSetPlacementHint(EntryId dir_id){
+    List entries = MDGetDirEntries(dir_id);
+    DataBlockId last = 0;
+
+    for(LNode node = ListGetFirstNode(entries); node != NULL; node = LNodeGetNext(node)){
+        EntryId entry_id = INPairGetId(LNodeGetItem(node));
+        uint64_t pointer = CIBEntryGetPointer(entry_id);
+
+        if(CIBEntryIsDir(GetEntryAddress(entry_id)) == false && DataIsBaseRef(pointer) == false && DataGetChunk(pointer) > last)
+            last = DataGetChunk(pointer);
+    }
+
+    if(last != 0)
+        DataSetPlacementHint(last);
+
+    ListDestroy(entries);
+    return;
+}
+
+/*Returns true iff the entity with the given stat info must not be inserted in the open cib file, whose stat info
+is cib_info: it is the open cib file itself or the cib file that the open one will be committed to.*/
+bool CIBIsSkipped(struct stat *info, struct stat *cib_info){
+    return info->st_ino == cib_info->st_ino || (cib->operation->staged_target != 0 && info->st_ino == cib->operation->staged_target);
+}
+
+/*Returns true iff --resume was given and the entry with the given name in the given directory already holds the file
+or link with the given stat info, unchanged, so that it is not inserted again. The entry of a file whose data were
+still being compressed when an insertion was interrupted points to nothing, and is inserted again.*/
+bool CIBIsStored(EntryId dir_id, char *name, struct stat *info){
+    if(cib->operation->insert_resume == false || S_ISDIR(info->st_mode))
+        return false;
+
+    bool found; EntryId entry_id = MDGetPath(name, dir_id, &found);
+
+    return found == true && CIBEntryGetMode(entry_id) == info->st_mode && CIBEntryGetModified(entry_id) == (uint32_t) info->st_mtime &&
+        (CIBEntryGetPointer(entry_id) != 0 || info->st_size == 0);
+}
+
+/*Marks that every entry under the directory defined by path has been inserted. Once the files of the directory, and
+of the entries inserted before it, are stored, the directory becomes the cursor of the insertion's checkpoints. The
+files that an external program compresses are stored in any order, so then the insertion keeps no cursor.*/
+void CIBDirectoryDone(char *path){
+    if(cib->operation->insert_checkpoint == 0 || cib->operation->external_filter != NULL)
+        return;
+
+    while(strncmp(path, "./", 2) == 0)
+        path += 2;
+
+    free(cib->operation->completed_dir);
+    cib->operation->completed_dir = strdup(path);
+
+    if(cib->operation->solid.count == 0)
+        CIBSetCheckpointCursor(cib->operation->completed_dir);
+
+    return;
+}
+
+/*Inserts all the entities under the directory that corresponds to the given point. The directory
+must be inserted before calling this function and its EntryId has to be passed as a parameter.
+
+The entries are inserted in the order of their names, so that the directory cursor of the insertion's checkpoints
+tells which ones a resumed insertion does not have to read again. If user wants its content compressed then the
+given flag should be set to true.*/
+void CIBInsertDirectory(char *path, EntryId dir_id, bool compress){
+    //A resumed insertion stored the whole directory.
+    if(CIBResumeSkips(path, NULL) == true)
+        return;
+
+    //Obtain the stat info about our cib file. We don't want to include it inside itself.
+    struct stat cib_info; fstat(cib->fd, &cib_info);
+    
+    //Siblings are stored next to each other, after the data the directory already holds.
+    CIBSetPlacementHint(dir_id);
+
+    Vector names = VectorCreate(64, free);
+    DIR *dir = opendir(path);
+
+    struct dirent *dir_entry;
+    while(dir != NULL && (dir_entry = readdir(dir)) != NULL)
+        if(strcmp(dir_entry->d_name, ".") != 0 && strcmp(dir_entry->d_name, "..") != 0 && CIBResumeSkips(path, dir_entry->d_name) == false)
+            VectorInsertLast(names, strdup(dir_entry->d_name));
+
+    if(dir != NULL)
+        closedir(dir);
+
+    //VectorSort() places the greatest name first, so the names are visited from the last one.
+    VectorSort(names, (CompFunc) strcmp);
+
+    //Go through directory entries.
+    uint64_t pointer;
+    for(int i = VectorGetSize(names) - 1; i >= 0; i--){
+        char *name = VectorGetAt(names, i);
+
+        //Create the path of the current entry.
+        char entry_path[strlen(path) + strlen(name) + 2];
+        snprintf(entry_path, sizeof(entry_path), "%s/%s", path, name);
+        //Obtain stat info about the current entry.
+        struct stat info; lstat(entry_path, &info);
+
+        //If current entry is the open cib file we skip the loop.
+        if(CIBIsSkipped(&info, &cib_info))
+            continue;
+
+        if(!(S_ISDIR(info.st_mode) || S_ISLNK(info.st_mode) || S_ISREG(info.st_mode))){
+            CIBCannotInsertPath(entry_path);
+
+        //A file or link that an interrupted insertion already stored is skipped.
+        }else if(CIBIsStored(dir_id, name, &info) == true){
+            continue;
+
+        //If entry is a directory then after inserting it inside the cib file its content is inserted
+        //too by calling this function again.
+        }else if(S_ISDIR(info.st_mode)){
+            CIBEntry entry = CIBEntryCreate(NULL, entry_path); bool inserted; 
+            EntryId entry_id = MDUpdatePath(entry, name, dir_id, &inserted); free(entry);
+
+            if(inserted == true)
+                CIBInsertDirectory(entry_path, entry_id, compress);
+
+        //If the entry is unchanged since the base archive was created, it refers to the base's data.
+        }else if((S_ISREG(info.st_mode) || S_ISLNK(info.st_mode)) && CIBBaseLookup(entry_path, &info, &pointer) == true){
+            CIBEntry entry = CIBEntryCreate(NULL, entry_path); bool inserted;
+            EntryId entry_id = MDUpdatePath(entry, name, dir_id, &inserted); free(entry);
+
+            if(inserted == true){
+                if(CIBEntryGetPointer(entry_id) != 0)
+                    DataDeleteFile(CIBEntryGetPointer(entry_id));
+
+                CIBEntrySetPointer(entry_id, pointer);
+            }
+
+        //Otherwise the entry is inserted, its data compressed if the user asked for it.
+        }else{
+            CIBEntry entry = CIBEntryCreate(NULL, entry_path); bool inserted;
+            EntryId entry_id = MDUpdatePath(entry, name, dir_id, &inserted);
+
+            if(inserted == true && CIBEntryIsDir(entry) == true)
+                CIBInsertDirectory(entry_path, entry_id, compress);
+
+            else if(inserted == true){
+                //Pointer is not zero iff an entry with that path already existed. In this case we replace its content.
+                if(CIBEntryGetPointer(entry_id) != 0)
+                    DataDeleteFile(CIBEntryGetPointer(entry_id));
+
+                if(CIBEntryIsFile(entry) == false)
+                    CIBEntrySetPointer(entry_id, DataInsertLink(entry_path));
+                else
+                    CIBSetFileData(entry_id, entry_path, compress);
+            }
+
+            free(entry);
+        }
+    }
+
+    VectorDestroy(names);
+    CIBDirectoryDone(path);
+    return;
+}
+
+/*Inserts each "component" of the given path. For example if this function is called with path
+"base_dir/dirA/dirB/file1.txt", where base_dir is the base directory of the cib file, then function
+will insert dirA, dirA/dirB, dirA/dirB/dirC.
+
+For each entry inserted with this function its entry id is saved in the hash table for future reference.*/
+EntryId CIBRecInsertEntry(char *rel_path, HashTable inserted_entries, bool compress, bool *inserted){
+    HashNode node;
+    *inserted = true;
+
+    if((node = HTFindKey(inserted_entries, rel_path)) != NULL)
+        return *((EntryId *) HNGetItem(node));
+    
+    char copy[strlen(rel_path) + 1]; strcpy(copy, rel_path);
+    char *dir = strdup(dirname(copy)); strcpy(copy, rel_path);
+
+    char *base_name = strdup(basename(copy));
+    
+    EntryId parent_id = CIBRecInsertEntry(dir, inserted_entries, compress, inserted);
+
+    if(*inserted == false){
+        free(dir); free(base_name);
+        
+        return 0;
+    }
+
+    //A file or link that an interrupted insertion already stored is skipped.
+    struct stat info; uint64_t pointer;
+    if(lstat(rel_path, &info) == 0 && CIBIsStored(parent_id, base_name, &info) == true){
+        free(dir); free(base_name);
+
+        *inserted = false;
+        return 0;
+    }
+
+    CIBEntry entry = CIBEntryCreate(NULL, rel_path);
+    if(CIBEntryIsDir(entry) == false)
+        CIBSetPlacementHint(parent_id);
+
+    EntryId rel_path_id = MDUpdatePath(entry, base_name, parent_id, inserted);
+
+    if(*inserted == true && CIBEntryIsDir(entry) == false && lstat(rel_path, &info) == 0 && CIBBaseLookup(rel_path, &info, &pointer) == true){
+        if(CIBEntryGetPointer(rel_path_id) != 0)
+            DataDeleteFile(CIBEntryGetPointer(rel_path_id));
+
+        CIBEntrySetPointer(rel_path_id, pointer);
+
+    }else if(*inserted == true && CIBEntryIsDir(entry) == false){
+        if(CIBEntryGetPointer(rel_path_id) != 0)
+            DataDeleteFile(CIBEntryGetPointer(rel_path_id));
+
+        if(CIBEntryIsFile(entry) == true)
+            CIBSetFileData(rel_path_id, rel_path, compress);
+        else
+            CIBEntrySetPointer(rel_path_id, DataInsertLink(rel_path));
+
+    }else if(*inserted == true && CIBEntryIsDir(entry) == true)
+        HTInsertItem(inserted_entries, strdup(rel_path), intdup(rel_path_id));
+ 
+    free(entry); free(dir); free(base_name);
+    return rel_path_id;
+}
+
+/*Inserts the given paths inside the .cib file. If any of these entries already exist, their content will be updated.
+
+If compressed == true then the data will be compressed before inserted inside the .cib file.*/
+void CIBInsertEntries(Vector rel_paths, bool compress){
+    HashTable inserted_entries = HTCreate(VectorGetSize(rel_paths) * 2, HashString, (CompFunc) strcmp, free, free);
+    HTInsertItem(inserted_entries, strdup("."), intdup(0));
+
+    struct stat cib_info; fstat(cib->fd, &cib_info);
+
+    for(int i = 0; i < VectorGetSize(rel_paths); i++){
+        char *path = VectorGetAt(rel_paths, i);
+        struct stat info;
+
+        //If attempting to inserted the .cib file itself or an entry that does not exist or is not a file/link/directory
+        //then an error message is printed.
+        if(lstat(path, &info) == -1 || !(S_ISDIR(info.st_mode) || S_ISLNK(info.st_mode) || S_ISREG(info.st_mode)) || CIBIsSkipped(&info, &cib_info)){
+            CIBCannotInsertPath(path);    
+            continue;
+            
+        }
+
+        bool inserted; EntryId entry_id = CIBRecInsertEntry(path, inserted_entries, compress, &inserted);
+
+        if(inserted == true && S_ISDIR(info.st_mode))
+            CIBInsertDirectory(path, entry_id, compress);
+    }
+
+    //The files that external programs still compress are inserted as soon as each program ends.
+    if(cib->operation->external_filter != NULL)
+        CodecFilterWait(cib->operation->external_filter);
+
+    HTDestroy(inserted_entries);
+    return;
+}
+
+//--------------------------------------------
+
+/*Returns a list with the names of the entries of the given directory that can be inserted in the
+open cib file. The cib file itself is skipped.*/
+List CIBReadDirectory(char *path, struct stat *cib_info){
+    List names = ListCreate(free);
+
+    DIR *dir = opendir(path);
+    if(dir == NULL)
+        return names;
+
+    struct dirent *dir_entry;
+    while((dir_entry = readdir(dir)) != NULL){
+        char entry_path[strlen(path) + strlen(dir_entry->d_name) + 2];
+        snprintf(entry_path, sizeof(entry_path), "%s/%s", path, dir_entry->d_name);
+
+        struct stat info;
+        if(strcmp(dir_entry->d_name, ".") == 0 || strcmp(dir_entry->d_name, "..") == 0 || lstat(entry_path, &info) == -1 || CIBIsSkipped(&info, cib_info))
+            continue;
+
+        if(!(S_ISDIR(info.st_mode) || S_ISLNK(info.st_mode) || S_ISREG(info.st_mode)))
+            CIBCannotInsertPath(entry_path);
+        else
+            ListInsertLast(names, strdup(dir_entry->d_name));
+    }
+
+    closedir(dir);
+    return names;
+}
+
+/*Inserts the given paths in a newly initialized cib file, loading the metadata in bulk. Directories are
+read once, breadth-first, and the entries of each one are inserted together. A directory whose path is
+given is inserted with its whole content; a directory that only leads to given paths contains just the
+entries that lead to them. Used instead of CIBInsertEntries() unless the data are compressed by an external program.*/
+void CIBBulkInsertEntries(Vector rel_paths, bool compress){
+    struct stat cib_info; fstat(cib->fd, &cib_info);
+
+    //The given paths and, for every directory that leads to a given path, the names of its entries that do so.
+    HashTable given = HTCreate(VectorGetSize(rel_paths) + 1, HashString, (CompFunc) strcmp, free, NULL);
+    HashTable partial = HTCreate(VectorGetSize(rel_paths) * 2 + 1, HashString, (CompFunc) strcmp, free, (DestroyFunc) ListDestroy);
+
+    for(int i = 0; i < VectorGetSize(rel_paths); i++){
+        char *path = VectorGetAt(rel_paths, i);
+        struct stat info;
+
+        if(lstat(path, &info) == -1 || !(S_ISDIR(info.st_mode) || S_ISLNK(info.st_mode) || S_ISREG(info.st_mode)) || CIBIsSkipped(&info, &cib_info)){
+            CIBCannotInsertPath(path);
+            continue;
+        }
+
+        if(HTFindKey(given, path) != NULL)
+            continue;
+        HTInsertItem(given, strdup(path), NULL);
+
+        //Register every component of the path under its parent directory.
+        char *child = strdup(path);
+        while(strcmp(child, ".") != 0){
+            char copy[strlen(child) + 1]; strcpy(copy, child);
+            char *parent = strdup(dirname(copy)); strcpy(copy, child);
+            char *name = basename(copy);
+
+            HashNode node = HTFindKey(partial, parent);
+            if(node == NULL){
+                HTInsertItem(partial, strdup(parent), ListCreate(free));
+                node = HTFindKey(partial, parent);
+            }
+
+            if(ListFindItem(HNGetItem(node), name, (CompFunc) strcmp) == NULL)
+                ListInsertLast(HNGetItem(node), strdup(name));
+
+            free(child);
+            child = parent;
+        }
+
+        free(child);
+    }
+
+    List queue = ListCreate(NULL);
+    PendingDir root = malloc(sizeof(struct pending_dir));
+    *root = (struct pending_dir) {strdup("."), 0, 0, HTFindKey(given, ".") != NULL};
+    ListInsertLast(queue, root);
+
+    MDBulkBegin();
+
+    while(ListGetSize(queue) != 0){
+        PendingDir dir = LNodeGetItem(ListGetFirstNode(queue));
+        ListRemoveNode(queue, ListGetFirstNode(queue));
+
+        HashNode node = dir->whole == true ? NULL : HTFindKey(partial, dir->path);
+        List names = dir->whole == true ? CIBReadDirectory(dir->path, &cib_info) : node != NULL ? HNGetItem(node) : NULL;
+
+        MDBulkOpenDir(dir->entry_id, dir->parent_id, names != NULL ? ListGetSize(names) : 0);
+
+        for(LNode lnode = names != NULL ? ListGetFirstNode(names) : NULL; lnode != NULL; lnode = LNodeGetNext(lnode)){
+            char *name = LNodeGetItem(lnode);
+
+            char entry_path[strlen(dir->path) + strlen(name) + 2];
+            snprintf(entry_path, sizeof(entry_path), "%s/%s", dir->path, name);
+            char *rel_path = strcmp(dir->path, ".") == 0 ? name : entry_path;
+
+            //A directory that leads to given paths must be a directory indeed.
+            struct stat info; uint64_t pointer;
+            if(lstat(rel_path, &info) == -1 || (dir->whole == false && S_ISDIR(info.st_mode) == false && HTFindKey(given, rel_path) == NULL)){
+                CIBCannotInsertPath(rel_path);
+                continue;
+            }
+
+            CIBEntry entry = CIBEntryCreate(NULL, rel_path);
+            EntryId entry_id = MDBulkInsertEntry(entry, name);
+
+            if(S_ISDIR(info.st_mode)){
+                PendingDir child = malloc(sizeof(struct pending_dir));
+                *child = (struct pending_dir) {strdup(rel_path), entry_id, dir->entry_id, dir->whole == true || HTFindKey(given, rel_path) != NULL};
+
+                ListInsertLast(queue, child);
+
+            //If the entry is unchanged since the base archive was created, it refers to the base's data.
+            }else if(CIBBaseLookup(rel_path, &info, &pointer) == true){
+                CIBEntrySetPointer(entry_id, pointer);
+
+            }else if(S_ISREG(info.st_mode))
+                CIBSetFileData(entry_id, rel_path, compress);
+
+            else
+                CIBEntrySetPointer(entry_id, DataInsertLink(rel_path));
+
+            free(entry);
+        }
+
+        if(dir->whole == true)
+            ListDestroy(names);
+
+        free(dir->path); free(dir);
+    }
+
+    MDBulkEnd();
+
+    ListDestroy(queue);
+    HTDestroy(given); HTDestroy(partial);
+    return;
+}
+
+/*Creates the specified cib file, with the current working directory as its base directory, and inserts the paths
+stored in the vector. If paths is NULL, the cib file holds only the root. If compressed == true then the inserted
+entities will be compressed before inserttion.
+
+Until the paths are inserted, the metadata of the cib file are not consistent, so the cib file is marked unfinished.*/
+void CIBCreateTree(char *cib_file, Vector paths, bool compress, char *base_file, bool log_structured){
+    //Readers of a cib file that is being replaced must be done with it first.
+    if(OpenNewCIB(cib_file) == -1)
+        return;
+
+    //The cib file will have as a base directory the current working directory. Thus, we make
+    //every path given as input relative to the current working directory.
+    char *cwd = getcwd(NULL, 0);
+    Vector rel_paths = paths != NULL ? CreateRelativePath(paths, cwd) : NULL;
+
+    if(rel_paths == NULL || VectorGetSize(rel_paths) != 0){
+        //Calculate how many node_blocks, data_blocks and list blocks we need. Without paths, only the root's.
+        uint32_t node_blocks_needed = 1; uint64_t data_blocks = 0, entries = 1;
+        if(rel_paths != NULL)
+            entries = CalculateSpace(rel_paths, &node_blocks_needed, &data_blocks);
+        
+        uint32_t list_blocks = entries / LIST_ENTRIES_PER_BLOCK + (entries % LIST_ENTRIES_PER_BLOCK > 0);
+        uint64_t md_blocks = 1 + node_blocks_needed + list_blocks; //+1 for the free_list_block.
+        uint64_t header_size = HeadCalculateNeededSpace(cwd);
+        data_blocks += EXTRA_BLOCKS_NEEDED;
+
+        //The record of the base archive, relative to the new cib file, which is open so that its path can be found.
+        uint64_t record_size = 0;
+        char *base_path = base_file != NULL ? RealPath(base_file) : NULL;
+        void *record = base_path != NULL ? CIBBaseRecordCreate(base_path, cib_file, &cib->operation->base_identity, &record_size) : NULL;
+        if(record != NULL)
+            data_blocks += DataCaclulateNeededBlocks(record_size) + 1;
+
+        if(cib->operation->insert_dictionary == true && rel_paths != NULL)
+            data_blocks += DataCaclulateNeededBlocks(CODEC_DICT_SIZE) + 1;
+
+        //Adjust the file size
+        TruncMapAndUpdate(header_size, md_blocks * MD_BLOCK_SIZE, data_blocks << DATA_BLOCK_SHIFT, false);
+        
+        //Initialize each "partition"
+        HeadInit(cwd);
+        HeadSetLogStructured(log_structured);
+        HeadSetUnfinished(rel_paths != NULL);
+        DataInit(data_blocks);
+        MDInit(list_blocks, node_blocks_needed);    
+
+        //Save the record of the base archive, so that its data can be found when extracting.
+        if(record != NULL)
+            HeadSetBaseArchive(DataInsertBytes(record, record_size, CODEC_NONE, 0));
+
+        free(base_path); free(record);
+
+        //The dictionary is stored before the files that are compressed with it. A staging cib file stores the
+        //dictionary of the cib file that it will be committed to.
+        if(cib->operation->insert_dictionary == true && cib->operation->staged_dictionary != NULL && rel_paths != NULL){
+            DataSetDictionary(cib->operation->staged_dictionary, cib->operation->staged_dictionary_size);
+            cib->operation->dictionary_size = cib->operation->staged_dictionary_size;
+            cib->operation->dictionary_samples = 0;
+
+        }else if(cib->operation->insert_dictionary == true && rel_paths != NULL)
+            CIBTrainDictionary(rel_paths);
+
+        //Insert the entries. Unless an external program compresses the data, the metadata are loaded in bulk.
+        if(rel_paths != NULL && (compress == false || CodecIsExternal(cib->operation->insert_codec) == false))
+            CIBBulkInsertEntries(rel_paths, compress);
+        else if(rel_paths != NULL)
+            CIBInsertEntries(rel_paths, compress);
+        CIBSolidFlush();
+        HeadSetUnfinished(false);
+
+        //Remove, if exist, the unoccupied blocks that make up the last chunk of data size.
+        DataRemoveLastChunk();
+        CloseExistingCIB();
+
+    }else
+        close(cib->fd);
+
+    if(rel_paths != NULL)
+        VectorDestroy(rel_paths);
+
+    free(cwd);
+    return;
+}
+
+/*Appends to the existing cib file the paths stored in the given vector. If any inserted entity is already
+inserted inside the .cib file then its content is updated.*/
+void CIBAppend(char *cib_file, Vector paths, bool compress){
+    if(OpenExistingCIB(cib_file) == -1)
+        return;
+
+    if(chdir(HeadGetBaseDir()) == -1){
+        perror("chdir:");
+        return;
+
+    }
+
+    //We make every path relative to the base directory of the .cib file.
+    Vector rel_paths = CreateRelativePath(paths, HeadGetBaseDir());
+    
+    if(VectorGetSize(rel_paths) != 0){
+        //A resumed insertion goes on from the directory cursor of its last checkpoint; any other insertion removes
+        //the cursor that an interrupted one left.
+        if(cib->operation->insert_checkpoint != 0 && cib->operation->insert_resume == true)
+            CIBResumeBegin();
+        else
+            CIBSetCheckpointCursor(NULL);
+
+        //Calculate the needed blocks. We care about the data blocks that are generally more
+        //than the metadata block that we will need.
+        uint32_t node_blocks_needed; uint64_t data_blocks;
+        CalculateSpace(rel_paths, &node_blocks_needed, &data_blocks);
+
+        //An archive that has a dictionary keeps it; otherwise one is trained on the appended files.
+        bool train = cib->operation->insert_dictionary == true && HeadGetDictionary() == 0;
+        if(train == true)
+            data_blocks += DataCaclulateNeededBlocks(CODEC_DICT_SIZE) + 1;
+
+        //Adjust the file size.
+        TruncMapAndUpdate(HeadGetHeaderSize(), HeadGetMDSize(), HeadGetDataSize() + (data_blocks << DATA_BLOCK_SHIFT), true);
+        
+        //Move the md partition so that the new space is accessible to the data "partition".
+        memmove(cib->md, (char *) cib->md - (data_blocks << DATA_BLOCK_SHIFT), HeadGetMDSize());
+        DataInsertFreeBlocks(data_blocks);
+
+        //Update the root entry.
+        CIBEntry root = CIBEntryCreate(NULL, "."); bool updated;
+        MDUpdatePath(root, ".", 0, &updated); free(root);
+
+        if(train == true)
+            CIBTrainDictionary(rel_paths);
+        else if(cib->operation->insert_dictionary == true){
+            DataGetBytes(HeadGetDictionary(), &cib->operation->dictionary_size);
+            cib->operation->dictionary_samples = 0;
+        }
+
+        CIBInsertEntries(rel_paths, compress);
+        CIBSolidFlush();
+
+        //The insertion ended, so it has no cursor to resume from.
+        free(cib->operation->completed_dir); cib->operation->completed_dir = NULL;
+        CIBSetCheckpointCursor(NULL);
+        CIBResumeEnd();
+
+        DataRemoveLastChunk();
+        CloseExistingCIB();
+
+    }else
+        close(cib->fd);
+
+    VectorDestroy(rel_paths);
+    return;
+}
+
+/*Checks whether the creation of the cib file defined by path, in the current working directory, can be resumed.
+Returns 1 if it can. Returns 0 if the creation starts over, since the cib file does not exist or its creation was
+interrupted before its first commit. Returns -1 if the cib file is an archive of another base directory, base archive
+or layout, which is not replaced. The index of the base archive, if any, must have been created.*/
+int CIBResumeCheck(char *cib_file, char *base_file, bool log_structured){
+    char *cwd = getcwd(NULL, 0);
+    struct stat info;
+
+    if(stat(cib_file, &info) == -1 || (uint64_t) info.st_size < HeadCalculateNeededSpace(cwd) || OpenExistingCIBReadOnly(cib_file) == -1){
+        free(cwd);
+        return 0;
+    }
+
+    fstat(cib->fd, &info);
+    int res = 0;
+
+    //The cib file may have grown after its last commit.
+    if(HeadGetFileSize() <= (uint64_t) info.st_size && HeadIsUnfinished() == false && CIBEntryIsDir(GetEntryAddress(0)) == true){
+        //The base archive must be the one, with the same data, that the cib file was created from.
+        char *base_path = base_file != NULL ? RealPath(base_file) : NULL, *stored = NULL, *archive = CIBGetPath();
+        struct base_record identity; uint64_t stored_size = 0;
+
+        if(HeadGetBaseArchive() != 0 && archive != NULL){
+            void *record = DataGetBytes(HeadGetBaseArchive(), &stored_size);
+            stored = CIBBaseRecordPath(record, stored_size, archive, &identity, false);
+        }
+
+        bool same_base = base_path == NULL ? HeadGetBaseArchive() == 0 : stored != NULL && strcmp(stored, base_path) == 0 &&
+            memcmp(&identity, &cib->operation->base_identity, sizeof(identity)) == 0;
+        if(strcmp(HeadGetBaseDir(), cwd) == 0 && same_base == true && HeadIsLogStructured() == log_structured)
+            res = 1;
+        else{
+            CIBCannotResume(cib_file);
+            res = -1;
+        }
+
+        free(base_path); free(stored); free(archive);
+    }
+
+    CloseExistingCIB();
+    free(cwd);
+    return res;
+}
+
+/*Creates the specified cib file and inserted the paths stored in the vector. If compressed == true
+then the inserted entities will be compressed before inserttion.
+
+If base_file is not NULL, the cib file is created as a differential archive of base_file: files that are
+unchanged since base_file was created are not stored, their entries refer to the data of base_file.
+
+If log_structured is true, the data of the cib file are only ever appended to its log; see CIBClean().
+
+If the insertion takes checkpoints, the cib file is first created with only the root and the paths are appended to
+it, so that the files inserted before each checkpoint are committed. With --resume, a cib file that such a creation
+left behind is appended to instead, and the files that it already holds are skipped.*/
+void CIBCreate(char *cib_file, Vector paths, bool compress, char *base_file, bool log_structured){
+    struct stat base_info, cib_info;
+    if(base_file != NULL && stat(base_file, &base_info) == 0 && stat(cib_file, &cib_info) == 0 && base_info.st_ino == cib_info.st_ino){
+        CIBInvalidBase(base_file);
+        return;
+    }
+
+    //The index of the base's files is created before the new cib file is opened.
+    if(base_file != NULL && (cib->operation->base_files = CIBBaseIndexCreate(base_file, &cib->operation->base_identity)) == NULL)
+        return;
+
+    int resume = cib->operation->insert_checkpoint != 0 && cib->operation->insert_resume == true ? CIBResumeCheck(cib_file, base_file, log_structured) : 0;
+    if(resume == -1){
+        if(cib->operation->base_files != NULL) HTDestroy(cib->operation->base_files);
+        cib->operation->base_files = NULL;
+        return;
+    }
+
+    if(cib->operation->insert_checkpoint != 0){
+        if(resume == 0)
+            CIBCreateTree(cib_file, NULL, false, base_file, log_structured);
+
+        CIBAppend(cib_file, paths, compress);
+
+    }else
+        CIBCreateTree(cib_file, paths, compress, base_file, log_structured);
+
+    if(cib->operation->base_files != NULL){
+        HTDestroy(cib->operation->base_files);
+        cib->operation->base_files = NULL;
+    }
+
+    //--verify opened the base archive to compare the files with.
+    CIBCloseBases();
+    return;
+}
+
+/*If current_id represents a directory inside .cib file the function calls itself.
+If current_id represents a file/link the function extracts it.
+
+The destination of the extracted entities depends on rel_path.
+
+Returns the number of forks() that were made.*/
+int CIBExtractRec(char *rel_path, EntryId current_id){
+
+    if(CIBEntryIsDir(GetEntryAddress(current_id)) == true){
+        if(CreateDir(rel_path) == -1)
+            return -1;
+
+        List entries = MDGetDirEntries(current_id);
+        uint64_t count = 0;
+
+        for(LNode node = ListGetFirstNode(entries); node != NULL; node = LNodeGetNext(node)){
+            INPair pair = LNodeGetItem(node);
+
+            char *entry_name = INPairGetName(pair);
+            EntryId entry_id = INPairGetId(pair);
+
+            char entry_path[strlen(rel_path) + strlen(entry_name) + 2];
+            snprintf(entry_path, sizeof(entry_path), "%s/%s", rel_path, entry_name);
+
+            count += CIBExtractRec(entry_path, entry_id);
+        }
+
+        ListDestroy(entries);
+        for(uint64_t i = 0; i < count; i++)
+            wait(NULL);
+        
+    }else{
+        DataBlockId block = CIBEntryGetPointer(current_id);
+        CIBTraceAccess(rel_path);
+
+        //Data of unchanged files of differential archives are stored in the chain of base archives.
+        if(DataIsBaseRef(block) == true)
+            return CIBExtractFromBase(block, rel_path, CIBEntryIsFile(GetEntryAddress(current_id))) == true;
+
+        if(CIBEntryIsFile(GetEntryAddress(current_id)) == true)
+            return DataExtractFile(block, rel_path, 0644) == true;
+
+        else
+            DataExtractLink(block, rel_path);
+    }
+
+    return 0;
+}
+
+/*Obtains the root of the tree that the operation refers to. If snapshot is NULL, the root is the entry 0.
+Otherwise, it is the root of the snapshot with the given name.
+
+Returns false, after printing an error message, if the snapshot does not exist.*/
+bool CIBGetRoot(char *cib_file, char *snapshot, EntryId *root){
+    bool found = true;
+    *root = snapshot == NULL ? 0 : MDGetSnapshot(snapshot, &found);
+    
+    if(found == false)
+        CIBSnapshotNotFound(snapshot, cib_file);
+
+    return found;
+}
+
+/*Extractes the givern paths from the cib_file. Keep in mind that the extracted entities are not deleted
+from the cib file and they are still accessible.
+
+If snapshot is not NULL the paths are extracted from the snapshot with that name. If traced is true the
+extracted files and links are recorded in the access trace of the cib file.*/
+void CIBExtract(char *cib_file, Vector paths, char *snapshot, bool traced){
+    if(OpenExistingCIBReadOnly(cib_file) == -1)
+        return;
+
+    EntryId root;
+    if(CIBGetRoot(cib_file, snapshot, &root) == false){
+        CloseExistingCIB();
+        return;
+    }
+
+    if(traced == true)
+        CIBTraceBegin();
+
+    //Number of wait()s that we have to perform in order to collect zombies.
+    int waits = 0;
+
+    if(VectorGetSize(paths) == 0)
+        waits += CIBExtractRec(".", root);
+
+    else{
+        for(int i = 0; i < VectorGetSize(paths); i++){
+            char *path = VectorGetAt(paths, i);
+
+            bool found; EntryId entry_id = MDGetPath(path, root, &found);
+
+            if(found == true){
+                char *copy = strdup(path);
+                if(CreateDirRec(dirname(copy)) == -1) continue;
+
+                waits += CIBExtractRec(path, entry_id);
+                free(copy);
+
+            }else
+                CIBPathNotFound(path, cib_file);
+        }
+
+    }
+
+    for(int i = 0; i < waits; i++)
+        wait(NULL);
+
+    if(traced == true)
+        CIBTraceEnd(cib_file);
+
+    CIBCloseBases();
+    CloseExistingCIB();
+    return;
+}
+
+/*Deletes the paths stored in the given vector from the .cib file.*/
+void CIBDelete(char *cib_file, Vector paths){
+    if(OpenExistingCIB(cib_file) == -1)
+        return;
+
+    if(chdir(HeadGetBaseDir()) == -1)
+        return;
+
+    //We want the paths relative to the base directory of the .cib file.
+    Vector rel_paths = CreateRelativePath(paths, HeadGetBaseDir());
+
+    if(VectorGetSize(rel_paths) > 0){
+        //The data of the deleted entries are deleted after every path has been removed from the metadata.
+        Vector pointers = VectorCreate(LIST_ENTRIES_PER_BLOCK, free);
+
+        for(int i = 0; i < VectorGetSize(rel_paths); i++){
+            char *path = VectorGetAt(rel_paths, i);
+
+            //There is no meaning in deleting ".".
+            if(strcmp(path, ".") == 0){
+                CIBCannotDeleteRoot();
+                continue;
+
+            }
+
+            bool found; EntryId current = MDGetPath(path, 0, &found);
+            
+            if(found == true){
+                char *copy = strdup(path);
+                char *parent_path = dirname(copy);
+
+                //The parent is modified, thus it is copied if it is shared with a snapshot.
+                EntryId parent = MDUnsharePath(parent_path, 0, &found);
+
+                MDDeleteTree(current, parent, pointers);
+                free(copy);
+
+            }else
+                CIBPathNotFound(path, cib_file);
+            
+        }
+
+        DataDeleteFiles(pointers);
+        VectorDestroy(pointers);
+
+        //If there are blocks at the end of the data partition that are unused then they are deleted.
+        DataRemoveLastChunk();
+        CloseExistingCIB();
+    
+    }else{
+        close(cib->fd);
+        
+    }
+
+    VectorDestroy(rel_paths);
+    return;
+}
+
+/*Prints the structuuure of the given cib file. If snapshot is not NULL, the structure of the snapshot
+with that name is printed. Otherwise, the names of the snapshots are printed after the structure.*/
+void CIBPrintStructure(char *cib_file, char *snapshot){
+    if(OpenExistingCIBReadOnly(cib_file) == -1)
+        return;
+
+    EntryId root;
+    if(CIBGetRoot(cib_file, snapshot, &root) == true)
+        MDPrintStructure(root);
+
+    List snapshots = MDGetSnapshots();
+    if(snapshot == NULL && ListGetSize(snapshots) > 0){
+        char buff[512];
+        snprintf(buff, sizeof(buff), "\nSnapshots\n-------------------------------------------------------------------------\n");
+        WriteBytes(buff, strlen(buff), 1);
+
+        for(LNode node = ListGetLastNode(snapshots); node != NULL; node = LNodeGetPrevious(node)){
+            INPair pair = LNodeGetItem(node);
+
+            snprintf(buff, sizeof(buff), "%6lu. %.256s\n", INPairGetId(pair), INPairGetName(pair));
+            WriteBytes(buff, strlen(buff), 1);
+        }
+        WriteBytes("-------------------------------------------------------------------------\n\n", 75, 1);
+    }
+
+    ListDestroy(snapshots);
+    CloseExistingCIB();
+    return;
+}
+
+/*Prints the metadata information about each entity of the cib file.*/
+void CIBPrintMetadata(char *cib_file){
+    if(OpenExistingCIBReadOnly(cib_file) == -1)
+        return;
+
+    MDPrintEntriesMetadata();
+
+    CloseExistingCIB();
+    return;
+}
+
+/*Searches the cib to find each path in the Vector. Then, it prints the results of the search.
+If snapshot is not NULL the paths are searched inside the snapshot with that name.*/
+void CIBQuery(char *cib_file, Vector paths, char *snapshot){
+    if(OpenExistingCIBReadOnly(cib_file) == -1)
+        return;
+
+    EntryId root;
+    if(CIBGetRoot(cib_file, snapshot, &root) == false){
+        CloseExistingCIB();
+        return;
+    }
+
+    char title[512]; snprintf(title, sizeof(title), "+----------------------------+\n| %-26s |\n", "Query Results");
+    char *line = "+----------------------------+--------------------------------------------------------------------------------------------------------------------------------+\n";
+    
+    strcat(title, line);
+    WriteBytes(title, strlen(title), 1);
+
+    for(int i = 0; i < VectorGetSize(paths); i++){
+        bool found; char *curr = VectorGetAt(paths, i);
+        EntryId id = MDGetPath(curr, root, &found);
+
+        char buff[256 + 4096];
+        memset(buff, 0, sizeof(buff));
+        if(found == true)
+            snprintf(buff, sizeof(buff), "|\033[1;32m EntryID: %17lu \033[0m|\033[1;32m Path: %s\033[0m", id, curr);
+        else
+            snprintf(buff, sizeof(buff), "|\033[1;31m EntryID: %17s \033[0m|\033[1;31m Path: %s\033[0m", "-", curr);
+
+        for(int i = strlen(buff); i < 180; i++) 
+            buff[i] = ' ';
+
+        strcat(buff, "|\n");
+        WriteBytes(buff, strlen(buff), 1);
+        WriteBytes(line, strlen(line), 1);
+    }
+
+    CloseExistingCIB();
+
+    return;
+}
+
+/*Takes a snapshot, with the given name, of the current tree of the cib file. The snapshot
+shares every data chunk with the current tree.*/
+void CIBSnapshot(char *cib_file, char *name){
+    if(OpenExistingCIB(cib_file) == -1)
+        return;
+
+    bool created; MDCreateSnapshot(name, &created);
+    if(created == false)
+        CIBCannotCreateSnapshot(name);
+
+    CloseExistingCIB();
+    return;
+}
+
+/*Deletes the snapshot with the given name. The data chunks that are not shared with the current
+tree or other snapshots are freed.*/
+void CIBDeleteSnapshot(char *cib_file, char *name){
+    if(OpenExistingCIB(cib_file) == -1)
+        return;
+
+    EntryId root;
+    if(CIBGetRoot(cib_file, name, &root) == true){
+        Vector pointers = VectorCreate(LIST_ENTRIES_PER_BLOCK, free);
+
+        MDRemoveSnapshot(root);
+        MDDeleteTree(root, root, pointers);
+
+        DataDeleteFiles(pointers);
+        VectorDestroy(pointers);
+
+        DataRemoveLastChunk();
+    }
+
+    CloseExistingCIB();
+    return;
+}
+
+/*Returns true iff the chunk that starts from the given block is owned by the header, not by an entry: it holds
+the path of the base archive or the dictionary.*/
+bool CIBIsHeaderChunk(DataBlockId block){
+    return block == HeadGetBaseArchive() || block == HeadGetDictionary();
+}
+
+/*Moves the used chunk that starts from block src to the free chunk that starts from block dest and frees src.
+If dest is 0 the chunk is appended to the log of a log-structured cib file instead. The entries in "owners",
+the map of CIBListGetDataOwners(), that point to src are updated and so is the map.
+The copy is written to the disk before the entries are updated and the entries before src is freed, so
+an interruption leaves at most an unreferenced chunk behind.*/
+void CIBMoveChunk(DataBlockId src, DataBlockId dest, HashTable owners){
+    if(dest == 0)
+        dest = DataAppendChunk(src);
+    else
+        DataMoveChunk(src, dest);
+    CIBSync();
+
+    HashNode node = HTFindKey(owners, &src);
+    if(node != NULL){
+        List entries = ListCreate(free);
+
+        for(LNode lnode = ListGetFirstNode(HNGetItem(node)); lnode != NULL; lnode = LNodeGetNext(lnode)){
+            EntryId entry_id = *(EntryId *) LNodeGetItem(lnode);
+            CIBEntrySetPointer(entry_id, DataSetChunk(CIBEntryGetPointer(entry_id), dest));
+            ListInsertLast(entries, intdup(*(EntryId *) LNodeGetItem(lnode)));
+        }
+
+        HTRemoveItem(owners, &src);
+        HTInsertItem(owners, intdup(dest), entries);
+    }
+
+    if(src == HeadGetBaseArchive())
+        HeadSetBaseArchive(dest);
+    if(src == HeadGetDictionary())
+        HeadSetDictionary(dest);
+    CIBSync();
+
+    DataFreeChunk(src);
+    return;
+}
+
+/*Moves the used chunks from block "from" on, starting from the last one, each to the lowest free chunk from "from"
+on that precedes it and fits it, and removes the free blocks at the end of the data partition after each move. At
+most steps chunks are moved, or every chunk if steps is 0. Returns the number of moved chunks; done is set to true
+if every chunk was visited.*/
+uint64_t CIBPackChunks(DataBlockId from, uint64_t steps, HashTable owners, bool *done){
+    Vector chunks = VectorCreate(HeadGetListEntries(), free);
+    uint64_t moved = 0;
+
+    DataBlockId end = HeadGetDataSize() >> DATA_BLOCK_SHIFT;
+    for(DataBlockId block = from, next; block < end; block = next){
+        bool used; next = DataGetNextChunk(block, &used);
+
+        if(used == true)
+            VectorInsertLast(chunks, intdup(block));
+    }
+
+    //Chunks are visited from the end of the partition. A moved chunk never lands on a chunk that is yet to be visited.
+    int i = VectorGetSize(chunks) - 1;
+    for(; i >= 0 && (steps == 0 || moved < steps); i--){
+        DataBlockId block = *(DataBlockId *) VectorGetAt(chunks, i), dest;
+        bool used; uint64_t blocks = DataGetNextChunk(block, &used) - block;
+
+        if(DataFindLowestFreeChunk(blocks, from, block, &dest) == false)
+            continue;
+
+        CIBMoveChunk(block, dest, owners);
+        DataRemoveLastChunk();
+        CIBSync();
+
+        moved++;
+    }
+
+    *done = i < 0;
+    VectorDestroy(chunks);
+    return moved;
+}
+
+/*Moves every used chunk from block "from" on to the start of the free space that precedes it, so that no free
+space is left between the chunks. A chunk that overlaps the free space before it is moved to the end of the data
+partition and moved back when the scan reaches it. Returns the number of moves.*/
+uint64_t CIBSlideChunks(DataBlockId from, HashTable owners){
+    uint64_t moved = 0;
+
+    for(DataBlockId current = from, next, free_start = 0; current < HeadGetDataSize() >> DATA_BLOCK_SHIFT; current = next){
+        bool used; next = DataGetNextChunk(current, &used);
+        if(used == false){
+            free_start = current;
+            continue;
+        }
+
+        if(free_start == 0)
+            continue;
+
+        //The freed chunk is merged with the free space before it, so the scan goes on from the end of the moved
+        //chunk, or from the start of the free space if the chunk was moved to the end.
+        if(next - current <= current - free_start){
+            CIBMoveChunk(current, free_start, owners);
+            next = free_start + (next - current);
+
+        }else{
+            CIBMoveChunk(current, 0, owners);
+            next = free_start;
+
+        }
+
+        moved++;
+        free_start = 0;
+    }
+
+    return moved;
+}
+
+/*Moves the data chunks of the cib file towards the start of the data partition, so that the free space
+gathers at its end and can be removed. At most steps chunks are moved, or every chunk if steps is 0. Each
+move is written to the disk before the entries are updated and the entries are written before the old
+chunk is freed, so an interrupted run loses no data. Chunks that no entry points to, which is what an
+interrupted move leaves behind, are freed at the start of the next run.*/
+void CIBCompact(char *cib_file, uint64_t steps){
+    if(OpenExistingCIB(cib_file) == -1)
+        return;
+
+    if(HeadIsLogStructured() == true){
+        CIBLogStructured(cib_file);
+        CloseExistingCIB();
+        return;
+    }
+
+    uint64_t old_size = HeadGetFileSize(), moved, orphans;
+    HashTable owners = MDGetDataOwners();
+    Vector chunks = VectorCreate(HeadGetListEntries(), free);
+
+    //Collect the used chunks. The chunks that are not owned by an entry or by the header are freed.
+    DataBlockId end = HeadGetDataSize() >> DATA_BLOCK_SHIFT;
+    for(DataBlockId block = 1, next; block < end; block = next){
+        bool used; next = DataGetNextChunk(block, &used);
+
+        if(used == true && HTFindKey(owners, &block) == NULL && CIBIsHeaderChunk(block) == false)
+            VectorInsertLast(chunks, intdup(block));
+    }
+
+    for(int i = 0; i < VectorGetSize(chunks); i++)
+        DataFreeChunk(*(DataBlockId *) VectorGetAt(chunks, i));
+    orphans = VectorGetSize(chunks);
+
+    VectorDestroy(chunks);
+
+    DataRemoveLastChunk();
+    CIBSync();
+
+    bool done; moved = CIBPackChunks(1, steps, owners, &done);
+    CIBCompactReport(cib_file, moved, orphans, old_size, HeadGetFileSize(), done);
+
+    HTDestroy(owners);
+    CloseExistingCIB();
+    return;
+}
+
+/*Moves the data of the most extracted entries of the access trace to the start of the data partition, in the
+order in which they were first extracted, so that extracting them reads the cib file sequentially. The data
+of the hot entries with the highest counts are moved, or of every traced entry if hot is 0.
+
+The chunks that occupy the space of the hot chunks are moved to free space after it first. Once the hot chunks
+are laid out, the chunks after their space are packed into the space that they vacated, so the file does not grow.
+Every move is done with CIBMoveChunk(), so an interrupted relayout loses no data.*/
+void CIBRelayout(char *cib_file, uint64_t hot){
+    if(OpenExistingCIB(cib_file) == -1)
+        return;
+
+    if(HeadIsLogStructured() == true){
+        CIBLogStructured(cib_file);
+        CloseExistingCIB();
+        return;
+    }
+
+    Vector records = CIBTraceLoad(cib_file);
+    if(VectorGetSize(records) == 0){
+        CIBTraceNotFound(cib_file);
+
+        VectorDestroy(records);
+        CloseExistingCIB();
+        return;
+    }
+
+    //Select the records with the highest counts.
+    Vector ranked = VectorCreate(VectorGetSize(records), NULL);
+    for(int i = 0; i < VectorGetSize(records); i++)
+        VectorInsertLast(ranked, VectorGetAt(records, i));
+
+    VectorSort(ranked, CIBTraceCompare);
+
+    HashTable selected = HTCreate(VectorGetSize(records), HashString, (CompFunc) strcmp, NULL, NULL);
+    for(int i = 0; i < VectorGetSize(ranked) && (hot == 0 || (uint64_t) i < hot); i++)
+        HTInsertItem(selected, ((TraceRecord) VectorGetAt(ranked, i))->path, NULL);
+
+    //Keep one entry per chunk, in access order. Paths deleted since they were traced are skipped.
+    Vector order = VectorCreate(VectorGetSize(records), free);
+    HashTable chunks = HTCreate(VectorGetSize(records), HashUint64, CompareUint64, free, NULL);
+    uint64_t hot_blocks = 0;
+
+    for(int i = 0; i < VectorGetSize(records); i++){
+        TraceRecord record = VectorGetAt(records, i);
+        if(HTFindKey(selected, record->path) == NULL)
+            continue;
+
+        bool found; EntryId entry_id = MDGetPath(record->path, 0, &found);
+        if(found == false || CIBEntryIsDir(GetEntryAddress(entry_id)) == true)
+            continue;
+
+        DataBlockId block = CIBEntryGetPointer(entry_id);
+        if(block == 0 || DataIsBaseRef(block) == true)
+            continue;
+
+        block = DataGetChunk(block);
+        if(HTFindKey(chunks, &block) != NULL)
+            continue;
+
+        bool used; hot_blocks += DataGetNextChunk(block, &used) - block;
+
+        HTInsertItem(chunks, intdup(block), NULL);
+        VectorInsertLast(order, intdup(entry_id));
+    }
+
+    HashTable owners = MDGetDataOwners();
+    uint64_t moved = 0;
+
+    //Hot chunks that are already in place stay where they are.
+    DataBlockId start = 1; int placed = 0;
+    for(bool used; placed < VectorGetSize(order) && DataGetChunk(CIBEntryGetPointer(*(EntryId *) VectorGetAt(order, placed))) == start; placed++){
+        uint64_t blocks = DataGetNextChunk(start, &used) - start;
+
+        hot_blocks -= blocks;
+        start += blocks;
+    }
+
+    //Empty the space of the hot chunks that are not in place. Each chunk in it is moved to the lowest free chunk
+    //after it, or to the end of the file if none fits. A vacated chunk is merged with its free neighbours, so the
+    //scan goes on from the start of the merged chunk.
+    DataBlockId limit = start + hot_blocks;
+    for(DataBlockId current = start, next, free_start = 0; current < limit; current = next){
+        bool used; next = DataGetNextChunk(current, &used);
+        if(used == false){
+            free_start = current;
+            continue;
+        }
 
-        //Adjust the file size
-        TruncMapAndUpdate(header_size, md_blocks * MD_BLOCK_SIZE, data_blocks << DATA_BLOCK_SHIFT, false);
-        
-        //Initialize each "partition"
-        HeadInit(cwd);
-        DataInit(data_blocks);
-        MDInit(list_blocks, node_blocks_needed);    
+        DataBlockId dest, end = HeadGetDataSize() >> DATA_BLOCK_SHIFT;
+        if(DataFindLowestFreeChunk(next - current, limit, end, &dest) == false)
+            dest = DataExtend(next - current);
 
-        //Insert the entries.
-        CIBInsertEntries(rel_paths, compress);
+        CIBMoveChunk(current, dest, owners);
+        moved++;
 
-        //Remove, if exist, the unoccupied blocks that make up the last chunk of data size.
-        DataRemoveLastChunk();
-        CloseExistingCIB();
+        next = free_start != 0 ? free_start : current;
+        free_start = 0;
+    }
 
-    }else
-        close(fd);
+    //Lay the hot chunks out from start, in order.
+    for(bool used; placed < VectorGetSize(order); placed++){
+        DataBlockId block = DataGetChunk(CIBEntryGetPointer(*(EntryId *) VectorGetAt(order, placed)));
+        uint64_t blocks = DataGetNextChunk(block, &used) - block;
+
+        CIBMoveChunk(block, start, owners);
+        moved++;
+        start += blocks;
+    }
 
-    VectorDestroy(rel_paths); free(cwd);
+    //The chunks after the hot space, the moved ones included, are packed into the space that the hot chunks
+    //vacated. A pass may free the space that a chunk it visited before needed, so passes are made until none moves.
+    //The chunks that fit no free space are then slid over the space that is left, so the file does not grow.
+    for(uint64_t packed = 1; packed != 0; moved += packed){
+        bool done;
+        packed = CIBPackChunks(limit, 0, owners, &done);
+    }
+    moved += CIBSlideChunks(limit, owners);
+
+    DataRemoveLastChunk();
+    CIBSync();
+
+    CIBRelayoutReport(cib_file, VectorGetSize(order), moved);
+
+    HTDestroy(owners); HTDestroy(chunks); HTDestroy(selected);
+    VectorDestroy(order); VectorDestroy(ranked); VectorDestroy(records);
+    CloseExistingCIB();
     return;
 }
 
-/*Appends to the existing cib file the paths stored in the given vector. If any inserted entity is already
-inserted inside the .cib file then its content is updated.*/
-void CIBAppend(char *cib_file, Vector paths, bool compress){
+/*Reclaims the space of the deleted data of a log-structured cib file. Its data partition is split in segments
+of DATA_SEGMENT_BLOCKS blocks and the live chunks of every segment that holds dead chunks and whose blocks are
+less than DATA_CLEAN_THRESHOLD percent live are appended to the log. Dead chunks are freed before and after
+the moves, so that their space is used by the next segments, and the free blocks at the end of the file are removed.
+
+As in CIBCompact(), chunks that no entry points to are deleted first and every move is done with CIBMoveChunk().*/
+void CIBClean(char *cib_file){
     if(OpenExistingCIB(cib_file) == -1)
         return;
 
-    if(chdir(HeadGetBaseDir()) == -1){
-        perror("chdir:");
+    if(HeadIsLogStructured() == false){
+        CIBNotLogStructured(cib_file);
+        CloseExistingCIB();
         return;
+    }
+
+    uint64_t old_size = HeadGetFileSize(), moved = 0, orphans = 0, cleaned = 0;
+    HashTable owners = MDGetDataOwners();
+    Vector chunks = VectorCreate(HeadGetListEntries() + 1, free);
+
+    //Count the live and the dead blocks of every segment. Chunks belong to the segment of their first block.
+    DataBlockId end = HeadGetDataSize() >> DATA_BLOCK_SHIFT, tail = HeadGetLogTail();
+    uint64_t segments = (end - 1) / DATA_SEGMENT_BLOCKS + 1;
+    uint64_t *live = calloc(segments, sizeof(uint64_t)), *dead = calloc(segments, sizeof(uint64_t));
+
+    for(DataBlockId block = 1, next; block < end; block = next){
+        bool used; next = DataGetNextChunk(block, &used);
+        uint64_t segment = (block - 1) / DATA_SEGMENT_BLOCKS;
 
+        if(used == false || block == tail)
+            continue;
+
+        if(DataIsDead(block) == false && HTFindKey(owners, &block) == NULL && CIBIsHeaderChunk(block) == false){
+            DataFreeChunk(block);
+            orphans++;
+        }
+
+        if(DataIsDead(block) == true)
+            dead[segment] += next - block;
+
+        else{
+            live[segment] += next - block;
+            VectorInsertLast(chunks, intdup(block));
+        }
     }
 
-    //We make every path relative to the base directory of the .cib file.
-    Vector rel_paths = CreateRelativePath(paths, HeadGetBaseDir());
-    
-    if(VectorGetSize(rel_paths) != 0){
-        //Calculate the needed blocks. We care about the data blocks that are generally more
-        //than the metadata block that we will need.
-        uint32_t node_blocks_needed; uint64_t data_blocks;
-        CalculateSpace(rel_paths, &node_blocks_needed, &data_blocks);
+    //The segment that is being filled is not cleaned.
+    if(tail != 0)
+        dead[(tail - 1) / DATA_SEGMENT_BLOCKS] = 0;
 
-        //Adjust the file size.
-        TruncMapAndUpdate(HeadGetHeaderSize(), HeadGetMDSize(), HeadGetDataSize() + (data_blocks << DATA_BLOCK_SHIFT), true);
-        
-        //Move the md partition so that the new space is accessible to the data "partition".
-        memmove(md, (char *) md - (data_blocks << DATA_BLOCK_SHIFT), HeadGetMDSize());
-        DataInsertFreeBlocks(data_blocks);
+    for(uint64_t i = 0; i < segments; i++)
+        cleaned += dead[i] != 0 && live[i] * 100 < (live[i] + dead[i]) * DATA_CLEAN_THRESHOLD;
 
-        //Update the root entry.
-        CIBEntry root = CIBEntryCreate(NULL, "."); bool updated;
-        MDUpdatePath(root, ".", 0, &updated); free(root);
+    //The dead chunks are freed first, so that the log continues in their space instead of growing the cib file.
+    DataReclaimDeadChunks();
 
-        CIBInsertEntries(rel_paths, compress);
-        DataRemoveLastChunk();
-        CloseExistingCIB();
+    for(int i = 0; i < VectorGetSize(chunks); i++){
+        DataBlockId block = *(DataBlockId *) VectorGetAt(chunks, i);
+        uint64_t segment = (block - 1) / DATA_SEGMENT_BLOCKS;
 
-    }else
-        close(fd);
+        if(dead[segment] == 0 || live[segment] * 100 >= (live[segment] + dead[segment]) * DATA_CLEAN_THRESHOLD)
+            continue;
 
-    VectorDestroy(rel_paths);
+        CIBMoveChunk(block, 0, owners);
+        moved++;
+    }
+
+    DataReclaimDeadChunks();
+    DataRemoveLastChunk();
+    CIBSync();
+
+    CIBCleanReport(cib_file, cleaned, moved, orphans, old_size, HeadGetFileSize());
+
+    free(live); free(dead);
+    VectorDestroy(chunks);
+    HTDestroy(owners);
+    CloseExistingCIB();
     return;
 }
 
-/*If current_id represents a directory inside .cib file the function calls itself.
-If current_id represents a file/link the function extracts it.
+/*Calculates the space that the tree under the given directory needs in a new cib file and returns the
+number of its entries. Chunks that are shared by more than one entry are counted once.*/
+uint64_t CIBVacuumSpaceRec(EntryId dir_id, uint32_t *node_blocks, uint64_t *data_blocks, HashTable counted){
+    List entries = MDGetDirEntries(dir_id);
+    uint64_t count = ListGetSize(entries);
 
-The destination of the extracted entities depends on rel_path.
+    *node_blocks += ListGetSize(entries) / 3 + (ListGetSize(entries) % 3 > 0);
 
-Returns the number of forks() that were made.*/
-int CIBExtractRec(char *rel_path, EntryId current_id){
+    for(LNode node = ListGetFirstNode(entries); node != NULL; node = LNodeGetNext(node)){
+        EntryId entry_id = INPairGetId(LNodeGetItem(node));
+        uint64_t pointer = CIBEntryGetPointer(entry_id);
 
-    if(CIBEntryIsDir(GetEntryAddress(current_id)) == true){
-        if(CreateDir(rel_path) == -1)
-            return -1;
+        if(CIBEntryIsDir(GetEntryAddress(entry_id)) == true){
+            count += CIBVacuumSpaceRec(entry_id, node_blocks, data_blocks, counted);
 
-        List entries = MDGetDirEntries(current_id);
-        uint64_t count = 0;
+        }else if(pointer != 0 && DataIsBaseRef(pointer) == false){
+            DataBlockId chunk = DataGetChunk(pointer);
+            if(HTFindKey(counted, &chunk) != NULL)
+                continue;
+
+            bool used; *data_blocks += DataGetNextChunk(chunk, &used) - chunk;
+            HTInsertItem(counted, intdup(chunk), NULL);
+        }
+    }
+
+    ListDestroy(entries);
+    return count;
+}
+
+/*Inserts in the new cib file the entries of the tree of the old cib file, one directory at a time, so that
+the entries of each directory, and of each level of the tree, take consecutive entry ids. The new ids are
+stored in entry_ids, indexed by the old ones. The old cib file is the open one; new holds the state of the new.*/
+void CIBVacuumEntries(CIBState new, HashTable entry_ids){
+    List queue = ListCreate(free);
+    ListInsertLast(queue, intdup(0));
+
+    while(ListGetSize(queue) != 0){
+        EntryId old_dir = *(EntryId *) LNodeGetItem(ListGetFirstNode(queue));
+        EntryId new_dir = *(EntryId *) HNGetItem(HTFindKey(entry_ids, &old_dir));
+        ListRemoveNode(queue, ListGetFirstNode(queue));
+
+        List entries = MDGetDirEntries(old_dir);
 
         for(LNode node = ListGetFirstNode(entries); node != NULL; node = LNodeGetNext(node)){
             INPair pair = LNodeGetItem(node);
+            CIBEntry entry = CIBEntryCopy(INPairGetId(pair)); bool inserted;
 
-            char *entry_name = INPairGetName(pair);
-            EntryId entry_id = INPairGetId(pair);
+            CIBState previous = CIBStateUse(new);
+            EntryId entry_id = MDUpdatePath(entry, INPairGetName(pair), new_dir, &inserted);
+            CIBStateUse(previous);
 
-            char entry_path[strlen(rel_path) + strlen(entry_name) + 2];
-            snprintf(entry_path, sizeof(entry_path), "%s/%s", rel_path, entry_name);
+            HTInsertItem(entry_ids, intdup(INPairGetId(pair)), intdup(entry_id));
+            if(CIBEntryIsDir(entry) == true)
+                ListInsertLast(queue, intdup(INPairGetId(pair)));
 
-            count += CIBExtractRec(entry_path, entry_id);
+            free(entry);
         }
 
         ListDestroy(entries);
-        for(uint64_t i = 0; i < count; i++)
-            wait(NULL);
-        
-    }else{
-        DataBlockId block = CIBEntryGetPointer(current_id);
-
-        if(CIBEntryIsFile(GetEntryAddress(current_id)) == true)
-            return DataExtractFile(block, rel_path, 0644) == true;
-
-        else
-            DataExtractLink(block, rel_path);
     }
 
-    return 0;
+    ListDestroy(queue);
+    return;
 }
 
-/*Extractes the givern paths from the cib_file. Keep in mind that the extracted entities are not deleted
-from the cib file and they are still accessible.*/
-void CIBExtract(char *cib_file, Vector paths){
-    if(OpenExistingCIB(cib_file) == -1)
-        return;
+/*Copies the data of the tree under the given entry of the old cib file to the new one. Entries are visited
+in the order of CIBExtractRec(), so that extraction reads the new cib file sequentially. Chunks shared by
+more than one entry are copied once; blocks maps the chunks of the old cib file to those of the new.
+The old cib file is the open one; new holds the state of the new.*/
+void CIBVacuumDataRec(EntryId current_id, CIBState new, HashTable entry_ids, HashTable blocks){
+    if(CIBEntryIsDir(GetEntryAddress(current_id)) == true){
+        List entries = MDGetDirEntries(current_id);
 
-    //Number of wait()s that we have to perform in order to collect zombies.
-    int waits = 0;
+        for(LNode node = ListGetFirstNode(entries); node != NULL; node = LNodeGetNext(node))
+            CIBVacuumDataRec(INPairGetId(LNodeGetItem(node)), new, entry_ids, blocks);
 
-    if(VectorGetSize(paths) == 0)
-        waits += CIBExtractRec(".", 0);
+        ListDestroy(entries);
+        return;
+    }
 
-    else{
-        for(int i = 0; i < VectorGetSize(paths); i++){
-            char *path = VectorGetAt(paths, i);
+    uint64_t pointer = CIBEntryGetPointer(current_id), new_pointer = pointer;
+    DataBlockId chunk = pointer != 0 && DataIsBaseRef(pointer) == false ? DataGetChunk(pointer) : 0;
+    EntryId entry_id = *(EntryId *) HNGetItem(HTFindKey(entry_ids, &current_id));
+    HashNode node = chunk != 0 ? HTFindKey(blocks, &chunk) : NULL;
 
-            bool found; EntryId entry_id = MDGetPath(path, 0, &found);
+    if(node != NULL){
+        new_pointer = DataSetChunk(pointer, *(uint64_t *) HNGetItem(node));
 
-            if(found == true){
-                char *copy = strdup(path);
-                if(CreateDirRec(dirname(copy)) == -1) continue;
+        CIBState previous = CIBStateUse(new);
+        DataShareFile(new_pointer);
+        CIBStateUse(previous);
 
-                waits += CIBExtractRec(path, entry_id);
-                free(copy);
+    }else if(chunk != 0){
+        uint64_t size; void *bytes = DataGetBytes(chunk, &size);
+        uint8_t level, codec = DataGetCodec(chunk, &level), raw = DataGetRawReason(chunk);
 
-            }else
-                CIBPathNotFound(path, cib_file);
-        }
+        //The old cib file stays mapped while the new one is open, so its bytes are copied directly.
+        CIBState previous = CIBStateUse(new);
+        DataBlockId new_chunk = DataInsertBytes(bytes, size, codec, level);
+        DataSetRawReason(new_chunk, raw);
+        CIBStateUse(previous);
 
+        new_pointer = DataSetChunk(pointer, new_chunk);
+        HTInsertItem(blocks, intdup(chunk), intdup(new_chunk));
     }
 
-    for(int i = 0; i < waits; i++)
-        wait(NULL);
+    CIBState previous = CIBStateUse(new);
+    CIBEntrySetPointer(entry_id, new_pointer);
+    CIBStateUse(previous);
 
     return;
 }
 
-/*Recursively deletes the entity with the current id.
+/*Writes the current tree of cib_file to out_file, which is created or overwritten. The entries of the new
+cib file are numbered breadth-first and its data are stored in the order in which extraction visits them,
+without any free space in between. Snapshots are not copied.*/
+void CIBVacuum(char *cib_file, char *out_file){
+    struct stat cib_info, out_info;
+    if(stat(cib_file, &cib_info) == 0 && stat(out_file, &out_info) == 0 && cib_info.st_ino == out_info.st_ino){
+        CIBInvalidVacuumTarget(out_file);
+        return;
+    }
 
-If current id represents a directory then the function calls itself and afterwards the entry is deleted.
-If current id represents a file or a link then its data is deleted and afterwards the entry is deleted from
-the metadata partition too.*/
-void CIBDeleteRec(EntryId current, EntryId parent){
+    if(OpenExistingCIBReadOnly(cib_file) == -1)
+        return;
 
-    if(CIBEntryIsDir(GetEntryAddress(current)) == true){
-        List entries = MDGetDirEntries(current);
+    //Calculate the space of the new cib file, so that nothing has to be moved while it is written.
+    uint32_t node_blocks = 0; uint64_t data_blocks = EXTRA_BLOCKS_NEEDED;
+    HashTable counted = HTCreate(HeadGetListEntries(), HashUint64, CompareUint64, free, NULL);
+    uint64_t entries = CIBVacuumSpaceRec(0, &node_blocks, &data_blocks, counted);
+    HTDestroy(counted);
+
+    //The record of the base archive is made relative to the new cib file. If the base archive cannot be found,
+    //the record is copied as it is.
+    uint64_t base_size = 0; void *base_record = NULL;
+    if(HeadGetBaseArchive() != 0){
+        void *record = DataGetBytes(HeadGetBaseArchive(), &base_size);
+        char *archive = CIBGetPath(), *base_path = NULL;
+        struct base_record identity;
+
+        if(archive != NULL && (base_path = CIBBaseRecordPath(record, base_size, archive, &identity, false)) != NULL)
+            base_record = CIBBaseRecordCreate(base_path, out_file, &identity, &base_size);
+        else
+            base_record = memcpy(malloc(base_size), record, base_size);
 
-        for(LNode node = ListGetFirstNode(entries); node != NULL; node = LNodeGetNext(node))
-            CIBDeleteRec(INPairGetId((INPair) LNodeGetItem(node)), current);
-    
-        ListDestroy(entries);
-    }else{
-        DataBlockId pointer = CIBEntryGetPointer(current);
+        data_blocks += DataCaclulateNeededBlocks(base_size);
+        free(archive); free(base_path);
+    }
+
+    //The files compressed with the dictionary are copied as they are, so the dictionary is copied too.
+    uint64_t dict_size = 0; void *dict = NULL;
+    if(HeadGetDictionary() != 0){
+        dict = DataGetBytes(HeadGetDictionary(), &dict_size);
+        data_blocks += DataCaclulateNeededBlocks(dict_size);
+    }
+
+    uint32_t list_blocks = entries / LIST_ENTRIES_PER_BLOCK + (entries % LIST_ENTRIES_PER_BLOCK > 0);
+    uint64_t md_blocks = 1 + node_blocks + list_blocks;
+    char *base_dir = strdup(HeadGetBaseDir());
+    bool log_structured = HeadIsLogStructured();
 
-        DataDeleteFile(pointer);
+    //The new cib file is opened in a state of its own, while the old one stays the current archive.
+    CIBState new = CIBStateCreate(), previous = CIBStateUse(new);
+    if(OpenNewCIB(out_file) == -1){
+        CIBStateUse(previous); CIBStateDestroy(new);
+        CloseExistingCIB();
+
+        free(base_dir); free(base_record);
+        return;
     }
 
-    MDDeleteEntry(current, parent);
+    TruncMapAndUpdate(HeadCalculateNeededSpace(base_dir), md_blocks * MD_BLOCK_SIZE, data_blocks << DATA_BLOCK_SHIFT, false);
+
+    HeadInit(base_dir);
+    DataInit(data_blocks);
+    MDInit(list_blocks, node_blocks);
 
+    if(base_record != NULL)
+        HeadSetBaseArchive(DataInsertBytes(base_record, base_size, CODEC_NONE, 0));
+    free(base_record);
+
+    if(dict != NULL)
+        DataSetDictionary(dict, dict_size);
+
+    HashTable entry_ids = HTCreate(entries + 1, HashUint64, CompareUint64, free, free);
+    HashTable blocks = HTCreate(entries + 1, HashUint64, CompareUint64, free, free);
+    HTInsertItem(entry_ids, intdup(0), intdup(0));
+
+    CIBStateUse(previous);
+    CIBVacuumEntries(new, entry_ids);
+    CIBVacuumDataRec(0, new, entry_ids, blocks);
+
+    //The data are copied without segments, so that the new cib file has no free space. New data start a new segment.
+    CIBStateUse(new);
+    DataRemoveLastChunk();
+    HeadSetLogStructured(log_structured);
+    CloseExistingCIB();
+
+    CIBStateUse(previous); CIBStateDestroy(new);
+    CloseExistingCIB();
+
+    HTDestroy(entry_ids); HTDestroy(blocks);
+    free(base_dir);
     return;
 }
 
-/*Deletes the paths stored in the given vector from the .cib file.*/
-void CIBDelete(char *cib_file, Vector paths){
-    if(OpenExistingCIB(cib_file) == -1)
-        return;
+/*Returns the pointer that an entry of the open cib file should hold to refer to a copy of the data that the given
+pointer of the staging cib file refers to. Chunks shared by more than one entry are copied once; blocks maps the
+chunks of the staging cib file to those of the open one. stage holds the state of the staging cib file.*/
+uint64_t CIBCommitData(CIBState stage, uint64_t pointer, HashTable blocks){
+    if(pointer == 0)
+        return 0;
 
-    if(chdir(HeadGetBaseDir()) == -1)
-        return;
+    DataBlockId chunk = DataGetChunk(pointer);
+    HashNode node = HTFindKey(blocks, &chunk);
 
-    //We want the paths relative to the base directory of the .cib file.
-    Vector rel_paths = CreateRelativePath(paths, HeadGetBaseDir());
+    if(node != NULL){
+        uint64_t new_pointer = DataSetChunk(pointer, *(uint64_t *) HNGetItem(node));
+        DataShareFile(new_pointer);
 
-    if(VectorGetSize(rel_paths) > 0){    
-        for(int i = 0; i < VectorGetSize(rel_paths); i++){
-            char *path = VectorGetAt(rel_paths, i);
+        return new_pointer;
+    }
 
-            //There is no meaning in deleting ".".
-            if(strcmp(path, ".") == 0){
-                CIBCannotDeleteRoot();
-                continue;
+    CIBState previous = CIBStateUse(stage);
+    uint64_t size; void *bytes = DataGetBytes(chunk, &size);
+    uint8_t level, codec = DataGetCodec(chunk, &level), raw = DataGetRawReason(chunk);
+    CIBStateUse(previous);
 
-            }
+    //The staging cib file stays mapped while the open one is, so its bytes are copied directly.
+    DataBlockId new_chunk = DataInsertBytes(bytes, size, codec, level);
+    DataSetRawReason(new_chunk, raw);
 
-            bool found; EntryId current = MDGetPath(path, 0, &found);
-            
-            if(found == true){
-                char *copy = strdup(path);
-                char *parent_path = dirname(copy);
+    HTInsertItem(blocks, intdup(chunk), intdup(new_chunk));
+    return DataSetChunk(pointer, new_chunk);
+}
 
-                EntryId parent = MDGetPath(parent_path, 0, &found);
+/*Links the entries of the given directory of the staging cib file, and the trees under them, in the directory dir_id
+of the open cib file, and copies their data. An entry that already exists is updated and its old data are deleted,
+as when it is appended. stage holds the state of the staging cib file.*/
+void CIBCommitRec(CIBState stage, EntryId stage_dir, EntryId dir_id, HashTable blocks){
+    CIBState previous = CIBStateUse(stage);
+    List entries = MDGetDirEntries(stage_dir);
+    CIBStateUse(previous);
 
-                CIBDeleteRec(current, parent);
-                free(copy);
+    CIBSetPlacementHint(dir_id);
 
-            }else
-                CIBPathNotFound(path, cib_file);
-            
+    for(LNode node = ListGetFirstNode(entries); node != NULL; node = LNodeGetNext(node)){
+        INPair pair = LNodeGetItem(node);
+        EntryId stage_id = INPairGetId(pair);
+
+        CIBStateUse(stage);
+        CIBEntry entry = CIBEntryCopy(stage_id);
+        uint64_t pointer = CIBEntryGetPointer(stage_id);
+        CIBStateUse(previous);
+
+        bool inserted; EntryId entry_id = MDUpdatePath(entry, INPairGetName(pair), dir_id, &inserted);
+
+        if(inserted == true && CIBEntryIsDir(entry) == true){
+            CIBCommitRec(stage, stage_id, entry_id, blocks);
+
+        }else if(inserted == true){
+            if(CIBEntryGetPointer(entry_id) != 0)
+                DataDeleteFile(CIBEntryGetPointer(entry_id));
+
+            CIBEntrySetPointer(entry_id, CIBCommitData(stage, pointer, blocks));
+            CIBFileStored();
         }
 
-        //If there are blocks at the end of the data partition that are unused then they are deleted.
-        DataRemoveLastChunk();
-        CloseExistingCIB();
-    
-    }else{
-        close(fd);
-        
+        free(entry);
     }
 
-    VectorDestroy(rel_paths);
+    ListDestroy(entries);
     return;
 }
 
-/*Prints the structuuure of the given cib file.*/
-void CIBPrintStructure(char *cib_file){
-    if(OpenExistingCIB(cib_file) == -1)
+/*Commits the staging cib file defined by stage_file to the cib file: under the exclusive lock of the cib file,
+the tree of the staging cib file is linked in its tree and the data are copied as they are. Since nothing is
+compressed again, the lock is held for about as long as copying the data takes.*/
+void CIBCommit(char *cib_file, char *stage_file){
+    //The staging cib file is opened in a state of its own, while the cib file is the current archive.
+    CIBState stage = CIBStateCreate(), previous = CIBStateUse(stage);
+    if(OpenExistingCIBReadOnly(stage_file) == -1){
+        CIBStateUse(previous); CIBStateDestroy(stage);
         return;
+    }
 
-    MDPrintStructure();
+    //The root of a staging cib file in which no entity could be inserted is not a directory; there is nothing to commit.
+    uint32_t node_blocks = 0; uint64_t data_blocks = EXTRA_BLOCKS_NEEDED;
+    bool empty = CIBEntryIsDir(GetEntryAddress(0)) == false;
 
-    CloseExistingCIB();
-    return;
-}
+    if(empty == false){
+        HashTable counted = HTCreate(HeadGetListEntries(), HashUint64, CompareUint64, free, NULL);
+        CIBVacuumSpaceRec(0, &node_blocks, &data_blocks, counted);
+        HTDestroy(counted);
+    }
 
-/*Prints the metadata information about each entity of the cib file.*/
-void CIBPrintMetadata(char *cib_file){
-    if(OpenExistingCIB(cib_file) == -1)
+    CIBStateUse(previous);
+    if(empty == true || OpenExistingCIB(cib_file) == -1){
+        CIBStateUse(stage);
+        CloseExistingCIB();
+
+        CIBStateUse(previous); CIBStateDestroy(stage);
         return;
+    }
 
-    MDPrintEntriesMetadata();
+    TruncMapAndUpdate(HeadGetHeaderSize(), HeadGetMDSize(), HeadGetDataSize() + (data_blocks << DATA_BLOCK_SHIFT), true);
+    memmove(cib->md, (char *) cib->md - (data_blocks << DATA_BLOCK_SHIFT), HeadGetMDSize());
+    DataInsertFreeBlocks(data_blocks);
+
+    CIBStateUse(stage);
+    CIBEntry root = CIBEntryCopy(0); bool updated;
+    CIBStateUse(previous);
+    MDUpdatePath(root, ".", 0, &updated); free(root);
+
+    HashTable blocks = HTCreate(HeadGetListEntries() + 1, HashUint64, CompareUint64, free, free);
+    CIBCommitRec(stage, 0, 0, blocks);
+    HTDestroy(blocks);
+
+    DataRemoveLastChunk();
+    CloseExistingCIB();
 
+    CIBStateUse(stage);
     CloseExistingCIB();
+
+    CIBStateUse(previous); CIBStateDestroy(stage);
     return;
 }
 
-/*Searches the cib to find each path in the Vector. Then, it prints the results of the search.*/
-void CIBQuery(char *cib_file, Vector paths){
-    if(OpenExistingCIB(cib_file) == -1)
+/*Appends the paths to the existing cib file through a staging cib file, so that any number of appenders may insert
+files in the same cib file at once. The files are inserted, and compressed, in a staging cib file next to the cib
+file, without holding its lock; the base directory and the dictionary of the cib file are read under a shared lock
+first. The staging cib file is then committed with CIBCommit() and deleted.
+
+A dictionary that the cib file does not have yet can only be trained by one appender, so in that case the paths
+are appended with CIBAppend(), after a warning.*/
+void CIBAppendStaged(char *cib_file, Vector paths, bool compress){
+    char *cib_path = RealPath(cib_file);
+    if(OpenExistingCIBReadOnly(cib_path) == -1){
+        free(cib_path);
         return;
+    }
 
-    char title[512]; snprintf(title, sizeof(title), "+----------------------------+\n| %-26s |\n", "Query Results");
-    char *line = "+----------------------------+--------------------------------------------------------------------------------------------------------------------------------+\n";
-    
-    strcat(title, line);
-    WriteBytes(title, strlen(title), 1);
+    char *base_dir = strdup(HeadGetBaseDir());
+    if(HeadGetDictionary() != 0){
+        void *dict = DataGetBytes(HeadGetDictionary(), &cib->operation->staged_dictionary_size);
+        cib->operation->staged_dictionary = malloc(cib->operation->staged_dictionary_size);
+        memcpy(cib->operation->staged_dictionary, dict, cib->operation->staged_dictionary_size);
+    }
 
-    for(int i = 0; i < VectorGetSize(paths); i++){
-        bool found; char *curr = VectorGetAt(paths, i);
-        EntryId id = MDGetPath(curr, 0, &found);
+    struct stat cib_info; fstat(cib->fd, &cib_info);
+    CloseExistingCIB();
 
-        char buff[256 + 4096];
-        memset(buff, 0, sizeof(buff));
-        if(found == true)
-            snprintf(buff, sizeof(buff), "|\033[1;32m EntryID: %17lu \033[0m|\033[1;32m Path: %s\033[0m", id, curr);
-        else
-            snprintf(buff, sizeof(buff), "|\033[1;31m EntryID: %17s \033[0m|\033[1;31m Path: %s\033[0m", "-", curr);
+    //The paths are relative to the current working directory, but they are inserted from the base directory.
+    Vector rel_paths = CreateRelativePath(paths, base_dir);
 
-        for(int i = strlen(buff); i < 180; i++) 
-            buff[i] = ' ';
+    if(cib->operation->insert_dictionary == true && cib->operation->staged_dictionary == NULL){
+        CIBCannotStage(cib_file);
+        CIBAppend(cib_file, paths, compress);
 
-        strcat(buff, "|\n");
-        WriteBytes(buff, strlen(buff), 1);
-        WriteBytes(line, strlen(line), 1);
-    }
+    }else if(chdir(base_dir) == -1){
+        perror("chdir:");
 
-    CloseExistingCIB();
+    }else{
+        //The staging cib file is named after the appender, so that appenders do not share one.
+        char stage_file[strlen(cib_path) + 32];
+        snprintf(stage_file, sizeof(stage_file), "%s.%d.stage", cib_path, (int) getpid());
+
+        //CIBCreate() gives the staging cib file the current working directory, the base directory of the cib file,
+        //as its base directory, so the paths of the two cib files are the same.
+        cib->operation->staged_target = cib_info.st_ino;
+        CIBCreate(stage_file, rel_paths, compress, NULL, false);
+        cib->operation->staged_target = 0;
 
+        struct stat stage_info;
+        if(stat(stage_file, &stage_info) == 0 && stage_info.st_size != 0)
+            CIBCommit(cib_path, stage_file);
+
+        unlink(stage_file);
+    }
+
+    free(cib->operation->staged_dictionary); cib->operation->staged_dictionary = NULL;
+    free(base_dir); free(cib_path);
+    VectorDestroy(rel_paths);
     return;
 }
 
 /*Selects which function should be called.*/
 void CIBStart(CIBArgs args){
-    switch(args->flags){
-        case C: CIBCreate(args->cib_file, args->paths, false); break;
-        case C | J: CIBCreate(args->cib_file, args->paths, true); break;
+    CIBState state = CIBStateCreate(), previous = CIBStateUse(state);
+
+    //The released disk space is measured on the file, since the blocks of a freed chunk may be reused and freed
+    //again, as moves do, and each free punches them.
+    struct stat before;
+    bool existed = stat(args->cib_file, &before) == 0;
+
+    cib->operation->insert_codec = args->codec;
+    cib->operation->insert_level = args->level;
+
+    //Solid chunks are compressed in-process, so gzip is replaced by deflate, which it is built on.
+    cib->operation->insert_solid = (args->flags & SOLID) != 0;
+    if(cib->operation->insert_solid == true && cib->operation->insert_codec == CODEC_GZIP)
+        cib->operation->insert_codec = CODEC_DEFLATE;
+
+    //So are files compressed with a dictionary, which gzip cannot be given.
+    cib->operation->insert_dictionary = (args->flags & DICT) != 0;
+    if(cib->operation->insert_dictionary == true && cib->operation->insert_codec == CODEC_GZIP)
+        cib->operation->insert_codec = CODEC_DEFLATE;
+    DataUseDictionary(cib->operation->insert_dictionary);
+    DataSetThreads(args->threads);
+    DataSetFilter((args->flags & X) != 0 ? args->filter : NULL);
+    CIBSetDurability(args->durability);
+
+    //An insertion that is resumed keeps taking checkpoints, so that it can be resumed again.
+    cib->operation->insert_resume = (args->flags & RESUME) != 0;
+    cib->operation->base_verify = (args->flags & VERIFY) != 0;
+    cib->operation->insert_checkpoint = args->checkpoint != 0 ? args->checkpoint : cib->operation->insert_resume == true ? 60 : 0;
+    CIBSetCheckpoint(cib->operation->insert_checkpoint);
+
+    //gzip and the program of --filter compress at most as many files at once as the frames of a file.
+    cib->operation->insert_filter = args->filter;
+    cib->operation->insert_filter_name = args->filter != NULL ? CodecFilterName(args->filter) : NULL;
+    if((args->flags & J) != 0 && CodecIsExternal(cib->operation->insert_codec) == true)
+        cib->operation->external_filter = CodecFilterCreate(args->threads != 0 ? args->threads : sysconf(_SC_NPROCESSORS_ONLN), CIBFilterDone);
+
+    //The deadline is turned into a rate from the size of the files to insert.
+    if(args->rate != 0 || args->deadline != 0){
+        uint64_t total_bytes = 0;
+        for(int i = 0; args->deadline != 0 && i < VectorGetSize(args->paths); i++)
+            total_bytes += CIBPathSize(VectorGetAt(args->paths, i));
+
+        cib->operation->level_controller = CodecControllerCreate(cib->operation->insert_codec, cib->operation->insert_level, args->rate, args->deadline, total_bytes);
+        cib->operation->control_stats = *DataGetCompressionStats();
+        cib->operation->control_time = CodecControllerNow();
+    }
+    uint64_t start = CodecControllerNow();
+
+    switch(args->flags & ~(SOLID | DICT | RESUME | VERIFY)){
+        case C: CIBCreate(args->cib_file, args->paths, false, args->base, false); break;
+        case C | J: CIBCreate(args->cib_file, args->paths, true, args->base, false); break;
+        case C | LOG: CIBCreate(args->cib_file, args->paths, false, args->base, true); break;
+        case C | J | LOG: CIBCreate(args->cib_file, args->paths, true, args->base, true); break;
         case A: CIBAppend(args->cib_file, args->paths, false); break;
         case A | J: CIBAppend(args->cib_file, args->paths, true); break;
-        case D: CIBDelete(args->cib_file, args->paths); break;
-        case Q: CIBQuery(args->cib_file, args->paths); break;
-        case X: CIBExtract(args->cib_file, args->paths); break;
+        case A | STAGE: CIBAppendStaged(args->cib_file, args->paths, false); break;
+        case A | J | STAGE: CIBAppendStaged(args->cib_file, args->paths, true); break;
+        case D:
+            if(args->snapshot != NULL) CIBDeleteSnapshot(args->cib_file, args->snapshot);
+            else CIBDelete(args->cib_file, args->paths);
+            break;
+        case Q: CIBQuery(args->cib_file, args->paths, args->snapshot); break;
+        case X: CIBExtract(args->cib_file, args->paths, args->snapshot, false); break;
+        case X | TRACE: CIBExtract(args->cib_file, args->paths, args->snapshot, true); break;
         case M: CIBPrintMetadata(args->cib_file); break;
-        case P: CIBPrintStructure(args->cib_file); break;
+        case P: CIBPrintStructure(args->cib_file, args->snapshot); break;
+        case S: CIBSnapshot(args->cib_file, VectorGetAt(args->paths, 0)); break;
+        case COMPACT: CIBCompact(args->cib_file, args->steps); break;
+        case VACUUM: CIBVacuum(args->cib_file, VectorGetAt(args->paths, 0)); break;
+        case RELAYOUT: CIBRelayout(args->cib_file, args->hot); break;
+        case CLEAN: CIBClean(args->cib_file); break;
+        case SERVE: CIBServe(args->socket, args->cib_file, args->paths, false); break;
+        case SERVE | MLOCK: CIBServe(args->socket, args->cib_file, args->paths, true); break;
+        case CLIENT: CIBClient(args->socket, args->cib_file, args->snapshot, args->batch); break;
         default: break;
     }
 
-    return;
-}
+    struct stat after;
+    if(DataGetPunchedBytes() != 0 && existed == true && stat(args->cib_file, &after) == 0 && after.st_blocks < before.st_blocks)
+        CIBPunchReport(args->cib_file, (before.st_blocks - after.st_blocks) * 512);
 
-int main(int argc, char *argv[]){
-    CIBArgs args;
-    
-    if((args = CIBReadArgs(argc, argv)) == NULL)
-        return -1;
+    //The compression time that the probe saved is estimated from the speed of the in-process codec on the
+    //files that it did compress. The probing time is subtracted.
+    DataCompressionStats stats = DataGetCompressionStats();
+    if(stats->compressed_files + stats->probed_files + stats->expanded_files != 0){
+        int64_t saved_ms = -1;
+        if(stats->timed_bytes != 0)
+            saved_ms = fmax(0, ((double) stats->probed_bytes * stats->compress_ns / stats->timed_bytes - stats->probe_ns) / 1e6);
+
+        CIBCompressionReport(args->cib_file, stats->compressed_files, stats->compressed_bytes, stats->payload_bytes, stats->probed_files,
+            stats->probed_bytes, stats->expanded_files, stats->expanded_bytes, saved_ms);
+    }
 
-    CIBStart(args);
+    if(cib->operation->insert_dictionary == true && stats->compressed_files + stats->probed_files + stats->expanded_files != 0)
+        CIBDictionaryReport(args->cib_file, cib->operation->dictionary_size, cib->operation->dictionary_samples, stats->dictionary_files);
 
-    CIBArgsDestroy(args);
-    return 0;
-}
\ No newline at end of file
+    if(cib->operation->level_controller != NULL){
+        Codec codec = CodecGet(cib->operation->insert_codec);
+        uint64_t files[codec->max_level + 1], bytes[codec->max_level + 1], total_bytes = 0;
+
+        for(int level = codec->min_level; level <= codec->max_level; level++){
+            files[level] = CodecControllerGetUsage(cib->operation->level_controller, level, &bytes[level]);
+            total_bytes += bytes[level];
+        }
+
+        CIBLevelReport(args->cib_file, codec->name, codec->min_level, codec->max_level, files, bytes, total_bytes / ((CodecControllerNow() - start) / 1e9) / 1e6);
+        CodecControllerDestroy(cib->operation->level_controller);
+    }
+
+    if(cib->operation->external_filter != NULL)
+        CodecFilterDestroy(cib->operation->external_filter);
+    free(cib->operation->insert_filter_name);
+
+    CIBStateUse(previous); CIBStateDestroy(state);
+    return;
+}
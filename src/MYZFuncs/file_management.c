@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,22 +8,28 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/file.h>
+#include <linux/falloc.h>
 #include <errno.h>
+#include <time.h>
+#include <libgen.h>
+#include <zlib.h>
 
 #include "syscalls.h"
 #include "ADTVector.h"
 #include "cli_utils.h"
 
 #include "data.h"
+#include "metadata.h"
+#include "codec.h"
 #include "header.h"
+#include "file_management.h"
+#include "cibfuncs.h"
 
 #define max(a, b) ((a) > (b) ? (a) : (b))
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
-extern int fd;
-extern void *header;
-extern void *data;
-extern void *md;
+__thread CIBState cib = NULL;
 
 /*Creates the directory specified by path.
 
@@ -63,37 +70,956 @@ int CreateDirRec(char *path){
     return 0;
 }
 
-/*Opens the existing cib file defined by path. If the opening is successful, the file is
-mapped and the pointers are set to pointing to the different partitions of the file.
+#define JOURNAL_MAGIC "CIBJRNL1"
+#define UPDATE_MIN_RESERVE (4ULL << 40)     //Address space reserved for the mapping of a cib file open for writing, at least.
+#define UPDATE_MAX_CHANGED (256ULL << 20)   //Memory that the changed pages of an update may take before they are committed.
+#define UPDATE_CHECK_NS 100000000ULL        //Nanoseconds between two checks of that memory.
+
+/*A cib file that is open for writing is updated copy-on-write. Its pages are mapped privately, so the pages that an
+update changes are copies in memory and the file stays as it was last committed. Only the space after the end of the
+committed file, which the committed file does not refer to, is mapped shared and written in place; so is the inside
+of the free chunk at the end of the data partition, where the data that are inserted next go.
+
+An update is committed by writing the changed pages, each after its offset, to the journal of the cib file,
+<cib-file>.journal, followed by a commit record that holds their checksum and the new size of the file. Once the
+journal is on the disk, the pages are written to the cib file and the journal is deleted. The changed pages that only
+the inside of a free chunk spanned when the update was last committed are written in place instead, before the
+journal, since nothing committed refers to them. An update interrupted before
+its commit record is written leaves the cib file as it was committed last; one interrupted after is completed by the
+next opening of the cib file, which writes the pages of the journal again. No opening ever sees half of an update.
+
+The mapping starts a range of reserved address space, so that it grows in place and its copied pages never move. Each
+archive keeps its own update, so any number of archives may be open for writing at once.
+
+The changed pages are found in /proc/self/pagemap. If it cannot be read, the whole cib file is mapped shared and
+updated in place, as a new one is, and an interrupted update may leave it damaged.*/
+
+/*The last record of a journal.*/
+typedef struct journal_commit{
+    char magic[8];          //JOURNAL_MAGIC
+    uint64_t pages;         //Number of pages in the journal.
+    uint64_t page_size;
+    uint64_t file_size;     //Size of the cib file after the update.
+    uint64_t checksum;      //crc32 of the pages and their offsets.
+}* JournalCommit;
+
+/*The update of the cib file of an archive, if it is open for writing, and the settings of its updates.*/
+struct cib_update{
+    int fd;                 //File descriptor of the cib file that is open for writing. -1 if there is none.
+    char *journal;          //Path of its journal.
+    uint64_t committed;     //Size of the cib file when it was last committed.
+    uint64_t mapped;        //Bytes of the cib file that are mapped.
+    uint64_t reserved;      //Bytes of address space reserved for the mapping.
+    uint64_t anon;          //Anonymous memory of the process when the update was last committed.
+    uint64_t checked;       //Time when that memory was last checked.
+    uint64_t committed_at;  //Time when the update was last committed.
+    uint64_t shared_start;  //Range before the end of the committed file that is mapped shared: the inside of the free
+    uint64_t shared_end;    //chunk at the end of the data partition when the update was last committed.
+    int pagemap_fd;         //File descriptor of /proc/self/pagemap. -1 if the cib file is updated in place.
+
+    uint64_t *free_pages;   //First and end page of each range of pages that only the inside of a free chunk spanned
+    uint64_t free_count;    //when the update was last committed, sorted.
+
+    uint64_t *holes;        //Offsets and lengths of the ranges whose disk space is released when the update is committed.
+    uint64_t hole_count;
+    uint64_t hole_capacity;
+
+    int durability;         //When the changes reach the disk. One of DURABILITY_*.
+    uint64_t checkpoint_ns; //Nanoseconds between two checkpoints, at which the update is committed. 0 if it takes none.
+
+    //Directory cursor of the insertion: the path, relative to the base directory, of the last directory whose entries
+    //are all stored. The next commit stores it in the cib file iff cursor_changed is true. resume_cursor is the cursor
+    //of the interrupted insertion that is resumed. NULL if none.
+    char *checkpoint_cursor, *resume_cursor;
+    bool cursor_changed;
+};
+
+/*Returns a new state, allocated in heap, of an archive with no open cib file. Its settings, e.g. the durability
+and the codec of insertions, are copied from the current state, if there is one.*/
+CIBState CIBStateCreate(){
+    CIBState state = malloc(sizeof(struct cib_state));
+
+    state->fd = -1;
+    state->header = state->data = state->md = NULL;
+
+    state->update = calloc(1, sizeof(struct cib_update));
+    state->update->fd = state->update->pagemap_fd = -1;
+    state->update->durability = cib != NULL ? cib->update->durability : DURABILITY_COMMIT;
+    state->update->checkpoint_ns = cib != NULL ? cib->update->checkpoint_ns : 0;
+
+    state->data_state = DataStateCreate(cib != NULL ? cib->data_state : NULL);
+    state->md_state = MDStateCreate();
+    state->operation = CIBOperationCreate(cib != NULL ? cib->operation : NULL);
+
+    return state;
+}
+
+/*Destroys the given state. Its cib file must have been closed.*/
+void CIBStateDestroy(CIBState state){
+    free(state->update->holes); free(state->update->free_pages);
+    free(state->update->checkpoint_cursor); free(state->update->resume_cursor);
+    free(state->update);
+
+    DataStateDestroy(state->data_state);
+    MDStateDestroy(state->md_state);
+    CIBOperationDestroy(state->operation);
+
+    free(state);
+    return;
+}
+
+/*Makes the given state the current one of the calling thread and returns the previous one.*/
+CIBState CIBStateUse(CIBState state){
+    CIBState previous = cib;
+    cib = state;
+
+    return previous;
+}
+
+/*Returns the size of a page of memory.*/
+static uint64_t PageSize(){
+    return sysconf(_SC_PAGESIZE);
+}
+
+/*Rounds size up to a multiple of the page size.*/
+static uint64_t PageRound(uint64_t size){
+    return (size + PageSize() - 1) / PageSize() * PageSize();
+}
+
+/*Returns the anonymous memory of the process in bytes, which includes the pages that the update has copied.*/
+static uint64_t AnonBytes(){
+    unsigned long size, resident = 0, shared = 0;
+
+    FILE *statm = fopen("/proc/self/statm", "re");
+    if(statm != NULL){
+        if(fscanf(statm, "%lu %lu %lu", &size, &resident, &shared) != 3)
+            resident = shared = 0;
+        fclose(statm);
+    }
+
+    return resident > shared ? (resident - shared) * PageSize() : 0;
+}
+
+/*Returns the time of the monotonic clock in nanoseconds.*/
+static uint64_t UpdateNow(){
+    struct timespec now; clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*Returns the path of the journal of the cib file defined by path. It must be freed.*/
+static char *JournalPath(char *path){
+    char *real_path = RealPath(path);
+    char *journal = malloc(strlen(real_path) + 9);
+
+    sprintf(journal, "%s.journal", real_path);
+    free(real_path);
+    return journal;
+}
+
+/*Writes the directory that holds the file defined by path to the disk, so that the file's creation or deletion survives a crash.*/
+static void SyncParentDir(char *path){
+    char copy[strlen(path) + 1]; strcpy(copy, path);
+
+    int dir_fd = open(dirname(copy), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dir_fd != -1){
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+
+    return;
+}
+
+/*Reads the commit record of the journal with file descriptor journal_fd in *commit and checks the pages against
+it. Returns true iff the journal is complete.*/
+static bool JournalIsComplete(int journal_fd, JournalCommit commit){
+    struct stat info;
+    if(fstat(journal_fd, &info) == -1 || info.st_size < (off_t) sizeof(struct journal_commit))
+        return false;
+
+    if(pread(journal_fd, commit, sizeof(struct journal_commit), info.st_size - sizeof(struct journal_commit)) != sizeof(struct journal_commit) ||
+        memcmp(commit->magic, JOURNAL_MAGIC, sizeof(commit->magic)) != 0 || commit->page_size == 0 ||
+        commit->pages * (sizeof(uint64_t) + commit->page_size) + sizeof(struct journal_commit) != (uint64_t) info.st_size)
+        return false;
+
+    uint64_t record_size = sizeof(uint64_t) + commit->page_size;
+    char *record = malloc(record_size);
+    uLong checksum = crc32(0, NULL, 0);
+
+    for(uint64_t i = 0; i < commit->pages; i++){
+        if(pread(journal_fd, record, record_size, i * record_size) != (ssize_t) record_size){
+            free(record);
+            return false;
+        }
+
+        checksum = crc32(checksum, (Bytef *) record, record_size);
+    }
+
+    free(record);
+    return checksum == commit->checksum;
+}
+
+/*Returns true iff the journal defined by path is complete, so that its update must be completed before the cib file is read.*/
+static bool JournalIsPending(char *journal){
+    int journal_fd = open(journal, O_RDONLY | O_CLOEXEC);
+    if(journal_fd == -1)
+        return false;
+
+    struct journal_commit commit;
+    bool pending = JournalIsComplete(journal_fd, &commit);
+
+    close(journal_fd);
+    return pending;
+}
+
+/*If the journal defined by path is complete, writes its pages to the cib file with file descriptor cib_fd, which must
+be open for writing, and sets the size of the file. Then the journal, complete or not, is deleted.
 
 On success 0 is returned. On failure, -1 is returned.*/
-int OpenExistingCIB(char *path){
-    if(OpenFile(path, &fd, O_RDWR, 0777) == -1)
+static int JournalReplay(char *journal, int cib_fd){
+    int journal_fd = open(journal, O_RDONLY | O_CLOEXEC);
+    if(journal_fd == -1)
+        return 0;
+
+    struct journal_commit commit; int res = 0;
+    if(JournalIsComplete(journal_fd, &commit) == true){
+        uint64_t record_size = sizeof(uint64_t) + commit.page_size;
+        char *record = malloc(record_size);
+
+        for(uint64_t i = 0; i < commit.pages && res == 0; i++){
+            uint64_t offset;
+            if(pread(journal_fd, record, record_size, i * record_size) != (ssize_t) record_size || (offset = *(uint64_t *) record) >= commit.file_size)
+                continue;
+
+            uint64_t length = min(commit.page_size, commit.file_size - offset);
+            if(pwrite(cib_fd, record + sizeof(uint64_t), length, offset) != (ssize_t) length)
+                res = -1;
+        }
+
+        if(res == 0 && (ftruncate(cib_fd, commit.file_size) == -1 || fdatasync(cib_fd) == -1))
+            res = -1;
+
+        free(record);
+    }
+
+    close(journal_fd);
+    if(res == 0 && unlink(journal) == -1 && errno != ENOENT)
+        res = -1;
+
+    if(res == -1)
+        perror("journal");
+    else
+        SyncParentDir(journal);
+
+    return res;
+}
+
+/*Completes the interrupted update of the cib file defined by path for a reader. The reader's shared lock cannot be
+turned into the exclusive lock that this needs while it is held, so the reader closes the cib file first. If wait is
+false and another process holds a lock of the cib file, 1 is returned at once.
+
+On success 0 is returned. On failure, -1 is returned.*/
+static int RecoverCIB(char *path, char *journal, bool wait){
+    if((cib->fd = open(path, O_RDWR | O_CLOEXEC)) == -1){
+        CIBJournalNotReplayed(path);
         return -1;
+    }
+
+    int res = LockCIB(wait == true ? LOCK_EX : LOCK_EX | LOCK_NB);
+    if(res == 0)
+        res = JournalReplay(journal, cib->fd);
+
+    close(cib->fd);
+    return res;
+}
 
-    struct stat info; fstat(fd, &info);
+/*Opens /proc/self/pagemap, which tells which pages of a private mapping were copied on write, and returns its file
+descriptor. If it cannot be read, e.g. since /proc is not mounted, -1 is returned.*/
+static int UpdateOpenPagemap(){
+    uint64_t entry; int map_fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+
+    if(map_fd != -1 && pread(map_fd, &entry, sizeof(entry), (uintptr_t) &entry / PageSize() * sizeof(entry)) != sizeof(entry)){
+        close(map_fd);
+        map_fd = -1;
+    }
+
+    return map_fd;
+}
+
+/*Returns the end of the part of the mapping of the cib file that is open for writing that is mapped privately: the
+end of the committed file, or 0 if the file is updated in place.*/
+static uint64_t UpdatePrivateEnd(){
+
+    return cib->update->pagemap_fd == -1 ? 0 : PageRound(cib->update->committed);
+}
+
+/*Returns an array, allocated in heap, that tells for each of the first "pages" pages of the mapping of the cib file
+that is open for writing whether the update has changed it. Pages whose entries of /proc/self/pagemap cannot be
+read are taken as changed.*/
+static bool *UpdateChangedPages(uint64_t pages){
+    bool *changed = calloc(pages + 1, sizeof(bool));
+    uint64_t page = PageSize(), entries[512];
+
+    for(uint64_t i = 0; i < pages; i += 512){
+        uint64_t count = min(512, pages - i);
+        off_t offset = ((uintptr_t) cib->header / page + i) * sizeof(uint64_t);
+        bool read = pread(cib->update->pagemap_fd, entries, count * sizeof(uint64_t), offset) == (ssize_t) (count * sizeof(uint64_t));
+
+        //A page that is present but is no page of the file, or that is swapped out, is a copy.
+        for(uint64_t j = 0; j < count; j++)
+            changed[i + j] = read == false || (entries[j] >> 62 & 1) || ((entries[j] >> 63 & 1) && !(entries[j] >> 61 & 1));
+    }
 
-    header = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if(header == MAP_FAILED){
+    return changed;
+}
+
+/*Compares two ranges of pages by their first page.*/
+static int UpdateCompareRanges(const void *a, const void *b){
+    uint64_t first_a = *(const uint64_t *) a, first_b = *(const uint64_t *) b;
+
+    return first_a < first_b ? -1 : first_a > first_b;
+}
+
+/*Records the pages of the cib file that is open for writing that only the inside of a free chunk spans, which the
+next commit writes in place.*/
+static void UpdateRecordFreePages(){
+    uint64_t page = PageSize(), base = (char *) cib->data - (char *) cib->header, *ranges;
+    uint64_t count = DataGetFreeInsides(&ranges);
+
+    cib->update->free_count = 0;
+    for(uint64_t i = 0; i < count; i++){
+        uint64_t first = PageRound(base + ranges[2 * i]) / page, end = (base + ranges[2 * i] + ranges[2 * i + 1]) / page;
+        if(end <= first)
+            continue;
+
+        ranges[2 * cib->update->free_count] = first;
+        ranges[2 * cib->update->free_count + 1] = end;
+        cib->update->free_count++;
+    }
+
+    qsort(ranges, cib->update->free_count, 2 * sizeof(uint64_t), UpdateCompareRanges);
+
+    free(cib->update->free_pages);
+    cib->update->free_pages = ranges;
+    return;
+}
+
+/*Returns true iff only the inside of a free chunk spanned the given page of the cib file that is open for writing
+when the update was last committed.*/
+static bool UpdateWasFree(uint64_t page){
+    uint64_t low = 0, high = cib->update->free_count;
+
+    while(low < high){
+        uint64_t middle = (low + high) / 2;
+
+        if(cib->update->free_pages[2 * middle + 1] <= page)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low < cib->update->free_count && cib->update->free_pages[2 * low] <= page;
+}
+
+/*Releases the disk space of the ranges that the update freed, except of the pages that it changed since. changed
+tells which of the first "pages" pages of the cib file were changed.*/
+static void UpdatePunchHoles(bool *changed, uint64_t pages){
+    uint64_t page = PageSize();
+
+    for(uint64_t i = 0; i < cib->update->hole_count; i++){
+        uint64_t offset = cib->update->holes[2 * i], end = offset + cib->update->holes[2 * i + 1];
+
+        while(offset < end){
+            uint64_t run = offset;
+            while(run < end && (run / page >= pages || changed[run / page] == false))
+                run = min(end, (run / page + 1) * page);
+
+            if(run > offset)
+                fallocate(cib->update->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, run - offset);
+
+            offset = min(end, (run / page + 1) * page);
+        }
+    }
+
+    cib->update->hole_count = 0;
+    return;
+}
+
+/*Maps the inside of the free chunk at the end of the data partition of the cib file that is open for writing
+shared, so that the data inserted in it are written in place. Nothing that is committed refers to it.*/
+static void UpdateShareFreeTail(){
+    uint64_t page = PageSize(), offset, length;
+    cib->update->shared_start = cib->update->shared_end = 0;
+
+    if(DataGetFreeTail(&offset, &length) == false)
+        return;
+
+    offset += (char *) cib->data - (char *) cib->header;
+    uint64_t start = PageRound(offset), end = min((offset + length) / page * page, UpdatePrivateEnd());
+
+    if(end > start && mmap((char *) cib->header + start, end - start, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, cib->update->fd, start) != MAP_FAILED){
+        cib->update->shared_start = start;
+        cib->update->shared_end = end;
+    }
+
+    return;
+}
+
+/*Commits the changes that were made to the cib file that is open for writing since it was last committed.*/
+static void CommitUpdate(){
+    uint64_t page = PageSize(), size = cib->update->mapped;
+    bool durable = cib->update->durability != DURABILITY_NONE, ok = true;
+    cib->update->committed_at = UpdateNow();
+
+    //A cib file that is updated in place holds the changes already.
+    if(cib->update->pagemap_fd == -1){
+        if(size != cib->update->committed && ftruncate(cib->update->fd, size) == -1)
+            perror("ftruncate");
+        if(durable == true && size != 0)
+            msync(cib->header, size, MS_SYNC);
+
+        cib->update->committed = size;
+        cib->update->anon = AnonBytes();
+        return;
+    }
+
+    uint64_t pages = PageRound(min(cib->update->mapped, cib->update->committed)) / page, count = 0, journaled = 0;
+    bool *changed = UpdateChangedPages(pages), *free_before = calloc(pages + 1, sizeof(bool));
+
+    for(uint64_t i = 0; i < pages; i++){
+        free_before[i] = changed[i] == true && UpdateWasFree(i) == true;
+        count += changed[i];
+        journaled += changed[i] == true && free_before[i] == false;
+    }
+
+    if(count == 0 && size == cib->update->committed && cib->update->hole_count == 0){
+        free(changed); free(free_before);
+        return;
+    }
+
+    //The changed pages that were free are written in place, once, and reach the disk before the journal does.
+    for(uint64_t i = 0; i < pages && ok == true; i++){
+        uint64_t offset = i * page;
+
+        if(free_before[i] == true && offset < size)
+            ok = pwrite(cib->update->fd, (char *) cib->header + offset, min(page, size - offset), offset) != -1;
+    }
+
+    int journal_fd = open(cib->update->journal, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+    if(journal_fd == -1){
+        perror("journal");
+        free(changed); free(free_before);
+        return;
+    }
+
+    struct journal_commit commit = {.pages = journaled, .page_size = page, .file_size = size, .checksum = crc32(0, NULL, 0)};
+    memcpy(commit.magic, JOURNAL_MAGIC, sizeof(commit.magic));
+
+    uint64_t record_size = sizeof(uint64_t) + page;
+    char *record = malloc(record_size);
+
+    for(uint64_t i = 0; i < pages && ok == true; i++){
+        if(changed[i] == false || free_before[i] == true)
+            continue;
+
+        *(uint64_t *) record = i * page;
+        memcpy(record + sizeof(uint64_t), (char *) cib->header + i * page, page);
+
+        commit.checksum = crc32(commit.checksum, (Bytef *) record, record_size);
+        ok = WriteBytes(record, record_size, journal_fd) == (int) record_size;
+    }
+
+    ok = ok && WriteBytes((char *) &commit, sizeof(commit), journal_fd) == sizeof(commit);
+
+    //The data written in place, after the end of the committed file or in free space, and the journal reach the disk
+    //before any page of the committed file is overwritten.
+    if(durable == true)
+        ok = ok && fdatasync(cib->update->fd) == 0 && fdatasync(journal_fd) == 0;
+    close(journal_fd);
+
+    if(ok == false){
+        perror("journal");
+        unlink(cib->update->journal);
+
+        free(record); free(changed); free(free_before);
+        return;
+    }
+
+    if(durable == true)
+        SyncParentDir(cib->update->journal);
+
+    for(uint64_t i = 0; i < pages; i++){
+        uint64_t offset = i * page;
+
+        if(changed[i] == true && free_before[i] == false && offset < size && pwrite(cib->update->fd, (char *) cib->header + offset, min(page, size - offset), offset) == -1)
+            perror("pwrite");
+    }
+
+    if(ftruncate(cib->update->fd, size) == -1)
+        perror("ftruncate");
+
+    UpdatePunchHoles(changed, pages);
+
+    if(durable == true)
+        fdatasync(cib->update->fd);
+
+    unlink(cib->update->journal);
+    if(durable == true)
+        SyncParentDir(cib->update->journal);
+
+    //The pages are mapped afresh, now that they match the file, so that the next update copies them again.
+    if(mmap(cib->header, PageRound(size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, cib->update->fd, 0) == MAP_FAILED)
+        perror("mmap");
+
+    cib->update->committed = size;
+    cib->update->anon = AnonBytes();
+    UpdateShareFreeTail();
+    UpdateRecordFreePages();
+
+    free(record); free(changed); free(free_before);
+    return;
+}
+
+/*Stores the directory cursor of the insertion in the cib file that is open for writing, if it changed, so that
+it is committed together with the entries that it covers.*/
+static void UpdateCursor(){
+    if(cib->update->cursor_changed == false)
+        return;
+
+    if(HeadGetResumeCursor() != 0)
+        DataDeleteFile(HeadGetResumeCursor());
+
+    HeadSetResumeCursor(cib->update->checkpoint_cursor != NULL ? DataInsertBytes(cib->update->checkpoint_cursor, strlen(cib->update->checkpoint_cursor), CODEC_NONE, 0) : 0);
+    cib->update->cursor_changed = false;
+    return;
+}
+
+/*Commits the update of the cib file that is open for writing if every step is to be durable, if a checkpoint is
+due, or if the pages that it changed take too much memory.*/
+static void UpdateStep(){
+    uint64_t now_ns = UpdateNow();
+
+    if(cib->update->durability == DURABILITY_FILE || (cib->update->checkpoint_ns != 0 && now_ns - cib->update->committed_at >= cib->update->checkpoint_ns)){
+        UpdateCursor();
+        CommitUpdate();
+
+    }else if(now_ns - cib->update->checked >= UPDATE_CHECK_NS){
+        cib->update->checked = now_ns;
+
+        if(AnonBytes() > cib->update->anon + UPDATE_MAX_CHANGED){
+            UpdateCursor();
+            CommitUpdate();
+        }
+    }
+
+    return;
+}
+
+/*Sets the mapped size of the cib file that is open for writing to the given size. The file is never shrunk before
+the update is committed, since the committed file may refer to its end. Pages before the end of the committed file
+are mapped privately, the rest shared.
+
+On success 0 is returned. On failure -1 is returned.*/
+static int UpdateResize(uint64_t size){
+    uint64_t old_end = PageRound(cib->update->mapped), new_end = PageRound(size), committed_end = UpdatePrivateEnd();
+
+    struct stat info; fstat(cib->update->fd, &info);
+    if(new_end > cib->update->reserved){
+        errno = ENOMEM;
+        perror("mmap");
+        return -1;
+
+    }
+    if(size > (uint64_t) info.st_size && ftruncate(cib->update->fd, size) == -1){
+        perror("ftruncate");
+        return -1;
+
+    }
+
+    if(new_end > old_end){
+        uint64_t split = max(old_end, min(new_end, committed_end));
+
+        if((split > old_end && mmap((char *) cib->header + old_end, split - old_end, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, cib->update->fd, old_end) == MAP_FAILED) ||
+            (new_end > split && mmap((char *) cib->header + split, new_end - split, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, cib->update->fd, split) == MAP_FAILED)){
+            perror("mmap");
+            return -1;
+
+        }
+
+    }else if(new_end < old_end)
+        mmap((char *) cib->header + new_end, old_end - new_end, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+
+    //Space that the file held before it was shrunk reads as zeros, as it would after ftruncate().
+    if(size > cib->update->mapped && cib->update->mapped < (uint64_t) info.st_size)
+        memset((char *) cib->header + cib->update->mapped, 0, min(size, (uint64_t) info.st_size) - cib->update->mapped);
+
+    cib->update->mapped = size;
+    return 0;
+}
+
+/*Sets when the changes to the cib files that are opened for writing reach the disk. One of DURABILITY_*.*/
+void CIBSetDurability(int level){
+    cib->update->durability = level;
+
+    return;
+}
+
+/*Makes the updates of the cib files that are opened for writing be committed, between two files or steps, once
+the given number of seconds have passed since they were last committed. 0 turns the checkpoints off.*/
+void CIBSetCheckpoint(uint64_t seconds){
+    cib->update->checkpoint_ns = seconds * 1000000000ULL;
+
+    return;
+}
+
+/*Sets the directory cursor of the insertion into the cib file that is open for writing to the given path, relative
+to the base directory, of a directory whose entries, and the entries inserted before it, are all stored. Each commit
+stores the cursor in the cib file, so that a resumed insertion skips the entries before it without reading them
+again. NULL removes the cursor; an insertion that ends does so.*/
+void CIBSetCheckpointCursor(char *path){
+    if(path != NULL && cib->update->checkpoint_cursor != NULL && strcmp(path, cib->update->checkpoint_cursor) == 0)
+        return;
+
+    free(cib->update->checkpoint_cursor);
+    cib->update->checkpoint_cursor = path != NULL ? strdup(path) : NULL;
+    cib->update->cursor_changed = true;
+    return;
+}
+
+/*Resumes the interrupted insertion into the cib file that is open for writing from the directory cursor that it
+stored, if any. Until the cursor changes, it is kept in the cib file.*/
+void CIBResumeBegin(){
+    free(cib->update->resume_cursor); free(cib->update->checkpoint_cursor);
+    cib->update->resume_cursor = cib->update->checkpoint_cursor = NULL;
+    cib->update->cursor_changed = false;
+
+    if(HeadGetResumeCursor() != 0){
+        uint64_t size; char *bytes = DataGetBytes(HeadGetResumeCursor(), &size);
+
+        cib->update->resume_cursor = strndup(bytes, size);
+        cib->update->checkpoint_cursor = strdup(cib->update->resume_cursor);
+    }
+
+    return;
+}
+
+/*Returns true iff the entry with the given name in the directory defined by dir_path, relative to the base directory,
+was inserted, with everything under it, before the directory cursor of the resumed insertion. Insertions that store
+a cursor visit the entries of each directory in the order of their names. If name is NULL, the directory itself is
+checked.*/
+bool CIBResumeSkips(char *dir_path, char *name){
+    if(cib->update->resume_cursor == NULL)
+        return false;
+
+    //Paths of the entities under "." start with "./".
+    while(strncmp(dir_path, "./", 2) == 0)
+        dir_path += 2;
+    if(strcmp(dir_path, ".") == 0)
+        dir_path = "";
+
+    size_t length = strlen(dir_path);
+    if(name == NULL)
+        return length > 0 && strcmp(dir_path, cib->update->resume_cursor) == 0;
+
+    //Only the entries of the directories that lead to the cursor may precede it.
+    char *rest = cib->update->resume_cursor;
+    if(length > 0 && (strncmp(cib->update->resume_cursor, dir_path, length) != 0 || cib->update->resume_cursor[length] != '/'))
+        return false;
+    if(length > 0)
+        rest += length + 1;
+
+    size_t component = strcspn(rest, "/");
+    char next[component + 1];
+    memcpy(next, rest, component); next[component] = '\0';
+
+    int order = strcmp(name, next);
+    return order < 0 || (order == 0 && rest[component] == '\0');
+}
+
+/*Ends the resumed insertion.*/
+void CIBResumeEnd(){
+    free(cib->update->resume_cursor);
+    cib->update->resume_cursor = NULL;
+
+    return;
+}
+
+/*Waits until the open cib file of the current archive is locked with the given lock, LOCK_SH
+or LOCK_EX. Any number of processes may hold a shared lock on a cib file at once, but an exclusive lock only one
+and while no shared lock is held. The lock is released when the file is closed. If lock includes LOCK_NB, the call
+does not wait: if another process holds a lock that conflicts with it, 1 is returned.
+
+On success 0 is returned. On failure, -1 is returned.*/
+int LockCIB(int lock){
+    while(flock(cib->fd, lock) == -1){
+        if(errno == EWOULDBLOCK && (lock & LOCK_NB) != 0)
+            return 1;
+
+        if(errno != EINTR){
+            perror("flock");
+            return -1;
+
+        }
+    }
+
+    return 0;
+}
+
+/*Returns the absolute path, allocated in heap, of the open cib file. If it cannot be found, NULL is returned.*/
+char *CIBGetPath(){
+    char link[64];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", cib->fd);
+
+    return realpath(link, NULL);
+}
+
+/*Opens the existing cib file defined by path, for writing under an exclusive lock or for reading only under a
+shared one, and maps it. An update of the file that was interrupted after it was committed is completed first.
+If wait is false and another process holds a lock that conflicts with the one needed, 1 is returned at once.
+On success 0 is returned. On failure, -1 is returned.*/
+static int MapExistingCIB(char *path, bool writable, bool wait){
+    if(OpenFile(path, &cib->fd, (writable == true ? O_RDWR : O_RDONLY) | O_CLOEXEC, 0777) == -1)
+        return -1;
+
+    int res = LockCIB((writable == true ? LOCK_EX : LOCK_SH) | (wait == true ? 0 : LOCK_NB));
+    if(res != 0){
+        close(cib->fd);
+        return res;
+
+    }
+
+    char *journal = JournalPath(path);
+    if(writable == false && JournalIsPending(journal) == true){
+        close(cib->fd);
+        res = RecoverCIB(path, journal, wait);
+
+        free(journal);
+        return res != 0 ? res : MapExistingCIB(path, false, wait);
+    }
+
+    if(writable == true && JournalReplay(journal, cib->fd) == -1){
+        close(cib->fd); free(journal);
+        return -1;
+
+    }
+
+    struct stat info; fstat(cib->fd, &info);
+
+    if(writable == true){
+        cib->update->pagemap_fd = UpdateOpenPagemap();
+        if(cib->update->pagemap_fd == -1)
+            CIBUpdatedInPlace(path);
+
+        cib->update->reserved = PageRound(max(8 * (uint64_t) info.st_size, UPDATE_MIN_RESERVE));
+        void *reserved = mmap(NULL, cib->update->reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+        cib->header = reserved == MAP_FAILED ? MAP_FAILED : mmap(reserved, info.st_size, PROT_READ | PROT_WRITE, (cib->update->pagemap_fd == -1 ? MAP_SHARED : MAP_PRIVATE) | MAP_FIXED, cib->fd, 0);
+        if(cib->header == MAP_FAILED && reserved != MAP_FAILED)
+            munmap(reserved, cib->update->reserved);
+
+    }else
+        cib->header = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, cib->fd, 0);
+
+    if(cib->header == MAP_FAILED){
         perror("map");
+        if(writable == true && cib->update->pagemap_fd != -1)
+            close(cib->update->pagemap_fd);
+
+        close(cib->fd); free(journal);
         return -1;
 
     }
 
-    data = (char *) header + HeadGetHeaderSize();
-    md = (char *) data + HeadGetDataSize();
-    
+    if(writable == true){
+        cib->update->fd = cib->fd;
+        cib->update->journal = journal;
+        cib->update->committed = cib->update->mapped = info.st_size;
+        cib->update->anon = AnonBytes();
+        cib->update->committed_at = UpdateNow();
+        cib->update->hole_count = 0;
+
+    }else
+        free(journal);
+
+    cib->data = (char *) cib->header + HeadGetHeaderSize();
+    cib->md = (char *) cib->data + HeadGetDataSize();
+
+    if(writable == true){
+        UpdateShareFreeTail();
+        UpdateRecordFreePages();
+    }
+
+    return 0;
+}
+
+/*Opens the existing cib file defined by path for writing. The call waits until it holds the exclusive
+lock of the file. If the opening is successful, the file is mapped and the pointers are set to pointing
+to the different partitions of the file. The changes are committed when the file is closed.
+
+On success 0 is returned. On failure, -1 is returned.*/
+int OpenExistingCIB(char *path){
+    return MapExistingCIB(path, true, true);
+}
+
+/*Opens the existing cib file defined by path for reading only. The call waits until it holds a shared
+lock of the file, so that no writer changes the file while it is open. If the opening is successful, the
+file is mapped read-only and the pointers are set to pointing to the different partitions of the file.
+
+On success 0 is returned. On failure, -1 is returned.*/
+int OpenExistingCIBReadOnly(char *path){
+    return MapExistingCIB(path, false, true);
+}
+
+/*Releases the shared lock of the open cib file, which is open for reading only and stays mapped, so that writers may
+update it meanwhile. Nothing of the cib file may be read until RelockCIB() locks it again.*/
+void UnlockCIB(){
+    flock(cib->fd, LOCK_UN);
+
+    return;
+}
+
+/*Waits until the open cib file, defined by path and mapped size bytes long, whose lock UnlockCIB() released, holds
+a shared lock again. The updates that were committed meanwhile are seen through the mapping, unless they changed the
+size of the file; then, or if path now refers to another file or an update of it was interrupted, the cib file is
+closed and opened again. A cib file whose fd is -1, since it could not be opened again, is opened. If wait is false,
+the call does not wait while a writer holds the lock of the file.
+
+Returns 0 if the mapping is kept and 1 if the cib file was opened again. If wait is false and a writer holds the
+lock, 2 is returned and the cib file stays released; its fd is -1 if it was closed. On failure, -1 is returned and
+the cib file is closed. Whenever the lock is held again, the data state drops what it derived from the content.*/
+int RelockCIB(char *path, uint64_t size, bool wait){
+    int res = cib->fd == -1 ? -1 : LockCIB(wait == true ? LOCK_SH : LOCK_SH | LOCK_NB);
+    if(res == 1)
+        return 2;
+
+    struct stat info, current;
+    char *journal = JournalPath(path);
+
+    bool same = res == 0 && fstat(cib->fd, &info) == 0 && stat(path, &current) == 0 && (uint64_t) info.st_size == size &&
+        info.st_ino == current.st_ino && info.st_dev == current.st_dev && JournalIsPending(journal) == false;
+    free(journal);
+
+    if(same == true){
+        cib->data = (char *) cib->header + HeadGetHeaderSize();
+        cib->md = (char *) cib->data + HeadGetDataSize();
+        DataStateDropCaches();
+        return 0;
+    }
+
+    if(cib->fd != -1){
+        munmap(cib->header, size); close(cib->fd);
+    }
+
+    res = MapExistingCIB(path, false, wait);
+    if(res == 1)
+        cib->fd = -1;
+    else if(res == 0)
+        DataStateDropCaches();
+
+    return res == 0 ? 1 : res == 1 ? 2 : -1;
+}
+
+/*Creates the cib file defined by path, or opens it to be overwritten, and waits until it holds its exclusive lock.
+The journal that an interrupted update of an older file with the same path may have left is deleted.
+
+On success 0 is returned. On failure, -1 is returned.*/
+int OpenNewCIB(char *path){
+    if(OpenFile(path, &cib->fd, O_CREAT | O_RDWR | O_CLOEXEC, 0755) == -1)
+        return -1;
+
+    if(LockCIB(LOCK_EX) == -1){
+        close(cib->fd);
+        cib->fd = -1;
+        return -1;
+
+    }
+
+    char *journal = JournalPath(path);
+    unlink(journal); free(journal);
+
     return 0;
 }
 
-/*Closes the open cib file with file descriptor the global int fd and unmaps it.*/
+/*Closes the open cib file of the current archive and unmaps it. If the file is open for
+writing, its changes are committed first.*/
 void CloseExistingCIB(){
-    struct stat info; fstat(fd, &info);
+    if(cib->update->fd == cib->fd){
+        UpdateCursor();
+        CommitUpdate();
+        munmap(cib->header, cib->update->reserved); close(cib->fd);
+        if(cib->update->pagemap_fd != -1)
+            close(cib->update->pagemap_fd);
+
+        cib->update->fd = cib->update->pagemap_fd = -1;
+        free(cib->update->journal); cib->update->journal = NULL;
+        return;
+    }
+
+    struct stat info; fstat(cib->fd, &info);
+
+    munmap(cib->header, info.st_size); close(cib->fd);
+    return;
+}
+
+/*Writes the changes made to the open cib file to the disk. The function returns after the write is complete.
+If the cib file is open for writing, its changes are committed instead when every step is to be durable, or when
+they take too much memory; otherwise they are committed when the file is closed.*/
+void CIBSync(){
+    if(cib->update->fd == cib->fd){
+        UpdateStep();
+        return;
+    }
+
+    msync(cib->header, HeadGetFileSize(), MS_SYNC);
+
+    return;
+}
+
+/*Marks that a file has been stored in the open cib file. If the cib file is open for writing, the changes made
+so far are committed when every file is to be durable, when a checkpoint is due, or when they take too much memory.*/
+void CIBFileStored(){
+    if(cib->update->fd == cib->fd)
+        UpdateStep();
 
-    munmap(header, info.st_size); close(fd);
     return;
 }
 
+/*Releases the disk space of length bytes of the open cib file from the given offset. Their content reads as
+zeros afterwards. If the cib file is open for writing, the space that the committed file refers to is released
+when the update is committed. Returns false if the file system does not support it.*/
+bool CIBPunchHole(uint64_t offset, uint64_t length){
+    if(cib->update->fd != cib->fd)
+        return fallocate(cib->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) == 0;
+
+    uint64_t end = offset + length, committed_end = UpdatePrivateEnd();
+    bool punched = true;
+
+    while(offset < end){
+        //Ranges that the committed file does not refer to are released at once.
+        bool shared = offset >= committed_end || (offset >= cib->update->shared_start && offset < cib->update->shared_end);
+        uint64_t next = offset >= committed_end ? end : shared == true ? min(end, cib->update->shared_end) :
+            min(end, offset < cib->update->shared_start ? min(cib->update->shared_start, committed_end) : committed_end);
+
+        if(shared == true){
+            punched = fallocate(cib->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, next - offset) == 0 && punched;
+
+        }else{
+            if(cib->update->hole_count == cib->update->hole_capacity){
+                cib->update->hole_capacity = 2 * cib->update->hole_capacity + 16;
+                cib->update->holes = realloc(cib->update->holes, 2 * cib->update->hole_capacity * sizeof(uint64_t));
+            }
+
+            cib->update->holes[2 * cib->update->hole_count] = offset;
+            cib->update->holes[2 * cib->update->hole_count + 1] = next - offset;
+            cib->update->hole_count++;
+        }
+
+        offset = next;
+    }
+
+    return punched;
+}
+
 /*Sets the size of the different partitions of the cib file to the given sizes. After truncation, the
 file is re-mapped and the pointers of the different partitions are recalculated.
 
@@ -102,30 +1028,36 @@ Warning! This function does not shift chunks of data inside the cib file.
 
 On success 0 is returned. On failure -1 is returned.*/
 int TruncMapAndUpdate(uint64_t header_size, int64_t md_size, int64_t data_size, bool mapped){
-    struct stat info; fstat(fd, &info);
-
-    if(mapped == true){
-        if(munmap(header, info.st_size) == -1){
-            perror("mmap");
+    if(mapped == true && cib->update->fd == cib->fd){
+        if(UpdateResize(header_size + md_size + data_size) == -1)
             return -1;
 
+    }else{
+        struct stat info; fstat(cib->fd, &info);
+
+        if(mapped == true){
+            if(munmap(cib->header, info.st_size) == -1){
+                perror("mmap");
+                return -1;
+
+            }
         }
-    }
-    if(ftruncate(fd, header_size + md_size + data_size) == -1){
-        perror("ftruncate");
-        return -1;
+        if(ftruncate(cib->fd, header_size + md_size + data_size) == -1){
+            perror("ftruncate");
+            return -1;
 
-    }
+        }
 
-    header = mmap(NULL, header_size + data_size + md_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if(header == MAP_FAILED){
-        perror("mmap");
-        return -1;
+        cib->header = mmap(NULL, header_size + data_size + md_size, PROT_READ | PROT_WRITE, MAP_SHARED, cib->fd, 0);
+        if(cib->header == MAP_FAILED){
+            perror("mmap");
+            return -1;
 
+        }
     }
     
-    data = (char *) header + header_size;
-    md = (char *) data + data_size;
+    cib->data = (char *) cib->header + header_size;
+    cib->md = (char *) cib->data + data_size;
 
     HeadSetMDSize(md_size);
     HeadSetDataSize(data_size);
@@ -137,7 +1069,7 @@ int TruncMapAndUpdate(uint64_t header_size, int64_t md_size, int64_t data_size,
 Returns the number of dirs/entries/lists under the directory.*/
 uint64_t CalculateDirSpaceRec(char *path, uint32_t *node_blocks, uint64_t *data_blocks){
     //Obtain stat info about our .cib file.
-    struct stat cib_info; fstat(fd, &cib_info);
+    struct stat cib_info; fstat(cib->fd, &cib_info);
 
     //Number of entries under current_directory and subdirectories of current_directory
     uint64_t entries = 0;
@@ -156,6 +1088,10 @@ uint64_t CalculateDirSpaceRec(char *path, uint32_t *node_blocks, uint64_t *data_
         char entry_path[strlen(path) + strlen(entry->d_name) + 2];
         snprintf(entry_path, sizeof(entry_path), "%s/%s", path, entry->d_name);
 
+        //The entries that a resumed insertion stored before its cursor are not read again.
+        if(CIBResumeSkips(path, entry->d_name) == true)
+            continue;
+
         struct stat info;
         //Something must have gone really wrong. 
         if(lstat(entry_path, &info) == -1){
@@ -203,7 +1139,10 @@ uint64_t CalculateSpace(Vector paths, uint32_t *node_blocks, uint64_t *data_bloc
             continue;
         }
 
-        if(S_ISDIR(info.st_mode) == true){
+        if(S_ISDIR(info.st_mode) == true && CIBResumeSkips(path, NULL) == true){
+            entries += 1;
+
+        }else if(S_ISDIR(info.st_mode) == true){
             entries += 1 + CalculateDirSpaceRec(path, node_blocks, data_blocks);
         
         }else if(S_ISREG(info.st_mode) || S_ISLNK(info.st_mode)){
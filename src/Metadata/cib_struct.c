@@ -13,11 +13,14 @@
 #include "header.h"
 #include "freelist.h"
 #include "data.h"
+#include "file_management.h"
 
 #include "syscalls.h"
 #include "ADTVector.h"
+#include "ADTHashTable.h"
 
 #define LIST_BLOCK_EMPTY 0x80000000
+#define ENTRY_MAX_REFS UINT16_MAX
 
 typedef uint64_t EntryId;
 
@@ -26,11 +29,18 @@ typedef uint64_t EntryId;
 /*In metadata partition we split the address space in blocks of size MD_BLOCK_SIZE.*/
 
 /*Entries are stored inside the list. Each entry has a "pointer"
-pointing to either a cib-node-block or to a data block.*/
+pointing to either a cib-node-block or to a data block.
+
+An entry may be listed in the directories of more than one tree, i.e. of the current tree and of
+snapshots. "refs" holds the number of the extra trees that share it, thus an entry is modified only
+when refs is 0. Archives written before snapshots were shared have 0 there, as the mode fits in 16 bits.
+Once refs reaches ENTRY_MAX_REFS it is no longer counted and the entry is shared for good: no tree
+modifies or frees it.*/
 typedef struct cib_entry{
     uint32_t uid;
     uint32_t gid;
-    uint32_t mode;
+    uint16_t mode;
+    uint16_t refs;
     uint32_t created;
     uint32_t modified;
     uint32_t accessed;
@@ -79,8 +89,6 @@ typedef struct cib_node{
     char padding[210];
 }* CIBNode;
 
-extern void *md;
-extern void *data;
 
 //---------------------------------------------------------------
 //CIB-Node Functions
@@ -129,7 +137,7 @@ void CIBNodeInsertEntry(MDBlockId block, EntryId entry_id, char *entry_name){
     //If node is full and the are no following nodes, we create one
     //and perform the insertion in the new block.
     if(node->count == 3 && node->next_flag == false){
-        MDBlockId new_block = FreeListRequestNodeBlock();
+        MDBlockId new_block = FreeListRequestNodeBlockNear(block);
         node = GetNodeBlockAddress(block);
 
         CIBNodeInit(new_block, node->parent, node->self);
@@ -274,6 +282,60 @@ void CIBNodeGetDirEntries(MDBlockId block, List entries){
     return;
 }
 
+/*Replaces the entry id old_id with new_id in the cib-node that starts from the given block. The name
+of the entry is kept.*/
+void CIBNodeReplaceEntryId(MDBlockId block, EntryId old_id, EntryId new_id){
+    CIBNode node = GetNodeBlockAddress(block);
+
+    for(int i = 0; i < 3; i++){
+        if(node->entry[i] == old_id){
+            node->entry[i] = new_id;
+
+            return;
+        }
+    }
+
+    if(node->next_flag == true)
+        CIBNodeReplaceEntryId(node->next, old_id, new_id);
+
+    return;
+}
+
+void CIBEntryShare(CIBEntry entry);
+
+/*Copies the cib-node that starts from the given block to new blocks, whose parent and self are the
+given entry ids, and returns the first of them. The entries of the cib-node are not copied; each
+of them becomes shared by one more tree.*/
+MDBlockId CIBNodeCopy(MDBlockId block, EntryId parent, EntryId self){
+    MDBlockId first = FreeListRequestNodeBlockNear(block);
+    MDBlockId copy = first, previous = first;
+
+    while(true){
+        CIBNode src = GetNodeBlockAddress(block), dest = GetNodeBlockAddress(copy);
+
+        memcpy(dest, src, MD_BLOCK_SIZE);
+        dest->parent = parent;
+        dest->self = self;
+        dest->previous = previous;
+
+        for(int i = 0; i < 3; i++)
+            if(src->entry[i] != 0)
+                CIBEntryShare(GetEntryAddress(src->entry[i]));
+
+        if(src->next_flag == false)
+            break;
+
+        //Requesting a block may remap the metadata partition, thus the nodes are obtained again.
+        block = src->next;
+        previous = copy;
+
+        copy = FreeListRequestNodeBlockNear(previous);
+        CIBNodeSetNext(previous, copy);
+    }
+
+    return first;
+}
+
 //---------------------------------------------------------------
 //CIB-Entry Functions
 
@@ -300,6 +362,7 @@ CIBEntry CIBEntryCreate(CIBEntry mem, char *path){
     mem->uid = info.st_uid;
     mem->gid = info.st_gid;
     mem->mode = info.st_mode;
+    mem->refs = 0;
     mem->modified = (uint32_t) info.st_mtime;
     mem->accessed = (uint32_t) info.st_atime;
     mem->created = (uint32_t) info.st_ctime;
@@ -308,6 +371,17 @@ CIBEntry CIBEntryCreate(CIBEntry mem, char *path){
     return mem;
 }
 
+/*Returns a copy, allocated in heap, of the cib_entry with the given id. The pointer of the
+copy is set to 0, as in CIBEntryCreate().*/
+CIBEntry CIBEntryCopy(EntryId entry_id){
+    CIBEntry entry = malloc(sizeof(struct cib_entry));
+
+    memcpy(entry, GetEntryAddress(entry_id), sizeof(struct cib_entry));
+    entry->pointer = 0;
+
+    return entry;
+}
+
 /*Return true or false depending on whether the given entry
 represents a directory.*/
 bool CIBEntryIsDir(CIBEntry entry){
@@ -326,11 +400,29 @@ bool CIBEntryIsFile(CIBEntry entry){
     return (entry->mode & __S_IFMT) == __S_IFREG;
 }
 
+/*Makes the given entry shared by one more tree. The count stops at ENTRY_MAX_REFS, after which the entry
+stays shared for good.*/
+void CIBEntryShare(CIBEntry entry){
+    if(entry->refs < ENTRY_MAX_REFS)
+        entry->refs++;
+
+    return;
+}
+
+/*Makes the given entry, which must be shared, shared by one tree less, unless its count has stopped.*/
+void CIBEntryRelease(CIBEntry entry){
+    if(entry->refs < ENTRY_MAX_REFS)
+        entry->refs--;
+
+    return;
+}
+
 /*Copies everything, includeing the pointer, from src entry
-to dest.*/
+to dest. The dest entry is not shared with any other tree.*/
 void CIBEntryInit(EntryId dest, CIBEntry src){
     CIBEntry entry = GetEntryAddress(dest);
     memcpy(entry, src, sizeof(struct cib_entry));
+    entry->refs = 0;
 
     return;
 }
@@ -365,6 +457,16 @@ uint64_t CIBEntryGetPointer(EntryId entry_id){
     return entry->pointer;
 }
 
+/*Returns the modification time of the entry with the given id.*/
+uint32_t CIBEntryGetModified(EntryId entry_id){
+    return GetEntryAddress(entry_id)->modified;
+}
+
+/*Returns the mode of the entry with the given id.*/
+uint32_t CIBEntryGetMode(EntryId entry_id){
+    return GetEntryAddress(entry_id)->mode;
+}
+
 //---------------------------------------------------------------
 //CIB-List Functions
 
@@ -490,7 +592,7 @@ void CIBListUpdateGroupBitmap(ListBlock inserted_block, uint8_t nest_level, uint
     if(list->list_block_bitmap == (uint64_t) -1 && nest_level < max_nest)
         CIBListUpdateGroupBitmap(inserted_block, nest_level + 1, max_nest);
 
-    list->list_block_bitmap &= ~(1 << subset);
+    list->list_block_bitmap &= ~(1ULL << subset);
     return;
 }
 
@@ -512,32 +614,52 @@ void CIBListFreeEntry(EntryId entry_id){
     return;
 }
 
-/*Returns the entry id of the entry defined by the path given, which is relative to the path
-of the directory specified by the "current_id".
+EntryId CIBListCopyEntry(EntryId src_id, EntryId parent_id);
 
-Found is set to true if the requested entry was found. Otherwise it is set to false.*/
-EntryId CIBListGetEntry(EntryId current_id, char *path, bool *found){
+/*Makes the entry entry_id, which is listed in the directory parent_id, private to the tree of that directory
+and returns its id. If the entry is shared with other trees, it is replaced in the directory by a copy.
+The directory must be private already.*/
+EntryId CIBListUnshareEntry(EntryId entry_id, EntryId parent_id){
+    CIBEntry entry = GetEntryAddress(entry_id);
+    if(entry->refs == 0)
+        return entry_id;
+
+    CIBEntryRelease(entry);
+    EntryId new_id = CIBListCopyEntry(entry_id, parent_id);
+
+    CIBNodeReplaceEntryId(GetEntryAddress(parent_id)->pointer, entry_id, new_id);
+    return new_id;
+}
+
+/*Walks the given path from the directory "current_id". If unshare is true, every entry on the way is made
+private to the tree of current_id, which must be private already.*/
+EntryId CIBListWalkPath(EntryId current_id, char *path, bool unshare, bool *found){
     if(strcmp(path, "/") == 0 || strcmp(path, ".") == 0){
         *found = true;
         return current_id;
     }
 
-    char copy[strlen(path) + 1]; strcpy(copy, path);
+    char copy[strlen(path) + 1], *saved; strcpy(copy, path);
     CIBEntry current = GetEntryAddress(current_id);
 
-    //Iterate throught the directories of the path.
-    for(char *iter = strtok(copy, "/"); iter != NULL; iter = strtok(NULL, "/")){
+    //Iterate throught the directories of the path. Threads may look up paths of different archives at once.
+    for(char *iter = strtok_r(copy, "/", &saved); iter != NULL; iter = strtok_r(NULL, "/", &saved)){
         //If the iterator is not a directory and it is not the last "entity" in the path,
         //then the given path does not exit inside the cib-file.
         if(CIBEntryIsDir(current) == true){
             //Make sure that the entity iter-n is under directory iter-(n-1).
-            current_id = CIBNodeGetEntry(current->pointer, iter, found);
+            EntryId next_id = CIBNodeGetEntry(current->pointer, iter, found);
             if(*found == false)
                 return 0;
 
+            //"." and ".." are not listed in the directory, thus they are not copied.
+            if(unshare == true && strcmp(iter, ".") != 0 && strcmp(iter, "..") != 0)
+                next_id = CIBListUnshareEntry(next_id, current_id);
+
+            current_id = next_id;
             current = GetEntryAddress(current_id);
 
-        }else if(strtok(NULL, "/") != NULL){
+        }else if(strtok_r(NULL, "/", &saved) != NULL){
             *found = false;
 
             return 1;
@@ -549,6 +671,21 @@ EntryId CIBListGetEntry(EntryId current_id, char *path, bool *found){
     return current_id;
 }
 
+/*Returns the entry id of the entry defined by the path given, which is relative to the path
+of the directory specified by the "current_id".
+
+Found is set to true if the requested entry was found. Otherwise it is set to false.*/
+EntryId CIBListGetEntry(EntryId current_id, char *path, bool *found){
+    return CIBListWalkPath(current_id, path, false, found);
+}
+
+/*Returns the entry id of the entry defined by the given path, as CIBListGetEntry() does. Every entry
+on the way, including the returned one, that is shared with a snapshot is copied first, so that it can be
+modified. The directory "current_id" must not be shared.*/
+EntryId CIBListUnsharePath(EntryId current_id, char *path, bool *found){
+    return CIBListWalkPath(current_id, path, true, found);
+}
+
 /*User needs to make sure that parent_id refers to a directory entry.
 If entry_id refers to a directory, a cib_node will be also created.*/
 void CIBListInsertEntryUnderDir(EntryId entry_id, EntryId parent_id, char *name){
@@ -558,7 +695,7 @@ void CIBListInsertEntryUnderDir(EntryId entry_id, EntryId parent_id, char *name)
 
     CIBEntry entry = GetEntryAddress(entry_id);
     if(CIBEntryIsDir(entry) == true){
-        MDBlockId block = FreeListRequestNodeBlock();
+        MDBlockId block = FreeListRequestNodeBlockNear(GetEntryAddress(parent_id)->pointer);
 
         CIBNodeInit(block, parent_id, entry_id);
         CIBEntrySetPointer(entry_id, block);
@@ -574,7 +711,7 @@ We consider the path to be relative to the directory defined by the entry id "cu
 EntryId CIBListUpdateEntry(CIBEntry entry, char *path, EntryId current_id, bool *inserted){
     char copy[strlen(path) + 1]; strcpy(copy, path);
 
-    EntryId parent_id = CIBListGetEntry(current_id, dirname(copy), inserted);
+    EntryId parent_id = CIBListUnsharePath(current_id, dirname(copy), inserted);
 
     if(*inserted == false || CIBEntryIsDir(GetEntryAddress(parent_id)) == false){
         char buff[128 + strlen(path)];
@@ -607,6 +744,8 @@ EntryId CIBListUpdateEntry(CIBEntry entry, char *path, EntryId current_id, bool
         return 0;
 
     }else{
+        new_id = CIBListUnshareEntry(new_id, parent_id);
+
         CIBEntryUpdate(new_id, entry);
         *inserted = true;
 
@@ -615,48 +754,82 @@ EntryId CIBListUpdateEntry(CIBEntry entry, char *path, EntryId current_id, bool
     return new_id;
 }
 
+/*Inserts in the given vectors the entry ids and the data pointers of the tree under the given entry.
+The node blocks of the tree's directories are freed on the way. An entry that is shared with other
+trees is only released by this one, along with everything under it.*/
+void CIBListCollectTree(EntryId entry_id, Vector entries, Vector pointers){
+    CIBEntry entry = GetEntryAddress(entry_id);
+    if(entry->refs > 0){
+        CIBEntryRelease(entry);
+        return;
+    }
 
-void CIBListDeleteEntry(EntryId entry_id, EntryId parent_id);
+    VectorInsertLast(entries, intdup(entry_id));
 
-/*Deletes the directory specified by the given entry id. The function also deletes
-everything under that directory.*/
-void CIBListDeleteDirEntry(EntryId entry_id){
-    CIBEntry entry = GetEntryAddress(entry_id);
-    MDBlockId block = entry->pointer;
-    CIBNode node = GetNodeBlockAddress(block);
-    bool next_flag;
+    if(CIBEntryIsDir(entry) == false){
+        VectorInsertLast(pointers, intdup(entry->pointer));
+        return;
+    }
 
+    MDBlockId block = entry->pointer; bool next_flag;
     do{
-        next_flag = node->next_flag;
+        CIBNode node = GetNodeBlockAddress(block);
 
-        //Goes through the first cib_node and deletes every entry.
-        for(int i = 0; i < 3; i++){
+        for(int i = 0; i < 3; i++)
+            if(node->entry[i] != 0)
+                CIBListCollectTree(node->entry[i], entries, pointers);
 
-            if(node->entry[i] != 0){
-                CIBListDeleteEntry(node->entry[i], entry_id);
+        MDBlockId next = node->next;
+        next_flag = node->next_flag;
 
-            }
-        }
+        FreeListInsertNodeBlock(block);
+        block = next;
 
     }while(next_flag == true);
 
     return;
 }
 
-/*Deletes the entry specified by entry_id. If it is a directory then its content
-is also deleted.*/
-void CIBListDeleteEntry(EntryId entry_id, EntryId parent_id){
-    CIBEntry parent = GetEntryAddress(parent_id);
-    
-    CIBEntry entry = GetEntryAddress(entry_id);
-    if(CIBEntryIsDir(entry) == true)
-        CIBListDeleteDirEntry(entry_id);
+/*Marks the spots of the given entries in the cib list as free. The entries of each list block
+are freed together, so the group bitmaps are updated once per block.*/
+void CIBListFreeEntries(Vector entries){
+    VectorSort(entries, CompareUint64);
 
-    CIBNodeRemoveEntryId(parent->pointer, entry_id);
+    for(int i = 0; i < VectorGetSize(entries);){
+        ListBlock block = *(EntryId *) VectorGetAt(entries, i) / LIST_ENTRIES_PER_BLOCK;
+        CIBList list = GetListBlockAddress(block);
 
-    CIBListFreeEntry(entry_id);
-    HeadSetListEntries(HeadGetListEntries() - 1);   
+        if(list->bitmap == (uint32_t) -1)
+            CIBListUpdateGroupBitmap(block, 0, HeadGetNestLevel());
 
+        for(; i < VectorGetSize(entries) && *(EntryId *) VectorGetAt(entries, i) / LIST_ENTRIES_PER_BLOCK == block; i++){
+            EntryId entry_id = *(EntryId *) VectorGetAt(entries, i);
+
+            list->bitmap &= ~(1 << (entry_id % LIST_ENTRIES_PER_BLOCK));
+            list->count--;
+
+            memset(GetEntryAddress(entry_id), 0, sizeof(struct cib_entry));
+        }
+    }
+
+    HeadSetListEntries(HeadGetListEntries() - VectorGetSize(entries));
+    return;
+}
+
+/*Deletes the entry specified by entry_id and everything under it. The data pointers of the deleted
+files and links are inserted in "pointers", so that their data can be deleted all at once. If parent_id
+is equal to entry_id, the entry is the root of a snapshot and has no parent; otherwise the parent must not
+be shared. Entries that are shared with other trees are kept.*/
+void CIBListDeleteTree(EntryId entry_id, EntryId parent_id, Vector pointers){
+    if(parent_id != entry_id)
+        CIBNodeRemoveEntryId(GetEntryAddress(parent_id)->pointer, entry_id);
+
+    Vector entries = VectorCreate(LIST_ENTRIES_PER_BLOCK, free);
+
+    CIBListCollectTree(entry_id, entries, pointers);
+    CIBListFreeEntries(entries);
+
+    VectorDestroy(entries);
     return;
 }
 
@@ -710,59 +883,123 @@ void CIBListPrintStructure(EntryId current_id, char *name){
     return;
 }
 
-/*Prints the Metadata for each entry stored in the metadata partition.*/
+/*Prints the metadata of the entry with the given id.*/
+void CIBListPrintEntry(EntryId entry_id){
+    CIBEntry entry = GetEntryAddress(entry_id);
+
+    char mode[] = "----------";
+    switch(entry->mode & __S_IFMT){
+        case __S_IFDIR: mode[0] = 'd'; break;
+        case __S_IFREG: mode[0] = '-'; break;
+        case __S_IFLNK: mode[0] = 'l'; break;
+    }
+
+    if(entry->mode & S_IRUSR) mode[1] = 'r';
+    if(entry->mode & S_IWUSR) mode[2] = 'w';
+    if(entry->mode & S_IXUSR) mode[3] = 'x';
+    if(entry->mode & S_IRGRP) mode[4] = 'r';
+    if(entry->mode & S_IWGRP) mode[5] = 'w';
+    if(entry->mode & S_IXGRP) mode[6] = 'x';
+    if(entry->mode & S_IROTH) mode[7] = 'r';
+    if(entry->mode & S_IWOTH) mode[8] = 'w';
+    if(entry->mode & S_IXOTH) mode[9] = 'x';
+
+    struct passwd *pw = getpwuid(entry->uid);
+    struct group *gt = getgrgid(entry->gid);
+
+    char *user_name = pw != NULL ?  pw->pw_name : "uknown";
+    char *group_name = gt != NULL ? gt->gr_name : "uknown";
+
+    time_t t = (time_t) entry->created;
+    struct tm *tm_info = localtime(&t);
+    char created[64];
+    strftime(created, sizeof(created), "%Y-%m-%d %H:%M:%S", tm_info);
+
+    t = (time_t) entry->modified;
+    tm_info = localtime(&t);
+    char modified[64];
+    strftime(modified, sizeof(modified), "%Y-%m-%d %H:%M:%S", tm_info);
+
+    t = (time_t) entry->accessed;
+    tm_info = localtime(&t);
+    char accessed[64];
+    strftime(accessed, sizeof(accessed), "%Y-%m-%d %H:%M:%S", tm_info);
+    
+    char buff[1024 + strlen(user_name) + strlen(group_name)];
+    snprintf(buff, sizeof(buff), "%lu. %s\t%s\t%s\tCreated: %s\tModified: %s\tAccessed: %s\n", entry_id, mode, user_name, group_name, created, modified, accessed);
+    WriteBytes(buff, strlen(buff), 1);
+    return;
+}
+
+/*Inserts in "ids" the entry ids of the tree under the given entry that are not marked, and marks them. Since an
+entry is shared along with everything under it, the tree under a marked entry is skipped.*/
+void CIBListMarkTree(EntryId entry_id, bool *marked, Vector ids){
+    if(marked[entry_id] == true)
+        return;
+
+    marked[entry_id] = true;
+    VectorInsertLast(ids, intdup(entry_id));
+
+    CIBEntry entry = GetEntryAddress(entry_id);
+    if(CIBEntryIsDir(entry) == false)
+        return;
+
+    MDBlockId block = entry->pointer; bool next_flag;
+    do{
+        CIBNode node = GetNodeBlockAddress(block);
+
+        for(int i = 0; i < 3; i++)
+            if(node->entry[i] != 0)
+                CIBListMarkTree(node->entry[i], marked, ids);
+
+        block = node->next;
+        next_flag = node->next_flag;
+
+    }while(next_flag == true);
+
+    return;
+}
+
+/*Prints, in the order of their ids, the entries of the tree under the given entry that were not printed yet.*/
+void CIBListPrintTree(EntryId root, bool *marked){
+    Vector ids = VectorCreate(LIST_ENTRIES_PER_BLOCK, free);
+
+    CIBListMarkTree(root, marked, ids);
+    VectorSort(ids, CompareUint64);
+
+    //VectorSort() puts the greatest id first.
+    for(int i = VectorGetSize(ids) - 1; i >= 0; i--)
+        CIBListPrintEntry(*(EntryId *) VectorGetAt(ids, i));
+
+    VectorDestroy(ids);
+    return;
+}
+
+List CIBListGetSnapshots();
+
+/*Prints the Metadata for each entry of the current tree. The entries that only snapshots hold follow, under
+the name of the first snapshot that holds each of them; entries shared with the current tree or with a snapshot
+printed earlier are not repeated.*/
 void CIBListPrintEntriesMetadata(){
-    for(uint32_t i = 0; i < HeadGetListBlocks(); i++){
-        CIBList list = GetListBlockAddress(i);
+    bool *marked = calloc((uint64_t) HeadGetListBlocks() * LIST_ENTRIES_PER_BLOCK, sizeof(bool));
 
-        for(uint64_t j = 0; j < LIST_ENTRIES_PER_BLOCK; j++){
-            if(list->bitmap & (1 << j)){
-                CIBEntry entry = GetEntryAddress(i * LIST_ENTRIES_PER_BLOCK + j);
-
-                char mode[] = "----------";
-                switch(entry->mode & __S_IFMT){
-                    case __S_IFDIR: mode[0] = 'd'; break;
-                    case __S_IFREG: mode[0] = '-'; break;
-                    case __S_IFLNK: mode[0] = 'l'; break;
-                }
-
-                if(entry->mode & S_IRUSR) mode[1] = 'r';
-                if(entry->mode & S_IWUSR) mode[2] = 'w';
-                if(entry->mode & S_IXUSR) mode[3] = 'x';
-                if(entry->mode & S_IRGRP) mode[4] = 'r';
-                if(entry->mode & S_IWGRP) mode[5] = 'w';
-                if(entry->mode & S_IXGRP) mode[6] = 'x';
-                if(entry->mode & S_IROTH) mode[7] = 'r';
-                if(entry->mode & S_IWOTH) mode[8] = 'w';
-                if(entry->mode & S_IXOTH) mode[9] = 'x';
-
-                struct passwd *pw = getpwuid(entry->uid);
-                struct group *gt = getgrgid(entry->gid);
-
-                char *user_name = pw != NULL ?  pw->pw_name : "uknown";
-                char *group_name = gt != NULL ? gt->gr_name : "uknown";
-
-                time_t t = (time_t) entry->created;
-                struct tm *tm_info = localtime(&t);
-                char created[64];
-                strftime(created, sizeof(created), "%Y-%m-%d %H:%M:%S", tm_info);
-
-                t = (time_t) entry->modified;
-                tm_info = localtime(&t);
-                char modified[64];
-                strftime(modified, sizeof(modified), "%Y-%m-%d %H:%M:%S", tm_info);
-
-                t = (time_t) entry->accessed;
-                tm_info = localtime(&t);
-                char accessed[64];
-                strftime(accessed, sizeof(accessed), "%Y-%m-%d %H:%M:%S", tm_info);
-                
-                char buff[1024 + strlen(user_name) + strlen(group_name)];
-                snprintf(buff, sizeof(buff), "%lu. %s\t%s\t%s\tCreated: %s\tModified: %s\tAccessed: %s\n", i * LIST_ENTRIES_PER_BLOCK + j, mode, user_name, group_name, created, modified, accessed);
-                WriteBytes(buff, strlen(buff), 1);
-            }
-        }
+    CIBListPrintTree(0, marked);
+
+    //Snapshots are listed in reverse order, so we iterate backwards to print them in the order they were taken.
+    List snapshots = CIBListGetSnapshots();
+    for(LNode node = ListGetLastNode(snapshots); node != NULL; node = LNodeGetPrevious(node)){
+        INPair pair = LNodeGetItem(node);
+
+        char buff[512];
+        snprintf(buff, sizeof(buff), "\nSnapshot: %.256s\n-------------------------------------------------------------------------\n", INPairGetName(pair));
+        WriteBytes(buff, strlen(buff), 1);
+
+        CIBListPrintTree(INPairGetId(pair), marked);
     }
+
+    ListDestroy(snapshots);
+    free(marked);
+    return;
 }
 
 /*Returns a list containing the pairs <entry_id, name> that the directory specified by the
@@ -779,6 +1016,49 @@ List CIBListGetDirEntries(EntryId dir_id){
     return entries;
 }
 
+/*Returns a hash table that maps the first block of each data chunk to a list with the entry ids of the
+files and links that point to it, or to one of its members if it is solid. Entries that refer to the data
+of a base archive are not included.*/
+HashTable CIBListGetDataOwners(){
+    HashTable owners = HTCreate(HeadGetListEntries(), HashUint64, CompareUint64, free, (DestroyFunc) ListDestroy);
+
+    for(uint32_t i = 0; i < HeadGetListBlocks(); i++){
+        CIBList list = GetListBlockAddress(i);
+
+        for(uint64_t j = 0; j < LIST_ENTRIES_PER_BLOCK; j++){
+            EntryId entry_id = i * LIST_ENTRIES_PER_BLOCK + j;
+            CIBEntry entry = GetEntryAddress(entry_id);
+
+            if((list->bitmap & (1 << j)) == 0 || CIBEntryIsDir(entry) == true || DataIsBaseRef(entry->pointer) == true)
+                continue;
+
+            DataBlockId chunk = DataGetChunk(entry->pointer);
+            HashNode node = HTFindKey(owners, &chunk);
+            List entries;
+
+            if(node == NULL){
+                entries = ListCreate(free);
+                HTInsertItem(owners, intdup(chunk), entries);
+
+            }else
+                entries = HNGetItem(node);
+
+            ListInsertLast(entries, intdup(entry_id));
+        }
+    }
+
+    return owners;
+}
+
+/*Returns true iff the given entry id belongs to an entry that is in use.*/
+bool CIBListEntryExists(EntryId entry_id){
+    if(entry_id >= (uint64_t) HeadGetListBlocks() * LIST_ENTRIES_PER_BLOCK)
+        return false;
+
+    CIBList list = GetListBlockAddress(entry_id / LIST_ENTRIES_PER_BLOCK);
+    return (list->bitmap & (1 << (entry_id % LIST_ENTRIES_PER_BLOCK))) != 0;
+}
+
 /*Initializes the CIBList.*/
 void CIBListInit(CIBEntry root){
     CIBListBlockInit(0);
@@ -792,5 +1072,272 @@ void CIBListInit(CIBEntry root){
     CIBNodeInit(block, 0, 0);
     CIBEntrySetPointer(0, block);
 
+    return;
+}
+
+/*Copies the entry "src_id" to a new entry and returns its id. The copy is not inserted under any directory.
+If the entry is a directory, the copy gets its own cib-node, with parent_id as parent, that lists the same
+entries; these become shared by one more tree, so a whole tree is copied in O(1) per entry of its root. Files
+and links of the copy share their data chunks with the original entries.
+
+If parent_id is equal to src_id the copy is its own parent. This is how the root of a snapshot is created.*/
+EntryId CIBListCopyEntry(EntryId src_id, EntryId parent_id){
+    EntryId new_id = CIBListGetFreeSpot();
+    CIBEntryInit(new_id, GetEntryAddress(src_id));
+    HeadSetListEntries(HeadGetListEntries() + 1);
+
+    if(CIBEntryIsDir(GetEntryAddress(new_id)) == false){
+        DataShareFile(CIBEntryGetPointer(new_id));
+
+        return new_id;
+    }
+
+    MDBlockId block = CIBNodeCopy(CIBEntryGetPointer(src_id), parent_id == src_id ? new_id : parent_id, new_id);
+    CIBEntrySetPointer(new_id, block);
+
+    return new_id;
+}
+
+//---------------------------------------------------------------
+//Snapshot Functions
+
+/*Snapshots are stored in a cib-node, which we call snapshot table, that holds pairs of <name, entry_id>.
+The entry id is the root directory of the snapshot's tree. Snapshot roots are not linked under any directory.*/
+
+/*Creates a snapshot of the tree rooted at entry 0 with the given name. Only the root is copied; the rest of the
+tree is shared with the current one, and a directory of the current tree is copied the first time it is modified.
+
+If a snapshot with the same name exists, *created is set to false and 0 is returned.*/
+EntryId CIBListCreateSnapshot(char *name, bool *created){
+    MDBlockId table;
+
+    if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strlen(name) > 255 || strchr(name, '/') != NULL){
+        *created = false;
+        return 0;
+    }
+
+    if(HeadGetSnapshotBlock(&table) == false){
+        table = FreeListRequestNodeBlock();
+        
+        CIBNodeInit(table, 0, 0);
+        HeadSetSnapshotBlock(table);
+
+    }else{
+        CIBNodeGetEntry(table, name, created);
+        
+        if(*created == true){
+            *created = false;
+            return 0;
+        }
+    }
+
+    EntryId root = CIBListCopyEntry(0, 0);
+    
+    //The table may have been moved by the copy, thus we obtain it again.
+    HeadGetSnapshotBlock(&table);
+    CIBNodeInsertEntry(table, root, name);
+    
+    *created = true;
+    return root;
+}
+
+/*Returns the root entry id of the snapshot with the given name. Found is set to false if no
+such snapshot exists.*/
+EntryId CIBListGetSnapshot(char *name, bool *found){
+    MDBlockId table;
+
+    if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || HeadGetSnapshotBlock(&table) == false){
+        *found = false;
+        return 0;
+    }
+
+    return CIBNodeGetEntry(table, name, found);
+}
+
+/*Removes the snapshot whose root is the given entry from the snapshot table. The snapshot's tree
+is not deleted.*/
+void CIBListRemoveSnapshot(EntryId root){
+    MDBlockId table;
+
+    if(HeadGetSnapshotBlock(&table) == true)
+        CIBNodeRemoveEntryId(table, root);
+
+    return;
+}
+
+/*Returns a list containing the pairs <root_id, name> of every snapshot.*/
+List CIBListGetSnapshots(){
+    List snapshots = ListCreate((DestroyFunc) INPairDestroy);
+    MDBlockId table;
+
+    if(HeadGetSnapshotBlock(&table) == true)
+        CIBNodeGetDirEntries(table, snapshots);
+
+    return snapshots;
+}
+
+//---------------------------------------------------------------
+//Bulk Loading
+
+/*A bulk load fills an empty metadata partition without searching for free spots. Entry ids are
+handed out in order and the cib-node blocks of each directory are consecutive. The bitmaps of the
+CIB-List are calculated once, when the load ends.
+
+Where the load is, is kept in the metadata state of the archive, so threads may load different archives at once.*/
+struct md_state{
+    MDBlockId bulk_next_node;       //Next node block that the load hands out
+    MDBlockId bulk_node_blocks;     //and the end of the reserved ones.
+    MDBlockId bulk_tail;            //Node block of the directory that was opened last that the next entry goes in
+    EntryId bulk_dir;               //and the id of that directory.
+};
+
+/*Returns a new metadata state, allocated in heap.*/
+MDState MDStateCreate(){
+
+    return calloc(1, sizeof(struct md_state));
+}
+
+/*Destroys the given metadata state.*/
+void MDStateDestroy(MDState state){
+    free(state);
+
+    return;
+}
+
+/*Returns the next node block of the bulk load. If the reserved ones run out, the metadata
+partition is extended by one block, which is the next one too.*/
+MDBlockId CIBListBulkRequestNodeBlock(){
+    MDState state = cib->md_state;
+
+    if(state->bulk_next_node == state->bulk_node_blocks){
+        FreeListRequestNodeBlock();
+        state->bulk_node_blocks++;
+    }
+
+    return state->bulk_next_node++;
+}
+
+/*Starts a bulk load. The metadata partition must have just been initialized with MDInit(). Every
+free node block is reserved for the load.*/
+void CIBListBulkBegin(){
+    MDState state = cib->md_state;
+
+    state->bulk_node_blocks = (HeadGetMDSize() >> MD_BLOCK_SHIFT) - 1 - HeadGetListBlocks();
+    state->bulk_next_node = 1;      //Block 0 holds the root's cib-node.
+
+    FreeListInit(0);
+
+    state->bulk_dir = 0;
+    state->bulk_tail = GetEntryAddress(0)->pointer;
+    return;
+}
+
+/*Creates the cib-node of the directory with the given id, with enough consecutive blocks for the given
+number of entries. The entries that follow are inserted in that directory. Every directory that is inserted
+during the bulk load must be opened exactly once, even if it is empty.*/
+void CIBListBulkOpenDir(EntryId dir_id, EntryId parent_id, uint64_t entries){
+    MDState state = cib->md_state;
+    uint64_t blocks = entries / 3 + (entries % 3 > 0);
+    MDBlockId first;
+
+    //The root's first block exists since the metadata partition was initialized.
+    if(dir_id == 0){
+        first = GetEntryAddress(0)->pointer;
+
+    }else{
+        first = CIBListBulkRequestNodeBlock();
+        CIBNodeInit(first, parent_id, dir_id);
+        CIBEntrySetPointer(dir_id, first);
+    }
+
+    for(MDBlockId previous = first, i = 1; i < blocks; i++){
+        MDBlockId block = CIBListBulkRequestNodeBlock();
+
+        CIBNodeInit(block, parent_id, dir_id);
+        CIBNodeSetPrevious(block, previous);
+        CIBNodeSetNext(previous, block);
+
+        previous = block;
+    }
+
+    state->bulk_dir = dir_id;
+    state->bulk_tail = first;
+    return;
+}
+
+/*Inserts the given entry, with the given name, in the directory that was opened last and returns its
+entry id. If the entry is a directory it must be opened later with CIBListBulkOpenDir().*/
+EntryId CIBListBulkInsertEntry(CIBEntry entry, char *name){
+    MDState state = cib->md_state;
+    EntryId entry_id = HeadGetListEntries();
+
+    if(entry_id / LIST_ENTRIES_PER_BLOCK == HeadGetListBlocks())
+        FreeListIncreaseListSize(1);
+
+    CIBEntryInit(entry_id, entry);
+    HeadSetListEntries(entry_id + 1);
+
+    //If the directory has more entries than expected, its cib-node is extended.
+    CIBNode node = GetNodeBlockAddress(state->bulk_tail);
+    if(node->count == 3 && node->next_flag == false){
+        MDBlockId block = CIBListBulkRequestNodeBlock();
+        node = GetNodeBlockAddress(state->bulk_tail);
+
+        CIBNodeInit(block, node->parent, state->bulk_dir);
+        CIBNodeSetPrevious(block, state->bulk_tail);
+        CIBNodeSetNext(state->bulk_tail, block);
+    }
+
+    if(node->count == 3){
+        state->bulk_tail = node->next;
+        node = GetNodeBlockAddress(state->bulk_tail);
+    }
+
+    node->entry[node->count] = entry_id;
+    strcpy(node->name[node->count], name);
+    node->count++;
+
+    return entry_id;
+}
+
+/*Ends the bulk load. The node blocks that were not used are given back to the free list and the
+bitmaps of the CIB-List are set.*/
+void CIBListBulkEnd(){
+    for(MDBlockId block = cib->md_state->bulk_next_node; block < cib->md_state->bulk_node_blocks; block++)
+        FreeListInsertNodeBlock(block);
+
+    uint64_t entries = HeadGetListEntries();
+    uint32_t list_blocks = HeadGetListBlocks();
+    uint64_t full_blocks = entries / LIST_ENTRIES_PER_BLOCK;
+
+    for(ListBlock block = 0; block < list_blocks; block++){
+        CIBList list = GetListBlockAddress(block);
+        uint64_t used = block < full_blocks ? LIST_ENTRIES_PER_BLOCK : block == full_blocks ? entries % LIST_ENTRIES_PER_BLOCK : 0;
+
+        list->count = used;
+        list->bitmap = LIST_BLOCK_EMPTY | ((1U << used) - 1);
+        list->list_block_bitmap = 0;
+    }
+
+    //The nest level grows every time the set at the top becomes full, i.e. every time the
+    //full blocks reach a power of 64.
+    uint8_t nest_level = 0;
+    while(full_blocks >= 64ULL << (6 * nest_level))
+        nest_level++;
+
+    //At nest level l, the first block of every set of 64^(l + 1) blocks plus l holds a bit for each of its 64
+    //subsets. The bit is set iff every block of the subset is full.
+    for(uint8_t l = 0; l <= nest_level; l++){
+        uint64_t subset = 1ULL << (6 * l);
+
+        for(uint64_t first = 0; first + l < list_blocks; first += subset << 6){
+            CIBList list = GetListBlockAddress(first + l);
+
+            for(uint64_t k = 0; k < 64 && first + (k + 1) * subset <= full_blocks; k++)
+                list->list_block_bitmap |= 1ULL << k;
+        }
+    }
+
+    HeadSetNestLevel(nest_level);
     return;
 }
\ No newline at end of file
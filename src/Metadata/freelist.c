@@ -8,10 +8,12 @@
 #include "metadata.h"
 #include "header.h"
 #include "cib_struct.h"
+#include "freelist.h"
 #include "file_management.h"
 
 
 #define FREE_LIST_MAX_ENTRIES 253
+#define NODE_RUN_BLOCKS 4           //Node blocks added at once when a cib-node grows at the end of the partition.
 #define max(a,b) ((a) > (b) ? (a) : (b))
 
 //-------------------------------------------------------------
@@ -38,7 +40,6 @@ typedef struct free_list{
     char padding[2];
 }* FreeList;
 
-extern void *md;
 
 //-------------------------------------------------------------
 //Free-Node Functions
@@ -110,6 +111,47 @@ MDBlockId FreeListRequestNodeBlock(){
     }
 }
 
+/*Returns the id of a free block, preferring the block right after "hint", so that the blocks of a cib-node
+stay consecutive. If that block lies past the end of the metadata partition, the partition grows by a run of
+blocks: the first is returned and the rest stay free for the cib-node to grow into. Otherwise, any free block
+is returned.*/
+MDBlockId FreeListRequestNodeBlockNear(MDBlockId hint){
+    FreeList list = GetFreeListBlockAddress();
+    MDBlockId wanted = hint + 1;
+    MDBlockId node_blocks = (HeadGetMDSize() >> MD_BLOCK_SHIFT) - 1 - HeadGetListBlocks();
+
+    //Search the circular array. The found block is replaced by the one at its start.
+    for(int i = 0; i < list->arr_count; i++){
+        int index = (list->arr_start + i) % FREE_LIST_MAX_ENTRIES;
+
+        if(list->array[index] == wanted){
+            list->array[index] = list->array[list->arr_start];
+            list->arr_start = (list->arr_start + 1) % FREE_LIST_MAX_ENTRIES;
+            list->arr_count--;
+
+            HeadSetMDFreeNodeBlocks(--list->total_free);
+            return wanted;
+        }
+    }
+
+    if(list->total_free > list->arr_count && list->header == wanted){
+        HeadSetMDFreeNodeBlocks(--list->total_free);
+        list->header = FreeNodeGetNext(wanted);
+
+        return wanted;
+    }
+
+    if(wanted != node_blocks && list->total_free != 0)
+        return FreeListRequestNodeBlock();
+
+    TruncMapAndUpdate(HeadGetHeaderSize(), HeadGetMDSize() + NODE_RUN_BLOCKS * MD_BLOCK_SIZE, HeadGetDataSize(), true);
+
+    for(MDBlockId block = node_blocks + 1; block < node_blocks + NODE_RUN_BLOCKS; block++)
+        FreeListInsertNodeBlock(block);
+
+    return node_blocks;
+}
+
 /*Increases the size of the list by the specified amount of blocks.*/
 void FreeListIncreaseListSize(uint32_t blocks){
     TruncMapAndUpdate(HeadGetHeaderSize(), HeadGetMDSize() + blocks * MD_BLOCK_SIZE, HeadGetDataSize(), true);
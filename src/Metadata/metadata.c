@@ -10,8 +10,8 @@
 #include "freelist.h"
 #include "cib_struct.h"
 #include "header.h"
+#include "file_management.h"
 
-extern void *md;
 
 //---------------------------------------------------------------
 //EntryID-Name Pair Functions
@@ -58,21 +58,21 @@ EntryId INPairGetId(INPair pair){
 
 //Returns a pointer to the free-list block.
 void *GetFreeListBlockAddress(){
-    void *new = (void *)((uint64_t) md + ((FREE_LIST_BLOCK) << MD_BLOCK_SHIFT));
+    void *new = (void *)((uint64_t) cib->md + ((FREE_LIST_BLOCK) << MD_BLOCK_SHIFT));
 
     return new;
 }
 
 //Returns a pointer to the requested list-block.
 void *GetListBlockAddress(uint64_t block_num){
-    void *new = (void *)((uint64_t) md + ((CIB_LIST_BLOCK + block_num) << MD_BLOCK_SHIFT));
+    void *new = (void *)((uint64_t) cib->md + ((CIB_LIST_BLOCK + block_num) << MD_BLOCK_SHIFT));
 
     return new;
 }
 
 //Returns a pointer to the requested node-block.
 void *GetNodeBlockAddress(uint64_t block_num){
-    void *new = (void *)((uint64_t) md + ((CIB_LIST_BLOCK + block_num + HeadGetListBlocks()) << MD_BLOCK_SHIFT));
+    void *new = (void *)((uint64_t) cib->md + ((CIB_LIST_BLOCK + block_num + HeadGetListBlocks()) << MD_BLOCK_SHIFT));
 
     return new;
 }
@@ -142,7 +142,10 @@ will result in inserting file1.txt.
 
 On the other hand if the path base_dir/dirA exists inside cib-file and its entry_id is 7, whilst
 base_dir/dirA does not contain dirD, then running MDInsertPath(entry, "dirD/file2.txt", 7, inserted) will result
-in inserting "dirD" and not "dirD/file2.txt" as you may expect.*/
+in inserting "dirD" and not "dirD/file2.txt" as you may expect.
+
+Entries on the way that are shared with snapshots are copied before they are modified, thus start_id must
+not be shared: it must be 0 or an id that this function returned.*/
 EntryId MDUpdatePath(CIBEntry entry, char *path, EntryId start_id, bool *inserted){
     EntryId updated_id = CIBListUpdateEntry(entry, path, start_id, inserted);
 
@@ -159,14 +162,22 @@ EntryId MDGetPath(char *path, EntryId start_id, bool *found){
     return target_id;
 }
 
-/*Prints the structure of the CIB file.*/
-void MDPrintStructure(){
-    CIBListPrintStructure(0, "/");
+/*Returns the entry_id of the entity defined by "path", as MDGetPath() does. Every entry on the way,
+including the returned one, that is shared with a snapshot is copied first, so that it can be modified.
+As in MDUpdatePath(), start_id must not be shared.*/
+EntryId MDUnsharePath(char *path, EntryId start_id, bool *found){
+    return CIBListUnsharePath(start_id, path, found);
+}
+
+/*Prints the structure of the tree rooted at the given entry.*/
+void MDPrintStructure(EntryId root){
+    CIBListPrintStructure(root, "/");
 
     return;
 }
 
-/*Prints information about every entity inside the CIB file.*/
+/*Prints information about every entity inside the CIB file. The entities that only snapshots hold are
+printed under the name of a snapshot.*/
 void MDPrintEntriesMetadata(){
     CIBListPrintEntriesMetadata();
 
@@ -179,10 +190,78 @@ List MDGetDirEntries(EntryId dir_id){
     return CIBListGetDirEntries(dir_id);
 }
 
-/*Deletes the entry specified by entry_id. If it is a directory then its content
-is also deleted.*/
-void MDDeleteEntry(EntryId entry_id, EntryId parent_id){
-    CIBListDeleteEntry(entry_id, parent_id);
+/*Deletes the entry specified by entry_id and everything under it. The data pointers of the deleted
+files and links are inserted in "pointers", so that their data can be deleted all at once. Entries that
+are shared with snapshots are kept for them. The parent must not be shared; see MDUnsharePath().*/
+void MDDeleteTree(EntryId entry_id, EntryId parent_id, Vector pointers){
+    CIBListDeleteTree(entry_id, parent_id, pointers);
+
+    return;
+}
+
+/*Starts a bulk load of the metadata partition, which must have just been initialized with MDInit().
+Entries are inserted with MDBulkInsertEntry() one directory at a time, and MDBulkEnd() must be called
+when every entry has been inserted. Nothing else may modify the metadata in between.*/
+void MDBulkBegin(){
+    CIBListBulkBegin();
+
+    return;
+}
+
+/*Opens the directory with the given id, whose parent is parent_id and which will contain the given
+number of entries. The entries inserted next are placed in that directory.*/
+void MDBulkOpenDir(EntryId dir_id, EntryId parent_id, uint64_t entries){
+    CIBListBulkOpenDir(dir_id, parent_id, entries);
+
+    return;
+}
+
+/*Inserts the given entry, with the given name, in the directory that was opened last and returns its
+entry id. Directories must be opened with MDBulkOpenDir() after they are inserted.*/
+EntryId MDBulkInsertEntry(CIBEntry entry, char *name){
+    return CIBListBulkInsertEntry(entry, name);
+}
+
+/*Ends the bulk load of the metadata partition.*/
+void MDBulkEnd(){
+    CIBListBulkEnd();
+
+    return;
+}
+
+/*Creates a snapshot of the current tree with the given name and returns its root entry id.
+
+If a snapshot with that name already exists, or the name is not valid, *created is set to false.*/
+EntryId MDCreateSnapshot(char *name, bool *created){
+    return CIBListCreateSnapshot(name, created);
+}
+
+/*Returns the root entry id of the snapshot with the given name. Found is set to false if no
+such snapshot exists.*/
+EntryId MDGetSnapshot(char *name, bool *found){
+    return CIBListGetSnapshot(name, found);
+}
+
+/*Removes the snapshot whose root is the given entry from the snapshot table. The snapshot's
+tree should be deleted with MDDeleteTree().*/
+void MDRemoveSnapshot(EntryId root){
+    CIBListRemoveSnapshot(root);
 
     return;
+}
+
+/*Returns a list containing the pairs <root_id, name> of every snapshot.*/
+List MDGetSnapshots(){
+    return CIBListGetSnapshots();
+}
+
+/*Returns a hash table that maps the first block of each data chunk to a list with the entry ids of the
+files and links that point to it.*/
+HashTable MDGetDataOwners(){
+    return CIBListGetDataOwners();
+}
+
+/*Returns true iff the given entry id belongs to an entry that is in use.*/
+bool MDEntryExists(EntryId entry_id){
+    return CIBListEntryExists(entry_id);
 }
\ No newline at end of file
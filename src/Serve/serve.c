@@ -0,0 +1,691 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "serve.h"
+#include "libcib.h"
+#include "cli_utils.h"
+#include "syscalls.h"
+
+#define SERVE_READ_BYTES (64 << 10)         //Bytes read from a socket at once.
+#define SERVE_MAX_PENDING (64 << 20)        //Bytes of replies to a client that are not sent, above which its requests are not read.
+#define SERVE_HOLD_NS 10000000ULL           //Longest time that the archives stay locked while requests keep arriving.
+#define SERVE_RETRY_NS 1000000ULL           //Time between two tries to lock an archive that a writer holds.
+#define SERVE_BATCH 64                      //Requests that a client sends at once, unless --batch is given.
+#define LATENCY_BUCKETS 512
+
+/*The server answers the requests of its clients on a single thread. It waits on the sockets with ppoll, answers the
+requests of a client that have arrived whole and sends the replies without blocking. The archives stay mapped for as
+long as the server runs, but their locks are released whenever no request is waiting, and at least every
+SERVE_HOLD_NS while requests keep arriving, so writers are not kept waiting.
+
+The server never waits for the lock of an archive either. While a writer holds it, the requests of a client from the
+first one on that archive on wait, so that the replies stay in order, and the lock is tried again every
+SERVE_RETRY_NS; the requests of the other clients are answered meanwhile.*/
+
+/*The latencies are counted in buckets, 8 for each power of 2 of nanoseconds, so a percentile is known within an
+eighth of its value.*/
+typedef struct latency{
+    uint64_t count;
+    uint64_t buckets[LATENCY_BUCKETS];
+}* Latency;
+
+typedef struct serve_client{
+    int fd;
+    bool closed;            //True once the client has sent all of its requests.
+
+    char *in;               //The requests that have not been answered.
+    uint64_t in_size;
+    uint64_t in_capacity;
+
+    char *out;              //The replies, of which out_sent bytes have been sent.
+    uint64_t out_size;
+    uint64_t out_sent;
+    uint64_t out_capacity;
+
+    bool waiting;           //True iff a request waits until a writer releases the lock of its archive.
+}* ServeClient;
+
+//A client's request, the reply to which it prints.
+typedef struct serve_pending{
+    uint8_t op;
+    char *path;
+}* ServePending;
+
+static const char *serve_op_names[SERVE_OPS] = {"open", "query", "stat", "list", "read", "stats"};
+
+//The archives that are served, and the absolute paths of their cib files.
+static CIBArchive *served = NULL;
+static char **served_paths = NULL;
+static uint64_t served_count = 0;
+
+//The latency of the requests of each operation.
+static struct latency latencies[SERVE_OPS];
+
+static volatile sig_atomic_t serve_stop = 0;
+
+/*Returns the time of the monotonic clock in nanoseconds.*/
+static uint64_t ServeNow(){
+    struct timespec now; clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*Records a latency of the given nanoseconds.*/
+static void LatencyRecord(Latency latency, uint64_t ns){
+    int bucket = ns;
+
+    if(ns >= 8){
+        int power = 63 - __builtin_clzll(ns);
+        bucket = (power - 2) * 8 + (ns >> (power - 3) & 7);
+    }
+
+    latency->buckets[bucket]++;
+    latency->count++;
+    return;
+}
+
+/*Returns the latency, in nanoseconds, that the given fraction of the recorded latencies do not exceed. The middle of
+its bucket is returned.*/
+static uint64_t LatencyPercentile(Latency latency, double fraction){
+    uint64_t rank = fraction * latency->count, seen = 0;
+    int bucket = 0;
+
+    while(bucket < LATENCY_BUCKETS - 1 && (seen += latency->buckets[bucket]) <= rank)
+        bucket++;
+
+    if(bucket < 8)
+        return bucket;
+
+    int power = bucket / 8 + 2;
+    return (8 + bucket % 8) * (1ULL << (power - 3)) + (1ULL << (power - 3)) / 2;
+}
+
+/*Returns the path of the socket, allocated in heap: the given path, or <cib-file>.sock if it is NULL.*/
+static char *ServeSocketPath(char *socket_path, char *cib_file){
+    if(socket_path != NULL)
+        return strdup(socket_path);
+
+    char *path = malloc(strlen(cib_file) + 6);
+    sprintf(path, "%s.sock", cib_file);
+
+    return path;
+}
+
+/*Connects to the Unix domain socket defined by path. Returns the file descriptor of the connection, or -1 if no
+server listens on it.*/
+static int ServeConnect(char *path){
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if(strlen(path) >= sizeof(address.sun_path))
+        return -1;
+
+    strcpy(address.sun_path, path);
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if(sock != -1 && connect(sock, (struct sockaddr *) &address, sizeof(address)) == -1){
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+/*Creates the Unix domain socket defined by path and listens on it. A socket that a server that no longer runs
+left behind is replaced. Returns -1 if the socket cannot be created, or another server listens on it.*/
+static int ServeListen(char *path){
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if(strlen(path) >= sizeof(address.sun_path))
+        return -1;
+
+    int sock = ServeConnect(path);
+    if(sock != -1){
+        close(sock);
+        return -1;
+    }
+
+    struct stat info;
+    if(lstat(path, &info) == 0 && S_ISSOCK(info.st_mode))
+        unlink(path);
+
+    strcpy(address.sun_path, path);
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if(sock != -1 && (bind(sock, (struct sockaddr *) &address, sizeof(address)) == -1 || listen(sock, SOMAXCONN) == -1)){
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+/*Makes room for the given number of bytes at the end of the replies to the client and returns their address.*/
+static void *ServeReserve(ServeClient client, uint64_t bytes){
+    if(client->out_capacity - client->out_size < bytes){
+        client->out_capacity = 2 * client->out_capacity + bytes;
+        client->out = realloc(client->out, client->out_capacity);
+    }
+
+    return client->out + client->out_size;
+}
+
+/*Answers the request, whose path and snapshot are given, and appends the reply to the replies to the client. Returns
+false, without answering it, if a writer holds the lock of the archive of the request.*/
+static bool ServeAnswer(ServeClient client, ServeRequest request, char *path, char *snapshot){
+    uint64_t start = ServeNow(), at = client->out_size;
+    struct serve_reply reply = {.status = SERVE_OK};
+
+    CIBArchive archive = request->archive < served_count ? served[request->archive] : NULL;
+
+    int acquired = 0;
+    if(archive != NULL && request->op != SERVE_OPEN && request->op < SERVE_STATS && (acquired = CIBArchiveTryAcquire(archive)) == 1)
+        return false;
+
+    ServeReserve(client, sizeof(reply));
+    client->out_size += sizeof(reply);
+
+    if(request->op == SERVE_OPEN){
+        reply.status = SERVE_NOT_FOUND;
+
+        for(uint64_t i = 0; i < served_count && reply.status == SERVE_NOT_FOUND; i++)
+            if(strcmp(served_paths[i], path) == 0){
+                reply.status = SERVE_OK;
+                reply.size = i;
+            }
+
+    }else if(request->op == SERVE_STATS){
+        uint64_t *stats = ServeReserve(client, SERVE_OPS * 3 * sizeof(uint64_t));
+
+        for(int op = 0; op < SERVE_OPS; op++){
+            stats[3 * op] = latencies[op].count;
+            stats[3 * op + 1] = LatencyPercentile(&latencies[op], 0.5);
+            stats[3 * op + 2] = LatencyPercentile(&latencies[op], 0.99);
+        }
+
+        reply.size = SERVE_OPS * 3 * sizeof(uint64_t);
+
+    }else if(request->op >= SERVE_OPS){
+        reply.status = SERVE_ERROR;
+
+    }else if(archive == NULL){
+        reply.status = SERVE_NOT_FOUND;
+
+    }else if(acquired == -1){
+        reply.status = SERVE_ERROR;
+
+    }else if(request->op == SERVE_QUERY){
+        reply.status = CIBArchiveQuery(archive, path, snapshot) == true ? SERVE_OK : SERVE_NOT_FOUND;
+
+    }else if(request->op == SERVE_STAT){
+        struct cib_archive_stat stat;
+
+        if(CIBArchiveGetStat(archive, path, snapshot, &stat) == true){
+            reply.mode = stat.mode;
+            reply.modified = stat.modified;
+            reply.size = stat.size;
+            reply.sized = stat.sized;
+
+        }else
+            reply.status = SERVE_NOT_FOUND;
+
+    }else if(request->op == SERVE_LIST){
+        uint64_t count; char **names = CIBArchiveList(archive, path, snapshot, &count);
+        reply.status = names == NULL ? SERVE_NOT_FOUND : SERVE_OK;
+
+        for(uint64_t i = 0; i < count; i++){
+            uint64_t bytes = strlen(names[i]) + 1;
+
+            memcpy(ServeReserve(client, bytes), names[i], bytes);
+            client->out_size += bytes;
+            reply.size += bytes;
+        }
+
+        CIBArchiveListFree(names, count);
+
+    }else{
+        uint64_t length = request->length < SERVE_MAX_READ ? request->length : SERVE_MAX_READ;
+        void *dest = ServeReserve(client, length);
+
+        if(CIBArchiveRead(archive, path, snapshot, request->offset, length, dest, &reply.size) == false){
+            reply.status = CIBArchiveQuery(archive, path, snapshot) == true ? SERVE_ERROR : SERVE_NOT_FOUND;
+            reply.size = 0;
+        }
+    }
+
+    //The payload of SERVE_STATS and SERVE_READ is in place; the names of SERVE_LIST have been appended already.
+    if(request->op == SERVE_STATS || request->op == SERVE_READ)
+        client->out_size += reply.size;
+
+    memcpy(client->out + at, &reply, sizeof(reply));
+
+    if(request->op < SERVE_OPS)
+        LatencyRecord(&latencies[request->op], ServeNow() - start);
+
+    return true;
+}
+
+/*Answers the requests of the client that have arrived whole, up to the first one whose archive a writer holds.
+Returns the number of requests answered.*/
+static uint64_t ServeRequests(ServeClient client){
+    uint64_t position = 0, answered = 0;
+    client->waiting = false;
+
+    while(client->in_size - position >= sizeof(struct serve_request)){
+        struct serve_request request; memcpy(&request, client->in + position, sizeof(request));
+        uint64_t size = sizeof(request) + request.path_size + request.snapshot_size;
+
+        if(client->in_size - position < size)
+            break;
+
+        char path[request.path_size + 1], snapshot[request.snapshot_size + 1];
+        memcpy(path, client->in + position + sizeof(request), request.path_size);
+        memcpy(snapshot, client->in + position + sizeof(request) + request.path_size, request.snapshot_size);
+        path[request.path_size] = snapshot[request.snapshot_size] = '\0';
+
+        if(ServeAnswer(client, &request, path, request.snapshot_size != 0 ? snapshot : NULL) == false){
+            client->waiting = true;
+            break;
+        }
+
+        position += size;
+        answered++;
+    }
+
+    memmove(client->in, client->in + position, client->in_size - position);
+    client->in_size -= position;
+
+    return answered;
+}
+
+/*Reads what the client has sent.*/
+static void ServeRead(ServeClient client){
+    if(client->in_capacity - client->in_size < SERVE_READ_BYTES){
+        client->in_capacity = 2 * client->in_capacity + SERVE_READ_BYTES;
+        client->in = realloc(client->in, client->in_capacity);
+    }
+
+    ssize_t bytes = read(client->fd, client->in + client->in_size, SERVE_READ_BYTES);
+    if(bytes > 0)
+        client->in_size += bytes;
+
+    client->closed = bytes == 0 || (bytes == -1 && errno != EAGAIN && errno != EINTR);
+    return;
+}
+
+/*Sends as much of the replies to the client as its socket takes. Returns false if the client has gone.*/
+static bool ServeWrite(ServeClient client){
+    while(client->out_sent < client->out_size){
+        ssize_t bytes = send(client->fd, client->out + client->out_sent, client->out_size - client->out_sent, MSG_NOSIGNAL);
+
+        if(bytes == -1)
+            return errno == EAGAIN || errno == EINTR;
+
+        client->out_sent += bytes;
+    }
+
+    client->out_sent = client->out_size = 0;
+    return true;
+}
+
+/*Releases the locks of the served archives, so that writers may update them.*/
+static void ServeRelease(){
+    for(uint64_t i = 0; i < served_count; i++)
+        CIBArchiveRelease(served[i]);
+
+    return;
+}
+
+/*Stops the server.*/
+static void ServeStop(int signal){
+    serve_stop = 1;
+
+    return;
+}
+
+/*Serves the cib file and the other cib files of the vector, which stay open, on the Unix domain socket defined by
+path, <cib-file>.sock if it is NULL, until the process is interrupted. If pin is true, their metadata are locked in
+memory. Between batches of requests the cib files are released, so that writers may update them.
+
+Then prints how many requests of each operation were served and the p50 and p99 of their latency.*/
+void CIBServe(char *socket_path, char *cib_file, Vector paths, bool pin){
+    char *path = ServeSocketPath(socket_path, cib_file);
+    served = malloc((VectorGetSize(paths) + 1) * sizeof(CIBArchive));
+    served_paths = malloc((VectorGetSize(paths) + 1) * sizeof(char *));
+
+    int listener = -1;
+    for(served_count = 0; served_count <= (uint64_t) VectorGetSize(paths); served_count++){
+        char *file = served_count == 0 ? cib_file : VectorGetAt(paths, served_count - 1);
+
+        if((served[served_count] = CIBArchiveOpen(file)) == NULL)
+            break;
+
+        served_paths[served_count] = RealPath(file);
+        if(pin == true && CIBArchivePin(served[served_count]) == false)
+            CIBCannotPin(file);
+
+        CIBArchiveRelease(served[served_count]);
+    }
+
+    if(served_count == (uint64_t) VectorGetSize(paths) + 1 && (listener = ServeListen(path)) == -1)
+        CIBCannotServe(path);
+
+    //SIGINT and SIGTERM are only delivered while the server waits, so that it stops between requests.
+    sigset_t blocked, waiting;
+    sigemptyset(&blocked); sigaddset(&blocked, SIGINT); sigaddset(&blocked, SIGTERM);
+    sigprocmask(SIG_BLOCK, &blocked, &waiting);
+
+    struct sigaction action = {.sa_handler = ServeStop};
+    sigaction(SIGINT, &action, NULL); sigaction(SIGTERM, &action, NULL);
+
+    struct serve_client *clients = NULL;
+    uint64_t count = 0, capacity = 0, locked_at = 0;
+    bool locked = false;
+
+    while(listener != -1 && serve_stop == 0){
+        struct pollfd fds[count + 1];
+        fds[0] = (struct pollfd) {listener, POLLIN, 0};
+        bool retrying = false;
+
+        for(uint64_t i = 0; i < count; i++){
+            retrying = retrying || clients[i].waiting;
+
+            //The requests of a client are not read while too many of its replies have not been sent.
+            bool full = clients[i].out_size - clients[i].out_sent >= SERVE_MAX_PENDING || clients[i].closed == true;
+            fds[i + 1] = (struct pollfd) {clients[i].fd, (full == false ? POLLIN : 0) | (clients[i].out_sent < clients[i].out_size ? POLLOUT : 0), 0};
+        }
+
+        //Once no request is waiting, the archives are released. The requests that wait for a writer are tried again
+        //after a while, even if nothing else happens.
+        struct timespec now = {0, 0}, retry = {0, SERVE_RETRY_NS};
+        int ready = ppoll(fds, count + 1, locked == true ? &now : retrying == true ? &retry : NULL, &waiting);
+
+        if(ready == 0 && locked == true){
+            ServeRelease();
+            locked = false;
+        }
+
+        if(ready < 0 || (ready == 0 && retrying == false))
+            continue;
+
+        //Gone clients are removed from the last one, so that the indices of the rest stay the same.
+        for(uint64_t i = count; i-- > 0; ){
+            ServeClient client = &clients[i];
+
+            if((fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) != 0 && client->closed == false)
+                ServeRead(client);
+
+            if(ServeRequests(client) != 0 && locked == false){
+                locked = true;
+                locked_at = ServeNow();
+            }
+
+            if(ServeWrite(client) == false || (client->closed == true && client->out_size == 0 && client->waiting == false)){
+                close(client->fd);
+                free(client->in); free(client->out);
+                clients[i] = clients[--count];
+            }
+        }
+
+        int sock;
+        while((fds[0].revents & POLLIN) != 0 && (sock = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1){
+            if(count == capacity){
+                capacity = 2 * capacity + 16;
+                clients = realloc(clients, capacity * sizeof(struct serve_client));
+            }
+
+            clients[count++] = (struct serve_client) {sock, false, NULL, 0, 0, NULL, 0, 0, 0, false};
+        }
+
+        //While requests keep arriving, the archives are released every so often.
+        if(locked == true && ServeNow() - locked_at >= SERVE_HOLD_NS){
+            ServeRelease();
+            locked = false;
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &waiting, NULL);
+
+    for(uint64_t i = 0; i < count; i++){
+        close(clients[i].fd);
+        free(clients[i].in); free(clients[i].out);
+    }
+
+    if(listener != -1){
+        close(listener);
+        unlink(path);
+    }
+
+    for(uint64_t i = 0; i < served_count; i++){
+        CIBArchiveClose(served[i]);
+        free(served_paths[i]);
+    }
+
+    for(int op = 0; op < SERVE_OPS; op++)
+        if(latencies[op].count != 0)
+            CIBLatencyReport(path, (char *) serve_op_names[op], latencies[op].count, LatencyPercentile(&latencies[op], 0.5), LatencyPercentile(&latencies[op], 0.99));
+
+    free(clients); free(served); free(served_paths); free(path);
+    return;
+}
+
+/*Parses a line of the client's input into a request, and sets *path to the path in the line. Returns false if
+the line is not a request.*/
+static bool ServeParse(char *line, ServeRequest request, char **path){
+    line[strcspn(line, "\n")] = '\0';
+    *request = (struct serve_request) {0};
+
+    char *space = strchr(line, ' ');
+    uint64_t word = space != NULL ? (uint64_t) (space - line) : strlen(line);
+    int op = SERVE_QUERY;
+
+    while(op < SERVE_OPS && !(strlen(serve_op_names[op]) == word && strncmp(line, serve_op_names[op], word) == 0))
+        op++;
+
+    if(op == SERVE_OPS || (op == SERVE_STATS) != (space == NULL))
+        return false;
+
+    request->op = op;
+    *path = space != NULL ? space + 1 : line + word;
+
+    if(op == SERVE_READ){
+        int consumed = 0;
+        if(sscanf(*path, "%lu %lu %n", &request->offset, &request->length, &consumed) != 2 || consumed == 0)
+            return false;
+
+        *path += consumed;
+    }
+
+    request->path_size = strlen(*path);
+    return strlen(*path) <= UINT16_MAX && (op == SERVE_STATS || **path != '\0');
+}
+
+/*Prints the reply to the pending request, followed by its payload.*/
+static void ServePrint(ServePending pending, ServeReply reply, char *payload){
+    char buff[128 + strlen(pending->path)];
+
+    if(reply->status != SERVE_OK){
+        snprintf(buff, sizeof(buff), "%s\t%s\n", reply->status == SERVE_NOT_FOUND ? "missing" : "error", pending->path);
+        WriteBytes(buff, strlen(buff), 1);
+
+    }else if(pending->op == SERVE_QUERY){
+        snprintf(buff, sizeof(buff), "found\t%s\n", pending->path);
+        WriteBytes(buff, strlen(buff), 1);
+
+    }else if(pending->op == SERVE_STAT && reply->sized == 1){
+        snprintf(buff, sizeof(buff), "%o\t%u\t%lu\t%s\n", reply->mode, reply->modified, reply->size, pending->path);
+        WriteBytes(buff, strlen(buff), 1);
+
+    }else if(pending->op == SERVE_STAT){
+        snprintf(buff, sizeof(buff), "%o\t%u\t-\t%s\n", reply->mode, reply->modified, pending->path);
+        WriteBytes(buff, strlen(buff), 1);
+
+    //The names of the entries of the directory are printed as paths.
+    }else if(pending->op == SERVE_LIST){
+        for(char *name = payload; name < payload + reply->size; name += strlen(name) + 1){
+            char entry[strlen(pending->path) + strlen(name) + 3];
+            snprintf(entry, sizeof(entry), "%s%s%s\n", strcmp(pending->path, ".") == 0 ? "" : pending->path, strcmp(pending->path, ".") == 0 ? "" : "/", name);
+
+            WriteBytes(entry, strlen(entry), 1);
+        }
+
+    }else if(pending->op == SERVE_READ){
+        WriteBytes(payload, reply->size, 1);
+
+    }else{
+        uint64_t *stats = (uint64_t *) payload;
+
+        for(int op = 0; op < SERVE_OPS; op++)
+            if(stats[3 * op] != 0)
+                CIBLatencyReport("server", (char *) serve_op_names[op], stats[3 * op], stats[3 * op + 1], stats[3 * op + 2]);
+    }
+
+    return;
+}
+
+/*Sends the batch of requests to the server and prints the replies to the pending requests, as they arrive. The
+requests are sent while the replies are read, so that neither side waits for the other. Returns false if the
+server has gone.*/
+static bool ServeExchange(int sock, char *requests, uint64_t size, struct serve_pending *pending, uint64_t count){
+    uint64_t sent = 0, answered = 0, received = 0, capacity = 0;
+    char *in = NULL;
+
+    while(answered < count){
+        struct pollfd fds = {sock, POLLIN | (sent < size ? POLLOUT : 0), 0};
+        if(poll(&fds, 1, -1) == -1)
+            continue;
+
+        if((fds.revents & POLLOUT) != 0){
+            ssize_t bytes = send(sock, requests + sent, size - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+            sent += bytes > 0 ? bytes : 0;
+        }
+
+        if((fds.revents & (POLLIN | POLLHUP | POLLERR)) == 0)
+            continue;
+
+        if(capacity - received < SERVE_READ_BYTES){
+            capacity = 2 * capacity + SERVE_READ_BYTES;
+            in = realloc(in, capacity);
+        }
+
+        ssize_t bytes = recv(sock, in + received, SERVE_READ_BYTES, MSG_DONTWAIT);
+        if(bytes == 0 || (bytes == -1 && errno != EAGAIN && errno != EINTR)){
+            free(in);
+            return false;
+        }
+
+        received += bytes > 0 ? bytes : 0;
+
+        //The replies that have arrived whole are printed.
+        uint64_t position = 0;
+        while(answered < count && received - position >= sizeof(struct serve_reply)){
+            struct serve_reply reply; memcpy(&reply, in + position, sizeof(reply));
+            uint64_t payload = pending[answered].op == SERVE_STAT ? 0 : reply.size;
+
+            if(received - position - sizeof(reply) < payload)
+                break;
+
+            ServePrint(&pending[answered++], &reply, in + position + sizeof(reply));
+            position += sizeof(reply) + payload;
+        }
+
+        memmove(in, in + position, received - position);
+        received -= position;
+    }
+
+    free(in);
+    return true;
+}
+
+/*Sends the requests that are read from the standard input, one per line, to the server of the cib file, on the
+socket defined by path, <cib-file>.sock if it is NULL, in batches of the given size, and prints their replies. A
+line is one of "query <path>", "stat <path>", "list <path>", "read <offset> <length> <path>" and "stats".
+
+Then prints, to the standard error, the p50 and p99 of the time that a batch took.*/
+void CIBClient(char *socket_path, char *cib_file, char *snapshot, uint64_t batch){
+    char *path = ServeSocketPath(socket_path, cib_file);
+    int sock = ServeConnect(path);
+
+    if(sock == -1){
+        CIBServerNotFound(path);
+        free(path);
+        return;
+    }
+
+    //The archive is named by the absolute path of its cib file.
+    char *archive_path = RealPath(cib_file);
+    struct serve_request open_request = {.op = SERVE_OPEN, .path_size = strlen(archive_path)};
+    struct serve_reply reply = {.status = SERVE_ERROR};
+
+    WriteBytes((char *) &open_request, sizeof(open_request), sock);
+    WriteBytes(archive_path, open_request.path_size, sock);
+
+    if(ReadBytes(&reply, sizeof(reply), sock) != sizeof(reply) || reply.status != SERVE_OK){
+        CIBNotServed(cib_file, path);
+        close(sock); free(archive_path); free(path);
+        return;
+    }
+
+    batch = batch != 0 ? batch : SERVE_BATCH;
+    ServePending pending = malloc(batch * sizeof(struct serve_pending));
+    uint64_t count = 0, size = 0, capacity = 0, requests = 0, start = ServeNow();
+    uint16_t snapshot_size = snapshot != NULL ? strlen(snapshot) : 0;
+    struct latency batches = {0};
+    char *buffer = NULL, *line = NULL;
+    size_t line_size = 0;
+    bool done = false, alive = true;
+
+    while(alive == true && done == false){
+        struct serve_request request; char *request_path;
+        done = getline(&line, &line_size, stdin) == -1;
+
+        if(done == false && ServeParse(line, &request, &request_path) == false){
+            CIBInvalidRequest(line);
+
+        }else if(done == false){
+            request.archive = reply.size;
+            request.snapshot_size = snapshot_size;
+
+            if(capacity - size < sizeof(request) + request.path_size + snapshot_size){
+                capacity = 2 * capacity + sizeof(request) + request.path_size + snapshot_size;
+                buffer = realloc(buffer, capacity);
+            }
+
+            memcpy(buffer + size, &request, sizeof(request));
+            memcpy(buffer + size + sizeof(request), request_path, request.path_size);
+            if(snapshot != NULL)
+                memcpy(buffer + size + sizeof(request) + request.path_size, snapshot, snapshot_size);
+            size += sizeof(request) + request.path_size + snapshot_size;
+
+            pending[count++] = (struct serve_pending) {request.op, strdup(request_path)};
+        }
+
+        if(count != 0 && (count == batch || done == true)){
+            uint64_t sent = ServeNow();
+            alive = ServeExchange(sock, buffer, size, pending, count);
+            LatencyRecord(&batches, ServeNow() - sent);
+
+            for(uint64_t i = 0; i < count; i++)
+                free(pending[i].path);
+
+            requests += count;
+            count = size = 0;
+        }
+    }
+
+    if(alive == false)
+        CIBServerNotFound(path);
+    else if(batches.count != 0)
+        CIBClientReport(path, requests, batches.count, LatencyPercentile(&batches, 0.5), LatencyPercentile(&batches, 0.99), (ServeNow() - start) / 1e9);
+
+    close(sock);
+    free(pending); free(buffer); free(line); free(archive_path); free(path);
+    return;
+}
@@ -0,0 +1,30 @@
+#!/bin/bash
+# Checks that the argument after -j is taken as a codec only when it is one: an unknown codec, or one that this
+# build lacks, is an error and never becomes the name of the archive.
+CIB=$(realpath "${CIB:-./cib}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+status=0
+
+mkdir tree; seq 1 5000 > tree/a
+
+"$CIB" -c -j zstd f.cib tree > /dev/null 2>&1 && { echo "codec_args: -j zstd was accepted"; status=1; }
+[ -e zstd ] || [ -e f.cib ] && { echo "codec_args: -j zstd created an archive"; status=1; }
+rm -f zstd f.cib
+
+"$CIB" -c -j deflate:99 f.cib tree > /dev/null 2>&1 && { echo "codec_args: an invalid level was accepted"; status=1; }
+rm -f f.cib
+
+if "$CIB" 2>&1 | grep -q "lzma (high ratio)"; then
+    "$CIB" -c -j lzma f.cib tree > /dev/null 2>&1 && [ -e f.cib ] || { echo "codec_args: -j lzma failed although it is built"; status=1; }
+else
+    "$CIB" -c -j lzma f.cib tree > /dev/null 2>&1 && { echo "codec_args: -j lzma was accepted without lzma"; status=1; }
+    [ -e lzma ] || [ -e f.cib ] && { echo "codec_args: -j lzma created an archive without lzma"; status=1; }
+fi
+rm -f lzma f.cib
+
+"$CIB" -c -j f.cib tree > /dev/null 2>&1 && [ -e f.cib ] || { echo "codec_args: -j without a codec failed"; status=1; }
+
+[ $status -eq 0 ] && echo "codec_args: ok"
+exit $status
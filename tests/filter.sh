@@ -0,0 +1,35 @@
+#!/bin/bash
+# Compresses files with an external program and checks that no shell runs the command, that only the name of
+# the program is stored and that the files are extracted only by the program that -x is given with --filter.
+CIB=$(realpath "${CIB:-./cib}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+status=0
+
+if ! command -v gzip > /dev/null; then
+    echo "filter: skipped, gzip is not installed"
+    exit 0
+fi
+
+mkdir tree
+seq 1 20000 > tree/a; seq 7 9000 > tree/b
+"$CIB" -c -j --filter "gzip -9" f.cib tree > /dev/null
+
+grep -q -a "gzip -9" f.cib && { echo "filter: the command was stored in the archive"; status=1; }
+
+mkdir none; (cd none && "$CIB" -x ../f.cib) > /dev/null 2>&1
+[ -s none/tree/a ] && { echo "filter: a file was extracted without --filter"; status=1; }
+
+mkdir other; (cd other && "$CIB" -x --filter "xz" ../f.cib) > /dev/null 2>&1
+[ -s other/tree/a ] && { echo "filter: a file was extracted by another program"; status=1; }
+
+mkdir out; (cd out && "$CIB" -x --filter gzip ../f.cib) > /dev/null 2>&1
+diff -r tree out/tree > /dev/null || { echo "filter: the files were not extracted by gzip"; status=1; }
+
+"$CIB" -c -j --filter "gzip -9; touch injected" s.cib tree > /dev/null 2>&1
+mkdir shell; (cd shell && "$CIB" -x --filter "gzip; touch injected" ../s.cib) > /dev/null 2>&1
+[ -e injected ] || [ -e shell/injected ] && { echo "filter: the command was run through a shell"; status=1; }
+
+[ $status -eq 0 ] && echo "filter: ok"
+exit $status
@@ -0,0 +1,36 @@
+#!/bin/bash
+# Appends files into the free space that deleted files left, with a commit after each file, and kills the
+# append at different times. The changed pages that were free are written in place rather than journaled, so
+# every file the archive kept must extract intact, and so must the files it held before.
+CIB=$(realpath "${CIB:-./cib}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+status=0
+
+mkdir -p tree/old new
+for i in $(seq 1 40); do head -c 30000 /dev/urandom > tree/old/o$i; done
+for i in $(seq 1 40); do head -c 25000 /dev/urandom > new/n$i; done
+
+for delay in 0 0.02 0.05 0.1 0.2 0.4 1; do
+    rm -rf j.cib* out tree/new
+    "$CIB" -c j.cib tree > /dev/null
+    "$CIB" -d j.cib $(for i in $(seq 2 2 40); do echo tree/old/o$i; done) > /dev/null
+
+    cp -r new tree/new
+    "$CIB" -a j.cib --durability file tree/new > /dev/null 2>&1 &
+    sleep $delay; kill -9 $! 2> /dev/null; wait $! 2> /dev/null
+
+    mkdir out
+    (cd out && "$CIB" -x ../j.cib) > /dev/null 2>&1
+    for i in $(seq 1 2 40); do
+        cmp -s tree/old/o$i out/tree/old/o$i || { echo "journal: tree/old/o$i was damaged after ${delay}s"; status=1; }
+    done
+    for f in out/tree/new/*; do
+        [ -e "$f" ] || continue
+        cmp -s new/$(basename "$f") "$f" || { echo "journal: tree/new/$(basename "$f") was damaged after ${delay}s"; status=1; }
+    done
+done
+
+[ $status -eq 0 ] && echo "journal: ok"
+exit $status
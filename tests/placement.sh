@@ -0,0 +1,38 @@
+#!/bin/bash
+# Deletes files from two directories, rewrites a file of the first one and appends new files to each
+# directory, so that new chunks are placed near a hint left inside merged free space. Every file must
+# extract unchanged.
+CIB=$(realpath "${CIB:-./cib}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+status=0
+
+for size in 1 6 10 20; do
+    for count in 1 3; do
+        for dir in d e f; do
+            rm -rf "$WORK"/*; cd "$WORK"
+            mkdir -p tree/d tree/e tree/$dir
+            for f in d/a d/b d/c e/x e/y; do head -c 9500 /dev/urandom > tree/$f; done
+
+            (cd tree && "$CIB" -c ../t.cib d e) > /dev/null
+            "$CIB" -d t.cib d/c e/x > /dev/null
+            rm tree/d/c tree/e/x
+
+            head -c 5000 /dev/urandom > tree/d/a
+            (cd tree && "$CIB" -a ../t.cib d/a) > /dev/null
+
+            for i in $(seq $count); do head -c $((size * 1024 - 100)) /dev/urandom > tree/$dir/n$i; done
+            (cd tree && "$CIB" -a ../t.cib $dir) > /dev/null
+
+            mkdir out
+            (cd out && "$CIB" -x ../t.cib) > /dev/null 2>&1
+            if ! diff -r tree out > /dev/null; then
+                echo "placement: files of $size KB x$count in $dir were not extracted intact"
+                status=1
+            fi
+        done
+    done
+done
+
+[ $status -eq 0 ] && echo "placement: ok"
+exit $status
@@ -0,0 +1,33 @@
+#!/bin/bash
+# Traces the extraction of the files that were inserted last, which lie at the end of the data, and lays them out
+# at its start. The archive must not grow, the released space it reports must have left the file and every file
+# must extract intact.
+CIB=$(realpath "${CIB:-./cib}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+status=0
+
+mkdir -p tree/cold tree/hot
+for i in $(seq 1 60); do head -c $((i * 700)) /dev/urandom > tree/cold/c$i; done
+"$CIB" -c r.cib tree > /dev/null
+for i in $(seq 1 20); do head -c $((i * 1500)) /dev/urandom > tree/hot/h$i; done
+"$CIB" -a r.cib tree/hot > /dev/null
+"$CIB" -d r.cib tree/cold/c7 tree/cold/c30 > /dev/null
+rm tree/cold/c7 tree/cold/c30
+
+mkdir trace; (cd trace && "$CIB" -x --trace ../r.cib tree/hot) > /dev/null
+
+size=$(stat -c %s r.cib); disk=$(($(stat -c %b r.cib) * $(stat -c %B r.cib)))
+report=$("$CIB" --relayout r.cib)
+released=$(echo "$report" | sed -n 's/.*Released \([0-9]*\) bytes.*/\1/p')
+after_disk=$(($(stat -c %b r.cib) * $(stat -c %B r.cib)))
+
+[ $(stat -c %s r.cib) -le $size ] || { echo "relayout: the archive grew from $size to $(stat -c %s r.cib) bytes"; status=1; }
+[ -z "$released" ] || [ "$released" -le $((disk - after_disk)) ] || { echo "relayout: reported $released bytes released of $((disk - after_disk))"; status=1; }
+
+mkdir out; (cd out && "$CIB" -x ../r.cib) > /dev/null
+diff -r tree out/tree > /dev/null || { echo "relayout: the files were not extracted intact"; status=1; }
+
+[ $status -eq 0 ] && echo "relayout: ok"
+exit $status
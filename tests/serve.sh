@@ -0,0 +1,30 @@
+#!/bin/bash
+# Keeps an archive served while another process deletes a solid chunk and appends a new one, which may
+# be placed at the same blocks. The server and libcib must answer with the new content.
+CIB=$(realpath "${CIB:-./cib}")
+WORK=$(mktemp -d)
+cd "$WORK"
+status=0
+
+mkdir q
+for i in 1 2 3; do echo "old content $i" > q/f$i; done
+"$CIB" -c -j deflate --solid s.cib q > /dev/null
+
+"$CIB" --serve s.cib > server.out 2>&1 & server=$!
+trap 'kill -INT $server 2> /dev/null; wait $server; rm -rf "$WORK"' EXIT
+for i in $(seq 50); do [ -S s.cib.sock ] && break; sleep 0.1; done
+
+[ "$(printf 'read 0 100 q/f2\n' | "$CIB" --client s.cib 2> /dev/null)" = "old content 2" ] || { echo "serve: q/f2 was not read"; status=1; }
+
+"$CIB" -d s.cib q > /dev/null
+mkdir q2
+for i in 1 2 3; do echo "new content $i" > q2/f$i; done
+"$CIB" -a -j deflate --solid s.cib q2 > /dev/null
+
+for i in 1 2 3; do
+    reply=$(printf 'read 0 100 q2/f%s\n' $i | "$CIB" --client s.cib 2> /dev/null)
+    [ "$reply" = "new content $i" ] || { echo "serve: q2/f$i read \"$reply\" after the archive changed"; status=1; }
+done
+
+[ $status -eq 0 ] && echo "serve: ok"
+exit $status